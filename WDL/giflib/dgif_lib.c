@@ -59,7 +59,7 @@ static int DGifBufferedInput(GifFileType *GifFile, GifByteType *Buf,
 /******************************************************************************
  * Open a new gif file for read, given by its name.
  * Returns GifFileType pointer dynamically allocated which serves as the gif
- * info record. _GifError is cleared if succesfull.
+ * info record, or NULL on failure.
  *****************************************************************************/
 GifFileType *
 DGifOpenFileName(const char *FileName) {
@@ -71,7 +71,6 @@ DGifOpenFileName(const char *FileName) {
                            | O_BINARY
 #endif /* __MSDOS__ || _OPEN_BINARY */
          )) == -1) {
-        _GifError = D_GIF_ERR_OPEN_FAILED;
         return NULL;
     }
 
@@ -84,7 +83,7 @@ DGifOpenFileName(const char *FileName) {
 /******************************************************************************
  * Update a new gif file, given its file handle.
  * Returns GifFileType pointer dynamically allocated which serves as the gif
- * info record. _GifError is cleared if succesfull.
+ * info record, or NULL on failure.
  *****************************************************************************/
 GifFileType *
 DGifOpenFileHandle(int FileHandle) {
@@ -96,7 +95,6 @@ DGifOpenFileHandle(int FileHandle) {
 
     GifFile = (GifFileType *)malloc(sizeof(GifFileType));
     if (GifFile == NULL) {
-        _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
         return NULL;
     }
 
@@ -104,7 +102,6 @@ DGifOpenFileHandle(int FileHandle) {
 
     Private = (GifFilePrivateType *)malloc(sizeof(GifFilePrivateType));
     if (Private == NULL) {
-        _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
         free((char *)GifFile);
         return NULL;
     }
@@ -128,7 +125,6 @@ DGifOpenFileHandle(int FileHandle) {
 
     /* Lets see if this is a GIF file: */
     if (READ(GifFile, Buf, GIF_STAMP_LEN) != GIF_STAMP_LEN) {
-        _GifError = D_GIF_ERR_READ_FAILED;
         fclose(f);
         free((char *)Private);
         free((char *)GifFile);
@@ -139,7 +135,6 @@ DGifOpenFileHandle(int FileHandle) {
      * something more useful with it.  */
     Buf[GIF_STAMP_LEN] = 0;
     if (strncmp(GIF_STAMP, Buf, GIF_VERSION_POS) != 0) {
-        _GifError = D_GIF_ERR_NOT_GIF_FILE;
         fclose(f);
         free((char *)Private);
         free((char *)GifFile);
@@ -153,7 +148,7 @@ DGifOpenFileHandle(int FileHandle) {
         return NULL;
     }
 
-    _GifError = 0;
+    GifFile->Error = 0;
 
     return GifFile;
 }
@@ -173,7 +168,6 @@ DGifOpen(void *userData,
 
     GifFile = (GifFileType *)malloc(sizeof(GifFileType));
     if (GifFile == NULL) {
-        _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
         return NULL;
     }
 
@@ -181,7 +175,6 @@ DGifOpen(void *userData,
 
     Private = (GifFilePrivateType *)malloc(sizeof(GifFilePrivateType));
     if (!Private) {
-        _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
         free((char *)GifFile);
         return NULL;
     }
@@ -196,7 +189,6 @@ DGifOpen(void *userData,
 
     /* Lets see if this is a GIF file: */
     if (READ(GifFile, Buf, GIF_STAMP_LEN) != GIF_STAMP_LEN) {
-        _GifError = D_GIF_ERR_READ_FAILED;
         free((char *)Private);
         free((char *)GifFile);
         return NULL;
@@ -206,7 +198,6 @@ DGifOpen(void *userData,
      * something more useful with it. */
     Buf[GIF_STAMP_LEN] = 0;
     if (strncmp(GIF_STAMP, Buf, GIF_VERSION_POS) != 0) {
-        _GifError = D_GIF_ERR_NOT_GIF_FILE;
         free((char *)Private);
         free((char *)GifFile);
         return NULL;
@@ -218,7 +209,7 @@ DGifOpen(void *userData,
         return NULL;
     }
 
-    _GifError = 0;
+    GifFile->Error = 0;
 
     return GifFile;
 }
@@ -236,7 +227,7 @@ DGifGetScreenDesc(GifFileType * GifFile) {
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
@@ -246,7 +237,7 @@ DGifGetScreenDesc(GifFileType * GifFile) {
         return GIF_ERROR;
 
     if (READ(GifFile, Buf, 3) != 3) {
-        _GifError = D_GIF_ERR_READ_FAILED;
+        GifFile->Error = D_GIF_ERR_READ_FAILED;
         return GIF_ERROR;
     }
     GifFile->SColorResolution = (((Buf[0] & 0x70) + 1) >> 4) + 1;
@@ -256,7 +247,7 @@ DGifGetScreenDesc(GifFileType * GifFile) {
 
         GifFile->SColorMap = MakeMapObject(1 << BitsPerPixel, NULL);
         if (GifFile->SColorMap == NULL) {
-            _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
+            GifFile->Error = D_GIF_ERR_NOT_ENOUGH_MEM;
             return GIF_ERROR;
         }
 
@@ -265,7 +256,7 @@ DGifGetScreenDesc(GifFileType * GifFile) {
             if (READ(GifFile, Buf, 3) != 3) {
                 FreeMapObject(GifFile->SColorMap);
                 GifFile->SColorMap = NULL;
-                _GifError = D_GIF_ERR_READ_FAILED;
+                GifFile->Error = D_GIF_ERR_READ_FAILED;
                 return GIF_ERROR;
             }
             GifFile->SColorMap->Colors[i].Red = Buf[0];
@@ -291,12 +282,12 @@ DGifGetRecordType(GifFileType * GifFile,
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
     if (READ(GifFile, &Buf, 1) != 1) {
-        _GifError = D_GIF_ERR_READ_FAILED;
+        GifFile->Error = D_GIF_ERR_READ_FAILED;
         return GIF_ERROR;
     }
 
@@ -312,7 +303,7 @@ DGifGetRecordType(GifFileType * GifFile,
           break;
       default:
           *Type = UNDEFINED_RECORD_TYPE;
-          _GifError = D_GIF_ERR_WRONG_RECORD;
+          GifFile->Error = D_GIF_ERR_WRONG_RECORD;
           return GIF_ERROR;
     }
 
@@ -333,7 +324,7 @@ DGifGetImageDesc(GifFileType * GifFile) {
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
@@ -343,7 +334,7 @@ DGifGetImageDesc(GifFileType * GifFile) {
         DGifGetWord(GifFile, &GifFile->Image.Height) == GIF_ERROR)
         return GIF_ERROR;
     if (READ(GifFile, Buf, 1) != 1) {
-        _GifError = D_GIF_ERR_READ_FAILED;
+        GifFile->Error = D_GIF_ERR_READ_FAILED;
         return GIF_ERROR;
     }
     BitsPerPixel = (Buf[0] & 0x07) + 1;
@@ -357,7 +348,7 @@ DGifGetImageDesc(GifFileType * GifFile) {
 
         GifFile->Image.ColorMap = MakeMapObject(1 << BitsPerPixel, NULL);
         if (GifFile->Image.ColorMap == NULL) {
-            _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
+            GifFile->Error = D_GIF_ERR_NOT_ENOUGH_MEM;
             return GIF_ERROR;
         }
 
@@ -365,7 +356,7 @@ DGifGetImageDesc(GifFileType * GifFile) {
         for (i = 0; i < GifFile->Image.ColorMap->ColorCount; i++) {
             if (READ(GifFile, Buf, 3) != 3) {
                 FreeMapObject(GifFile->Image.ColorMap);
-                _GifError = D_GIF_ERR_READ_FAILED;
+                GifFile->Error = D_GIF_ERR_READ_FAILED;
                 GifFile->Image.ColorMap = NULL;
                 return GIF_ERROR;
             }
@@ -382,13 +373,13 @@ DGifGetImageDesc(GifFileType * GifFile) {
         if ((GifFile->SavedImages = (SavedImage *)realloc(GifFile->SavedImages,
                                       sizeof(SavedImage) *
                                       (GifFile->ImageCount + 1))) == NULL) {
-            _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
+            GifFile->Error = D_GIF_ERR_NOT_ENOUGH_MEM;
             return GIF_ERROR;
         }
     } else {
         if ((GifFile->SavedImages =
              (SavedImage *) malloc(sizeof(SavedImage))) == NULL) {
-            _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
+            GifFile->Error = D_GIF_ERR_NOT_ENOUGH_MEM;
             return GIF_ERROR;
         }
     }
@@ -400,7 +391,7 @@ DGifGetImageDesc(GifFileType * GifFile) {
                                  GifFile->Image.ColorMap->ColorCount,
                                  GifFile->Image.ColorMap->Colors);
         if (sp->ImageDesc.ColorMap == NULL) {
-            _GifError = D_GIF_ERR_NOT_ENOUGH_MEM;
+            GifFile->Error = D_GIF_ERR_NOT_ENOUGH_MEM;
             return GIF_ERROR;
         }
     }
@@ -431,7 +422,7 @@ DGifGetLine(GifFileType * GifFile,
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
@@ -443,7 +434,7 @@ DGifGetLine(GifFileType * GifFile,
 #else
     if ((Private->PixelCount -= LineLen) > 0xffff0000) {
 #endif /* __MSDOS__ */
-        _GifError = D_GIF_ERR_DATA_TOO_BIG;
+        GifFile->Error = D_GIF_ERR_DATA_TOO_BIG;
         return GIF_ERROR;
     }
 
@@ -474,7 +465,7 @@ DGifGetPixel(GifFileType * GifFile,
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 #if defined(__MSDOS__) || defined(__GNUC__)
@@ -483,7 +474,7 @@ DGifGetPixel(GifFileType * GifFile,
     if (--Private->PixelCount > 0xffff0000)
 #endif /* __MSDOS__ */
     {
-        _GifError = D_GIF_ERR_DATA_TOO_BIG;
+        GifFile->Error = D_GIF_ERR_DATA_TOO_BIG;
         return GIF_ERROR;
     }
 
@@ -519,12 +510,12 @@ DGifGetExtension(GifFileType * GifFile,
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
     if (READ(GifFile, &Buf, 1) != 1) {
-        _GifError = D_GIF_ERR_READ_FAILED;
+        GifFile->Error = D_GIF_ERR_READ_FAILED;
         return GIF_ERROR;
     }
     *ExtCode = Buf;
@@ -545,14 +536,14 @@ DGifGetExtensionNext(GifFileType * GifFile,
     GifFilePrivateType *Private = (GifFilePrivateType *)GifFile->Private;
 
     if (READ(GifFile, &Buf, 1) != 1) {
-        _GifError = D_GIF_ERR_READ_FAILED;
+        GifFile->Error = D_GIF_ERR_READ_FAILED;
         return GIF_ERROR;
     }
     if (Buf > 0) {
         *Extension = Private->Buf;    /* Use private unused buffer. */
         (*Extension)[0] = Buf;  /* Pascal strings notation (pos. 0 is len.). */
         if (READ(GifFile, &((*Extension)[1]), Buf) != Buf) {
-            _GifError = D_GIF_ERR_READ_FAILED;
+            GifFile->Error = D_GIF_ERR_READ_FAILED;
             return GIF_ERROR;
         }
     } else
@@ -577,7 +568,7 @@ DGifCloseFile(GifFileType * GifFile) {
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
@@ -606,8 +597,7 @@ DGifCloseFile(GifFileType * GifFile) {
     free(GifFile);
 
     if (File && (fclose(File) != 0)) {
-        _GifError = D_GIF_ERR_CLOSE_FAILED;
-        return GIF_ERROR;
+        return GIF_ERROR;    /* GifFile is already freed. */
     }
     return GIF_OK;
 }
@@ -622,7 +612,7 @@ DGifGetWord(GifFileType * GifFile,
     unsigned char c[2];
 
     if (READ(GifFile, c, 2) != 2) {
-        _GifError = D_GIF_ERR_READ_FAILED;
+        GifFile->Error = D_GIF_ERR_READ_FAILED;
         return GIF_ERROR;
     }
 
@@ -646,7 +636,7 @@ DGifGetCode(GifFileType * GifFile,
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
@@ -668,7 +658,7 @@ DGifGetCodeNext(GifFileType * GifFile,
     GifFilePrivateType *Private = (GifFilePrivateType *)GifFile->Private;
 
     if (READ(GifFile, &Buf, 1) != 1) {
-        _GifError = D_GIF_ERR_READ_FAILED;
+        GifFile->Error = D_GIF_ERR_READ_FAILED;
         return GIF_ERROR;
     }
 
@@ -676,7 +666,7 @@ DGifGetCodeNext(GifFileType * GifFile,
         *CodeBlock = Private->Buf;    /* Use private unused buffer. */
         (*CodeBlock)[0] = Buf;  /* Pascal strings notation (pos. 0 is len.). */
         if (READ(GifFile, &((*CodeBlock)[1]), Buf) != Buf) {
-            _GifError = D_GIF_ERR_READ_FAILED;
+            GifFile->Error = D_GIF_ERR_READ_FAILED;
             return GIF_ERROR;
         }
     } else {
@@ -761,7 +751,7 @@ DGifDecompressLine(GifFileType * GifFile,
              * decoding as soon as we got all the pixel, or EOF code will
              * not be read at all, and DGifGetLine/Pixel clean everything.  */
             if (i != LineLen - 1 || Private->PixelCount != 0) {
-                _GifError = D_GIF_ERR_EOF_TOO_SOON;
+                GifFile->Error = D_GIF_ERR_EOF_TOO_SOON;
                 return GIF_ERROR;
             }
             i++;
@@ -797,7 +787,7 @@ DGifDecompressLine(GifFileType * GifFile,
                                                                  LastCode,
                                                                  ClearCode);
                     } else {
-                        _GifError = D_GIF_ERR_IMAGE_DEFECT;
+                        GifFile->Error = D_GIF_ERR_IMAGE_DEFECT;
                         return GIF_ERROR;
                     }
                 } else
@@ -815,7 +805,7 @@ DGifDecompressLine(GifFileType * GifFile,
                     CrntPrefix = Prefix[CrntPrefix];
                 }
                 if (j >= LZ_MAX_CODE || CrntPrefix > LZ_MAX_CODE) {
-                    _GifError = D_GIF_ERR_IMAGE_DEFECT;
+                    GifFile->Error = D_GIF_ERR_IMAGE_DEFECT;
                     return GIF_ERROR;
                 }
                 /* Push the last character on stack: */
@@ -881,7 +871,7 @@ DGifGetLZCodes(GifFileType * GifFile,
 
     if (!IS_READABLE(Private)) {
         /* This file was NOT open for reading: */
-        _GifError = D_GIF_ERR_NOT_READABLE;
+        GifFile->Error = D_GIF_ERR_NOT_READABLE;
         return GIF_ERROR;
     }
 
@@ -927,7 +917,7 @@ DGifDecompressInput(GifFileType * GifFile,
     };
     /* The image can't contain more than LZ_BITS per code. */
     if (Private->RunningBits > LZ_BITS) {
-        _GifError = D_GIF_ERR_IMAGE_DEFECT;
+        GifFile->Error = D_GIF_ERR_IMAGE_DEFECT;
         return GIF_ERROR;
     }
     
@@ -973,7 +963,7 @@ DGifBufferedInput(GifFileType * GifFile,
     if (Buf[0] == 0) {
         /* Needs to read the next buffer - this one is empty: */
         if (READ(GifFile, Buf, 1) != 1) {
-            _GifError = D_GIF_ERR_READ_FAILED;
+            GifFile->Error = D_GIF_ERR_READ_FAILED;
             return GIF_ERROR;
         }
         /* There shouldn't be any empty data blocks here as the LZW spec
@@ -981,11 +971,11 @@ DGifBufferedInput(GifFileType * GifFile,
          * shouldn't be inside this routine at that point.
          */
         if (Buf[0] == 0) {
-            _GifError = D_GIF_ERR_IMAGE_DEFECT;
+            GifFile->Error = D_GIF_ERR_IMAGE_DEFECT;
             return GIF_ERROR;
         }
         if (READ(GifFile, &Buf[1], Buf[0]) != Buf[0]) {
-            _GifError = D_GIF_ERR_READ_FAILED;
+            GifFile->Error = D_GIF_ERR_READ_FAILED;
             return GIF_ERROR;
         }
         *NextByte = Buf[1];
@@ -60,26 +60,26 @@ static GifPixelType CodeMask[] = {
     0x00, 0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff
 };
 
-static char GifVersionPrefix[GIF_STAMP_LEN + 1] = GIF87_STAMP;
-
 #define WRITE(_gif,_buf,_len)   \
   (((GifFilePrivateType*)_gif->Private)->Write ?    \
    ((GifFilePrivateType*)_gif->Private)->Write(_gif,_buf,_len) :    \
    fwrite(_buf, 1, _len, ((GifFilePrivateType*)_gif->Private)->File))
 
 static int EGifPutWord(int Word, GifFileType * GifFile);
+static void EGifInitCompress(GifFilePrivateType * Private);
 static int EGifSetupCompress(GifFileType * GifFile);
+static int EGifLossyMatch(GifFilePrivateType * Private, int CrntCode,
+                          GifPixelType Pixel);
 static int EGifCompressLine(GifFileType * GifFile, GifPixelType * Line,
                             int LineLen);
 static int EGifCompressOutput(GifFileType * GifFile, int Code);
-static int EGifBufferedOutput(GifFileType * GifFile, GifByteType * Buf,
-                              int c);
+static int EGifFlushOutput(GifFileType * GifFile, int Final);
 
 /******************************************************************************
  * Open a new gif file for write, given by its name. If TestExistance then
  * if the file exists this routines fails (returns NULL).
  * Returns GifFileType pointer dynamically allocated which serves as the gif
- * info record. _GifError is cleared if succesfull.
+ * info record, or NULL on failure.
  *****************************************************************************/
 GifFileType *
 EGifOpenFileName(const char *FileName,
@@ -102,7 +102,6 @@ EGifOpenFileName(const char *FileName,
                           , 0644 );
 
     if (FileHandle == -1) {
-        _GifError = E_GIF_ERR_OPEN_FAILED;
         return NULL;
     }
     GifFile = EGifOpenFileHandle(FileHandle);
@@ -115,7 +114,7 @@ EGifOpenFileName(const char *FileName,
  * Update a new gif file, given its file handle, which must be opened for
  * write in binary mode.
  * Returns GifFileType pointer dynamically allocated which serves as the gif
- * info record. _GifError is cleared if succesfull.
+ * info record, or NULL on failure.
  *****************************************************************************/
 GifFileType *
 EGifOpenFileHandle(int FileHandle) {
@@ -126,7 +125,6 @@ EGifOpenFileHandle(int FileHandle) {
 
     GifFile = (GifFileType *) malloc(sizeof(GifFileType));
     if (GifFile == NULL) {
-        _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
         return NULL;
     }
 
@@ -135,15 +133,10 @@ EGifOpenFileHandle(int FileHandle) {
     Private = (GifFilePrivateType *)malloc(sizeof(GifFilePrivateType));
     if (Private == NULL) {
         free(GifFile);
-        _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
-        return NULL;
-    }
-    if ((Private->HashTable = _InitHashTable()) == NULL) {
-        free(GifFile);
-        free(Private);
-        _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
         return NULL;
     }
+    EGifInitCompress(Private);
+    strcpy(Private->Version, GIF87_STAMP);
 
 #ifdef __MSDOS__
     setmode(FileHandle, O_BINARY);    /* Make sure it is in binary mode. */
@@ -164,7 +157,7 @@ EGifOpenFileHandle(int FileHandle) {
     Private->Write = (OutputFunc) 0;    /* No user write routine (MRB) */
     GifFile->UserData = (VoidPtr) 0;    /* No user write handle (MRB) */
 
-    _GifError = 0;
+    GifFile->Error = 0;
 
     return GifFile;
 }
@@ -182,7 +175,6 @@ EGifOpen(void *userData,
 
     GifFile = (GifFileType *)malloc(sizeof(GifFileType));
     if (GifFile == NULL) {
-        _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
         return NULL;
     }
 
@@ -191,17 +183,11 @@ EGifOpen(void *userData,
     Private = (GifFilePrivateType *)malloc(sizeof(GifFilePrivateType));
     if (Private == NULL) {
         free(GifFile);
-        _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
         return NULL;
     }
 
-    Private->HashTable = _InitHashTable();
-    if (Private->HashTable == NULL) {
-        free (GifFile);
-        free (Private);
-        _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
-        return NULL;
-    }
+    EGifInitCompress(Private);
+    strcpy(Private->Version, GIF87_STAMP);
 
     GifFile->Private = (VoidPtr) Private;
     Private->FileHandle = 0;
@@ -211,19 +197,39 @@ EGifOpen(void *userData,
     Private->Write = writeFunc;    /* User write routine (MRB) */
     GifFile->UserData = userData;    /* User write handle (MRB) */
 
-    _GifError = 0;
+    GifFile->Error = 0;
 
     return GifFile;
 }
 
 /******************************************************************************
- * Routine to set current GIF version. All files open for write will be
- * using this version until next call to this routine. Version consists of
- * 3 characters as "87a" or "89a". No test is made to validate the version.
+ * Routine to set the GIF version of a file open for write, must be called
+ * before EGifPutScreenDesc. Version consists of 3 characters as "87a" or
+ * "89a". No test is made to validate the version.
+ *****************************************************************************/
+void
+EGifSetGifVersion(GifFileType * GifFile,
+                  const char *Version) {
+    GifFilePrivateType *Private = (GifFilePrivateType *) GifFile->Private;
+
+    strncpy(Private->Version + GIF_VERSION_POS, Version, 3);
+}
+
+/******************************************************************************
+ * Routine to make the images that are put after this call lossy: a pixel
+ * may be encoded as another color of the image's color map, at most
+ * Tolerance away from it (distance in RGB), when that lets the LZ string
+ * being matched continue. TransparentColor (-1 if none) is never replaced
+ * or used as a replacement. Tolerance 0 (the default) is lossless.
  *****************************************************************************/
 void
-EGifSetGifVersion(const char *Version) {
-    strncpy(GifVersionPrefix + GIF_VERSION_POS, Version, 3);
+EGifSetLossy(GifFileType * GifFile,
+             int Tolerance,
+             int TransparentColor) {
+    GifFilePrivateType *Private = (GifFilePrivateType *) GifFile->Private;
+
+    Private->LZTolerance = Tolerance > 0 ? Tolerance : 0;
+    Private->LZTransparent = TransparentColor;
 }
 
 /******************************************************************************
@@ -244,20 +250,20 @@ EGifPutScreenDesc(GifFileType * GifFile,
 
     if (Private->FileState & FILE_STATE_SCREEN) {
         /* If already has screen descriptor - something is wrong! */
-        _GifError = E_GIF_ERR_HAS_SCRN_DSCR;
+        GifFile->Error = E_GIF_ERR_HAS_SCRN_DSCR;
         return GIF_ERROR;
     }
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
 /* First write the version prefix into the file. */
 #ifndef DEBUG_NO_PREFIX
-    if (WRITE(GifFile, (unsigned char *)GifVersionPrefix,
-              strlen(GifVersionPrefix)) != strlen(GifVersionPrefix)) {
-        _GifError = E_GIF_ERR_WRITE_FAILED;
+    if (WRITE(GifFile, (unsigned char *)Private->Version,
+              strlen(Private->Version)) != strlen(Private->Version)) {
+        GifFile->Error = E_GIF_ERR_WRITE_FAILED;
         return GIF_ERROR;
     }
 #endif /* DEBUG_NO_PREFIX */
@@ -270,7 +276,7 @@ EGifPutScreenDesc(GifFileType * GifFile,
         GifFile->SColorMap = MakeMapObject(ColorMap->ColorCount,
                                            ColorMap->Colors);
         if (GifFile->SColorMap == NULL) {
-            _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
+            GifFile->Error = E_GIF_ERR_NOT_ENOUGH_MEM;
             return GIF_ERROR;
         }
     } else
@@ -307,7 +313,7 @@ EGifPutScreenDesc(GifFileType * GifFile,
             Buf[1] = ColorMap->Colors[i].Green;
             Buf[2] = ColorMap->Colors[i].Blue;
             if (WRITE(GifFile, Buf, 3) != 3) {
-                _GifError = E_GIF_ERR_WRITE_FAILED;
+                GifFile->Error = E_GIF_ERR_WRITE_FAILED;
                 return GIF_ERROR;
             }
         }
@@ -343,12 +349,12 @@ EGifPutImageDesc(GifFileType * GifFile,
         Private->PixelCount > 0xffff0000) {
 #endif /* __MSDOS__ */
         /* If already has active image descriptor - something is wrong! */
-        _GifError = E_GIF_ERR_HAS_IMAG_DSCR;
+        GifFile->Error = E_GIF_ERR_HAS_IMAG_DSCR;
         return GIF_ERROR;
     }
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
     GifFile->Image.Left = Left;
@@ -360,7 +366,7 @@ EGifPutImageDesc(GifFileType * GifFile,
         GifFile->Image.ColorMap = MakeMapObject(ColorMap->ColorCount,
                                                 ColorMap->Colors);
         if (GifFile->Image.ColorMap == NULL) {
-            _GifError = E_GIF_ERR_NOT_ENOUGH_MEM;
+            GifFile->Error = E_GIF_ERR_NOT_ENOUGH_MEM;
             return GIF_ERROR;
         }
     } else {
@@ -392,13 +398,13 @@ EGifPutImageDesc(GifFileType * GifFile,
             Buf[1] = ColorMap->Colors[i].Green;
             Buf[2] = ColorMap->Colors[i].Blue;
             if (WRITE(GifFile, Buf, 3) != 3) {
-                _GifError = E_GIF_ERR_WRITE_FAILED;
+                GifFile->Error = E_GIF_ERR_WRITE_FAILED;
                 return GIF_ERROR;
             }
         }
 #endif /* DEBUG_NO_PREFIX */
     if (GifFile->SColorMap == NULL && GifFile->Image.ColorMap == NULL) {
-        _GifError = E_GIF_ERR_NO_COLOR_MAP;
+        GifFile->Error = E_GIF_ERR_NO_COLOR_MAP;
         return GIF_ERROR;
     }
 
@@ -425,14 +431,14 @@ EGifPutLine(GifFileType * GifFile,
 
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
     if (!LineLen)
         LineLen = GifFile->Image.Width;
     if (Private->PixelCount < (unsigned)LineLen) {
-        _GifError = E_GIF_ERR_DATA_TOO_BIG;
+        GifFile->Error = E_GIF_ERR_DATA_TOO_BIG;
         return GIF_ERROR;
     }
     Private->PixelCount -= LineLen;
@@ -457,12 +463,12 @@ EGifPutPixel(GifFileType * GifFile,
 
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
     if (Private->PixelCount == 0) {
-        _GifError = E_GIF_ERR_DATA_TOO_BIG;
+        GifFile->Error = E_GIF_ERR_DATA_TOO_BIG;
         return GIF_ERROR;
     }
     --Private->PixelCount;
@@ -535,7 +541,7 @@ EGifPutExtensionFirst(GifFileType * GifFile,
 
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
@@ -567,7 +573,7 @@ EGifPutExtensionNext(GifFileType * GifFile,
 
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
@@ -592,7 +598,7 @@ EGifPutExtensionLast(GifFileType * GifFile,
 
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
@@ -627,7 +633,7 @@ EGifPutExtension(GifFileType * GifFile,
 
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
@@ -662,7 +668,7 @@ EGifPutCode(GifFileType * GifFile,
 
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
@@ -670,7 +676,7 @@ EGifPutCode(GifFileType * GifFile,
     /* 
      * Buf = CodeSize;
      * if (WRITE(GifFile, &Buf, 1) != 1) {
-     *      _GifError = E_GIF_ERR_WRITE_FAILED;
+     *      GifFile->Error = E_GIF_ERR_WRITE_FAILED;
      *      return GIF_ERROR;
      * }
      */
@@ -693,13 +699,13 @@ EGifPutCodeNext(GifFileType * GifFile,
     if (CodeBlock != NULL) {
         if (WRITE(GifFile, CodeBlock, CodeBlock[0] + 1)
                != (unsigned)(CodeBlock[0] + 1)) {
-            _GifError = E_GIF_ERR_WRITE_FAILED;
+            GifFile->Error = E_GIF_ERR_WRITE_FAILED;
             return GIF_ERROR;
         }
     } else {
         Buf = 0;
         if (WRITE(GifFile, &Buf, 1) != 1) {
-            _GifError = E_GIF_ERR_WRITE_FAILED;
+            GifFile->Error = E_GIF_ERR_WRITE_FAILED;
             return GIF_ERROR;
         }
         Private->PixelCount = 0;    /* And local info. indicate image read. */
@@ -724,7 +730,7 @@ EGifCloseFile(GifFileType * GifFile) {
     Private = (GifFilePrivateType *) GifFile->Private;
     if (!IS_WRITEABLE(Private)) {
         /* This file was NOT open for writing: */
-        _GifError = E_GIF_ERR_NOT_WRITEABLE;
+        GifFile->Error = E_GIF_ERR_NOT_WRITEABLE;
         return GIF_ERROR;
     }
 
@@ -742,16 +748,14 @@ EGifCloseFile(GifFileType * GifFile) {
         GifFile->SColorMap = NULL;
     }
     if (Private) {
-        if (Private->HashTable) {
-            free((char *) Private->HashTable);
-        }
+        free((char *) Private->LZDict);
+        free((char *) Private->LZRunCodes);
 	    free((char *) Private);
     }
     free(GifFile);
 
     if (File && fclose(File) != 0) {
-        _GifError = E_GIF_ERR_CLOSE_FAILED;
-        return GIF_ERROR;
+        return GIF_ERROR;    /* GifFile is already freed. */
     }
     return GIF_OK;
 }
@@ -777,6 +781,23 @@ EGifPutWord(int Word,
 #endif /* DEBUG_NO_PREFIX */
 }
 
+/******************************************************************************
+ * Initialize the LZ compression state of a newly opened file:
+ *****************************************************************************/
+static void
+EGifInitCompress(GifFilePrivateType * Private) {
+
+    Private->LZDict = NULL;
+    Private->LZRunCodes = NULL;
+    Private->LZDictSize = 0;
+    Private->BitsPerPixel = 0;
+    Private->EOFCode = 0;
+    Private->RunningCode = 0;
+    Private->OutLen = Private->OutBlock = 0;
+    Private->LZTolerance = Private->LZLossy = 0;
+    Private->LZTransparent = -1;
+}
+
 /******************************************************************************
  * Setup the LZ compression for this image:
  *****************************************************************************/
@@ -786,21 +807,54 @@ EGifSetupCompress(GifFileType * GifFile) {
     int BitsPerPixel;
     GifByteType Buf;
     GifFilePrivateType *Private = (GifFilePrivateType *) GifFile->Private;
+    const ColorMapObject *ColorMap;
 
     /* Test and see what color map to use, and from it # bits per pixel: */
     if (GifFile->Image.ColorMap)
-        BitsPerPixel = GifFile->Image.ColorMap->BitsPerPixel;
+        ColorMap = GifFile->Image.ColorMap;
     else if (GifFile->SColorMap)
-        BitsPerPixel = GifFile->SColorMap->BitsPerPixel;
+        ColorMap = GifFile->SColorMap;
     else {
-        _GifError = E_GIF_ERR_NO_COLOR_MAP;
+        GifFile->Error = E_GIF_ERR_NO_COLOR_MAP;
         return GIF_ERROR;
     }
+    BitsPerPixel = ColorMap->BitsPerPixel;
 
     Buf = BitsPerPixel = (BitsPerPixel < 2 ? 2 : BitsPerPixel);
     WRITE(GifFile, &Buf, 1);    /* Write the Code size to file. */
 
-    Private->Buf[0] = 0;    /* Nothing was output yet. */
+    /* Two pixel strings are looked up directly by their pixels, this table
+     * is never cleared, see EGifCompressLine(): */
+    if (Private->LZDictSize < (1 << (BitsPerPixel * 2))) {
+        free((char *) Private->LZDict);
+        free((char *) Private->LZRunCodes);
+        Private->LZDictSize = 1 << (BitsPerPixel * 2);
+        Private->LZDict = (unsigned short *)calloc(Private->LZDictSize,
+                                                   sizeof(unsigned short));
+        /* Only the entries up to LZRunMax are used, most are never touched: */
+        Private->LZRunCodes = (unsigned short *)malloc(
+            ((LZ_MAX_CODE + 1) << BitsPerPixel) * sizeof(unsigned short));
+        if (Private->LZDict == NULL || Private->LZRunCodes == NULL) {
+            free((char *) Private->LZDict);
+            free((char *) Private->LZRunCodes);
+            Private->LZDict = Private->LZRunCodes = NULL;
+            Private->LZDictSize = 0;
+            GifFile->Error = E_GIF_ERR_NOT_ENOUGH_MEM;
+            return GIF_ERROR;
+        }
+    }
+    memset(Private->LZRunMax, 0, sizeof(Private->LZRunMax));
+
+    /* The lossy search goes through the continuations of single pixels too,
+     * so these are linked from their Child as well: */
+    Private->LZLossy = Private->LZTolerance * Private->LZTolerance;
+    Private->LZColors = ColorMap->Colors;
+    Private->LZColorCount = ColorMap->ColorCount;
+    if (Private->LZLossy)
+        memset(Private->LZChild, 0, sizeof(Private->LZChild[0]) << BitsPerPixel);
+
+    Private->OutLen = 1;    /* Nothing was output yet, room for the size. */
+    Private->OutBlock = 0;
     Private->BitsPerPixel = BitsPerPixel;
     Private->ClearCode = (1 << BitsPerPixel);
     Private->EOFCode = Private->ClearCode + 1;
@@ -811,11 +865,9 @@ EGifSetupCompress(GifFileType * GifFile) {
     Private->CrntShiftState = 0;    /* No information in CrntShiftDWord. */
     Private->CrntShiftDWord = 0;
 
-   /* Clear hash table and send Clear to make sure the decoder do the same. */
-    _ClearHashTable(Private->HashTable);
-
+   /* Send Clear to make sure the decoder starts with an empty dictionary too. */
     if (EGifCompressOutput(GifFile, Private->ClearCode) == GIF_ERROR) {
-        _GifError = E_GIF_ERR_DISK_IS_FULL;
+        GifFile->Error = E_GIF_ERR_DISK_IS_FULL;
         return GIF_ERROR;
     }
     return GIF_OK;
@@ -833,12 +885,20 @@ EGifCompressLine(GifFileType * GifFile,
                  int LineLen) {
 
     int i = 0, CrntCode, NewCode;
-    unsigned long NewKey;
     GifPixelType Pixel;
-    GifHashTableType *HashTable;
     GifFilePrivateType *Private = (GifFilePrivateType *) GifFile->Private;
-
-    HashTable = Private->HashTable;
+    unsigned short *Dict = Private->LZDict;
+    unsigned short *Child = Private->LZChild, *Sibling = Private->LZSibling;
+    unsigned short *RunLen = Private->LZRunLen, *RunMax = Private->LZRunMax;
+    unsigned short *RunCodes = Private->LZRunCodes;
+    GifPrefixType *Prefix = Private->Prefix;
+    GifByteType *Suffix = Private->Suffix;
+    const int Shift = Private->BitsPerPixel, ClearCode = Private->ClearCode;
+
+    if (Dict == NULL) {    /* EGifSetupCompress() failed. */
+        GifFile->Error = E_GIF_ERR_NOT_ENOUGH_MEM;
+        return GIF_ERROR;
+    }
 
     if (Private->CrntCode == FIRST_CODE)    /* Its first time! */
         CrntCode = Line[i++];
@@ -846,46 +906,101 @@ EGifCompressLine(GifFileType * GifFile,
         CrntCode = Private->CrntCode;    /* Get last code in compression. */
 
     while (i < LineLen) {   /* Decode LineLen items. */
+        if (CrntCode < ClearCode && Line[i] == CrntCode && RunMax[CrntCode] > 1) {
+            /* A new string starting with a run of a pixel. Its repeats have
+             * codes up to RunMax, so the search below would go through each
+             * of them: go directly to the longest one that matches instead.
+             */
+            int Len = 1;
+            const int Max = RunMax[CrntCode];
+            while (Len < Max && i < LineLen && Line[i] == CrntCode) {
+                Len++;
+                i++;
+            }
+            CrntCode = RunCodes[(CrntCode << LZ_BITS) | Len];
+            continue;
+        }
+
         Pixel = Line[i++];  /* Get next pixel from stream. */
-        /* Form a new unique key to search hash table for the code combines 
-         * CrntCode as Prefix string with Pixel as postfix char.
+        /* Look for CrntCode as Prefix string with Pixel as postfix char. A
+         * single pixel prefix can have many continuations, these have a direct
+         * slot, which has the last code given to that string: it is not
+         * cleared, the code is valid if it was assigned since the last clear
+         * (it is below RunningCode) to this string (Prefix and Suffix match).
+         * Longer strings have few continuations, which are linked from the
+         * prefix code (Child, Sibling), most recently assigned first.
          */
-        NewKey = (((UINT32) CrntCode) << 8) + Pixel;
-        if ((NewCode = _ExistsHashTable(HashTable, NewKey)) >= 0) {
-            /* This Key is already there, or the string is old one, so
-             * simple take new code as our CrntCode:
-             */
-            CrntCode = NewCode;
+        if (CrntCode < ClearCode) {
+            NewCode = Dict[(CrntCode << Shift) | Pixel];
+            if (NewCode <= Private->EOFCode || NewCode >= Private->RunningCode ||
+                Prefix[NewCode] != CrntCode || Suffix[NewCode] != Pixel)
+                NewCode = 0;
         } else {
-            /* Put it in hash table, output the prefix code, and make our
-             * CrntCode equal to Pixel.
+            NewCode = Child[CrntCode];
+            while (NewCode && Suffix[NewCode] != Pixel)
+                NewCode = Sibling[NewCode];
+        }
+        if (!NewCode && Private->LZLossy)
+            NewCode = EGifLossyMatch(Private, CrntCode, Pixel);
+        if (NewCode) {
+            /* This string is already there, so simple take new code as our
+             * CrntCode:
              */
-            if (EGifCompressOutput(GifFile, CrntCode) == GIF_ERROR) {
-                _GifError = E_GIF_ERR_DISK_IS_FULL;
+            CrntCode = NewCode;
+            continue;
+        }
+
+        /* Output the prefix code, put the string in the dictionary and make
+         * our CrntCode equal to Pixel.
+         */
+        if (EGifCompressOutput(GifFile, CrntCode) == GIF_ERROR) {
+            GifFile->Error = E_GIF_ERR_DISK_IS_FULL;
+            return GIF_ERROR;
+        }
+
+        /* If however the dictionary is full, we send a clear first and
+         * clear the dictionary.
+         */
+        if (Private->RunningCode >= LZ_MAX_CODE) {
+            /* Time to do some clearance: */
+            if (EGifCompressOutput(GifFile, Private->ClearCode)
+                    == GIF_ERROR) {
+                GifFile->Error = E_GIF_ERR_DISK_IS_FULL;
                 return GIF_ERROR;
             }
-            CrntCode = Pixel;
-
-            /* If however the HashTable if full, we send a clear first and
-             * Clear the hash table.
-             */
-            if (Private->RunningCode >= LZ_MAX_CODE) {
-                /* Time to do some clearance: */
-                if (EGifCompressOutput(GifFile, Private->ClearCode)
-                        == GIF_ERROR) {
-                    _GifError = E_GIF_ERR_DISK_IS_FULL;
-                    return GIF_ERROR;
+            Private->RunningCode = Private->EOFCode + 1;
+            Private->RunningBits = Private->BitsPerPixel + 1;
+            Private->MaxCode1 = 1 << Private->RunningBits;
+            memset(RunMax, 0, sizeof(Private->LZRunMax));
+            if (Private->LZLossy)
+                memset(Child, 0, sizeof(Child[0]) * ClearCode);
+        } else {
+            /* Put this string with its code in the dictionary: */
+            NewCode = Private->RunningCode++;
+            Prefix[NewCode] = CrntCode;
+            Suffix[NewCode] = Pixel;
+            Child[NewCode] = 0;
+            RunLen[NewCode] = 0;
+            if (CrntCode < ClearCode) {
+                Dict[(CrntCode << Shift) | Pixel] = NewCode;
+                if (CrntCode == Pixel)
+                    RunLen[NewCode] = 2;
+                if (Private->LZLossy) {
+                    Sibling[NewCode] = Child[CrntCode];
+                    Child[CrntCode] = NewCode;
                 }
-                Private->RunningCode = Private->EOFCode + 1;
-                Private->RunningBits = Private->BitsPerPixel + 1;
-                Private->MaxCode1 = 1 << Private->RunningBits;
-                _ClearHashTable(HashTable);
             } else {
-                /* Put this unique key with its relative Code in hash table: */
-                _InsertHashTable(HashTable, NewKey, Private->RunningCode++);
+                Sibling[NewCode] = Child[CrntCode];
+                Child[CrntCode] = NewCode;
+                if (RunLen[CrntCode] && Suffix[CrntCode] == Pixel)
+                    RunLen[NewCode] = RunLen[CrntCode] + 1;
+            }
+            if (RunLen[NewCode]) {
+                RunMax[Pixel] = RunLen[NewCode];
+                RunCodes[(Pixel << LZ_BITS) | RunLen[NewCode]] = NewCode;
             }
         }
-
+        CrntCode = Pixel;
     }
 
     /* Preserve the current state of the compression algorithm: */
@@ -894,15 +1009,15 @@ EGifCompressLine(GifFileType * GifFile,
     if (Private->PixelCount == 0) {
         /* We are done - output last Code and flush output buffers: */
         if (EGifCompressOutput(GifFile, CrntCode) == GIF_ERROR) {
-            _GifError = E_GIF_ERR_DISK_IS_FULL;
+            GifFile->Error = E_GIF_ERR_DISK_IS_FULL;
             return GIF_ERROR;
         }
         if (EGifCompressOutput(GifFile, Private->EOFCode) == GIF_ERROR) {
-            _GifError = E_GIF_ERR_DISK_IS_FULL;
+            GifFile->Error = E_GIF_ERR_DISK_IS_FULL;
             return GIF_ERROR;
         }
         if (EGifCompressOutput(GifFile, FLUSH_OUTPUT) == GIF_ERROR) {
-            _GifError = E_GIF_ERR_DISK_IS_FULL;
+            GifFile->Error = E_GIF_ERR_DISK_IS_FULL;
             return GIF_ERROR;
         }
     }
@@ -910,10 +1025,47 @@ EGifCompressLine(GifFileType * GifFile,
     return GIF_OK;
 }
 
+/******************************************************************************
+ * The lossy part of the LZ compression:
+ * CrntCode has no continuation with Pixel, look for one with the closest
+ * color within the tolerance instead. Returns its code, or 0 if none.
+ *****************************************************************************/
+static int
+EGifLossyMatch(GifFilePrivateType * Private,
+               int CrntCode,
+               GifPixelType Pixel) {
+
+    int Code, Best = 0, BestDist = Private->LZLossy + 1, n;
+    const GifColorType *Colors = Private->LZColors, *c;
+
+    if (Pixel == Private->LZTransparent || Pixel >= Private->LZColorCount)
+        return 0;
+    c = Colors + Pixel;
+    for (Code = Private->LZChild[CrntCode], n = 0;
+         Code && n < LZ_LOSSY_SEARCH;
+         Code = Private->LZSibling[Code], n++) {
+        const int s = Private->Suffix[Code];
+        int dr, dg, db, d;
+
+        if (s == Private->LZTransparent || s >= Private->LZColorCount)
+            continue;
+        dr = Colors[s].Red - c->Red;
+        dg = Colors[s].Green - c->Green;
+        db = Colors[s].Blue - c->Blue;
+        d = dr * dr + dg * dg + db * db;
+        if (d < BestDist) {
+            BestDist = d;
+            Best = Code;
+        }
+    }
+    return Best;
+}
+
 /******************************************************************************
  * The LZ compression output routine:
  * This routine is responsible for the compression of the bit stream into
- * 8 bits (bytes) packets.
+ * 8 bits (bytes) packets, which are stored in OutBuf, already split into
+ * sub-blocks: OutBlock is the position of the current sub-block's size byte.
  * Returns GIF_OK if written succesfully.
  *****************************************************************************/
 static int
@@ -922,31 +1074,46 @@ EGifCompressOutput(GifFileType * GifFile,
 
     GifFilePrivateType *Private = (GifFilePrivateType *) GifFile->Private;
     int retval = GIF_OK;
+    unsigned long ShiftDWord = Private->CrntShiftDWord;
+    int ShiftState = Private->CrntShiftState;
+    int OutLen = Private->OutLen, OutBlock = Private->OutBlock;
 
-    if (Code == FLUSH_OUTPUT) {
-        while (Private->CrntShiftState > 0) {
-            /* Get Rid of what is left in DWord, and flush it. */
-            if (EGifBufferedOutput(GifFile, Private->Buf,
-                                 Private->CrntShiftDWord & 0xff) == GIF_ERROR)
-                retval = GIF_ERROR;
-            Private->CrntShiftDWord >>= 8;
-            Private->CrntShiftState -= 8;
+    if (Code != FLUSH_OUTPUT) {
+        ShiftDWord |= ((unsigned long)Code) << ShiftState;
+        ShiftState += Private->RunningBits;
+    }
+
+    /* Dump out full bytes (or everything, on flush). A code is at most 12
+     * bits, and at most 7 bits are left over, so this is 1 to 3 bytes: */
+    while (ShiftState >= 8 || (Code == FLUSH_OUTPUT && ShiftState > 0)) {
+        if (OutLen - OutBlock > 255) {
+            /* This sub-block is full, start the next one, and write the
+             * complete sub-blocks if there might not be room for it: */
+            Private->OutBuf[OutBlock] = 255;
+            if (OutLen > LZ_OUT_BUF_SIZE - 256) {
+                Private->OutLen = OutLen;
+                if (EGifFlushOutput(GifFile, 0) == GIF_ERROR)
+                    retval = GIF_ERROR;
+                OutLen = 0;
+            }
+            OutBlock = OutLen++;
         }
+        Private->OutBuf[OutLen++] = (GifByteType)(ShiftDWord & 0xff);
+        ShiftDWord >>= 8;
+        ShiftState -= 8;
+    }
+
+    Private->OutLen = OutLen;
+    Private->OutBlock = OutBlock;
+
+    if (Code == FLUSH_OUTPUT) {
+        Private->CrntShiftDWord = 0;
         Private->CrntShiftState = 0;    /* For next time. */
-        if (EGifBufferedOutput(GifFile, Private->Buf,
-                               FLUSH_OUTPUT) == GIF_ERROR)
+        if (EGifFlushOutput(GifFile, 1) == GIF_ERROR)
             retval = GIF_ERROR;
     } else {
-        Private->CrntShiftDWord |= ((long)Code) << Private->CrntShiftState;
-        Private->CrntShiftState += Private->RunningBits;
-        while (Private->CrntShiftState >= 8) {
-            /* Dump out full bytes: */
-            if (EGifBufferedOutput(GifFile, Private->Buf,
-                                 Private->CrntShiftDWord & 0xff) == GIF_ERROR)
-                retval = GIF_ERROR;
-            Private->CrntShiftDWord >>= 8;
-            Private->CrntShiftState -= 8;
-        }
+        Private->CrntShiftDWord = ShiftDWord;
+        Private->CrntShiftState = ShiftState;
     }
 
     /* If code cannt fit into RunningBits bits, must raise its size. Note */
@@ -959,42 +1126,35 @@ EGifCompressOutput(GifFileType * GifFile,
 }
 
 /******************************************************************************
- * This routines buffers the given characters until 255 characters are ready
- * to be output. If Code is equal to -1 the buffer is flushed (EOF).
- * The buffer is Dumped with first byte as its size, as GIF format requires.
+ * Writes the sub-blocks in OutBuf. Unless Final is set, OutLen must be at a
+ * sub-block boundary. If Final is set, the last sub-block is completed and
+ * the end of compressed data is marked (by an empty block, see GIF doc).
  * Returns GIF_OK if written succesfully.
  *****************************************************************************/
 static int
-EGifBufferedOutput(GifFileType * GifFile,
-                   GifByteType * Buf,
-                   int c) {
-
-    if (c == FLUSH_OUTPUT) {
-        /* Flush everything out. */
-        if (Buf[0] != 0
-            && WRITE(GifFile, Buf, Buf[0] + 1) != (unsigned)(Buf[0] + 1)) {
-            _GifError = E_GIF_ERR_WRITE_FAILED;
-            return GIF_ERROR;
-        }
-        /* Mark end of compressed data, by an empty block (see GIF doc): */
-        Buf[0] = 0;
-        if (WRITE(GifFile, Buf, 1) != 1) {
-            _GifError = E_GIF_ERR_WRITE_FAILED;
-            return GIF_ERROR;
-        }
-    } else {
-        if (Buf[0] == 255) {
-            /* Dump out this buffer - it is full: */
-            if (WRITE(GifFile, Buf, Buf[0] + 1) != (unsigned)(Buf[0] + 1)) {
-                _GifError = E_GIF_ERR_WRITE_FAILED;
-                return GIF_ERROR;
-            }
-            Buf[0] = 0;
-        }
-        Buf[++Buf[0]] = c;
+EGifFlushOutput(GifFileType * GifFile,
+                int Final) {
+
+    GifFilePrivateType *Private = (GifFilePrivateType *) GifFile->Private;
+    int retval = GIF_OK;
+
+    if (Final) {
+        if (Private->OutLen - Private->OutBlock > 1)
+            Private->OutBuf[Private->OutBlock] =
+                (GifByteType)(Private->OutLen - Private->OutBlock - 1);
+        else
+            Private->OutLen = Private->OutBlock;    /* Empty, drop it. */
+        Private->OutBuf[Private->OutLen++] = 0;
     }
 
-    return GIF_OK;
+    if (Private->OutLen > 0 &&
+        WRITE(GifFile, Private->OutBuf, Private->OutLen) != (unsigned)Private->OutLen) {
+        GifFile->Error = E_GIF_ERR_WRITE_FAILED;
+        retval = GIF_ERROR;
+    }
+    Private->OutLen = 0;
+    Private->OutBlock = 0;
+    return retval;
 }
 
 /******************************************************************************
@@ -1006,7 +1166,6 @@ EGifSpew(GifFileType * GifFileOut) {
 
     int i, j, gif89 = FALSE;
     int bOff;   /* Block Offset for adding sub blocks in Extensions */
-    char SavedStamp[GIF_STAMP_LEN + 1];
 
     for (i = 0; i < GifFileOut->ImageCount; i++) {
         for (j = 0; j < GifFileOut->SavedImages[i].ExtensionBlockCount; j++) {
@@ -1021,22 +1180,15 @@ EGifSpew(GifFileType * GifFileOut) {
         }
     }
 
-    strncpy(SavedStamp, GifVersionPrefix, GIF_STAMP_LEN);
-    if (gif89) {
-        strncpy(GifVersionPrefix, GIF89_STAMP, GIF_STAMP_LEN);
-    } else {
-        strncpy(GifVersionPrefix, GIF87_STAMP, GIF_STAMP_LEN);
-    }
+    EGifSetGifVersion(GifFileOut, gif89 ? "89a" : "87a");
     if (EGifPutScreenDesc(GifFileOut,
                           GifFileOut->SWidth,
                           GifFileOut->SHeight,
                           GifFileOut->SColorResolution,
                           GifFileOut->SBackGroundColor,
                           GifFileOut->SColorMap) == GIF_ERROR) {
-        strncpy(GifVersionPrefix, SavedStamp, GIF_STAMP_LEN);
         return (GIF_ERROR);
     }
-    strncpy(GifVersionPrefix, SavedStamp, GIF_STAMP_LEN);
 
     for (i = 0; i < GifFileOut->ImageCount; i++) {
         SavedImage *sp = &GifFileOut->SavedImages[i];
@@ -91,6 +91,7 @@ typedef struct GifFileType {
     struct SavedImage *SavedImages; /* Use this to accumulate file state */
     VoidPtr UserData;           /* hook to attach user data (TVT) */
     VoidPtr Private;            /* Don't mess with this! */
+    int Error;                  /* Last [ED]_GIF_ERR_* of this file, 0 if none. */
 } GifFileType;
 
 typedef enum {
@@ -139,7 +140,8 @@ GifFileType *EGifOpenFileHandle(int GifFileHandle);
 GifFileType *EGifOpen(void *userPtr, OutputFunc writeFunc);
 
 int EGifSpew(GifFileType * GifFile);
-void EGifSetGifVersion(const char *Version);
+void EGifSetGifVersion(GifFileType * GifFile, const char *Version);
+void EGifSetLossy(GifFileType * GifFile, int Tolerance, int TransparentColor);
 int EGifPutScreenDesc(GifFileType * GifFile,
                       int GifWidth, int GifHeight, int GifColorRes,
                       int GifBackGround,
@@ -18,6 +18,9 @@
 #define LZ_MAX_CODE         4095    /* Biggest code possible in 12 bits. */
 #define LZ_BITS             12
 
+#define LZ_OUT_BUF_SIZE     16384   /* Encoder output, in sub-blocks, is written in chunks of this size. */
+#define LZ_LOSSY_SEARCH     32      /* Lossy encoder: continuations of a string that are tried. */
+
 #define FLUSH_OUTPUT        4096    /* Impossible code, to signal flush. */
 #define FIRST_CODE          4097    /* Impossible code, to signal first. */
 #define NO_SUCH_CODE        4098    /* Impossible code, to signal empty. */
@@ -51,9 +54,21 @@ typedef struct GifFilePrivateType {
     GifByteType Stack[LZ_MAX_CODE]; /* Decoded pixels are stacked here. */
     GifByteType Suffix[LZ_MAX_CODE + 1];    /* So we can trace the codes. */
     GifPrefixType Prefix[LZ_MAX_CODE + 1];
-    GifHashTableType *HashTable;
+    unsigned short *LZDict;    /* Encoder: code of (pixel << BitsPerPixel) | next pixel. */
+    int LZDictSize;    /* Encoder: number of entries in LZDict. */
+    unsigned short LZChild[LZ_MAX_CODE + 1];    /* Encoder: last code with this prefix, for longer strings. */
+    unsigned short LZSibling[LZ_MAX_CODE + 1];    /* Encoder: previous code with the same prefix. */
+    unsigned short LZRunLen[LZ_MAX_CODE + 1];    /* Encoder: n if the code is a pixel repeated n times, else 0. */
+    unsigned short LZRunMax[256];    /* Encoder: longest repeat of each pixel that has a code. */
+    unsigned short *LZRunCodes;    /* Encoder: code of (pixel << LZ_BITS) | repeat count. */
+    int OutLen, OutBlock;    /* Encoder: bytes in OutBuf, position of the current sub-block's size. */
+    GifByteType OutBuf[LZ_OUT_BUF_SIZE];
+    char Version[GIF_STAMP_LEN + 1];    /* Encoder: stamp written by EGifPutScreenDesc. */
+    int LZTolerance, LZTransparent;    /* Encoder: set by EGifSetLossy. */
+    int LZLossy;    /* Encoder: squared tolerance for this image, 0 if lossless. */
+    const GifColorType *LZColors;    /* Encoder: colors of this image, if lossy. */
+    int LZColorCount;
 } GifFilePrivateType;
 
-extern int _GifError;
 
 #endif /* _GIF_LIB_PRIVATE_H */
@@ -15,6 +15,8 @@
 
 #include "lice_combine.h"
 #include "lice_extended.h"
+#include "lice_simd.h"
+#include "lice_thread.h"
 
 #ifndef _WIN32
 #include "../swell/swell.h"
@@ -227,13 +229,7 @@ template<class COMBFUNC> class _LICE_Template_Blit0 // these always templated
     {
       while (h--)
       {
-        LICE_pixel *pout=dest;
-        int n=w;
-        while (n--)
-        {
-          COMBFUNC::doPixFAST(pout,color);          
-          ++pout;
-        }
+        _LICE_CombineSpanFAST<COMBFUNC>::solidRow(dest,w,color);
         dest+=dest_span;
       }
     }
@@ -296,6 +292,7 @@ class _LICE_Template_Blit1 // these controlled by LICE_FAVOR_SIZE_EXTREME
     {
       while (h--)
       {
+#ifdef LICE_FAVOR_SIZE_EXTREME
         LICE_pixel_chan *pout=dest;
         int n=w;
         while (n--)
@@ -303,6 +300,9 @@ class _LICE_Template_Blit1 // these controlled by LICE_FAVOR_SIZE_EXTREME
           DOPIX(pout,ir,ig,ib,ia,ia);          
           pout += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
         }
+#else
+        _LICE_CombineSpan<COMBFUNC>::solidRow(dest,w,ir,ig,ib,ia,ia);
+#endif
         dest+=dest_span;
       }
     }
@@ -358,6 +358,7 @@ class _LICE_Template_Blit2 // these controlled by LICE_FAVOR_SIZE
     {
       while (h-->0)
       {
+#ifdef LICE_FAVOR_SIZE
         int n=w;
         const LICE_pixel_chan *pin=src;
         LICE_pixel_chan *pout=dest;
@@ -369,6 +370,9 @@ class _LICE_Template_Blit2 // these controlled by LICE_FAVOR_SIZE
           pin += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
           pout += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
         }
+#else
+        _LICE_CombineSpan<COMBFUNC>::blitRow(dest,src,w,ia);
+#endif
         dest+=dest_span;
         src += src_span;
       }
@@ -803,9 +807,153 @@ class _LICE_Template_Blit4 // stuff controlled by LICE_FAVOR_SPEED
 };
 
 
+// optional worker pool for splitting large operations into horizontal bands of the destination.
+// every band computes its starting state the same way the serial loop would arrive at it, so the
+// output is identical regardless of the thread count. a band operation started while the pool is
+// in use (by another thread, or from inside a band) runs serially.
+
+#define LICE_BANDS_MINPIXELS 65536 // operations smaller than this are not split
+#define LICE_BANDS_MINROWS 16
+
+static WDL_Mutex s_bands_mutex;
+static LICE_ThreadPool *s_bands_pool;
+static int s_bands_nthreads=1;
+static bool s_bands_busy;
+
+void LICE_SetThreadCount(int nthreads)
+{
+  if (nthreads < 0) nthreads = LICE_Thread::GetCPUCount();
+  if (nthreads < 1) nthreads = 1;
+
+  s_bands_mutex.Enter();
+  while (s_bands_busy)
+  {
+    s_bands_mutex.Leave();
+    LICE_Thread::Sleep(1);
+    s_bands_mutex.Enter();
+  }
+  if (nthreads != s_bands_nthreads)
+  {
+    delete s_bands_pool;
+    s_bands_pool = nthreads > 1 ? new LICE_ThreadPool(nthreads-1) : NULL;
+    s_bands_nthreads = s_bands_pool ? s_bands_pool->GetThreadCount() : 1;
+  }
+  s_bands_mutex.Leave();
+}
+
+int LICE_GetThreadCount()
+{
+  return s_bands_nthreads;
+}
+
+struct _LICE_BandsRec
+{
+  void (*func)(void *ctx, int y, int h);
+  void *ctx;
+  int h, nbands;
+};
+
+static void _LICE_BandsJob(void *ctx, int job)
+{
+  const _LICE_BandsRec *rec = (const _LICE_BandsRec *)ctx;
+  const int y = (int) (((WDL_INT64)rec->h * job) / rec->nbands);
+  const int y2 = (int) (((WDL_INT64)rec->h * (job+1)) / rec->nbands);
+  if (y2 > y) rec->func(rec->ctx,y,y2-y);
+}
+
+// reading a bitmap while writing to it makes the result depend on the row order
+static bool _LICE_BitsOverlap(LICE_IBitmap *dest, LICE_IBitmap *src)
+{
+  if (dest == src) return true;
+  const LICE_pixel *d = dest->getBits(), *s = src->getBits();
+  if (!d || !s) return false;
+  const int dsz = dest->getRowSpan()*dest->getHeight(), ssz = src->getRowSpan()*src->getHeight();
+  return d < s + ssz && s < d + dsz;
+}
+
+// runs jobs 0..njobs-1 on the pool and returns true, or returns false if the pool is disabled or in use
+static bool LICE_RunJobs(int njobs, void (*func)(void *ctx, int job), void *ctx)
+{
+  if (!s_bands_pool) return false;
+
+  s_bands_mutex.Enter();
+  LICE_ThreadPool *pool = s_bands_busy ? NULL : s_bands_pool;
+  if (pool) s_bands_busy=true;
+  s_bands_mutex.Leave();
+  if (!pool) return false;
+
+  pool->Run(njobs,func,ctx);
+
+  s_bands_mutex.Enter();
+  s_bands_busy=false;
+  s_bands_mutex.Leave();
+  return true;
+}
+
+void LICE_RunThreadJobs(int njobs, void (*func)(void *ctx, int job), void *ctx)
+{
+  if (njobs > 1 && LICE_RunJobs(njobs,func,ctx)) return;
+  for (int i = 0; i < njobs; i ++) func(ctx,i);
+}
+
+// calls func(ctx,y,h) for bands covering rows 0..h-1, in parallel if enabled and worthwhile.
+// bands must write disjoint rows and not read anything another band writes.
+static void LICE_RunBands(int w, int h, void (*func)(void *ctx, int y, int h), void *ctx)
+{
+  if (s_bands_pool && h >= LICE_BANDS_MINROWS*2 && (WDL_INT64)w*h >= LICE_BANDS_MINPIXELS)
+  {
+    // a few bands per thread, so uneven rows (rotation, clipping) balance out
+    _LICE_BandsRec rec = { func, ctx, h, wdl_min(s_bands_nthreads*4, h/LICE_BANDS_MINROWS) };
+    if (LICE_RunJobs(rec.nbands,_LICE_BandsJob,&rec)) return;
+  }
+  func(ctx,0,h);
+}
+
 
 #ifndef LICE_NO_GRADIENT_SUPPORT
 
+struct _LICE_GradRectRec
+{
+  LICE_pixel_chan *pdest;
+  int w, dest_span, mode;
+  int c[4], dcdx[4], dcdy[4]; // r,g,b,a in 16.16
+};
+
+static void _LICE_GradRectBand(void *ctx, int y, int h)
+{
+  const _LICE_GradRectRec *p = (const _LICE_GradRectRec *)ctx;
+  LICE_pixel_chan *pdest = p->pdest + y*p->dest_span;
+  const int mode = p->mode;
+  const int dest_span = p->dest_span, dstw = p->w;
+  const int iir=p->c[0]+y*p->dcdy[0], iig=p->c[1]+y*p->dcdy[1], iib=p->c[2]+y*p->dcdy[2], iia=p->c[3]+y*p->dcdy[3];
+  const int idrdx=p->dcdx[0], idgdx=p->dcdx[1], idbdx=p->dcdx[2], idadx=p->dcdx[3];
+  const int idrdy=p->dcdy[0], idgdy=p->dcdy[1], idbdy=p->dcdy[2], idady=p->dcdy[3];
+
+#ifdef LICE_FAVOR_SIZE_EXTREME
+  LICE_COMBINEFUNC blitfunc=NULL;      
+  #define __LICE__ACTION(comb) blitfunc=comb::doPix;
+#else
+
+  #define __LICE__ACTION(comb) _LICE_Template_Blit1<comb>::gradBlit(pdest,dstw,h,iir,iig,iib,iia,idrdx,idgdx,idbdx,idadx,idrdy,idgdy,idbdy,idady,dest_span)
+#endif
+
+    // todo: could predict whether or not the colors will ever go out of 0.255 range and optimize
+
+    if ((mode & LICE_BLIT_MODE_MASK)==LICE_BLIT_MODE_COPY && p->c[3]==65536 && idady==0 && idadx == 0)
+    {
+      __LICE__ACTION(_LICE_CombinePixelsClobberClamp);
+    }
+    else 
+    {
+      __LICE_ACTION_NOSRCALPHA(mode,256,true);
+    }
+  #undef __LICE__ACTION
+
+#ifdef LICE_FAVOR_SIZE_EXTREME
+   if (blitfunc) _LICE_Template_Blit1::gradBlit(pdest,dstw,h,iir,iig,iib,iia,idrdx,idgdx,idbdx,idadx,idrdy,idgdy,idbdy,idady,dest_span,blitfunc);
+#endif
+}
+
 void LICE_GradRect(LICE_IBitmap *dest, int dstx, int dsty, int dstw, int dsth, 
                       float ir, float ig, float ib, float ia,
                       float drdx, float dgdx, float dbdx, float dadx,
@@ -855,33 +1003,13 @@ void LICE_GradRect(LICE_IBitmap *dest, int dstx, int dsty, int dstw, int dsth,
   pdest+=dstx*sizeof(LICE_pixel);
 #define TOFIX(a) ((int)((a)*65536.0))
 
-  int iir=TOFIX(ir), iig=TOFIX(ig), iib=TOFIX(ib), iia=TOFIX(ia), idrdx=TOFIX(drdx),idgdx=TOFIX(dgdx),idbdx=TOFIX(dbdx),idadx=TOFIX(dadx),
-      idrdy=TOFIX(drdy), idgdy=TOFIX(dgdy), idbdy=TOFIX(dbdy), idady=TOFIX(dady);
-
-
-#ifdef LICE_FAVOR_SIZE_EXTREME
-  LICE_COMBINEFUNC blitfunc=NULL;      
-  #define __LICE__ACTION(comb) blitfunc=comb::doPix;
-#else
-
-  #define __LICE__ACTION(comb) _LICE_Template_Blit1<comb>::gradBlit(pdest,dstw,dsth,iir,iig,iib,iia,idrdx,idgdx,idbdx,idadx,idrdy,idgdy,idbdy,idady,dest_span)
-#endif
-
-    // todo: could predict whether or not the colors will ever go out of 0.255 range and optimize
-
-    if ((mode & LICE_BLIT_MODE_MASK)==LICE_BLIT_MODE_COPY && iia==65536 && idady==0 && idadx == 0)
-    {
-      __LICE__ACTION(_LICE_CombinePixelsClobberClamp);
-    }
-    else 
-    {
-      __LICE_ACTION_NOSRCALPHA(mode,256,true);
-    }
-  #undef __LICE__ACTION
-
-#ifdef LICE_FAVOR_SIZE_EXTREME
-   if (blitfunc) _LICE_Template_Blit1::gradBlit(pdest,dstw,dsth,iir,iig,iib,iia,idrdx,idgdx,idbdx,idadx,idrdy,idgdy,idbdy,idady,dest_span,blitfunc);
-#endif
+  _LICE_GradRectRec rec = {
+    pdest, dstw, dest_span, mode,
+    { TOFIX(ir), TOFIX(ig), TOFIX(ib), TOFIX(ia) },
+    { TOFIX(drdx), TOFIX(dgdx), TOFIX(dbdx), TOFIX(dadx) },
+    { TOFIX(drdy), TOFIX(dgdy), TOFIX(dbdy), TOFIX(dady) }
+  };
+  LICE_RunBands(dstw,dsth,_LICE_GradRectBand,&rec);
 
 #undef TOFIX
 }
@@ -984,15 +1112,7 @@ void LICE_Blit(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, const
     {
       while (i-->0)
       {
-        int a=cpsize;
-        const LICE_pixel *rd = (LICE_pixel *)psrc;
-        LICE_pixel *wr = (LICE_pixel *)pdest;
-        while (a-->0)
-        {
-          *wr = ((*wr>>1)&0x7f7f7f7f)+((*rd++>>1)&0x7f7f7f7f);
-          wr++;
-        }
-
+        _LICE_CombineSpanFAST<_LICE_CombinePixelsHalfMixFAST>::blitRow((LICE_pixel *)pdest,(const LICE_pixel *)psrc,cpsize);
         pdest+=dest_span;
         psrc += src_span;
       }
@@ -1031,6 +1151,85 @@ void LICE_Blit(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, const
 
 #ifndef LICE_NO_BLUR_SUPPORT
 
+struct _LICE_BlurRec
+{
+  LICE_pixel *pdest;
+  const LICE_pixel *psrc;
+  int w, dest_span, src_span;
+  int top, bottom;
+  LICE_pixel *tmpbuf; // only used when blurring a bitmap to itself, which has to go top to bottom
+};
+
+static void _LICE_BlurBand(void *ctx, int y, int h)
+{
+  const _LICE_BlurRec *p = (const _LICE_BlurRec *)ctx;
+  const int w = p->w, dest_span = p->dest_span, src_span = p->src_span, top = p->top, bottom = p->bottom;
+  LICE_pixel *pdest = p->pdest + y*dest_span;
+  const LICE_pixel *psrc = p->psrc + y*src_span;
+  LICE_pixel *tmpbuf = p->tmpbuf;
+
+  int i;
+  for (i = top+y; i < top+y+h; i ++)
+  {
+    if (tmpbuf)
+      memcpy(tmpbuf+((i&1)?w:0),psrc,w*sizeof(LICE_pixel));
+
+    if (i==top || i==bottom-1)
+    {
+      const LICE_pixel *psrc2=psrc+(i==top ? src_span : -src_span);
+
+      LICE_pixel lp;
+
+      pdest[0] = LICE_PIXEL_HALF(lp=psrc[0]) + 
+                 LICE_PIXEL_QUARTER(psrc[1]) + 
+                 LICE_PIXEL_QUARTER(psrc2[0]);
+      int x;
+      for (x = 1; x < w-1; x ++)
+      {
+        LICE_pixel tp;
+        pdest[x] = LICE_PIXEL_HALF(tp=psrc[x]) + 
+                   LICE_PIXEL_QUARTER(psrc2[x]) + 
+                   LICE_PIXEL_EIGHTH(psrc[x+1]) +
+                   LICE_PIXEL_EIGHTH(lp);
+        lp=tp;
+      }
+      pdest[x] = LICE_PIXEL_HALF(psrc[x]) + 
+                   LICE_PIXEL_QUARTER(lp) + 
+                   LICE_PIXEL_QUARTER(psrc2[x]);
+    }
+    else
+    {
+      const LICE_pixel *psrc2=psrc-src_span;
+      const LICE_pixel *psrc3=psrc+src_span;
+      if (tmpbuf)
+        psrc2=tmpbuf + ((i&1) ? 0 : w);
+
+      LICE_pixel lp;
+      pdest[0] = LICE_PIXEL_HALF(lp=psrc[0]) + 
+                 LICE_PIXEL_QUARTER(psrc[1]) +
+                 LICE_PIXEL_EIGHTH(psrc2[0]) +
+                 LICE_PIXEL_EIGHTH(psrc3[0]);
+      int x;
+      for (x = 1; x < w-1; x ++)
+      {
+        LICE_pixel tp;
+        pdest[x] = LICE_PIXEL_HALF(tp=psrc[x]) +
+                   LICE_PIXEL_EIGHTH(psrc[x+1]) +
+                   LICE_PIXEL_EIGHTH(lp) +
+                   LICE_PIXEL_EIGHTH(psrc2[x]) + 
+                   LICE_PIXEL_EIGHTH(psrc3[x]);
+        lp=tp;
+      }
+      pdest[x] = LICE_PIXEL_HALF(psrc[x]) + 
+                 LICE_PIXEL_QUARTER(lp) + 
+                 LICE_PIXEL_EIGHTH(psrc2[x]) +
+                 LICE_PIXEL_EIGHTH(psrc3[x]);
+    }
+    pdest+=dest_span;
+    psrc += src_span;
+  }
+}
+
 void LICE_Blur(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, int srcx, int srcy, int srcw, int srch) // src and dest can overlap, however it may look fudgy if they do
 {
   if (!dest || !src) return;
@@ -1087,73 +1286,526 @@ void LICE_Blur(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, int sr
     else tmpbuf=(LICE_pixel*)malloc(w*2*sizeof(LICE_pixel));
   }
 
+  _LICE_BlurRec rec = { pdest, psrc, w, dest_span, src_span, sr.top, sr.bottom, tmpbuf };
+  if (tmpbuf || _LICE_BitsOverlap(dest,src)) _LICE_BlurBand(&rec,0,sr.bottom-sr.top);
+  else LICE_RunBands(w,sr.bottom-sr.top,_LICE_BlurBand,&rec);
+
+  if (tmpbuf && tmpbuf != turdbuf)
+    free(tmpbuf);
+}
+
+#endif
+
+#ifndef LICE_NO_BLIT_SUPPORT
+// LICE_BLIT_FILTER_AREA/LICE_BLIT_FILTER_LANCZOS: separable resampling with a table of 2.14 fixed point weights
+// per output column and row. the source is filtered horizontally into a temporary image, which is then
+// filtered vertically. the SIMD row functions use the same integer math as the scalar ones.
+
+#define LICE_RESAMPLE_BITS 14
+
+struct _LICE_ResampleTab
+{
+  int *start, *n; // first source index and number of taps, per output index
+  short *w; // maxn weights per output index, adding up to 1<<LICE_RESAMPLE_BITS
+  int maxn;
+};
+
+static void _LICE_ResampleTabFree(_LICE_ResampleTab *tab)
+{
+  free(tab->start);
+  free(tab->n);
+  free(tab->w);
+}
+
+static double _LICE_Lanczos3(double x)
+{
+  if (x < 0.0) x=-x;
+  if (x < 1.0e-8) return 1.0;
+  if (x >= 3.0) return 0.0;
+  const double px = x*3.14159265358979323846;
+  return 3.0 * sin(px) * sin(px*(1.0/3.0)) / (px*px);
+}
+
+// output index i covers source [s0+(ioffs+i)*adv, s0+(ioffs+i+1)*adv), taps outside [smin,smax) use the edge pixel
+static bool _LICE_ResampleTabInit(_LICE_ResampleTab *tab, int cnt, int ioffs, double s0, double adv, int smin, int smax, int filter)
+{
+  const double aadv = fabs(adv), fsc = aadv > 1.0 ? aadv : 1.0;
+  const int rawn = filter == LICE_BLIT_FILTER_LANCZOS ? (int)ceil(6.0*fsc)+2 : (int)ceil(aadv)+2;
+  const int maxn = wdl_min(rawn, smax-smin);
+
+  tab->maxn = maxn;
+  tab->start = (int *)malloc(cnt*sizeof(int));
+  tab->n = (int *)malloc(cnt*sizeof(int));
+  tab->w = (short *)malloc(cnt*maxn*sizeof(short));
+  double *wt = (double *)malloc(maxn*sizeof(double));
+  if (!tab->start || !tab->n || !tab->w || !wt)
+  {
+    free(wt);
+    _LICE_ResampleTabFree(tab);
+    return false;
+  }
+
   int i;
-  for (i = sr.top; i < sr.bottom; i ++)
+  for (i = 0; i < cnt; i ++)
   {
-    if (tmpbuf)
-      memcpy(tmpbuf+((i&1)?w:0),psrc,w*sizeof(LICE_pixel));
+    const double fi = ioffs + i;
+    double lo=s0 + fi*adv, hi=s0 + (fi+1.0)*adv, c=0.0;
+    int j0, j1;
+    if (filter == LICE_BLIT_FILTER_LANCZOS)
+    {
+      c = s0 + (fi+0.5)*adv;
+      j0 = (int)ceil(c - 3.0*fsc - 0.5);
+      j1 = (int)floor(c + 3.0*fsc - 0.5);
+    }
+    else
+    {
+      if (lo > hi) { const double t=lo; lo=hi; hi=t; }
+      j0 = (int)floor(lo);
+      j1 = wdl_max((int)ceil(hi)-1,j0);
+    }
+    const int cj0 = wdl_max(wdl_min(j0,smax-1),smin), cj1 = wdl_max(wdl_min(j1,smax-1),smin);
+    const int nt = cj1-cj0+1;
+
+    int k;
+    for (k = 0; k < nt; k ++) wt[k]=0.0;
+    double sum=0.0;
+    int j;
+    for (j = j0; j <= j1; j ++)
+    {
+      double v;
+      if (filter == LICE_BLIT_FILTER_LANCZOS) v = _LICE_Lanczos3((j+0.5-c)/fsc);
+      else v = wdl_min(hi,j+1.0) - wdl_max(lo,(double)j);
+      if (v == 0.0) continue;
+      wt[wdl_max(wdl_min(j,smax-1),smin)-cj0] += v;
+      sum += v;
+    }
+    if (fabs(sum) < 1.0e-9) { wt[0]=sum=1.0; } // zero width source
 
-    if (i==sr.top || i==sr.bottom-1)
+    // round to fixed point, then give the rounding error to the largest tap so the weights add up exactly
+    short *iw = tab->w + i*maxn;
+    int tot=0, big=0;
+    for (k = 0; k < nt; k ++)
     {
-      const LICE_pixel *psrc2=psrc+(i==sr.top ? src_span : -src_span);
+      iw[k] = (short)floor(wt[k]*(1<<LICE_RESAMPLE_BITS)/sum + 0.5);
+      tot += iw[k];
+      if (abs(iw[k]) > abs(iw[big])) big=k;
+    }
+    iw[big] += (1<<LICE_RESAMPLE_BITS) - tot;
 
-      LICE_pixel lp;
+    int first=0, last=nt-1;
+    while (first < last && !iw[first]) first++;
+    while (last > first && !iw[last]) last--;
+    if (first) memmove(iw,iw+first,(last-first+1)*sizeof(short));
+    tab->start[i] = cj0+first;
+    tab->n[i] = last-first+1;
+  }
+  free(wt);
+  return true;
+}
 
-      pdest[0] = LICE_PIXEL_HALF(lp=psrc[0]) + 
-                 LICE_PIXEL_QUARTER(psrc[1]) + 
-                 LICE_PIXEL_QUARTER(psrc2[0]);
-      int x;
-      for (x = 1; x < w-1; x ++)
-      {
-        LICE_pixel tp;
-        pdest[x] = LICE_PIXEL_HALF(tp=psrc[x]) + 
-                   LICE_PIXEL_QUARTER(psrc2[x]) + 
-                   LICE_PIXEL_EIGHTH(psrc[x+1]) +
-                   LICE_PIXEL_EIGHTH(lp);
-        lp=tp;
-      }
-      pdest[x] = LICE_PIXEL_HALF(psrc[x]) + 
-                   LICE_PIXEL_QUARTER(lp) + 
-                   LICE_PIXEL_QUARTER(psrc2[x]);
+static inline LICE_pixel_chan _LICE_ResampleOut(int v)
+{
+  v = (v + (1<<(LICE_RESAMPLE_BITS-1))) >> LICE_RESAMPLE_BITS;
+  return (LICE_pixel_chan) (v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+static void ResampleRowH(LICE_pixel *out, const LICE_pixel *in, int w, const _LICE_ResampleTab *tab)
+{
+  int x;
+  for (x = 0; x < w; x ++)
+  {
+    const LICE_pixel_chan *p = (const LICE_pixel_chan *)(in + tab->start[x]);
+    const short *wt = tab->w + x*tab->maxn;
+    int n = tab->n[x], a0=0, a1=0, a2=0, a3=0;
+    while (n--)
+    {
+      const int v = *wt++;
+      a0 += p[0]*v;
+      a1 += p[1]*v;
+      a2 += p[2]*v;
+      a3 += p[3]*v;
+      p += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+    }
+    LICE_pixel_chan *o = (LICE_pixel_chan *)(out+x);
+    o[0] = _LICE_ResampleOut(a0);
+    o[1] = _LICE_ResampleOut(a1);
+    o[2] = _LICE_ResampleOut(a2);
+    o[3] = _LICE_ResampleOut(a3);
+  }
+}
+
+static void ResampleRowV(LICE_pixel *out, const LICE_pixel *in, int in_span, int w, const short *wt, int n)
+{
+  int x;
+  for (x = 0; x < w; x ++)
+  {
+    const LICE_pixel_chan *p = (const LICE_pixel_chan *)(in + x);
+    int a0=0, a1=0, a2=0, a3=0, k;
+    for (k = 0; k < n; k ++)
+    {
+      const int v = wt[k];
+      a0 += p[0]*v;
+      a1 += p[1]*v;
+      a2 += p[2]*v;
+      a3 += p[3]*v;
+      p += in_span*sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+    }
+    LICE_pixel_chan *o = (LICE_pixel_chan *)(out+x);
+    o[0] = _LICE_ResampleOut(a0);
+    o[1] = _LICE_ResampleOut(a1);
+    o[2] = _LICE_ResampleOut(a2);
+    o[3] = _LICE_ResampleOut(a3);
+  }
+}
+
+#ifdef LICE_SIMD_HAVE_SSE2
+static inline __m128i ResampleWeightPair_SSE2(int w0, int w1) { return _mm_set1_epi32((w0&0xffff) | (w1<<16)); }
+static inline __m128i ResampleOut_SSE2(__m128i a) { return _mm_srai_epi32(_mm_add_epi32(a,_mm_set1_epi32(1<<(LICE_RESAMPLE_BITS-1))),LICE_RESAMPLE_BITS); }
+
+static void ResampleRowH_SSE2(LICE_pixel *out, const LICE_pixel *in, int w, const _LICE_ResampleTab *tab)
+{
+  const __m128i z = _mm_setzero_si128();
+  int x;
+  for (x = 0; x < w; x ++)
+  {
+    const LICE_pixel *p = in + tab->start[x];
+    const short *wt = tab->w + x*tab->maxn;
+    const int n = tab->n[x];
+    __m128i acc = z;
+    int k;
+    for (k = 0; k+1 < n; k += 2)
+    {
+      // 2 source pixels, channels interleaved as (pixel0, pixel1) pairs for pmaddwd
+      const __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p+k)),z);
+      acc = _mm_add_epi32(acc,_mm_madd_epi16(_mm_unpacklo_epi16(v,_mm_srli_si128(v,8)),ResampleWeightPair_SSE2(wt[k],wt[k+1])));
+    }
+    if (k < n)
+    {
+      const __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)p[k]),z);
+      acc = _mm_add_epi32(acc,_mm_madd_epi16(_mm_unpacklo_epi16(v,z),ResampleWeightPair_SSE2(wt[k],0)));
+    }
+    acc = ResampleOut_SSE2(acc);
+    acc = _mm_packs_epi32(acc,acc);
+    out[x] = (LICE_pixel)_mm_cvtsi128_si32(_mm_packus_epi16(acc,acc));
+  }
+}
+
+static void ResampleRowV_SSE2(LICE_pixel *out, const LICE_pixel *in, int in_span, int w, const short *wt, int n)
+{
+  const __m128i z = _mm_setzero_si128();
+  int x;
+  for (x = 0; x+4 <= w; x += 4)
+  {
+    const LICE_pixel *p = in + x;
+    __m128i acc0=z, acc1=z, acc2=z, acc3=z;
+    int k;
+    for (k = 0; k < n; k += 2)
+    {
+      const __m128i r0 = _mm_loadu_si128((const __m128i *)p);
+      const __m128i r1 = k+1 < n ? _mm_loadu_si128((const __m128i *)(p+in_span)) : z;
+      const __m128i wp = ResampleWeightPair_SSE2(wt[k],k+1 < n ? wt[k+1] : 0);
+      const __m128i lo0 = _mm_unpacklo_epi8(r0,z), lo1 = _mm_unpacklo_epi8(r1,z);
+      const __m128i hi0 = _mm_unpackhi_epi8(r0,z), hi1 = _mm_unpackhi_epi8(r1,z);
+      acc0 = _mm_add_epi32(acc0,_mm_madd_epi16(_mm_unpacklo_epi16(lo0,lo1),wp));
+      acc1 = _mm_add_epi32(acc1,_mm_madd_epi16(_mm_unpackhi_epi16(lo0,lo1),wp));
+      acc2 = _mm_add_epi32(acc2,_mm_madd_epi16(_mm_unpacklo_epi16(hi0,hi1),wp));
+      acc3 = _mm_add_epi32(acc3,_mm_madd_epi16(_mm_unpackhi_epi16(hi0,hi1),wp));
+      p += in_span*2;
+    }
+    _mm_storeu_si128((__m128i *)(out+x),_mm_packus_epi16(_mm_packs_epi32(ResampleOut_SSE2(acc0),ResampleOut_SSE2(acc1)),
+                                                        _mm_packs_epi32(ResampleOut_SSE2(acc2),ResampleOut_SSE2(acc3))));
+  }
+  ResampleRowV(out+x,in+x,in_span,w-x,wt,n);
+}
+#endif
+
+#ifdef LICE_SIMD_HAVE_NEON
+static inline uint32_t ResampleOut_NEON(int32x4_t a)
+{
+  const int16x4_t s = vqmovn_s32(vshrq_n_s32(vaddq_s32(a,vdupq_n_s32(1<<(LICE_RESAMPLE_BITS-1))),LICE_RESAMPLE_BITS));
+  return vget_lane_u32(vreinterpret_u32_u8(vqmovun_s16(vcombine_s16(s,s))),0);
+}
+
+static void ResampleRowH_NEON(LICE_pixel *out, const LICE_pixel *in, int w, const _LICE_ResampleTab *tab)
+{
+  int x;
+  for (x = 0; x < w; x ++)
+  {
+    const LICE_pixel *p = in + tab->start[x];
+    const short *wt = tab->w + x*tab->maxn;
+    int n = tab->n[x];
+    int32x4_t acc = vdupq_n_s32(0);
+    while (n--)
+    {
+      const int16x4_t v = vreinterpret_s16_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(*p++)))));
+      acc = vmlal_n_s16(acc,v,*wt++);
+    }
+    out[x] = ResampleOut_NEON(acc);
+  }
+}
+
+static void ResampleRowV_NEON(LICE_pixel *out, const LICE_pixel *in, int in_span, int w, const short *wt, int n)
+{
+  int x;
+  for (x = 0; x+4 <= w; x += 4)
+  {
+    const LICE_pixel *p = in + x;
+    int32x4_t acc0=vdupq_n_s32(0), acc1=acc0, acc2=acc0, acc3=acc0;
+    int k;
+    for (k = 0; k < n; k ++)
+    {
+      const uint8x16_t r = vreinterpretq_u8_u32(vld1q_u32(p));
+      const int16x8_t lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(r))), hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(r)));
+      acc0 = vmlal_n_s16(acc0,vget_low_s16(lo),wt[k]);
+      acc1 = vmlal_n_s16(acc1,vget_high_s16(lo),wt[k]);
+      acc2 = vmlal_n_s16(acc2,vget_low_s16(hi),wt[k]);
+      acc3 = vmlal_n_s16(acc3,vget_high_s16(hi),wt[k]);
+      p += in_span;
+    }
+    out[x] = ResampleOut_NEON(acc0);
+    out[x+1] = ResampleOut_NEON(acc1);
+    out[x+2] = ResampleOut_NEON(acc2);
+    out[x+3] = ResampleOut_NEON(acc3);
+  }
+  ResampleRowV(out+x,in+x,in_span,w-x,wt,n);
+}
+#endif
+
+struct _LICE_ResampleRec
+{
+  _LICE_ResampleTab htab, vtab;
+  const LICE_pixel *psrc; // source row 0, column 0
+  int src_span;
+  LICE_pixel *tmp; // horizontally filtered source rows tmp_y..
+  int tmp_y, w;
+  LICE_pixel *pdest;
+  int dest_span;
+  int ia, mode;
+  void (*rowH)(LICE_pixel *out, const LICE_pixel *in, int w, const _LICE_ResampleTab *tab);
+  void (*rowV)(LICE_pixel *out, const LICE_pixel *in, int in_span, int w, const short *wt, int n);
+};
+
+static void _LICE_ResampleBandH(void *ctx, int y, int h)
+{
+  const _LICE_ResampleRec *r = (const _LICE_ResampleRec *)ctx;
+  while (h--)
+  {
+    r->rowH(r->tmp + y*r->w, r->psrc + (r->tmp_y+y)*r->src_span, r->w, &r->htab);
+    y++;
+  }
+}
+
+static void _LICE_ResampleBandV(void *ctx, int y, int h)
+{
+  const _LICE_ResampleRec *r = (const _LICE_ResampleRec *)ctx;
+  const int w = r->w, mode = r->mode, ia = r->ia;
+  // with a plain copy the filtered rows go straight to the destination
+  const bool direct = (mode&(LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA))==LICE_BLIT_MODE_COPY && ia==256;
+  LICE_pixel *rowbuf = direct ? NULL : (LICE_pixel *)malloc(w*sizeof(LICE_pixel));
+  if (!direct && !rowbuf) return;
+
+  while (h--)
+  {
+    LICE_pixel *pdest = r->pdest + y*r->dest_span;
+    const int tap = r->vtab.start[y]-r->tmp_y;
+    r->rowV(direct ? pdest : rowbuf, r->tmp + tap*w, w, w, r->vtab.w + y*r->vtab.maxn, r->vtab.n[y]);
+    if (!direct)
+    {
+      #ifdef LICE_FAVOR_SIZE
+        LICE_COMBINEFUNC blitfunc=NULL;      
+        #define __LICE__ACTION(comb) blitfunc=comb::doPix;
+      #else
+        #define __LICE__ACTION(comb) _LICE_Template_Blit2<comb>::blit((LICE_pixel_chan*)pdest,(LICE_pixel_chan*)rowbuf,w,1,0,0,ia)
+      #endif
+          __LICE_ACTION_SRCALPHA(mode,ia,false);
+      #undef __LICE__ACTION
+      #ifdef LICE_FAVOR_SIZE
+        if (blitfunc) _LICE_Template_Blit2::blit((LICE_pixel_chan*)pdest,(LICE_pixel_chan*)rowbuf,w,1,0,0,ia,blitfunc);
+      #endif
+    }
+    y++;
+  }
+  free(rowbuf);
+}
+
+// dstw/dsth are positive here, srcw/srch negative for mirroring
+static void _LICE_ResampleBlit(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, int dstw, int dsth,
+                               double srcx, double srcy, double srcw, double srch, float alpha, int mode)
+{
+  const int destbm_w = dest->getWidth(), destbm_h = dest->getHeight();
+  const int cx = wdl_max(dstx,0), cy = wdl_max(dsty,0);
+  const int cw = wdl_min(dstx+dstw,destbm_w) - cx, ch = wdl_min(dsty+dsth,destbm_h) - cy;
+
+  // source area, limited to the bitmap
+  const int sx0 = wdl_max((int)floor(wdl_min(srcx,srcx+srcw)),0), sx1 = wdl_min((int)ceil(wdl_max(srcx,srcx+srcw)),src->getWidth());
+  const int sy0 = wdl_max((int)floor(wdl_min(srcy,srcy+srch)),0), sy1 = wdl_min((int)ceil(wdl_max(srcy,srcy+srch)),src->getHeight());
+  if (cw < 1 || ch < 1 || sx1 <= sx0 || sy1 <= sy0) return;
+
+  LICE_pixel *pdest = dest->getBits();
+  const LICE_pixel *psrc = src->getBits();
+  if (!pdest || !psrc) return;
+
+  _LICE_ResampleRec rec;
+  memset(&rec,0,sizeof(rec));
+  const int filter = mode&LICE_BLIT_FILTER_MASK;
+  if (!_LICE_ResampleTabInit(&rec.htab,cw,cx-dstx,srcx,srcw/dstw,sx0,sx1,filter)) return;
+  if (!_LICE_ResampleTabInit(&rec.vtab,ch,cy-dsty,srcy,srch/dsth,sy0,sy1,filter))
+  {
+    _LICE_ResampleTabFree(&rec.htab);
+    return;
+  }
+
+  int ymin=sy1, ymax=sy0, y;
+  for (y = 0; y < ch; y ++)
+  {
+    if (rec.vtab.start[y] < ymin) ymin = rec.vtab.start[y];
+    if (rec.vtab.start[y] + rec.vtab.n[y] > ymax) ymax = rec.vtab.start[y] + rec.vtab.n[y];
+  }
+
+  rec.w = cw;
+  rec.tmp_y = ymin;
+  rec.tmp = (LICE_pixel *)malloc((WDL_INT64)(ymax-ymin)*cw*sizeof(LICE_pixel));
+  if (rec.tmp)
+  {
+    rec.src_span = src->getRowSpan();
+    rec.psrc = psrc;
+    if (src->isFlipped())
+    {
+      rec.psrc += (src->getHeight()-1)*rec.src_span;
+      rec.src_span = -rec.src_span;
+    }
+    rec.dest_span = dest->getRowSpan();
+    rec.pdest = pdest;
+    if (dest->isFlipped())
+    {
+      rec.pdest += (destbm_h-cy-1)*rec.dest_span;
+      rec.dest_span = -rec.dest_span;
+    }
+    else rec.pdest += cy*rec.dest_span;
+    rec.pdest += cx;
+    rec.ia = (int)(alpha*256.0);
+    rec.mode = mode;
+
+    rec.rowH = ResampleRowH;
+    rec.rowV = ResampleRowV;
+    const int caps = LICE_SIMD_GetCaps();
+#ifdef LICE_SIMD_HAVE_SSE2
+    if (caps & LICE_SIMD_SSE2) { rec.rowH = ResampleRowH_SSE2; rec.rowV = ResampleRowV_SSE2; }
+#endif
+#ifdef LICE_SIMD_HAVE_NEON
+    if (caps & LICE_SIMD_NEON) { rec.rowH = ResampleRowH_NEON; rec.rowV = ResampleRowV_NEON; }
+#endif
+    (void)caps;
+
+    // the vertical pass only reads tmp, so this also works in place
+    LICE_RunBands(cw,ymax-ymin,_LICE_ResampleBandH,&rec);
+    LICE_RunBands(cw,ch,_LICE_ResampleBandV,&rec);
+    free(rec.tmp);
+  }
+  _LICE_ResampleTabFree(&rec.htab);
+  _LICE_ResampleTabFree(&rec.vtab);
+}
+
+struct _LICE_ScaledBlitRec
+{
+  LICE_pixel_chan *pdest;
+  const LICE_pixel_chan *psrc;
+  int w, dest_span, src_span;
+  int icurx, icury, idx, idy, clip_r, clip_b;
+  int ia, mode;
+  double xadvance, yadvance;
+};
+
+static void _LICE_ScaledBlitBand(void *ctx, int ystart, int dsth)
+{
+  const _LICE_ScaledBlitRec *parms = (const _LICE_ScaledBlitRec *)ctx;
+  LICE_pixel_chan *pdest = parms->pdest + ystart*parms->dest_span;
+  const LICE_pixel_chan *psrc = parms->psrc;
+  const int dstw = parms->w, dest_span = parms->dest_span, src_span = parms->src_span;
+  const int icurx = parms->icurx, icury = parms->icury + ystart*parms->idy, idx = parms->idx, idy = parms->idy;
+  const int clip_r = parms->clip_r, clip_b = parms->clip_b;
+  const int ia = parms->ia, mode = parms->mode;
+  const double xadvance = parms->xadvance, yadvance = parms->yadvance;
+
+  if ((mode&(LICE_BLIT_FILTER_MASK|LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA))==LICE_BLIT_MODE_COPY && (ia==128 || ia==256))
+  {
+    if (ia==128)
+    {
+      _LICE_Template_Blit0<_LICE_CombinePixelsHalfMixFAST>::scaleBlitFAST(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span);
     }
     else
     {
-      const LICE_pixel *psrc2=psrc-src_span;
-      const LICE_pixel *psrc3=psrc+src_span;
-      if (tmpbuf)
-        psrc2=tmpbuf + ((i&1) ? 0 : w);
+      _LICE_Template_Blit0<_LICE_CombinePixelsClobberFAST>::scaleBlitFAST(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span);
+    }
+  }
+  else
+  {
+    if (xadvance>=1.7 && yadvance >=1.7 && (mode&LICE_BLIT_FILTER_MASK)==LICE_BLIT_FILTER_BILINEAR)
+    {
+      int msc = lice_max(idx,idy);
+      const int filtsz=msc>(3<<16) ? 5 : 3;
+      const int filt_start = - (filtsz/2);
 
-      LICE_pixel lp;
-      pdest[0] = LICE_PIXEL_HALF(lp=psrc[0]) + 
-                 LICE_PIXEL_QUARTER(psrc[1]) +
-                 LICE_PIXEL_EIGHTH(psrc2[0]) +
-                 LICE_PIXEL_EIGHTH(psrc3[0]);
-      int x;
-      for (x = 1; x < w-1; x ++)
+      int filter[25]; // 5x5 max
       {
-        LICE_pixel tp;
-        pdest[x] = LICE_PIXEL_HALF(tp=psrc[x]) +
-                   LICE_PIXEL_EIGHTH(psrc[x+1]) +
-                   LICE_PIXEL_EIGHTH(lp) +
-                   LICE_PIXEL_EIGHTH(psrc2[x]) + 
-                   LICE_PIXEL_EIGHTH(psrc3[x]);
-        lp=tp;
+        int y;
+      //  char buf[4096];
+    //    sprintf(buf,"filter, msc=%f: ",msc);
+        int *p=filter;
+        for(y=0;y<filtsz;y++)
+        {
+          int x;
+          for(x=0;x<filtsz;x++)
+          {
+            if (x==y && x==filtsz/2) *p++ = 65536; // src pix is always valued at 1.
+            else
+            {
+              double dx=x+filt_start;
+              double dy=y+filt_start;
+              double v = (msc-1.0) / sqrt(dx*dx+dy*dy); // this needs serious tweaking...
+
+  //            sprintf(buf+strlen(buf),"%f,",v);
+
+              if(v<0.0) *p++=0;
+              else if (v>1.0) *p++=65536;
+              else *p++=(int)(v*65536.0);
+            }
+          }
+        }
+//        OutputDebugString(buf);
       }
-      pdest[x] = LICE_PIXEL_HALF(psrc[x]) + 
-                 LICE_PIXEL_QUARTER(lp) + 
-                 LICE_PIXEL_EIGHTH(psrc2[x]) +
-                 LICE_PIXEL_EIGHTH(psrc3[x]);
+
+      #ifdef LICE_FAVOR_SIZE
+        LICE_COMBINEFUNC blitfunc=NULL;      
+        #define __LICE__ACTION(comb) blitfunc=comb::doPix;
+      #else
+        #define __LICE__ACTION(comb) _LICE_Template_Blit2<comb>::scaleBlitFilterDown(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,filter,filt_start,filtsz)
+      #endif
+          __LICE_ACTION_SRCALPHA(mode,ia,false);
+      #undef __LICE__ACTION
+
+      #ifdef LICE_FAVOR_SIZE
+        if (blitfunc) _LICE_Template_Blit2::scaleBlitFilterDown(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,filter,filt_start,filtsz,blitfunc);
+      #endif
+
+    }
+    else
+    {
+      #ifdef LICE_FAVOR_SIZE
+        LICE_COMBINEFUNC blitfunc=NULL;      
+        #define __LICE__ACTION(comb) blitfunc=comb::doPix;
+      #else
+        #define __LICE__ACTION(comb) _LICE_Template_Blit2<comb>::scaleBlit(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK)
+      #endif
+          __LICE_ACTION_SRCALPHA(mode,ia,false);
+      #undef __LICE__ACTION
+      #ifdef LICE_FAVOR_SIZE
+        if (blitfunc) _LICE_Template_Blit2::scaleBlit(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK,blitfunc);
+      #endif
     }
-    pdest+=dest_span;
-    psrc += src_span;
   }
-  if (tmpbuf && tmpbuf != turdbuf)
-    free(tmpbuf);
 }
 
-#endif
-
-#ifndef LICE_NO_BLIT_SUPPORT
 void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src, 
                      int dstx, int dsty, int dstw, int dsth, 
                      float srcx, float srcy, float srcw, float srch, 
@@ -1164,9 +1816,9 @@ void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
   // non-scaling optimized omde
   if (fabs(srcw-dstw)<0.001 && fabs(srch-dsth)<0.001)
   {
-    // and if not bilinear filtering, or 
+    // and if not filtering, or 
     // the source coordinates are near their integer counterparts
-    if ((mode&LICE_BLIT_FILTER_MASK)!=LICE_BLIT_FILTER_BILINEAR ||
+    if ((mode&LICE_BLIT_FILTER_MASK)==LICE_BLIT_FILTER_NONE ||
         (fabs(srcx-floor(srcx+0.5f))<0.03 && fabs(srcy-floor(srcy+0.5f))<0.03))
     {
       RECT sr={(int)(srcx+0.5f),(int)(srcy+0.5f),};
@@ -1200,6 +1852,12 @@ void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
     srch=-srch;
   }
 
+  if ((mode&LICE_BLIT_FILTER_MASK)==LICE_BLIT_FILTER_AREA || (mode&LICE_BLIT_FILTER_MASK)==LICE_BLIT_FILTER_LANCZOS)
+  {
+    _LICE_ResampleBlit(dest,src,dstx,dsty,dstw,dsth,srcx,srcy,srcw,srch,alpha,mode);
+    return;
+  }
+
   double xadvance = srcw / dstw;
   double yadvance = srch / dsth;
 
@@ -1299,85 +1957,43 @@ void LICE_ScaledBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
 
   if (clip_r<1||clip_b<1) return;
 
-  int ia=(int)(alpha*256.0);
-
-  if ((mode&(LICE_BLIT_FILTER_MASK|LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA))==LICE_BLIT_MODE_COPY && (ia==128 || ia==256))
-  {
-    if (ia==128)
-    {
-      _LICE_Template_Blit0<_LICE_CombinePixelsHalfMixFAST>::scaleBlitFAST(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span);
-    }
-    else
-    {
-      _LICE_Template_Blit0<_LICE_CombinePixelsClobberFAST>::scaleBlitFAST(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span);
-    }
-  }
-  else
-  {
-    if (xadvance>=1.7 && yadvance >=1.7 && (mode&LICE_BLIT_FILTER_MASK)==LICE_BLIT_FILTER_BILINEAR)
-    {
-      int msc = lice_max(idx,idy);
-      const int filtsz=msc>(3<<16) ? 5 : 3;
-      const int filt_start = - (filtsz/2);
-
-      int filter[25]; // 5x5 max
-      {
-        int y;
-      //  char buf[4096];
-    //    sprintf(buf,"filter, msc=%f: ",msc);
-        int *p=filter;
-        for(y=0;y<filtsz;y++)
-        {
-          int x;
-          for(x=0;x<filtsz;x++)
-          {
-            if (x==y && x==filtsz/2) *p++ = 65536; // src pix is always valued at 1.
-            else
-            {
-              double dx=x+filt_start;
-              double dy=y+filt_start;
-              double v = (msc-1.0) / sqrt(dx*dx+dy*dy); // this needs serious tweaking...
-
-  //            sprintf(buf+strlen(buf),"%f,",v);
+  _LICE_ScaledBlitRec rec = { pdest, psrc, dstw, dest_span, src_span, icurx, icury, idx, idy, clip_r, clip_b, (int)(alpha*256.0), mode, xadvance, yadvance };
+  if (_LICE_BitsOverlap(dest,src)) _LICE_ScaledBlitBand(&rec,0,dsth);
+  else LICE_RunBands(dstw,dsth,_LICE_ScaledBlitBand,&rec);
+}
 
-              if(v<0.0) *p++=0;
-              else if (v>1.0) *p++=65536;
-              else *p++=(int)(v*65536.0);
-            }
-          }
-        }
-//        OutputDebugString(buf);
-      }
+struct _LICE_DeltaBlitRec
+{
+  LICE_pixel_chan *pdest;
+  const LICE_pixel_chan *psrc;
+  int w, dest_span, src_span, sr, sb;
+  int isrcx, isrcy, idsdx, idtdx, idsdy, idtdy, idsdxdy, idtdxdy;
+  int ia, mode;
+};
 
-      #ifdef LICE_FAVOR_SIZE
-        LICE_COMBINEFUNC blitfunc=NULL;      
-        #define __LICE__ACTION(comb) blitfunc=comb::doPix;
-      #else
-        #define __LICE__ACTION(comb) _LICE_Template_Blit2<comb>::scaleBlitFilterDown(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,filter,filt_start,filtsz)
-      #endif
-          __LICE_ACTION_SRCALPHA(mode,ia,false);
-      #undef __LICE__ACTION
+static void _LICE_DeltaBlitBand(void *ctx, int ystart, int dsth)
+{
+  const _LICE_DeltaBlitRec *parms = (const _LICE_DeltaBlitRec *)ctx;
+  LICE_pixel_chan *pdest = parms->pdest + ystart*parms->dest_span;
+  const LICE_pixel_chan *psrc = parms->psrc;
+  const int dstw = parms->w, dest_span = parms->dest_span, src_span = parms->src_span, sr = parms->sr, sb = parms->sb;
+  const int isrcx = parms->isrcx + ystart*parms->idsdy, isrcy = parms->isrcy + ystart*parms->idtdy;
+  const int idsdx = parms->idsdx + ystart*parms->idsdxdy, idtdx = parms->idtdx + ystart*parms->idtdxdy;
+  const int idsdy = parms->idsdy, idtdy = parms->idtdy, idsdxdy = parms->idsdxdy, idtdxdy = parms->idtdxdy;
+  const int ia = parms->ia, mode = parms->mode;
 
-      #ifdef LICE_FAVOR_SIZE
-        if (blitfunc) _LICE_Template_Blit2::scaleBlitFilterDown(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,filter,filt_start,filtsz,blitfunc);
-      #endif
+#ifndef LICE_FAVOR_SPEED
+  LICE_COMBINEFUNC blitfunc=NULL;
+  #define __LICE__ACTION(comb) blitfunc = comb::doPix;
+#else
+  #define __LICE__ACTION(comb) _LICE_Template_Blit3<comb>::deltaBlit(pdest,psrc,dstw,dsth,isrcx,isrcy,idsdx,idtdx,idsdy,idtdy,idsdxdy,idtdxdy,sr,sb,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK)
+#endif
+      __LICE_ACTION_SRCALPHA(mode,ia,false);
+  #undef __LICE__ACTION
 
-    }
-    else
-    {
-      #ifdef LICE_FAVOR_SIZE
-        LICE_COMBINEFUNC blitfunc=NULL;      
-        #define __LICE__ACTION(comb) blitfunc=comb::doPix;
-      #else
-        #define __LICE__ACTION(comb) _LICE_Template_Blit2<comb>::scaleBlit(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK)
-      #endif
-          __LICE_ACTION_SRCALPHA(mode,ia,false);
-      #undef __LICE__ACTION
-      #ifdef LICE_FAVOR_SIZE
-        if (blitfunc) _LICE_Template_Blit2::scaleBlit(pdest,psrc,dstw,dsth,icurx,icury,idx,idy,clip_r,clip_b,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK,blitfunc);
-      #endif
-    }
-  }
+#ifndef LICE_FAVOR_SPEED
+  if (blitfunc) _LICE_Template_Blit3::deltaBlit(pdest,psrc,dstw,dsth,isrcx,isrcy,idsdx,idtdx,idsdy,idtdy,idsdxdy,idtdxdy,sr,sb,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK,blitfunc);
+#endif
 }
 
 void LICE_DeltaBlit(LICE_IBitmap *dest, LICE_IBitmap *src, 
@@ -1477,19 +2093,9 @@ void LICE_DeltaBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
   int idsdxdy=(int)(dsdxdy*65536.0);
   int idtdxdy=(int)(dtdxdy*65536.0);
 
-#ifndef LICE_FAVOR_SPEED
-  LICE_COMBINEFUNC blitfunc=NULL;
-  #define __LICE__ACTION(comb) blitfunc = comb::doPix;
-#else
-  #define __LICE__ACTION(comb) _LICE_Template_Blit3<comb>::deltaBlit(pdest,psrc,dstw,dsth,isrcx,isrcy,idsdx,idtdx,idsdy,idtdy,idsdxdy,idtdxdy,sr,sb,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK)
-#endif
-      __LICE_ACTION_SRCALPHA(mode,ia,false);
-  #undef __LICE__ACTION
-
-#ifndef LICE_FAVOR_SPEED
-  if (blitfunc) _LICE_Template_Blit3::deltaBlit(pdest,psrc,dstw,dsth,isrcx,isrcy,idsdx,idtdx,idsdy,idtdy,idsdxdy,idtdxdy,sr,sb,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK,blitfunc);
-#endif
-
+  _LICE_DeltaBlitRec rec = { pdest, psrc, dstw, dest_span, src_span, sr, sb, isrcx, isrcy, idsdx, idtdx, idsdy, idtdy, idsdxdy, idtdxdy, ia, mode };
+  if (_LICE_BitsOverlap(dest,src)) _LICE_DeltaBlitBand(&rec,0,dsth);
+  else LICE_RunBands(dstw,dsth,_LICE_DeltaBlitBand,&rec);
 }
 
 void LICE_DeltaBlitAlpha(LICE_IBitmap *dest, LICE_IBitmap *src, 
@@ -1731,18 +2337,9 @@ void LICE_RotatedBlit(LICE_IBitmap *dest, LICE_IBitmap *src,
   int idsdy=(int)(dsdy*65536.0);
   int idtdy=(int)(dtdy*65536.0);
 
-#ifndef LICE_FAVOR_SPEED
-  LICE_COMBINEFUNC blitfunc=NULL;
-  #define __LICE__ACTION(comb) blitfunc = comb::doPix;
-#else
-  #define __LICE__ACTION(comb) _LICE_Template_Blit3<comb>::deltaBlit(pdest,psrc,dstw,dsth,isrcx,isrcy,idsdx,idtdx,idsdy,idtdy,0,0,sr,sb,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK)
-#endif
-      __LICE_ACTION_SRCALPHA(mode,ia,false);
-  #undef __LICE__ACTION
-
-#ifndef LICE_FAVOR_SPEED
-  if (blitfunc) _LICE_Template_Blit3::deltaBlit(pdest,psrc,dstw,dsth,isrcx,isrcy,idsdx,idtdx,idsdy,idtdy,0,0,sr,sb,src_span,dest_span,ia,mode&LICE_BLIT_FILTER_MASK,blitfunc);
-#endif
+  _LICE_DeltaBlitRec rec = { pdest, psrc, dstw, dest_span, src_span, sr, sb, isrcx, isrcy, idsdx, idtdx, idsdy, idtdy, 0, 0, ia, mode };
+  if (_LICE_BitsOverlap(dest,src)) _LICE_DeltaBlitBand(&rec,0,dsth);
+  else LICE_RunBands(dstw,dsth,_LICE_DeltaBlitBand,&rec);
 }
 
 #endif
@@ -2052,6 +2649,66 @@ void LICE_PutPixel(LICE_IBitmap *bm, int x, int y, LICE_pixel color, float alpha
 template<class T> class LICE_TransformBlit_class
 {
   public:
+  struct rowRec
+  {
+    LICE_IBitmap *dest, *src;
+    int dstx, dstw, div_w;
+    const T *srcpoints;
+    const int *ypos; // div_h output row positions
+    float alpha;
+    int mode;
+  };
+
+  // grid rows cover disjoint output rows, so they can be drawn in parallel
+  static void blitRow(void *ctx, int y)
+  {
+    const rowRec *r = (const rowRec *)ctx;
+    const int cypos=r->ypos[y], nypos=r->ypos[y+1];
+    if (nypos == cypos) return;
+
+    const int div_w=r->div_w;
+    const T *curpoints=r->srcpoints + y*div_w*2;
+    double dxpos=r->dstw/(float)(div_w-1);
+    double xpos=r->dstx;
+    int cxpos=r->dstx;
+    double iy=1.0/(double)(nypos-cypos);
+    int x;
+    for (x = 0; x < div_w-1; x ++)
+    {
+      int nxpos=(int) ((xpos+=dxpos) + 0.5);
+      if (nxpos != cxpos)
+      {
+        int offs=x*2;
+        double sx=curpoints[offs];
+        double sy=curpoints[offs+1];
+        double sw=curpoints[offs+2]-sx;
+        double sh=curpoints[offs+3]-sy;
+
+        offs+=div_w*2;
+        double sxdiff=curpoints[offs]-sx;
+        double sydiff=curpoints[offs+1]-sy;
+        double sw3=curpoints[offs+2]-curpoints[offs];
+        double sh3=curpoints[offs+3]-curpoints[offs+1];
+
+        double ix=1.0/(double)(nxpos-cxpos);
+        double dsdx=sw*ix;
+        double dtdx=sh*ix;
+        double dsdx2=sw3*ix;
+        double dtdx2=sh3*ix;
+        double dsdy=sxdiff*iy;
+        double dtdy=sydiff*iy;
+        double dsdxdy = (dsdx2-dsdx)*iy;
+        double dtdxdy = (dtdx2-dtdx)*iy;
+
+        LICE_DeltaBlit(r->dest,r->src,cxpos,cypos,nxpos-cxpos,nypos-cypos,
+            (float)sx,(float)sy,(float)sw,(float)sh,
+            dsdx,dtdx,dsdy,dtdy,dsdxdy,dtdxdy,false,r->alpha,r->mode);
+      }
+
+      cxpos=nxpos;
+    }
+  }
+
   static void blit(LICE_IBitmap *dest, LICE_IBitmap *src,  
                     int dstx, int dsty, int dstw, int dsth,
                     const T *srcpoints, int div_w, int div_h, // srcpoints coords should be div_w*div_h*2 long, and be in source image coordinates
@@ -2059,60 +2716,22 @@ template<class T> class LICE_TransformBlit_class
 {
   if (!dest || !src || dstw<1 || dsth<1 || div_w<2 || div_h<2) return;
 
-  int cypos=dsty;
+  int *ypos_tab = (int *)malloc(div_h*sizeof(int));
+  if (!ypos_tab) return;
+
   double ypos=dsty;
-  double dxpos=dstw/(float)(div_w-1);
   double dypos=dsth/(float)(div_h-1);
   int y;
-  const T *curpoints=srcpoints;
-  for (y = 0; y < div_h-1; y ++)
-  {
-    int nypos=(int)((ypos+=dypos) + 0.5);
-    int x;
-    double xpos=dstx;
-    int cxpos=dstx;
-
-    if (nypos != cypos)
-    {
-      double iy=1.0/(double)(nypos-cypos);
-      for (x = 0; x < div_w-1; x ++)
-      {
-        int nxpos=(int) ((xpos+=dxpos) + 0.5);
-        if (nxpos != cxpos)
-        {
-          int offs=x*2;
-          double sx=curpoints[offs];
-          double sy=curpoints[offs+1];
-          double sw=curpoints[offs+2]-sx;
-          double sh=curpoints[offs+3]-sy;
-
-          offs+=div_w*2;
-          double sxdiff=curpoints[offs]-sx;
-          double sydiff=curpoints[offs+1]-sy;
-          double sw3=curpoints[offs+2]-curpoints[offs];
-          double sh3=curpoints[offs+3]-curpoints[offs+1];
-
-          double ix=1.0/(double)(nxpos-cxpos);
-          double dsdx=sw*ix;
-          double dtdx=sh*ix;
-          double dsdx2=sw3*ix;
-          double dtdx2=sh3*ix;
-          double dsdy=sxdiff*iy;
-          double dtdy=sydiff*iy;
-          double dsdxdy = (dsdx2-dsdx)*iy;
-          double dtdxdy = (dtdx2-dtdx)*iy;
-
-          LICE_DeltaBlit(dest,src,cxpos,cypos,nxpos-cxpos,nypos-cypos,
-              (float)sx,(float)sy,(float)sw,(float)sh,
-              dsdx,dtdx,dsdy,dtdy,dsdxdy,dtdxdy,false,alpha,mode);
-        }
+  ypos_tab[0]=dsty;
+  for (y = 1; y < div_h; y ++) ypos_tab[y]=(int)((ypos+=dypos) + 0.5);
 
-        cxpos=nxpos;
-      }
-    }
-    curpoints+=div_w*2;
-    cypos=nypos;
+  rowRec rec = { dest, src, dstx, dstw, div_w, srcpoints, ypos_tab, alpha, mode };
+  if (div_h < 3 || (WDL_INT64)dstw*dsth < LICE_BANDS_MINPIXELS || _LICE_BitsOverlap(dest,src) || 
+      !LICE_RunJobs(div_h-1,blitRow,&rec))
+  {
+    for (y = 0; y < div_h-1; y ++) blitRow(&rec,y);
   }
+  free(ypos_tab);
 }
 };
 
@@ -2451,6 +3070,65 @@ void LICE_DrawMonoGlyph(LICE_IBitmap* dest, int x, int y, LICE_pixel color, cons
 #undef __LICE__ACTION
 }
 
+// LICE_HalveBlitAA() rows: each dest pixel is the rounded average of a 2x2 source block, per channel
+static void HalveRow(LICE_pixel *dp, const LICE_pixel *sp, const LICE_pixel *sp2, int w)
+{
+  while (w--)
+  {
+    const unsigned int rb = (sp[0]&0x00ff00ff) + (sp[1]&0x00ff00ff) + (sp2[0]&0x00ff00ff) + (sp2[1]&0x00ff00ff) + 0x00020002;
+    const unsigned int ga = ((sp[0]>>8)&0x00ff00ff) + ((sp[1]>>8)&0x00ff00ff) + ((sp2[0]>>8)&0x00ff00ff) + ((sp2[1]>>8)&0x00ff00ff) + 0x00020002;
+    *dp++ = ((rb>>2)&0x00ff00ff) | ((ga<<6)&0xff00ff00);
+    sp+=2;
+    sp2+=2;
+  }
+}
+
+#ifdef LICE_SIMD_HAVE_SSE2
+static void HalveRow_SSE2(LICE_pixel *dp, const LICE_pixel *sp, const LICE_pixel *sp2, int w)
+{
+  const __m128i z = _mm_setzero_si128(), rnd = _mm_set1_epi16(2);
+  int x = w/4;
+  while (x--)
+  {
+    const __m128i a0 = _mm_loadu_si128((const __m128i *)sp), a1 = _mm_loadu_si128((const __m128i *)(sp+4));
+    const __m128i b0 = _mm_loadu_si128((const __m128i *)sp2), b1 = _mm_loadu_si128((const __m128i *)(sp2+4));
+    // vertical sums, 2 pixels per register at 16 bits per channel
+    const __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0,z),_mm_unpacklo_epi8(b0,z));
+    const __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0,z),_mm_unpackhi_epi8(b0,z));
+    const __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1,z),_mm_unpacklo_epi8(b1,z));
+    const __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1,z),_mm_unpackhi_epi8(b1,z));
+    // horizontal pairs
+    const __m128i h0 = _mm_add_epi16(_mm_unpacklo_epi64(s0,s1),_mm_unpackhi_epi64(s0,s1));
+    const __m128i h1 = _mm_add_epi16(_mm_unpacklo_epi64(s2,s3),_mm_unpackhi_epi64(s2,s3));
+    _mm_storeu_si128((__m128i *)dp,_mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(h0,rnd),2),_mm_srli_epi16(_mm_add_epi16(h1,rnd),2)));
+    dp+=4;
+    sp+=8;
+    sp2+=8;
+  }
+  HalveRow(dp,sp,sp2,w&3);
+}
+#endif
+
+#ifdef LICE_SIMD_HAVE_NEON
+static void HalveRow_NEON(LICE_pixel *dp, const LICE_pixel *sp, const LICE_pixel *sp2, int w)
+{
+  int x = w/4;
+  while (x--)
+  {
+    const uint32x4x2_t a = vld2q_u32(sp), b = vld2q_u32(sp2); // even/odd source columns
+    const uint16x8_t lo = vaddq_u16(vaddl_u8(vreinterpret_u8_u32(vget_low_u32(a.val[0])),vreinterpret_u8_u32(vget_low_u32(a.val[1]))),
+                                    vaddl_u8(vreinterpret_u8_u32(vget_low_u32(b.val[0])),vreinterpret_u8_u32(vget_low_u32(b.val[1]))));
+    const uint16x8_t hi = vaddq_u16(vaddl_u8(vreinterpret_u8_u32(vget_high_u32(a.val[0])),vreinterpret_u8_u32(vget_high_u32(a.val[1]))),
+                                    vaddl_u8(vreinterpret_u8_u32(vget_high_u32(b.val[0])),vreinterpret_u8_u32(vget_high_u32(b.val[1]))));
+    vst1q_u32(dp,vreinterpretq_u32_u8(vcombine_u8(vrshrn_n_u16(lo,2),vrshrn_n_u16(hi,2))));
+    dp+=4;
+    sp+=8;
+    sp2+=8;
+  }
+  HalveRow(dp,sp,sp2,w&3);
+}
+#endif
+
 void LICE_HalveBlitAA(LICE_IBitmap *dest, LICE_IBitmap *src)
 {
   if (!dest||!src) return; 
@@ -2462,41 +3140,21 @@ void LICE_HalveBlitAA(LICE_IBitmap *dest, LICE_IBitmap *src)
   int dest_span = dest->getRowSpan();
   const LICE_pixel *srcptr = src->getBits();
   LICE_pixel *destptr = dest->getBits();
+  if (!srcptr || !destptr || w<1) return;
+
+  void (*halveRow)(LICE_pixel *, const LICE_pixel *, const LICE_pixel *, int) = HalveRow;
+  const int caps = LICE_SIMD_GetCaps();
+#ifdef LICE_SIMD_HAVE_SSE2
+  if (caps & LICE_SIMD_SSE2) halveRow = HalveRow_SSE2;
+#endif
+#ifdef LICE_SIMD_HAVE_NEON
+  if (caps & LICE_SIMD_NEON) halveRow = HalveRow_NEON;
+#endif
+  (void)caps;
 
   while (h--)
   {
-    const LICE_pixel *sp = srcptr;
-    const LICE_pixel *sp2 = srcptr+src_span;
-    LICE_pixel *dp = destptr;
-    int x=w/2;
-
-    // this is begging for SSE intrinsics, but we never use this function so leave it as-is :)
-
-      // perhaps we should use more precision rather than chopping each src pixel to 6 bits, but oh well
-    while (x--) // unroll 2px at a time, about 5% faster on core2 and ICC
-    {
-      int r1=((sp[0]>>2)&0x3f3f3f3f);
-      int r2=((sp[2]>>2)&0x3f3f3f3f);
-      r1 += ((sp[1]>>2)&0x3f3f3f3f);
-      r2 += ((sp[3]>>2)&0x3f3f3f3f);
-      dp[0] = r1  +
-        ((sp2[0]>>2)&0x3f3f3f3f) +
-        ((sp2[1]>>2)&0x3f3f3f3f);
-      dp[1] = r2  +
-        ((sp2[2]>>2)&0x3f3f3f3f) +
-        ((sp2[3]>>2)&0x3f3f3f3f);
-      sp+=4;
-      sp2+=4;
-      dp+=2;
-    }
-    if (w&1)
-    {
-      *dp =
-        ((sp[0]>>2)&0x3f3f3f3f) +
-        ((sp[1]>>2)&0x3f3f3f3f) +
-        ((sp2[0]>>2)&0x3f3f3f3f) +
-        ((sp2[1]>>2)&0x3f3f3f3f);
-    }
+    halveRow(destptr,srcptr,srcptr+src_span,w);
     srcptr+=src_span*2;
     destptr+=dest_span;
   }
@@ -2504,6 +3162,97 @@ void LICE_HalveBlitAA(LICE_IBitmap *dest, LICE_IBitmap *src)
 
 #endif // LICE_NO_MISC_SUPPORT
 
+// LICE_BitmapCmpEx() row scans: CmpRowFirst() returns the first x in [0,n) where the rows differ under mask (n if none),
+// CmpRowLast() the last x in (lo,n) (lo if none). the SIMD versions skip blocks of equal pixels, then finish like the scalar ones.
+
+static int CmpRowFirst(const LICE_pixel *a, const LICE_pixel *b, int n, LICE_pixel mask)
+{
+  int x;
+  for (x=0;x<n && !((a[x]^b[x])&mask);x++);
+  return x;
+}
+
+static int CmpRowLast(const LICE_pixel *a, const LICE_pixel *b, int lo, int n, LICE_pixel mask)
+{
+  int x;
+  for (x=n-1;x>lo && !((a[x]^b[x])&mask);x--);
+  return x;
+}
+
+#ifdef LICE_SIMD_HAVE_SSE2
+static inline bool CmpBlockEqual_SSE2(const LICE_pixel *a, const LICE_pixel *b, __m128i m)
+{
+  const __m128i d0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)a),_mm_loadu_si128((const __m128i *)b));
+  const __m128i d1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a+4)),_mm_loadu_si128((const __m128i *)(b+4)));
+  return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(_mm_or_si128(d0,d1),m),_mm_setzero_si128())) == 0xffff;
+}
+
+static int CmpRowFirst_SSE2(const LICE_pixel *a, const LICE_pixel *b, int n, LICE_pixel mask)
+{
+  const __m128i m = _mm_set1_epi32((int)mask);
+  int x=0;
+  while (x <= n-8 && CmpBlockEqual_SSE2(a+x,b+x,m)) x+=8;
+  return x + CmpRowFirst(a+x,b+x,n-x,mask);
+}
+
+static int CmpRowLast_SSE2(const LICE_pixel *a, const LICE_pixel *b, int lo, int n, LICE_pixel mask)
+{
+  const __m128i m = _mm_set1_epi32((int)mask);
+  while (n-8 > lo && CmpBlockEqual_SSE2(a+n-8,b+n-8,m)) n-=8;
+  return CmpRowLast(a,b,lo,n,mask);
+}
+#endif
+
+#ifdef LICE_SIMD_HAVE_AVX2
+LICE_SIMD_TARGET_AVX2 static inline bool CmpBlockEqual_AVX2(const LICE_pixel *a, const LICE_pixel *b, __m256i m)
+{
+  const __m256i d0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)a),_mm256_loadu_si256((const __m256i *)b));
+  const __m256i d1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a+8)),_mm256_loadu_si256((const __m256i *)(b+8)));
+  return _mm256_testz_si256(_mm256_or_si256(d0,d1),m) != 0;
+}
+
+LICE_SIMD_TARGET_AVX2 static int CmpRowFirst_AVX2(const LICE_pixel *a, const LICE_pixel *b, int n, LICE_pixel mask)
+{
+  const __m256i m = _mm256_set1_epi32((int)mask);
+  int x=0;
+  while (x <= n-16 && CmpBlockEqual_AVX2(a+x,b+x,m)) x+=16;
+  _mm256_zeroupper(); // the SSE2 code is not VEX encoded
+  return x + CmpRowFirst_SSE2(a+x,b+x,n-x,mask);
+}
+
+LICE_SIMD_TARGET_AVX2 static int CmpRowLast_AVX2(const LICE_pixel *a, const LICE_pixel *b, int lo, int n, LICE_pixel mask)
+{
+  const __m256i m = _mm256_set1_epi32((int)mask);
+  while (n-16 > lo && CmpBlockEqual_AVX2(a+n-16,b+n-16,m)) n-=16;
+  _mm256_zeroupper();
+  return CmpRowLast_SSE2(a,b,lo,n,mask);
+}
+#endif
+
+#ifdef LICE_SIMD_HAVE_NEON
+static inline bool CmpBlockEqual_NEON(const LICE_pixel *a, const LICE_pixel *b, uint32x4_t m)
+{
+  const uint32x4_t d = vandq_u32(vorrq_u32(veorq_u32(vld1q_u32(a),vld1q_u32(b)),veorq_u32(vld1q_u32(a+4),vld1q_u32(b+4))),m);
+  const uint32x2_t r = vorr_u32(vget_low_u32(d),vget_high_u32(d));
+  return !(vget_lane_u32(r,0) | vget_lane_u32(r,1));
+}
+
+static int CmpRowFirst_NEON(const LICE_pixel *a, const LICE_pixel *b, int n, LICE_pixel mask)
+{
+  const uint32x4_t m = vdupq_n_u32(mask);
+  int x=0;
+  while (x <= n-8 && CmpBlockEqual_NEON(a+x,b+x,m)) x+=8;
+  return x + CmpRowFirst(a+x,b+x,n-x,mask);
+}
+
+static int CmpRowLast_NEON(const LICE_pixel *a, const LICE_pixel *b, int lo, int n, LICE_pixel mask)
+{
+  const uint32x4_t m = vdupq_n_u32(mask);
+  while (n-8 > lo && CmpBlockEqual_NEON(a+n-8,b+n-8,m)) n-=8;
+  return CmpRowLast(a,b,lo,n,mask);
+}
+#endif
+
 int LICE_BitmapCmp(LICE_IBitmap* a, LICE_IBitmap* b, int *coordsOut)
 {
   return LICE_BitmapCmpEx(a,b,LICE_RGBA(255,255,255,255),coordsOut);
@@ -2538,6 +3287,21 @@ int LICE_BitmapCmpEx(LICE_IBitmap* a, LICE_IBitmap* b, LICE_pixel mask, int *coo
     span2=-span2;
   }
 
+  int (*rowFirst)(const LICE_pixel *, const LICE_pixel *, int, LICE_pixel) = CmpRowFirst;
+  int (*rowLast)(const LICE_pixel *, const LICE_pixel *, int, int, LICE_pixel) = CmpRowLast;
+  const int caps = LICE_SIMD_GetCaps();
+#ifdef LICE_SIMD_HAVE_AVX2
+  if (caps & LICE_SIMD_AVX2) { rowFirst = CmpRowFirst_AVX2; rowLast = CmpRowLast_AVX2; }
+  else
+#endif
+#ifdef LICE_SIMD_HAVE_SSE2
+  if (caps & LICE_SIMD_SSE2) { rowFirst = CmpRowFirst_SSE2; rowLast = CmpRowLast_SSE2; }
+#endif
+#ifdef LICE_SIMD_HAVE_NEON
+  if (caps & LICE_SIMD_NEON) { rowFirst = CmpRowFirst_NEON; rowLast = CmpRowLast_NEON; }
+#endif
+  (void)caps;
+
   int y;
   if (!coordsOut)
   {
@@ -2552,10 +3316,7 @@ int LICE_BitmapCmpEx(LICE_IBitmap* a, LICE_IBitmap* b, LICE_pixel mask, int *coo
     else
       for (y=0; y < ah; y ++)
       {
-        const LICE_pixel *ptr1 = px1, *ptr2 = px2;
-        int x=aw;
-        while (x--)
-          if ((*ptr1++ ^ *ptr2++) & mask) return true;
+        if (rowFirst(px1,px2,aw,mask) < aw) return true;
         px1+=span1;
         px2+=span2;
       }
@@ -2568,7 +3329,7 @@ int LICE_BitmapCmpEx(LICE_IBitmap* a, LICE_IBitmap* b, LICE_pixel mask, int *coo
     for (y=0; y < ah; y ++)
     {
       // check left side
-      for (x=0;x<aw && !((px1[x]^px2[x])&mask);x++);
+      x = rowFirst(px1,px2,aw,mask);
       if (x < aw) break;
 
       px1+=span1;
@@ -2583,8 +3344,7 @@ int LICE_BitmapCmpEx(LICE_IBitmap* a, LICE_IBitmap* b, LICE_pixel mask, int *coo
     int miny=y;
     int minx=x;
     // scan right edge of top differing row
-    for (x=aw-1;x>minx && !((px1[x]^px2[x])&mask);x--);
-    int maxx=x;
+    int maxx=rowLast(px1,px2,minx,aw,mask);
 
     // find last row that differs
     px1+=span1 * (ah-1-y);
@@ -2592,7 +3352,7 @@ int LICE_BitmapCmpEx(LICE_IBitmap* a, LICE_IBitmap* b, LICE_pixel mask, int *coo
     for (y = ah-1; y > miny; y --)
     {
       // check left side
-      for (x=0;x<aw && !((px1[x]^px2[x])&mask);x++);
+      x = rowFirst(px1,px2,aw,mask);
       if (x < aw) 
       {
         if (x < minx) minx=x;
@@ -2606,8 +3366,7 @@ int LICE_BitmapCmpEx(LICE_IBitmap* a, LICE_IBitmap* b, LICE_pixel mask, int *coo
     if (y > miny)
     {
       // scan right edge of bottom row that differs
-      for (x=aw-1;x>maxx && !((px1[x]^px2[x])&mask);x--);
-      maxx=x;
+      maxx=rowLast(px1,px2,maxx,aw,mask);
     }
 
 
@@ -2616,10 +3375,8 @@ int LICE_BitmapCmpEx(LICE_IBitmap* a, LICE_IBitmap* b, LICE_pixel mask, int *coo
     px2+=span2 * (miny+1-y);
     for (y=miny+1;y<maxy && (minx>0 || maxx<aw-1);y++) 
     {
-      for (x=0;x<minx && !((px1[x]^px2[x])&mask);x++);
-      minx=x;
-      for (x=aw-1;x>maxx && !((px1[x]^px2[x])&mask);x--);
-      maxx=x;
+      minx=rowFirst(px1,px2,minx,mask);
+      maxx=rowLast(px1,px2,maxx,aw,mask);
 
       px1+=span1;
       px2+=span2;
@@ -597,6 +597,24 @@ SOURCE=.\lice.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\lice_apng_write.cpp
+
+!IF  "$(CFG)" == "lice - Win32 Release"
+
+# ADD CPP /D "USE_ICC"
+
+!ELSEIF  "$(CFG)" == "lice - Win32 Debug"
+
+!ELSEIF  "$(CFG)" == "lice - Win32 Release Profile"
+
+# ADD BASE CPP /D "USE_ICC"
+# ADD CPP /D "USE_ICC"
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
 SOURCE=.\lice_arc.cpp
 
 !IF  "$(CFG)" == "lice - Win32 Release"
@@ -633,6 +651,24 @@ SOURCE=.\lice_bmp.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\lice_cmdbuf.cpp
+
+!IF  "$(CFG)" == "lice - Win32 Release"
+
+# ADD CPP /D "USE_ICC"
+
+!ELSEIF  "$(CFG)" == "lice - Win32 Debug"
+
+!ELSEIF  "$(CFG)" == "lice - Win32 Release Profile"
+
+# ADD BASE CPP /D "USE_ICC"
+# ADD CPP /D "USE_ICC"
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
 SOURCE=.\lice_colorspace.cpp
 
 !IF  "$(CFG)" == "lice - Win32 Release"
@@ -919,6 +955,10 @@ SOURCE=.\lice.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\lice_cmdbuf.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\lice_combine.h
 # End Source File
 # Begin Source File
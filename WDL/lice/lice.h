@@ -268,6 +268,8 @@ class LICE_SubBitmap : public LICE_IBitmap // note: you should only keep these a
 #define LICE_BLIT_FILTER_MASK 0xff00
 #define LICE_BLIT_FILTER_NONE 0
 #define LICE_BLIT_FILTER_BILINEAR 0x100 // currently pretty slow! ack
+#define LICE_BLIT_FILTER_AREA 0x200 // LICE_ScaledBlit() only: area average (box), good for downscaling by any ratio
+#define LICE_BLIT_FILTER_LANCZOS 0x300 // LICE_ScaledBlit() only: lanczos-3, sharper but slower
 
 
 #define LICE_BLIT_USE_ALPHA 0x10000 // use source's alpha channel
@@ -321,11 +323,41 @@ bool LICE_WriteGIF(const char *filename, LICE_IBitmap *bmp, int transparent_alph
 
 // animated GIF API. use transparent_alpha=-1 to encode unchanged pixels as transparent
 void *LICE_WriteGIFBegin(const char *filename, LICE_IBitmap *firstframe, int transparent_alpha=0, int frame_delay=0, bool dither=true, int nreps=0); // nreps=0 for infinite
-void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transparent_alpha=0, bool dither=true, bool is_append=false);
+// lossy_tolerance>0 lets the LZW encoder replace a pixel by another palette color at most that far away (RGB distance)
+// when that continues the current string, for smaller files. transparent pixels are never replaced.
+void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transparent_alpha=0, bool dither=true, bool is_append=false, int lossy_tolerance=0);
 bool LICE_WriteGIFFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, bool perImageColorMap=false, int frame_delay=0, int nreps=0); // nreps only used on the first frame, 0=infinite
 unsigned int LICE_WriteGIFGetSize(void *handle); // gets current output size
 bool LICE_WriteGIFEnd(void *handle);
 int LICE_SetGIFColorMapFromOctree(void *wr, void *octree, int numcolors); // can use after LICE_WriteGIFBeginNoFrame and before LICE_WriteGIFFrame
+int LICE_SetGIFColorMapFromHistogram(void *wr, void *hist); // global colormap from a LICE_CreateHistogram() histogram (leaves room for transparency), same restrictions
+
+#define LICE_GIF_DITHER_NONE 0
+#define LICE_GIF_DITHER_ORDERED 1 // 8x8 Bayer pattern, anchored to the canvas so it doesn't move between frames
+#define LICE_GIF_DITHER_FLOYD 2 // serpentine Floyd-Steinberg error diffusion (dither=true)
+void LICE_WriteGIFSetDither(void *wr, int mode); // LICE_GIF_DITHER_*, can be changed between frames
+
+// quantizes a frame ahead of time (safe to call from several threads at once), to be written later, in order, with
+// LICE_WriteGIFPreparedFrame(). output is identical to LICE_WriteGIFFrame(). returns NULL if the frame can't be
+// prepared (transparent_alpha<0 or a first frame that defines the global colormap): use LICE_WriteGIFFrame() instead.
+// reuse can be a previously prepared frame, to avoid reallocating (it remains owned by the caller if NULL is returned).
+void *LICE_WriteGIFPrepareFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, bool perImageColorMap=false, void *reuse=NULL);
+// LICE_WriteGIFPrepareFrame() reads the writer's global colormap, which writing a frame may still create or fill in.
+// returns true once prepares can run on other threads while frames are written (with LICE_WriteGIFFrame() too).
+// call it from the thread that writes frames, the answer only changes when a frame is written and stays true after.
+bool LICE_WriteGIFCanPrepareFrames(void *handle, bool perImageColorMap=false);
+bool LICE_WriteGIFPreparedFrame(void *handle, void *prepared, int frame_delay=0, int nreps=0);
+void LICE_WriteGIFFreePreparedFrame(void *prepared);
+
+// animated PNG writing, zlib only (no libpng). every frame must be the size passed to LICE_WriteAPNGBegin() and only the
+// rectangle that changed is stored. transparent_unchanged writes RGBA with unchanged pixels in that rectangle left transparent
+// (blended over the previous frame), otherwise RGB. frames with no changes extend the previous frame's delay.
+void *LICE_WriteAPNGBegin(const char *filename, int w, int h, bool transparent_unchanged=true, int nreps=0); // nreps=0 for infinite
+#define LICE_APNG_FILTER_ADAPTIVE -1 // pick a PNG row filter per row, 0-4 use that filter for every row
+void LICE_WriteAPNGSetCompression(void *handle, int level=6, int strategy=0, int rowfilter=LICE_APNG_FILTER_ADAPTIVE, int nthreads=1); // zlib level and strategy (Z_FILTERED etc), nthreads>1 deflates large frames in parallel
+bool LICE_WriteAPNGFrame(void *handle, LICE_IBitmap *frame, int frame_delay); // frame_delay in ms
+unsigned int LICE_WriteAPNGGetSize(void *handle); // gets current output size
+bool LICE_WriteAPNGEnd(void *handle); // writes the frame count and frees handle
 
 // animated GIF reading
 void *LICE_GIF_LoadEx(const char *filename);
@@ -342,6 +374,13 @@ LICE_pixel LICE_GetPixel(LICE_IBitmap *bm, int x, int y);
 
 // blit functions
 
+// number of threads used to split large LICE_ScaledBlit/LICE_Blur/LICE_RotatedBlit/LICE_DeltaBlit/LICE_TransformBlit/LICE_GradRect
+// calls into horizontal bands. defaults to 1 (no worker threads), <0 uses the CPU count. output is the same for any setting.
+void LICE_SetThreadCount(int nthreads);
+int LICE_GetThreadCount();
+// runs func(ctx,0..njobs-1) on the same worker threads, or serially if there are none or they are in use. returns when all are done.
+void LICE_RunThreadJobs(int njobs, void (*func)(void *ctx, int job), void *ctx);
+
 void LICE_Copy(LICE_IBitmap *dest, LICE_IBitmap *src); // resizes dest to fit
 
 
@@ -467,6 +506,13 @@ void LICE_FillTriangle(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, int x
 bool LICE_ClipLine(int* pX1, int* pY1, int* pX2, int* pY2, int xLo, int yLo, int xHi, int yHi);
 bool LICE_ClipFLine(float* px1, float* py1, float* px2, float* py2, float xlo, float ylo, float xhi, float yhi);
 
+// only touch the pixels within cliprect, which come out exactly as the unclipped call would draw them.
+// lets a primitive be drawn in pieces, e.g. from several threads into disjoint rectangles.
+void LICE_ClippedLine(LICE_IBitmap *dest, const RECT *cliprect, int x1, int y1, int x2, int y2, LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
+void LICE_ClippedFLine(LICE_IBitmap* dest, const RECT *cliprect, float x1, float y1, float x2, float y2, LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
+void LICE_ClippedArc(LICE_IBitmap* dest, const RECT *cliprect, float cx, float cy, float r, float minAngle, float maxAngle, 
+                     LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
+
 void LICE_Arc(LICE_IBitmap* dest, float cx, float cy, float r, float minAngle, float maxAngle, 
               LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
 void LICE_Circle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
@@ -530,7 +576,8 @@ void LICE_DestroyLVG(void *lvg);
 
 /// palette
 
-void* LICE_CreateOctree(int maxcolors);
+#define LICE_OCTREE_FLAG_POOL 1 // nodes are kept in one array (faster to build and reset, same results)
+void* LICE_CreateOctree(int maxcolors, int flags=0);
 void LICE_DestroyOctree(void* octree);
 void LICE_ResetOctree(void *octree, int maxcolors); // resets back to stock, but with spares (to avoid mallocs)
 int LICE_BuildOctree(void* octree, LICE_IBitmap* bmp);
@@ -539,6 +586,12 @@ int LICE_BuildOctreeForDiff(void* octree, LICE_IBitmap* bmp, LICE_IBitmap* refbm
 int LICE_FindInOctree(void* octree, LICE_pixel color);
 int LICE_ExtractOctreePalette(void* octree, LICE_pixel* palette);
 
+// color histogram (15-bit buckets, with the average color of each), for building one palette from many images
+void *LICE_CreateHistogram();
+void LICE_DestroyHistogram(void *hist);
+void LICE_AddToHistogram(void *hist, LICE_IBitmap *bmp);
+int LICE_BuildOctreeFromHistogram(void *octree, void *hist); // least used colors are merged first
+
 // wrapper
 int LICE_BuildPalette(LICE_IBitmap* bmp, LICE_pixel* palette, int maxcolors);
 void LICE_TestPalette(LICE_IBitmap* bmp, LICE_pixel* palette, int numcolors);
@@ -0,0 +1,487 @@
+/*
+  Cockos WDL - LICE - Lightweight Image Compositing Engine
+  Copyright (C) 2007 and later, Cockos Incorporated
+  File: lice_apng_write.cpp (animated PNG saving for LICE)
+  See lice.h for license and other information
+*/
+
+#include "lice.h"
+#include "lice_thread.h"
+
+#include <stdio.h>
+
+#include "../wdltypes.h"
+#include "../filewrite.h"
+#include "../heapbuf.h"
+#include "../zlib/zlib.h"
+
+// APNG is written with zlib directly: frames after the first are fcTL/fdAT chunks covering the bounding
+// rectangle of what changed. the frame count in acTL is patched in LICE_WriteAPNGEnd().
+
+#define APNG_DIFFMASK LICE_RGBA(255,255,255,0)
+#define APNG_MT_MINPIXELS (256*256) // smaller frames aren't worth splitting
+#define APNG_MT_MINROWS 16
+#define APNG_DICTSIZE 32768
+
+struct liceAPNGJob
+{
+  liceAPNGJob() { memset(&zs,0,sizeof(zs)); zinit=false; }
+  ~liceAPNGJob() { if (zinit) deflateEnd(&zs); }
+
+  int y0, y1; // rows of the frame rectangle
+  WDL_HeapBuf out; // raw deflate data
+  uLong adler;
+  bool ok;
+
+  z_stream zs; // kept between frames, reset by LICE_WriteAPNGSetCompression()
+  bool zinit;
+};
+
+struct liceAPNGWriteRec
+{
+  WDL_FileWrite *fh;
+  int w, h, bpp;
+  bool transparent, err;
+  int nreps;
+  int level, strategy, rowfilter, nthreads;
+  LICE_ThreadPool *pool;
+
+  LICE_MemBitmap lastfr; // what the viewer shows after the last frame
+  unsigned int nframes, seq, outsize;
+  WDL_FILEWRITE_POSTYPE actl_pos;
+
+  // the most recent frame is held until the next change so its delay can grow
+  bool has_pending;
+  int pend_rect[4], pend_delay;
+  WDL_HeapBuf pend_data; // zlib stream
+
+  // frame being encoded
+  LICE_IBitmap *cur;
+  int rect[4];
+  WDL_HeapBuf filtered; // rect[3] rows of 1+rect[2]*bpp
+  WDL_PtrList<liceAPNGJob> jobs;
+};
+
+static void apng_put32(unsigned char *p, unsigned int v)
+{
+  p[0]=(unsigned char)(v>>24);
+  p[1]=(unsigned char)(v>>16);
+  p[2]=(unsigned char)(v>>8);
+  p[3]=(unsigned char)v;
+}
+
+static void apng_write(liceAPNGWriteRec *wr, const void *buf, int len)
+{
+  if (len>0 && wr->fh->Write(buf,len) != len) wr->err=true;
+  wr->outsize += len;
+}
+
+// seqno>=0 is prefixed to the data (fdAT)
+static void apng_writechunk(liceAPNGWriteRec *wr, const char *type, const void *data, int len, int seqno=-1)
+{
+  unsigned char hdr[12];
+  const int pfx = seqno >= 0 ? 4 : 0;
+  apng_put32(hdr,len+pfx);
+  memcpy(hdr+4,type,4);
+  uLong crc = crc32(0,hdr+4,4);
+  if (pfx)
+  {
+    apng_put32(hdr+8,seqno);
+    crc = crc32(crc,hdr+8,4);
+  }
+  if (len>0) crc = crc32(crc,(const Bytef *)data,len);
+  apng_write(wr,hdr,8+pfx);
+  apng_write(wr,data,len);
+  apng_put32(hdr,crc);
+  apng_write(wr,hdr,4);
+}
+
+static const LICE_pixel *apng_getrow(LICE_IBitmap *bm, int y)
+{
+  const int span = bm->getRowSpan();
+  return bm->getBits() + (bm->isFlipped() ? bm->getHeight()-1-y : y)*span;
+}
+
+// converts a row of the frame rectangle to PNG bytes. in transparent mode pixels that match the previous frame are left 0
+static void apng_convrow(liceAPNGWriteRec *wr, int y, unsigned char *out)
+{
+  const LICE_pixel *in = apng_getrow(wr->cur,wr->rect[1]+y) + wr->rect[0];
+  int x=wr->rect[2];
+  if (wr->transparent && wr->nframes) // the first frame is opaque
+  {
+    const LICE_pixel *last = wr->lastfr.getBits() + (wr->rect[1]+y)*wr->lastfr.getRowSpan() + wr->rect[0];
+    while (x--)
+    {
+      const LICE_pixel p = *in++;
+      if ((p^*last++)&APNG_DIFFMASK)
+      {
+        out[0]=LICE_GETR(p);
+        out[1]=LICE_GETG(p);
+        out[2]=LICE_GETB(p);
+        out[3]=255;
+      }
+      else out[0]=out[1]=out[2]=out[3]=0;
+      out+=4;
+    }
+  }
+  else
+  {
+    const int bpp = wr->bpp;
+    while (x--)
+    {
+      const LICE_pixel p = *in++;
+      out[0]=LICE_GETR(p);
+      out[1]=LICE_GETG(p);
+      out[2]=LICE_GETB(p);
+      if (bpp>3) out[3]=255;
+      out+=bpp;
+    }
+  }
+}
+
+static inline unsigned char apng_paeth(int a, int b, int c)
+{
+  const int p = a+b-c;
+  int pa = p-a, pb = p-b, pc = p-c;
+  if (pa<0) pa=-pa;
+  if (pb<0) pb=-pb;
+  if (pc<0) pc=-pc;
+  if (pa <= pb && pa <= pc) return (unsigned char)a;
+  return (unsigned char)(pb <= pc ? b : c);
+}
+
+// out[0] gets the filter type, returns the sum of abs(signed bytes) used to pick a filter
+static int apng_filterrow(int filt, const unsigned char *cur, const unsigned char *prev, int n, int bpp, unsigned char *out)
+{
+  *out++ = (unsigned char)filt;
+  int i;
+  switch (filt)
+  {
+    case 0: memcpy(out,cur,n); break;
+    case 1:
+      for (i=0;i<bpp;i++) out[i]=cur[i];
+      for (;i<n;i++) out[i]=(unsigned char)(cur[i]-cur[i-bpp]);
+    break;
+    case 2:
+      for (i=0;i<n;i++) out[i]=(unsigned char)(cur[i]-prev[i]);
+    break;
+    case 3:
+      for (i=0;i<bpp;i++) out[i]=(unsigned char)(cur[i]-(prev[i]>>1));
+      for (;i<n;i++) out[i]=(unsigned char)(cur[i]-((cur[i-bpp]+prev[i])>>1));
+    break;
+    default:
+      for (i=0;i<bpp;i++) out[i]=(unsigned char)(cur[i]-prev[i]);
+      for (;i<n;i++) out[i]=(unsigned char)(cur[i]-apng_paeth(cur[i-bpp],prev[i],prev[i-bpp]));
+    break;
+  }
+  int sum=0;
+  for (i=0;i<n;i++) sum += out[i] < 128 ? out[i] : 256-out[i];
+  return sum;
+}
+
+// pass 1: convert and filter rows y0..y1 into wr->filtered
+static void apng_filterjob(void *ctx, int job)
+{
+  liceAPNGWriteRec *wr = (liceAPNGWriteRec *)ctx;
+  liceAPNGJob *j = wr->jobs.Get(job);
+  const int n = wr->rect[2]*wr->bpp, rowsz = n+1;
+
+  WDL_HeapBuf tmp;
+  unsigned char *cur = (unsigned char *)tmp.Resize(n*2 + rowsz,false);
+  unsigned char *prev = cur+n, *cand = prev+n;
+  if (!cur) { j->ok=false; return; }
+
+  memset(prev,0,n);
+  if (j->y0>0) apng_convrow(wr,j->y0-1,prev);
+
+  unsigned char *out = (unsigned char *)wr->filtered.Get() + j->y0*rowsz;
+  int y;
+  for (y=j->y0;y<j->y1;y++)
+  {
+    apng_convrow(wr,y,cur);
+    if (wr->rowfilter >= 0 && wr->rowfilter <= 4)
+    {
+      apng_filterrow(wr->rowfilter,cur,prev,n,wr->bpp,out);
+    }
+    else
+    {
+      int best = apng_filterrow(0,cur,prev,n,wr->bpp,out), f;
+      for (f=1;f<5 && best>0;f++)
+      {
+        const int s = apng_filterrow(f,cur,prev,n,wr->bpp,cand);
+        if (s < best) { best=s; memcpy(out,cand,rowsz); }
+      }
+    }
+    unsigned char *t=prev; prev=cur; cur=t;
+    out += rowsz;
+  }
+}
+
+// pass 2: raw deflate of this job's slice of wr->filtered, primed with the preceding 32k so splitting costs little.
+// all but the last job end with a sync flush so the pieces concatenate into one stream
+static void apng_deflatejob(void *ctx, int job)
+{
+  liceAPNGWriteRec *wr = (liceAPNGWriteRec *)ctx;
+  liceAPNGJob *j = wr->jobs.Get(job);
+  if (!j->ok) return;
+  const bool last = job == wr->jobs.GetSize()-1;
+  const int rowsz = 1+wr->rect[2]*wr->bpp;
+  const unsigned char *in = (const unsigned char *)wr->filtered.Get() + j->y0*rowsz;
+  const int inlen = (j->y1-j->y0)*rowsz;
+  j->adler = adler32(1,in,inlen);
+
+  z_stream &zs = j->zs;
+  if (!j->zinit)
+  {
+    if (deflateInit2(&zs,wr->level,Z_DEFLATED,-15,8,wr->strategy) != Z_OK) { j->ok=false; return; }
+    j->zinit=true;
+  }
+  else deflateReset(&zs);
+  if (j->y0>0)
+  {
+    const int dl = wdl_min(j->y0*rowsz,APNG_DICTSIZE);
+    deflateSetDictionary(&zs,in-dl,dl);
+  }
+
+  int cap = (int)deflateBound(&zs,inlen) + 64, used=0;
+  zs.next_in = (Bytef *)in;
+  zs.avail_in = inlen;
+  for (;;)
+  {
+    unsigned char *p = (unsigned char *)j->out.Resize(cap,false);
+    if (!p) { j->ok=false; break; }
+    zs.next_out = p+used;
+    zs.avail_out = cap-used;
+    const int rv = deflate(&zs,last ? Z_FINISH : Z_SYNC_FLUSH);
+    used = cap - zs.avail_out;
+    if (last ? rv == Z_STREAM_END : (rv == Z_OK && zs.avail_out>0)) break;
+    if (rv != Z_OK && rv != Z_BUF_ERROR) { j->ok=false; break; }
+    cap += cap/2;
+  }
+  j->out.Resize(j->ok ? used : 0,false);
+}
+
+// compresses the wr->rect area of frame into pend_data
+static bool apng_encode(liceAPNGWriteRec *wr, LICE_IBitmap *frame)
+{
+  wr->cur = frame;
+  const int rowsz = 1+wr->rect[2]*wr->bpp;
+  if (!wr->filtered.Resize(rowsz*wr->rect[3],false)) return false;
+
+  int njobs = 1;
+  if (wr->pool && wr->rect[2]*wr->rect[3] >= APNG_MT_MINPIXELS)
+    njobs = wdl_max(wdl_min(wr->nthreads,wr->rect[3]/APNG_MT_MINROWS),1);
+
+  while (wr->jobs.GetSize() < njobs) wr->jobs.Add(new liceAPNGJob);
+  while (wr->jobs.GetSize() > njobs) wr->jobs.Delete(wr->jobs.GetSize()-1,true);
+  int x;
+  for (x=0;x<njobs;x++)
+  {
+    liceAPNGJob *j = wr->jobs.Get(x);
+    j->y0 = x*wr->rect[3]/njobs;
+    j->y1 = (x+1)*wr->rect[3]/njobs;
+    j->ok = true;
+  }
+
+  if (njobs>1)
+  {
+    wr->pool->Run(njobs,apng_filterjob,wr);
+    wr->pool->Run(njobs,apng_deflatejob,wr);
+  }
+  else
+  {
+    apng_filterjob(wr,0);
+    apng_deflatejob(wr,0);
+  }
+  wr->cur = NULL;
+
+  // zlib header, the deflate pieces, then the combined adler32
+  int flevel = wr->level < 0 ? 2 : wr->level < 2 ? 0 : wr->level < 6 ? 1 : wr->level == 6 ? 2 : 3;
+  if (wr->strategy >= Z_HUFFMAN_ONLY) flevel = 0;
+  int flg = flevel<<6;
+  flg += 31 - ((0x78*256 + flg) % 31);
+
+  int total = 2+4;
+  for (x=0;x<njobs;x++)
+  {
+    if (!wr->jobs.Get(x)->ok) return false;
+    total += wr->jobs.Get(x)->out.GetSize();
+  }
+  unsigned char *p = (unsigned char *)wr->pend_data.Resize(total,false);
+  if (!p) return false;
+  *p++ = 0x78;
+  *p++ = (unsigned char)flg;
+  uLong adler = wr->jobs.Get(0)->adler;
+  for (x=0;x<njobs;x++)
+  {
+    liceAPNGJob *j = wr->jobs.Get(x);
+    memcpy(p,j->out.Get(),j->out.GetSize());
+    p += j->out.GetSize();
+    if (x) adler = adler32_combine(adler,j->adler,(j->y1-j->y0)*rowsz);
+  }
+  apng_put32(p,(unsigned int)adler);
+  return true;
+}
+
+static void apng_flushpending(liceAPNGWriteRec *wr)
+{
+  if (!wr->has_pending) return;
+  wr->has_pending=false;
+
+  int dnum = wdl_max(wr->pend_delay,1), dden = 1000;
+  if (dnum > 65535)
+  {
+    dnum = wdl_min((dnum+5)/10,65535);
+    dden = 100;
+  }
+
+  unsigned char fctl[26];
+  apng_put32(fctl,wr->seq++);
+  apng_put32(fctl+4,wr->pend_rect[2]);
+  apng_put32(fctl+8,wr->pend_rect[3]);
+  apng_put32(fctl+12,wr->pend_rect[0]);
+  apng_put32(fctl+16,wr->pend_rect[1]);
+  fctl[20]=(unsigned char)(dnum>>8);
+  fctl[21]=(unsigned char)dnum;
+  fctl[22]=(unsigned char)(dden>>8);
+  fctl[23]=(unsigned char)dden;
+  fctl[24]=0; // APNG_DISPOSE_OP_NONE
+  fctl[25]=(wr->transparent && wr->nframes>1) ? 1 : 0; // APNG_BLEND_OP_OVER for the transparent-unchanged frames, otherwise SOURCE
+  apng_writechunk(wr,"fcTL",fctl,26);
+
+  if (wr->nframes == 1) apng_writechunk(wr,"IDAT",wr->pend_data.Get(),wr->pend_data.GetSize());
+  else apng_writechunk(wr,"fdAT",wr->pend_data.Get(),wr->pend_data.GetSize(),wr->seq++);
+}
+
+void *LICE_WriteAPNGBegin(const char *filename, int w, int h, bool transparent_unchanged, int nreps)
+{
+  if (w<1 || h<1) return NULL;
+  WDL_FileWrite *fp = new WDL_FileWrite(filename,1,65536,16,16);
+  if (!fp->IsOpen())
+  {
+    delete fp;
+    return NULL;
+  }
+
+  liceAPNGWriteRec *wr = new liceAPNGWriteRec;
+  wr->fh = fp;
+  wr->w = w;
+  wr->h = h;
+  wr->transparent = transparent_unchanged;
+  wr->bpp = transparent_unchanged ? 4 : 3;
+  wr->err = false;
+  wr->nreps = wdl_max(nreps,0);
+  wr->level = 6;
+  wr->strategy = Z_DEFAULT_STRATEGY;
+  wr->rowfilter = LICE_APNG_FILTER_ADAPTIVE;
+  wr->nthreads = 1;
+  wr->pool = NULL;
+  wr->nframes = wr->seq = wr->outsize = 0;
+  wr->has_pending = false;
+  wr->pend_delay = 0;
+  wr->cur = NULL;
+  wr->lastfr.resize(w,h);
+  LICE_Clear(&wr->lastfr,0);
+
+  static const unsigned char sig[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+  apng_write(wr,sig,8);
+
+  unsigned char ihdr[13];
+  apng_put32(ihdr,w);
+  apng_put32(ihdr+4,h);
+  ihdr[8]=8;
+  ihdr[9]=transparent_unchanged ? 6 : 2; // RGBA or RGB
+  ihdr[10]=ihdr[11]=ihdr[12]=0;
+  apng_writechunk(wr,"IHDR",ihdr,13);
+
+  unsigned char actl[8];
+  apng_put32(actl,0); // frame count, set by LICE_WriteAPNGEnd()
+  apng_put32(actl+4,wr->nreps);
+  wr->actl_pos = fp->GetPosition();
+  apng_writechunk(wr,"acTL",actl,8);
+
+  return wr;
+}
+
+void LICE_WriteAPNGSetCompression(void *handle, int level, int strategy, int rowfilter, int nthreads)
+{
+  liceAPNGWriteRec *wr = (liceAPNGWriteRec *)handle;
+  if (!wr) return;
+  wr->level = wdl_max(wdl_min(level,9),0);
+  wr->strategy = strategy;
+  wr->rowfilter = rowfilter;
+  wr->jobs.Empty(true); // streams are reinitialized with the new settings
+  nthreads = wdl_max(nthreads,1);
+  if (nthreads != wr->nthreads)
+  {
+    delete wr->pool;
+    wr->pool = nthreads > 1 ? new LICE_ThreadPool(nthreads-1) : NULL;
+    wr->nthreads = nthreads;
+  }
+}
+
+bool LICE_WriteAPNGFrame(void *handle, LICE_IBitmap *frame, int frame_delay)
+{
+  liceAPNGWriteRec *wr = (liceAPNGWriteRec *)handle;
+  if (!wr || !frame || wr->err) return false;
+  if (frame->getWidth() != wr->w || frame->getHeight() != wr->h) return false;
+
+  int coords[4] = { 0, 0, wr->w, wr->h };
+  if (wr->nframes && !LICE_BitmapCmpEx(&wr->lastfr,frame,APNG_DIFFMASK,coords))
+  {
+    wr->pend_delay += frame_delay; // no change, show the previous frame longer
+    return true;
+  }
+
+  apng_flushpending(wr);
+
+  memcpy(wr->rect,coords,sizeof(coords));
+  if (!apng_encode(wr,frame))
+  {
+    wr->err=true;
+    return false;
+  }
+  LICE_Blit(&wr->lastfr,frame,coords[0],coords[1],coords[0],coords[1],coords[2],coords[3],1.0f,LICE_BLIT_MODE_COPY);
+
+  memcpy(wr->pend_rect,coords,sizeof(coords));
+  wr->pend_delay = frame_delay;
+  wr->has_pending = true;
+  wr->nframes++;
+  return !wr->err;
+}
+
+unsigned int LICE_WriteAPNGGetSize(void *handle)
+{
+  liceAPNGWriteRec *wr = (liceAPNGWriteRec *)handle;
+  return wr ? wr->outsize : 0;
+}
+
+bool LICE_WriteAPNGEnd(void *handle)
+{
+  liceAPNGWriteRec *wr = (liceAPNGWriteRec *)handle;
+  if (!wr) return false;
+
+  if (!wr->nframes) LICE_WriteAPNGFrame(wr,&wr->lastfr,0); // a PNG needs image data
+  apng_flushpending(wr);
+  apng_writechunk(wr,"IEND",NULL,0);
+
+  if (!wr->err)
+  {
+    unsigned char actl[8];
+    apng_put32(actl,wr->nframes);
+    apng_put32(actl+4,wr->nreps);
+    const WDL_FILEWRITE_POSTYPE endpos = wr->fh->GetPosition();
+    wr->fh->SetPosition(wr->actl_pos);
+    const unsigned int osz = wr->outsize;
+    apng_writechunk(wr,"acTL",actl,8);
+    wr->outsize = osz;
+    wr->fh->SetPosition(endpos);
+  }
+
+  const bool rv = !wr->err;
+  delete wr->pool;
+  wr->jobs.Empty(true);
+  delete wr->fh;
+  delete wr;
+  return rv;
+}
@@ -8,8 +8,11 @@ template <class T> inline void _SWAP(T& a, T& b) { T tmp = a; a = b; b = tmp; }
 
 #define A(x) ((LICE_pixel_chan)((x)*255.0+0.5))
 
-static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha, int mode, bool aa)
+// xo/yo: position of dest within the bitmap the circle coordinates refer to
+static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha, int mode, bool aa, int xo=0, int yo=0)
 {
+  const int gx = (int)(cx-r) - xo, gy = (int)(cy-r) - yo;
+
   // fast draw for some small circles 
   if (r == 1.5f)
   {
@@ -22,7 +25,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(1.00), A(0.06), A(0.06), A(1.00),
         A(0.31), A(1.00), A(1.00), A(0.31),
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 4, 4, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 4, 4, alpha, mode);
     }
     else 
     {
@@ -33,7 +36,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(1.00), A(0.00), A(0.00), A(1.00),
         A(0.00), A(1.00), A(1.00), A(0.00),
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 4, 4, alpha, mode);    
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 4, 4, alpha, mode);    
     }
     return true;
   }
@@ -49,7 +52,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.75), A(0.82), A(0.31), A(0.82), A(0.75),
         A(0.06), A(0.75), A(1.00), A(0.75), A(0.06)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 5, 5, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 5, 5, alpha, mode);
     }
     else 
     {
@@ -61,7 +64,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.00), A(1.00), A(0.00), A(1.00), A(0.00),
         A(0.00), A(0.00), A(1.00), A(0.00), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 5, 5, alpha, mode);    
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 5, 5, alpha, mode);    
     }
     return true;
   }
@@ -75,7 +78,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.75), A(0.82), A(0.31), A(0.31), A(0.82), A(0.75),
         A(0.06), A(0.75), A(1.00), A(1.00), A(0.75), A(0.06)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 6, 6, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 6, 6, alpha, mode);
     }
     else {
       LICE_pixel_chan alphas[36] = {
@@ -86,7 +89,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.00), A(1.00), A(0.00), A(0.00), A(1.00), A(0.00),
         A(0.00), A(0.00), A(1.00), A(1.00), A(0.00), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 6, 6, alpha, mode);    
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 6, 6, alpha, mode);    
     }
     return true;
   }
@@ -101,7 +104,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.56), A(1.00), A(0.38), A(0.25), A(0.38), A(1.00), A(0.56),
         A(0.00), A(0.56), A(1.00), A(1.00), A(1.00), A(0.56), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 7, 7, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 7, 7, alpha, mode);
     }
     else {
       LICE_pixel_chan alphas[49] = {
@@ -113,7 +116,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.00), A(1.00), A(0.00), A(0.00), A(0.00), A(1.00), A(0.00),
         A(0.00), A(0.00), A(1.00), A(1.00), A(1.00), A(0.00), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 7, 7, alpha, mode);    
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 7, 7, alpha, mode);    
     }
     return true;
   }
@@ -129,7 +132,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.31), A(1.00), A(0.69), A(0.25), A(0.25), A(0.69), A(1.00), A(0.31),
         A(0.00), A(0.31), A(0.87), A(1.00), A(1.00), A(0.87), A(0.31), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 8, 8, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 8, 8, alpha, mode);
     }
     else {
       LICE_pixel_chan alphas[64] = {
@@ -142,7 +145,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.00), A(1.00), A(1.00), A(0.00), A(0.00), A(1.00), A(1.00), A(0.00),
         A(0.00), A(0.00), A(1.00), A(1.00), A(1.00), A(1.00), A(0.00), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 8, 8, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 8, 8, alpha, mode);
     }
     return true;
   }
@@ -159,7 +162,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.12), A(0.94), A(0.82), A(0.31), A(0.25), A(0.31), A(0.82), A(0.94), A(0.12),
         A(0.00), A(0.12), A(0.69), A(1.00), A(1.00), A(1.00), A(0.69), A(0.12), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 9, 9, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 9, 9, alpha, mode);
     }
     else {
       LICE_pixel_chan alphas[81] = {
@@ -173,7 +176,7 @@ static bool CachedCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_p
         A(0.00), A(1.00), A(1.00), A(0.00), A(0.00), A(0.00), A(1.00), A(1.00), A(0.00),
         A(0.00), A(0.00), A(1.00), A(1.00), A(1.00), A(1.00), A(1.00), A(0.00), A(0.00)
       };
-      LICE_DrawGlyph(dest, cx-r, cy-r, color, alphas, 9, 9, alpha, mode);
+      LICE_DrawGlyph(dest, gx, gy, color, alphas, 9, 9, alpha, mode);
     }
     return true;
   }
@@ -407,8 +410,25 @@ static void __DrawCircleClipped(LICE_IBitmap* dest, float cx, float cy, float ra
 }
 
 
+static bool GetPhysicalClip(LICE_IBitmap *dest, const RECT *cliprect, int *clip)
+{
+  const int w = dest->getWidth(), h = dest->getHeight();
+  int y0 = cliprect->top, y1 = cliprect->bottom;
+  if (dest->isFlipped())
+  {
+    y0 = h-cliprect->bottom;
+    y1 = h-cliprect->top;
+  }
+  clip[0] = lice_max(cliprect->left,0);
+  clip[1] = lice_max(y0,0);
+  clip[2] = lice_min(cliprect->right,w);
+  clip[3] = lice_min(y1,h);
+  return clip[0] < clip[2] && clip[1] < clip[3];
+}
+
+// uclip, if set, is a physical clip rectangle within {0,0,w,h}
 static void __DrawArc(int w, int h, LICE_IBitmap* dest, float cx, float cy, float rad, double anglo, double anghi,
-  LICE_pixel color, int ialpha, bool aa, int mode)
+  LICE_pixel color, int ialpha, bool aa, int mode, const int *uclip)
 {
   // -2PI <= anglo <= anghi <= 2PI
   anglo += 2.0*_PI;
@@ -442,16 +462,27 @@ static void __DrawArc(int w, int h, LICE_IBitmap* dest, float cx, float cy, floa
     if (xhi != cx) xhi++;
     if (yhi != cy) yhi++;
 
-    const int clip[4]={lice_max(xlo,0),lice_max(0, ylo),lice_min(w,xhi+1),lice_min(h, yhi+1)};
+    int clip[4]={lice_max(xlo,0),lice_max(0, ylo),lice_min(w,xhi+1),lice_min(h, yhi+1)};
+    if (uclip)
+    {
+      clip[0]=lice_max(clip[0],uclip[0]);
+      clip[1]=lice_max(clip[1],uclip[1]);
+      clip[2]=lice_min(clip[2],uclip[2]);
+      clip[3]=lice_min(clip[3],uclip[3]);
+      if (clip[0] >= clip[2] || clip[1] >= clip[3]) continue;
+    }
 
     __DrawCircleClipped(dest,cx,cy,rad,color,ialpha,aa,false,mode,clip,true);
   }
 }
 
-void LICE_Arc(LICE_IBitmap* dest, float cx, float cy, float r, float minAngle, float maxAngle, 
-	LICE_pixel color, float alpha, int mode, bool aa)
+static void __LICE_Circle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha, int mode, bool aa, const RECT *cliprect);
+
+static void __LICE_Arc(LICE_IBitmap* dest, float cx, float cy, float r, float minAngle, float maxAngle, 
+	LICE_pixel color, float alpha, int mode, bool aa, const RECT *cliprect)
 {
-  if (!dest) return;
+  int uclip[4];
+  if (cliprect && !GetPhysicalClip(dest,cliprect,uclip)) return;
 
   if (dest->isFlipped()) { cy=dest->getHeight()-1-cy; minAngle=_PI-minAngle; maxAngle=_PI-maxAngle; }
 
@@ -464,7 +495,7 @@ void LICE_Arc(LICE_IBitmap* dest, float cx, float cy, float r, float minAngle, f
 
   if (maxAngle - minAngle >= 2.0f*_PI) 
   {
-    LICE_Circle(dest,cx,cy,r,color,alpha,mode,aa);
+    __LICE_Circle(dest,cx,cy,r,color,alpha,mode,aa,cliprect);
     return;
   }
 
@@ -486,35 +517,61 @@ void LICE_Arc(LICE_IBitmap* dest, float cx, float cy, float r, float minAngle, f
   int ia = (int) (alpha*256.0f);
   if (!ia) return;
 
-  __DrawArc(dest->getWidth(),dest->getHeight(),dest,cx,cy,r,minAngle,maxAngle,color,ia,aa,mode);
+  __DrawArc(dest->getWidth(),dest->getHeight(),dest,cx,cy,r,minAngle,maxAngle,color,ia,aa,mode,cliprect ? uclip : NULL);
 }
 
+void LICE_Arc(LICE_IBitmap* dest, float cx, float cy, float r, float minAngle, float maxAngle, 
+	LICE_pixel color, float alpha, int mode, bool aa)
+{
+  if (!dest) return;
+  __LICE_Arc(dest,cx,cy,r,minAngle,maxAngle,color,alpha,mode,aa,NULL);
+}
+
+void LICE_ClippedArc(LICE_IBitmap* dest, const RECT *cliprect, float cx, float cy, float r, float minAngle, float maxAngle, 
+	LICE_pixel color, float alpha, int mode, bool aa)
+{
+  if (!dest || !cliprect) return;
+  __LICE_Arc(dest,cx,cy,r,minAngle,maxAngle,color,alpha,mode,aa,cliprect);
+}
 
 
 
-void LICE_Circle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha, int mode, bool aa)
-{
-  if (!dest) return;
 
+static void __LICE_Circle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha, int mode, bool aa, const RECT *cliprect)
+{
   const int w = dest->getWidth(), h = dest->getHeight();
-  const int clip[4] = { 0, 0, w, h };
+  int clip[4] = { 0, 0, w, h };
   if (w < 1 || h <1 || r<0 || 
       (int)cx+(int)r < -2 || (int)cy + (int)r < - 2 ||
       (int)cx-(int)r > w + 2 || (int)cy - (int)r > h + 2
     ) return;
 
-  if (CachedCircle(dest, cx, cy, r, color, alpha, mode, aa)) return;  
+  if (cliprect)
+  {
+    if (!GetPhysicalClip(dest,cliprect,clip)) return;
+    // glyph circles go through a view of the clip rect, placed as they would be on dest
+    const int sx = lice_max(cliprect->left,0), sy = lice_max(cliprect->top,0);
+    LICE_SubBitmap sub(dest,sx,sy,lice_min(cliprect->right,w)-sx,lice_min(cliprect->bottom,h)-sy);
+    if (CachedCircle(&sub, cx, cy, r, color, alpha, mode, aa, sx, sy)) return;
+  }
+  else if (CachedCircle(dest, cx, cy, r, color, alpha, mode, aa)) return;  
 
   if (dest->isFlipped()) cy=h-1-cy;
 
   int ia = (int) (alpha*256.0f);
   if (!ia) return;
 
-  const bool doclip = !(cx-r-2 >= 0 && cy-r-2 >= 0 && cx+r+2 < w && cy+r+2 < h);
+  const bool doclip = cliprect || !(cx-r-2 >= 0 && cy-r-2 >= 0 && cx+r+2 < w && cy+r+2 < h);
 
   __DrawCircleClipped(dest,cx,cy,r,color,ia,aa,false,mode,clip,doclip);
 }
 
+void LICE_Circle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  if (!dest) return;
+  __LICE_Circle(dest,cx,cy,r,color,alpha,mode,aa,NULL);
+}
+
 void LICE_FillCircle(LICE_IBitmap* dest, float cx, float cy, float r, LICE_pixel color, float alpha, int mode, bool aa)
 {
   if (!dest) return;
@@ -0,0 +1,287 @@
+#include "lice_cmdbuf.h"
+#include <math.h>
+
+LICE_CmdBuf::LICE_CmdBuf(int tilesize)
+{
+  m_tilesize = tilesize < 8 ? 8 : tilesize;
+  m_dest = NULL;
+  m_tiles_w = 0;
+  m_cmds.SetGranul(256*sizeof(cmdEnt));
+}
+
+void LICE_CmdBuf::Clear()
+{
+  m_cmds.Resize(0,false);
+  m_polypts.Resize(0,false);
+  m_strings.Resize(0,false);
+}
+
+LICE_CmdBuf::cmdEnt *LICE_CmdBuf::addCmd(int type, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  const int n = m_cmds.GetSize();
+  cmdEnt *c = m_cmds.ResizeOK(n+1,false);
+  if (!c) return NULL;
+  c += n;
+  memset(c,0,sizeof(cmdEnt));
+  c->type = type;
+  c->color = color;
+  c->alpha = alpha;
+  c->mode = mode;
+  c->aa = aa;
+  return c;
+}
+
+static void setBounds(RECT *r, int l, int t, int rt, int b)
+{
+  r->left = l;
+  r->top = t;
+  r->right = rt;
+  r->bottom = b;
+}
+
+void LICE_CmdBuf::Line(int x1, int y1, int x2, int y2, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  cmdEnt *c = addCmd(CMD_LINE,color,alpha,mode,aa);
+  if (!c) return;
+  c->ip[0] = x1;
+  c->ip[1] = y1;
+  c->ip[2] = x2;
+  c->ip[3] = y2;
+  // AA pixels are drawn next to the line, clipping can move an endpoint by a pixel
+  setBounds(&c->bounds,lice_min(x1,x2)-2,lice_min(y1,y2)-2,lice_max(x1,x2)+3,lice_max(y1,y2)+3);
+}
+
+void LICE_CmdBuf::FLine(float x1, float y1, float x2, float y2, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  cmdEnt *c = addCmd(CMD_FLINE,color,alpha,mode,aa);
+  if (!c) return;
+  c->fp[0] = x1;
+  c->fp[1] = y1;
+  c->fp[2] = x2;
+  c->fp[3] = y2;
+  setBounds(&c->bounds,(int)floor(lice_min(x1,x2))-2,(int)floor(lice_min(y1,y2))-2,
+                       (int)ceil(lice_max(x1,x2))+3,(int)ceil(lice_max(y1,y2))+3);
+}
+
+void LICE_CmdBuf::FillRect(int x, int y, int w, int h, LICE_pixel color, float alpha, int mode)
+{
+  if (w < 1 || h < 1) return;
+  cmdEnt *c = addCmd(CMD_FILLRECT,color,alpha,mode,false);
+  if (!c) return;
+  c->ip[0] = x;
+  c->ip[1] = y;
+  c->ip[2] = w;
+  c->ip[3] = h;
+  setBounds(&c->bounds,x,y,x+w,y+h);
+}
+
+void LICE_CmdBuf::FillConvexPolygon(const int *x, const int *y, int npoints, LICE_pixel color, float alpha, int mode)
+{
+  if (!x || !y || npoints < 1) return;
+  const int offs = m_polypts.GetSize();
+  int *p = m_polypts.ResizeOK(offs+npoints*2,false);
+  if (!p) return;
+  cmdEnt *c = addCmd(CMD_POLY,color,alpha,mode,false);
+  if (!c)
+  {
+    m_polypts.Resize(offs,false);
+    return;
+  }
+  p += offs;
+  int minx = x[0], maxx = x[0], miny = y[0], maxy = y[0];
+  for (int i = 0; i < npoints; i ++)
+  {
+    p[i] = x[i];
+    p[npoints+i] = y[i];
+    if (x[i] < minx) minx = x[i];
+    else if (x[i] > maxx) maxx = x[i];
+    if (y[i] < miny) miny = y[i];
+    else if (y[i] > maxy) maxy = y[i];
+  }
+  c->ip[0] = offs;
+  c->ip[1] = npoints;
+  setBounds(&c->bounds,minx-1,miny-1,maxx+2,maxy+2);
+}
+
+void LICE_CmdBuf::Arc(float cx, float cy, float r, float minAngle, float maxAngle, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  cmdEnt *c = addCmd(CMD_ARC,color,alpha,mode,aa);
+  if (!c) return;
+  c->fp[0] = cx;
+  c->fp[1] = cy;
+  c->fp[2] = r;
+  c->fp[3] = minAngle;
+  c->fp[4] = maxAngle;
+  // whole circle, AA adds a pixel outside and the small cached circles are placed by truncation
+  setBounds(&c->bounds,(int)floor(cx-r)-3,(int)floor(cy-r)-3,(int)ceil(cx+r)+4,(int)ceil(cy+r)+4);
+}
+
+void LICE_CmdBuf::DrawText(int x, int y, const char *string, LICE_pixel color, float alpha, int mode)
+{
+  if (!string || !*string) return;
+  const int offs = m_strings.GetSize(), len = (int)strlen(string)+1;
+  if (!m_strings.Add(string,len)) return;
+  cmdEnt *c = addCmd(CMD_TEXT,color,alpha,mode,false);
+  if (!c)
+  {
+    m_strings.Resize(offs,false);
+    return;
+  }
+  int w, h;
+  LICE_MeasureText(string,&w,&h);
+  c->ip[0] = x;
+  c->ip[1] = y;
+  c->ip[2] = offs;
+  setBounds(&c->bounds,x,y,x+w,y+h);
+}
+
+void LICE_CmdBuf::getBounds(const cmdEnt *c, LICE_IBitmap *dest, RECT *r) const
+{
+  *r = c->bounds;
+  if (c->type == CMD_ARC && dest->isFlipped())
+  {
+    // LICE_Arc draws full circles vertically mirrored on flipped bitmaps
+    const int h = dest->getHeight();
+    r->top = lice_min(r->top, h-c->bounds.bottom);
+    r->bottom = lice_max(r->bottom, h-c->bounds.top);
+  }
+}
+
+void LICE_CmdBuf::Render(LICE_IBitmap *dest)
+{
+  m_dirty.Resize(0,false);
+  if (!dest) return;
+
+  const int w = dest->getWidth(), h = dest->getHeight(), ts = m_tilesize;
+  if (w < 1 || h < 1 || !m_cmds.GetSize()) return;
+
+  const int tw = (w+ts-1)/ts, th = (h+ts-1)/ts, ntiles = tw*th;
+  int *start = m_tilestart.ResizeOK(ntiles+1,false);
+  if (!start) return;
+  memset(start,0,(ntiles+1)*sizeof(int));
+
+  const cmdEnt *cmds = m_cmds.Get();
+  const int ncmds = m_cmds.GetSize();
+  RECT *tr = m_cmdtiles.ResizeOK(ncmds,false);
+  if (!tr) return;
+  int i, x, y, total = 0;
+
+  // tile range of each command, and the number of commands per tile
+  for (i = 0; i < ncmds; i ++)
+  {
+    RECT r;
+    getBounds(cmds+i,dest,&r);
+    if (r.left < 0) r.left = 0;
+    if (r.top < 0) r.top = 0;
+    if (r.right > w) r.right = w;
+    if (r.bottom > h) r.bottom = h;
+    if (r.left >= r.right || r.top >= r.bottom)
+    {
+      tr[i].left = tr[i].top = tr[i].right = tr[i].bottom = 0;
+      continue;
+    }
+    tr[i].left = r.left/ts;
+    tr[i].top = r.top/ts;
+    tr[i].right = (r.right-1)/ts + 1;
+    tr[i].bottom = (r.bottom-1)/ts + 1;
+
+    for (y = tr[i].top; y < tr[i].bottom; y ++)
+      for (x = tr[i].left; x < tr[i].right; x ++) start[y*tw+x]++;
+  }
+
+  for (i = 0; i < ntiles; i ++)
+  {
+    total += start[i];
+    start[i] = total;
+  }
+  start[ntiles] = total;
+  int *list = total ? m_tilecmds.ResizeOK(total,false) : NULL;
+  if (!list) return;
+
+  // filled backwards from the end of each tile's range, so each list stays in drawing order
+  for (i = ncmds-1; i >= 0; i --)
+  {
+    for (y = tr[i].top; y < tr[i].bottom; y ++)
+      for (x = tr[i].left; x < tr[i].right; x ++) list[--start[y*tw+x]] = i;
+  }
+
+  m_tilelist.Resize(0,false);
+  for (y = 0; y < th; y ++)
+  {
+    for (x = 0; x < tw; x ++)
+    {
+      const int t = y*tw+x;
+      if (start[t+1] == start[t]) continue;
+      m_tilelist.Add(t);
+
+      RECT r = { x*ts, y*ts, lice_min(w,x*ts+ts), lice_min(h,y*ts+ts) };
+      RECT *last = m_dirty.GetSize() ? m_dirty.Get()+m_dirty.GetSize()-1 : NULL;
+      if (last && last->top == r.top && last->right == r.left) last->right = r.right;
+      else m_dirty.Add(r);
+    }
+  }
+
+  m_dest = dest;
+  m_tiles_w = tw;
+  LICE_RunThreadJobs(m_tilelist.GetSize(),tileJob,this);
+  m_dest = NULL;
+}
+
+void LICE_CmdBuf::tileJob(void *ctx, int job)
+{
+  LICE_CmdBuf *_this = (LICE_CmdBuf *)ctx;
+  _this->renderTile(_this->m_tilelist.Get()[job]);
+}
+
+void LICE_CmdBuf::renderTile(int tile)
+{
+  LICE_IBitmap *dest = m_dest;
+  const int ts = m_tilesize, tx = tile%m_tiles_w, ty = tile/m_tiles_w;
+  const RECT r = { tx*ts, ty*ts, lice_min(dest->getWidth(),tx*ts+ts), lice_min(dest->getHeight(),ty*ts+ts) };
+
+  // the clipped line/arc functions draw exactly the in-tile pixels of the whole primitive. fills and
+  // text are exact under an integer translation, so those go through a view of the tile.
+  LICE_SubBitmap sub(dest,r.left,r.top,r.right-r.left,r.bottom-r.top);
+
+  const int *list = m_tilecmds.Get() + m_tilestart.Get()[tile];
+  const int n = m_tilestart.Get()[tile+1] - m_tilestart.Get()[tile];
+  int tmp[64];
+  WDL_TypedBuf<int> tmpbuf;
+
+  for (int i = 0; i < n; i ++)
+  {
+    const cmdEnt *c = m_cmds.Get() + list[i];
+    switch (c->type)
+    {
+      case CMD_LINE:
+        LICE_ClippedLine(dest,&r,c->ip[0],c->ip[1],c->ip[2],c->ip[3],c->color,c->alpha,c->mode,c->aa);
+      break;
+      case CMD_FLINE:
+        LICE_ClippedFLine(dest,&r,c->fp[0],c->fp[1],c->fp[2],c->fp[3],c->color,c->alpha,c->mode,c->aa);
+      break;
+      case CMD_FILLRECT:
+        LICE_FillRect(&sub,c->ip[0]-r.left,c->ip[1]-r.top,c->ip[2],c->ip[3],c->color,c->alpha,c->mode);
+      break;
+      case CMD_POLY:
+        {
+          const int np = c->ip[1];
+          const int *src = m_polypts.Get() + c->ip[0];
+          int *pts = np*2 <= (int)(sizeof(tmp)/sizeof(tmp[0])) ? tmp : tmpbuf.ResizeOK(np*2,false);
+          if (!pts) break;
+          for (int j = 0; j < np; j ++)
+          {
+            pts[j] = src[j]-r.left;
+            pts[np+j] = src[np+j]-r.top;
+          }
+          LICE_FillConvexPolygon(&sub,pts,pts+np,np,c->color,c->alpha,c->mode);
+        }
+      break;
+      case CMD_ARC:
+        LICE_ClippedArc(dest,&r,c->fp[0],c->fp[1],c->fp[2],c->fp[3],c->fp[4],c->color,c->alpha,c->mode,c->aa);
+      break;
+      case CMD_TEXT:
+        LICE_DrawText(&sub,c->ip[0]-r.left,c->ip[1]-r.top,m_strings.Get()+c->ip[2],c->color,c->alpha,c->mode);
+      break;
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef _LICE_CMDBUF_H_
+#define _LICE_CMDBUF_H_
+
+#include "lice.h"
+
+#include "../heapbuf.h"
+
+// records drawing calls and replays them into a bitmap tile by tile. tiles are drawn in parallel on the
+// LICE_SetThreadCount() workers, and tiles that no primitive touches are skipped. the result is the same as
+// making the calls directly, in order, on dest. the recorded commands are kept until Clear().
+class LICE_CmdBuf
+{
+  public:
+    LICE_CmdBuf(int tilesize=64);
+    ~LICE_CmdBuf() { }
+
+    void Clear();
+    int GetNumCommands() const { return m_cmds.GetSize(); }
+
+    void Line(int x1, int y1, int x2, int y2, LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
+    void FLine(float x1, float y1, float x2, float y2, LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
+    void FillRect(int x, int y, int w, int h, LICE_pixel color, float alpha=1.0f, int mode=0);
+    void FillConvexPolygon(const int *x, const int *y, int npoints, LICE_pixel color, float alpha=1.0f, int mode=0);
+    void Arc(float cx, float cy, float r, float minAngle, float maxAngle, LICE_pixel color, float alpha=1.0f, int mode=0, bool aa=true);
+    void DrawText(int x, int y, const char *string, LICE_pixel color, float alpha=1.0f, int mode=0);
+
+    void Render(LICE_IBitmap *dest);
+
+    // tiles the last Render() drew into (clipped to dest), adjacent tiles of a row merged
+    const RECT *GetDirtyRects(int *cnt) const { if (cnt) *cnt=m_dirty.GetSize(); return m_dirty.Get(); }
+
+  private:
+
+    enum { CMD_LINE, CMD_FLINE, CMD_FILLRECT, CMD_POLY, CMD_ARC, CMD_TEXT };
+
+    struct cmdEnt
+    {
+      int type, mode;
+      LICE_pixel color;
+      float alpha;
+      bool aa;
+      int ip[4]; // line: x1,y1,x2,y2, fillrect: x,y,w,h, poly: offset,npoints, text: x,y,offset
+      float fp[5]; // fline: x1,y1,x2,y2, arc: cx,cy,r,minAngle,maxAngle
+      RECT bounds; // pixels that may be touched, right/bottom exclusive
+    };
+
+    cmdEnt *addCmd(int type, LICE_pixel color, float alpha, int mode, bool aa);
+    void getBounds(const cmdEnt *c, LICE_IBitmap *dest, RECT *r) const;
+    void renderTile(int tile);
+    static void tileJob(void *ctx, int job);
+
+    int m_tilesize;
+    WDL_TypedBuf<cmdEnt> m_cmds;
+    WDL_TypedBuf<int> m_polypts;
+    WDL_TypedBuf<char> m_strings;
+
+    // valid during Render()
+    LICE_IBitmap *m_dest;
+    int m_tiles_w;
+    WDL_TypedBuf<int> m_tilelist; // non-empty tiles
+    WDL_TypedBuf<int> m_tilestart; // index into m_tilecmds per tile, +1 entry
+    WDL_TypedBuf<int> m_tilecmds;
+    WDL_TypedBuf<RECT> m_cmdtiles; // tile range per command
+
+    WDL_TypedBuf<RECT> m_dirty;
+};
+
+#endif
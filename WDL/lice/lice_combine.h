@@ -6,6 +6,8 @@
 #pragma warning(disable:4244) // float-to-int
 #endif
 
+#include "lice_simd.h"
+
 #define __LICE_BOUND(x,lo,hi) ((x)<(lo)?(lo):((x)>(hi)?(hi):(x)))
 
 
@@ -723,6 +725,386 @@ public:
 #define _LICE_CombinePixelsHSVAdjust _LICE_CombinePixelsCopyClamp
 #endif
 
+// span versions of the combiners, for blit loops that run over contiguous pixels. the generic versions call
+// doPix()/doPixFAST() per pixel, the specializations below do 4 pixels at a time with SSE2/NEON (for the ia
+// range they are exact for) and finish the row with the scalar code, so output is identical either way.
+template<class COMBFUNC> class _LICE_CombineSpanScalar
+{
+public:
+  static inline void blitRow(LICE_pixel_chan *pout, const LICE_pixel_chan *pin, int n, int ia)
+  {
+    while (n-->0)
+    {
+      COMBFUNC::doPix(pout,pin[LICE_PIXEL_R],pin[LICE_PIXEL_G],pin[LICE_PIXEL_B],pin[LICE_PIXEL_A],ia);
+      pin += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+      pout += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+    }
+  }
+  static inline void solidRow(LICE_pixel_chan *pout, int n, int r, int g, int b, int a, int ia)
+  {
+    while (n-->0)
+    {
+      COMBFUNC::doPix(pout,r,g,b,a,ia);
+      pout += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+    }
+  }
+};
+
+template<class COMBFUNC> class _LICE_CombineSpanScalarFAST
+{
+public:
+  static inline void blitRow(LICE_pixel *pout, const LICE_pixel *pin, int n)
+  {
+    while (n-->0) COMBFUNC::doPixFAST(pout++,*pin++);
+  }
+  static inline void solidRow(LICE_pixel *pout, int n, LICE_pixel color)
+  {
+    while (n-->0) COMBFUNC::doPixFAST(pout++,color);
+  }
+};
+
+template<class COMBFUNC> class _LICE_CombineSpan : public _LICE_CombineSpanScalar<COMBFUNC> { };
+template<class COMBFUNC> class _LICE_CombineSpanFAST : public _LICE_CombineSpanScalarFAST<COMBFUNC> { };
+
+#if (defined(LICE_SIMD_HAVE_SSE2) || defined(LICE_SIMD_HAVE_NEON)) && LICE_PIXEL_A == 3 && !defined(LICE_NO_SIMD_COMBINE)
+
+#ifdef LICE_SIMD_HAVE_SSE2
+
+#define _LICE_VEC_CAPS LICE_SIMD_SSE2
+typedef __m128i _LICE_vec;
+static inline _LICE_vec _LICE_vec_load(const void *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void _LICE_vec_store(void *p, _LICE_vec v) { _mm_storeu_si128((__m128i *)p,v); }
+static inline _LICE_vec _LICE_vec_splat(LICE_pixel v) { return _mm_set1_epi32((int)v); }
+
+// s + ((d-s)*sc)/256 per 16 bit channel, rounding toward zero like the scalar code. d,s 0..255, sc 0..256
+static inline __m128i _LICE_vec_lerp16(__m128i d, __m128i s, __m128i sc)
+{
+  const __m128i diff = _mm_sub_epi16(d,s);
+  const __m128i sign = _mm_srai_epi16(diff,15);
+  const __m128i q = _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_xor_si128(diff,sign),sign),sc),8);
+  return _mm_add_epi16(s,_mm_sub_epi16(_mm_xor_si128(q,sign),sign));
+}
+
+// source alpha of each pixel in all 4 of its bytes
+static inline __m128i _LICE_vec_alphabytes(__m128i s)
+{
+  const __m128i a = _mm_srli_epi32(s,24);
+  return _mm_or_si128(a,_mm_or_si128(_mm_slli_epi32(a,8),_mm_slli_epi32(_mm_or_si128(a,_mm_slli_epi32(a,8)),16)));
+}
+
+struct _LICE_CombineVec_Copy // _LICE_CombinePixelsCopy*
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const __m128i z = _mm_setzero_si128(), sc = _mm_set1_epi16((short)(256-ia));
+    return _mm_packus_epi16(_LICE_vec_lerp16(_mm_unpacklo_epi8(d,z),_mm_unpacklo_epi8(s,z),sc),
+                            _LICE_vec_lerp16(_mm_unpackhi_epi8(d,z),_mm_unpackhi_epi8(s,z),sc));
+  }
+};
+
+struct _LICE_CombineVec_SourceAlpha // _LICE_CombinePixelsCopySourceAlpha*
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const __m128i z = _mm_setzero_si128(), c1 = _mm_set1_epi16(1), c256 = _mm_set1_epi16(256), iav = _mm_set1_epi16((short)ia);
+    const __m128i a = _LICE_vec_alphabytes(s);
+    __m128i sc2lo = _mm_add_epi16(_mm_unpacklo_epi8(a,z),c1), sc2hi = _mm_add_epi16(_mm_unpackhi_epi8(a,z),c1);
+    if (ia < 256) // (a+1)*256 would overflow 16 bits
+    {
+      sc2lo = _mm_srli_epi16(_mm_mullo_epi16(sc2lo,iav),8);
+      sc2hi = _mm_srli_epi16(_mm_mullo_epi16(sc2hi,iav),8);
+    }
+    const __m128i rgb = _mm_packus_epi16(_LICE_vec_lerp16(_mm_unpacklo_epi8(d,z),_mm_unpacklo_epi8(s,z),_mm_sub_epi16(c256,sc2lo)),
+                                         _LICE_vec_lerp16(_mm_unpackhi_epi8(d,z),_mm_unpackhi_epi8(s,z),_mm_sub_epi16(c256,sc2hi)));
+    const __m128i am = _mm_set1_epi32((int)0xff000000);
+    const __m128i res = _mm_or_si128(_mm_andnot_si128(am,rgb),_mm_and_si128(am,_mm_adds_epu8(d,_mm_packus_epi16(sc2lo,sc2hi))));
+    const __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(s,am),z); // a=0 leaves dest alone
+    return _mm_or_si128(_mm_and_si128(keep,d),_mm_andnot_si128(keep,res));
+  }
+};
+
+struct _LICE_CombineVec_SourceAlphaIgnoreAlphaParm // _LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParm*
+{
+  static inline bool ok(int ia) { return true; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const __m128i z = _mm_setzero_si128(), c255 = _mm_set1_epi16(255);
+    const __m128i a = _LICE_vec_alphabytes(s);
+    const __m128i rgb = _mm_packus_epi16(_LICE_vec_lerp16(_mm_unpacklo_epi8(d,z),_mm_unpacklo_epi8(s,z),_mm_sub_epi16(c255,_mm_unpacklo_epi8(a,z))),
+                                         _LICE_vec_lerp16(_mm_unpackhi_epi8(d,z),_mm_unpackhi_epi8(s,z),_mm_sub_epi16(c255,_mm_unpackhi_epi8(a,z))));
+    const __m128i am = _mm_set1_epi32((int)0xff000000);
+    const __m128i res = _mm_or_si128(_mm_andnot_si128(am,rgb),_mm_and_si128(am,_mm_adds_epu8(d,s)));
+    const __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(s,am),z);
+    return _mm_or_si128(_mm_and_si128(keep,d),_mm_andnot_si128(keep,res));
+  }
+};
+
+struct _LICE_CombineVec_Add // _LICE_CombinePixelsAdd
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const __m128i z = _mm_setzero_si128(), iav = _mm_set1_epi16((short)ia);
+    return _mm_adds_epu8(d,_mm_packus_epi16(_mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s,z),iav),8),
+                                            _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s,z),iav),8)));
+  }
+};
+
+struct _LICE_CombineVec_Mul // _LICE_CombinePixelsMul*
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    // (d*((256-ia)*256 + s*ia))>>16, the multiplier is below 65536 for ia>0
+    const __m128i z = _mm_setzero_si128(), iav = _mm_set1_epi16((short)ia), da = _mm_set1_epi16((short)((256-ia)*256));
+    return _mm_packus_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(d,z),_mm_add_epi16(da,_mm_mullo_epi16(_mm_unpacklo_epi8(s,z),iav))),
+                            _mm_mulhi_epu16(_mm_unpackhi_epi8(d,z),_mm_add_epi16(da,_mm_mullo_epi16(_mm_unpackhi_epi8(s,z),iav))));
+  }
+};
+
+struct _LICE_CombineVec_HalfMix // _LICE_CombinePixelsHalfMix*
+{
+  static inline bool ok(int ia) { return true; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    // pavgb rounds up, (d+s)>>1 doesn't
+    return _mm_sub_epi8(_mm_avg_epu8(d,s),_mm_and_si128(_mm_xor_si128(d,s),_mm_set1_epi8(1)));
+  }
+};
+
+// the FAST combiners work on whole LICE_pixels with masked shifts, which are the same per 32 bit lane
+struct _LICE_CombineVecFAST_HalfMix { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { const __m128i m = _mm_set1_epi32(0x7f7f7f7f); return _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(d,1),m),_mm_and_si128(_mm_srli_epi32(s,1),m)); } };
+struct _LICE_CombineVecFAST_HalfMix2 { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { return _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(d,1),_mm_set1_epi32(0x7f7f7f7f)),s); } };
+struct _LICE_CombineVecFAST_QuarterMix2 { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { return _mm_add_epi32(_mm_add_epi32(_mm_and_si128(_mm_srli_epi32(d,1),_mm_set1_epi32(0x7f7f7f7f)),_mm_and_si128(_mm_srli_epi32(d,2),_mm_set1_epi32(0x3f3f3f3f))),s); } };
+struct _LICE_CombineVecFAST_ThreeQuarterMix2 { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { return _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(d,2),_mm_set1_epi32(0x3f3f3f3f)),s); } };
+
+#else // NEON
+
+#define _LICE_VEC_CAPS LICE_SIMD_NEON
+typedef uint32x4_t _LICE_vec;
+static inline _LICE_vec _LICE_vec_load(const void *p) { return vld1q_u32((const uint32_t *)p); }
+static inline void _LICE_vec_store(void *p, _LICE_vec v) { vst1q_u32((uint32_t *)p,v); }
+static inline _LICE_vec _LICE_vec_splat(LICE_pixel v) { return vdupq_n_u32(v); }
+
+static inline uint16x8_t _LICE_vec_lo16(_LICE_vec v) { return vmovl_u8(vget_low_u8(vreinterpretq_u8_u32(v))); }
+static inline uint16x8_t _LICE_vec_hi16(_LICE_vec v) { return vmovl_u8(vget_high_u8(vreinterpretq_u8_u32(v))); }
+static inline _LICE_vec _LICE_vec_pack16(uint16x8_t lo, uint16x8_t hi) { return vreinterpretq_u32_u8(vcombine_u8(vqmovn_u16(lo),vqmovn_u16(hi))); }
+
+// s + ((d-s)*sc)/256 per 16 bit channel, rounding toward zero like the scalar code. d,s 0..255, sc 0..256
+static inline uint16x8_t _LICE_vec_lerp16(uint16x8_t d, uint16x8_t s, uint16x8_t sc)
+{
+  const int16x8_t diff = vreinterpretq_s16_u16(vsubq_u16(d,s));
+  const int16x8_t q = vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vreinterpretq_u16_s16(vabsq_s16(diff)),sc),8));
+  return vreinterpretq_u16_s16(vaddq_s16(vreinterpretq_s16_u16(s),vbslq_s16(vcltq_s16(diff,vdupq_n_s16(0)),vnegq_s16(q),q)));
+}
+
+static inline _LICE_vec _LICE_vec_alphabytes(_LICE_vec s)
+{
+  const uint32x4_t a = vshrq_n_u32(s,24);
+  const uint32x4_t a2 = vorrq_u32(a,vshlq_n_u32(a,8));
+  return vorrq_u32(a2,vshlq_n_u32(a2,16));
+}
+
+struct _LICE_CombineVec_Copy
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const uint16x8_t sc = vdupq_n_u16((unsigned short)(256-ia));
+    return _LICE_vec_pack16(_LICE_vec_lerp16(_LICE_vec_lo16(d),_LICE_vec_lo16(s),sc),_LICE_vec_lerp16(_LICE_vec_hi16(d),_LICE_vec_hi16(s),sc));
+  }
+};
+
+struct _LICE_CombineVec_SourceAlpha
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const uint16x8_t c1 = vdupq_n_u16(1), c256 = vdupq_n_u16(256), iav = vdupq_n_u16((unsigned short)ia);
+    const _LICE_vec a = _LICE_vec_alphabytes(s);
+    uint16x8_t sc2lo = vaddq_u16(_LICE_vec_lo16(a),c1), sc2hi = vaddq_u16(_LICE_vec_hi16(a),c1);
+    if (ia < 256) // (a+1)*256 would overflow 16 bits
+    {
+      sc2lo = vshrq_n_u16(vmulq_u16(sc2lo,iav),8);
+      sc2hi = vshrq_n_u16(vmulq_u16(sc2hi,iav),8);
+    }
+    const _LICE_vec rgb = _LICE_vec_pack16(_LICE_vec_lerp16(_LICE_vec_lo16(d),_LICE_vec_lo16(s),vsubq_u16(c256,sc2lo)),
+                                           _LICE_vec_lerp16(_LICE_vec_hi16(d),_LICE_vec_hi16(s),vsubq_u16(c256,sc2hi)));
+    const _LICE_vec na = vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(d),vreinterpretq_u8_u32(_LICE_vec_pack16(sc2lo,sc2hi))));
+    const _LICE_vec res = vbslq_u32(vdupq_n_u32(0xff000000),na,rgb);
+    return vbslq_u32(vceqq_u32(vshrq_n_u32(s,24),vdupq_n_u32(0)),d,res);
+  }
+};
+
+struct _LICE_CombineVec_SourceAlphaIgnoreAlphaParm
+{
+  static inline bool ok(int ia) { return true; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const uint16x8_t c255 = vdupq_n_u16(255);
+    const _LICE_vec a = _LICE_vec_alphabytes(s);
+    const _LICE_vec rgb = _LICE_vec_pack16(_LICE_vec_lerp16(_LICE_vec_lo16(d),_LICE_vec_lo16(s),vsubq_u16(c255,_LICE_vec_lo16(a))),
+                                           _LICE_vec_lerp16(_LICE_vec_hi16(d),_LICE_vec_hi16(s),vsubq_u16(c255,_LICE_vec_hi16(a))));
+    const _LICE_vec na = vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(d),vreinterpretq_u8_u32(s)));
+    const _LICE_vec res = vbslq_u32(vdupq_n_u32(0xff000000),na,rgb);
+    return vbslq_u32(vceqq_u32(vshrq_n_u32(s,24),vdupq_n_u32(0)),d,res);
+  }
+};
+
+struct _LICE_CombineVec_Add
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const uint16x8_t iav = vdupq_n_u16((unsigned short)ia);
+    const _LICE_vec add = _LICE_vec_pack16(vshrq_n_u16(vmulq_u16(_LICE_vec_lo16(s),iav),8),vshrq_n_u16(vmulq_u16(_LICE_vec_hi16(s),iav),8));
+    return vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(d),vreinterpretq_u8_u32(add)));
+  }
+};
+
+struct _LICE_CombineVec_Mul
+{
+  static inline bool ok(int ia) { return ia>0 && ia<=256; }
+  static inline uint16x8_t mulhi(uint16x8_t a, uint16x8_t b)
+  {
+    return vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(a),vget_low_u16(b)),16),vshrn_n_u32(vmull_u16(vget_high_u16(a),vget_high_u16(b)),16));
+  }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    const uint16x8_t iav = vdupq_n_u16((unsigned short)ia), da = vdupq_n_u16((unsigned short)((256-ia)*256));
+    return _LICE_vec_pack16(mulhi(_LICE_vec_lo16(d),vmlaq_u16(da,_LICE_vec_lo16(s),iav)),mulhi(_LICE_vec_hi16(d),vmlaq_u16(da,_LICE_vec_hi16(s),iav)));
+  }
+};
+
+struct _LICE_CombineVec_HalfMix
+{
+  static inline bool ok(int ia) { return true; }
+  static inline _LICE_vec op(_LICE_vec d, _LICE_vec s, int ia)
+  {
+    return vreinterpretq_u32_u8(vhaddq_u8(vreinterpretq_u8_u32(d),vreinterpretq_u8_u32(s)));
+  }
+};
+
+struct _LICE_CombineVecFAST_HalfMix { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { const uint32x4_t m = vdupq_n_u32(0x7f7f7f7f); return vaddq_u32(vandq_u32(vshrq_n_u32(d,1),m),vandq_u32(vshrq_n_u32(s,1),m)); } };
+struct _LICE_CombineVecFAST_HalfMix2 { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { return vaddq_u32(vandq_u32(vshrq_n_u32(d,1),vdupq_n_u32(0x7f7f7f7f)),s); } };
+struct _LICE_CombineVecFAST_QuarterMix2 { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { return vaddq_u32(vaddq_u32(vandq_u32(vshrq_n_u32(d,1),vdupq_n_u32(0x7f7f7f7f)),vandq_u32(vshrq_n_u32(d,2),vdupq_n_u32(0x3f3f3f3f))),s); } };
+struct _LICE_CombineVecFAST_ThreeQuarterMix2 { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s)
+  { return vaddq_u32(vandq_u32(vshrq_n_u32(d,2),vdupq_n_u32(0x3f3f3f3f)),s); } };
+
+#endif
+
+template<class COMBFUNC, class VOP> class _LICE_CombineSpanVec
+{
+public:
+  static inline void blitRow(LICE_pixel_chan *pout, const LICE_pixel_chan *pin, int n, int ia)
+  {
+    // an in-place blit overlapping within the row must see what the scalar loop would already have written
+    if (n >= 4 && VOP::ok(ia) && (LICE_SIMD_GetCaps()&_LICE_VEC_CAPS) && (pout <= pin || pout >= pin + n*sizeof(LICE_pixel)))
+    {
+      const int nv = n&~3;
+      int x;
+      for (x=0;x<nv;x+=4)
+      {
+        _LICE_vec_store(pout,VOP::op(_LICE_vec_load(pout),_LICE_vec_load(pin),ia));
+        pin += 4*sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+        pout += 4*sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+      }
+      n -= nv;
+    }
+    _LICE_CombineSpanScalar<COMBFUNC>::blitRow(pout,pin,n,ia);
+  }
+  static inline void solidRow(LICE_pixel_chan *pout, int n, int r, int g, int b, int a, int ia)
+  {
+    // out of range colors are only handled (clamped or wrapped) by the scalar code
+    if (n >= 4 && VOP::ok(ia) && !((r|g|b|a)&~0xff) && (LICE_SIMD_GetCaps()&_LICE_VEC_CAPS))
+    {
+      const _LICE_vec s = _LICE_vec_splat(LICE_RGBA(r,g,b,a));
+      const int nv = n&~3;
+      int x;
+      for (x=0;x<nv;x+=4)
+      {
+        _LICE_vec_store(pout,VOP::op(_LICE_vec_load(pout),s,ia));
+        pout += 4*sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+      }
+      n -= nv;
+    }
+    _LICE_CombineSpanScalar<COMBFUNC>::solidRow(pout,n,r,g,b,a,ia);
+  }
+};
+
+template<class COMBFUNC, class VOP> class _LICE_CombineSpanVecFAST
+{
+public:
+  static inline void blitRow(LICE_pixel *pout, const LICE_pixel *pin, int n)
+  {
+    if (n >= 4 && (LICE_SIMD_GetCaps()&_LICE_VEC_CAPS) && (pout <= pin || pout >= pin + n))
+    {
+      const int nv = n&~3;
+      int x;
+      for (x=0;x<nv;x+=4) _LICE_vec_store(pout+x,VOP::op(_LICE_vec_load(pout+x),_LICE_vec_load(pin+x)));
+      pout += nv;
+      pin += nv;
+      n -= nv;
+    }
+    _LICE_CombineSpanScalarFAST<COMBFUNC>::blitRow(pout,pin,n);
+  }
+  static inline void solidRow(LICE_pixel *pout, int n, LICE_pixel color)
+  {
+    if (n >= 4 && (LICE_SIMD_GetCaps()&_LICE_VEC_CAPS))
+    {
+      const _LICE_vec s = _LICE_vec_splat(color);
+      const int nv = n&~3;
+      int x;
+      for (x=0;x<nv;x+=4) _LICE_vec_store(pout+x,VOP::op(_LICE_vec_load(pout+x),s));
+      pout += nv;
+      n -= nv;
+    }
+    _LICE_CombineSpanScalarFAST<COMBFUNC>::solidRow(pout,n,color);
+  }
+};
+
+struct _LICE_CombineVecFAST_Clobber { static inline _LICE_vec op(_LICE_vec d, _LICE_vec s) { return s; } };
+
+#define _LICE_COMBINE_SPAN(comb, vop) template<> class _LICE_CombineSpan<comb> : public _LICE_CombineSpanVec<comb, vop> { };
+#define _LICE_COMBINE_SPAN_FAST(comb, vop) template<> class _LICE_CombineSpanFAST<comb> : public _LICE_CombineSpanVecFAST<comb, vop> { };
+
+// the clamped variants give the same results for 0..255 input, which is all the vector code accepts
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsCopyNoClamp, _LICE_CombineVec_Copy)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsCopyClamp, _LICE_CombineVec_Copy)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsCopySourceAlphaNoClamp, _LICE_CombineVec_SourceAlpha)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsCopySourceAlphaClamp, _LICE_CombineVec_SourceAlpha)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParmNoClamp, _LICE_CombineVec_SourceAlphaIgnoreAlphaParm)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParmClamp, _LICE_CombineVec_SourceAlphaIgnoreAlphaParm)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsHalfMixNoClamp, _LICE_CombineVec_HalfMix)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsHalfMixClamp, _LICE_CombineVec_HalfMix)
+#ifndef LICE_DISABLE_BLEND_ADD
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsAdd, _LICE_CombineVec_Add)
+#endif
+#ifndef LICE_DISABLE_BLEND_MUL
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsMulNoClamp, _LICE_CombineVec_Mul)
+_LICE_COMBINE_SPAN(_LICE_CombinePixelsMulClamp, _LICE_CombineVec_Mul)
+#endif
+
+_LICE_COMBINE_SPAN_FAST(_LICE_CombinePixelsClobberFAST, _LICE_CombineVecFAST_Clobber)
+_LICE_COMBINE_SPAN_FAST(_LICE_CombinePixelsHalfMixFAST, _LICE_CombineVecFAST_HalfMix)
+_LICE_COMBINE_SPAN_FAST(_LICE_CombinePixelsHalfMix2FAST, _LICE_CombineVecFAST_HalfMix2)
+_LICE_COMBINE_SPAN_FAST(_LICE_CombinePixelsQuarterMix2FAST, _LICE_CombineVecFAST_QuarterMix2)
+_LICE_COMBINE_SPAN_FAST(_LICE_CombinePixelsThreeQuarterMix2FAST, _LICE_CombineVecFAST_ThreeQuarterMix2)
+
+#undef _LICE_COMBINE_SPAN
+#undef _LICE_COMBINE_SPAN_FAST
+
+#endif // SIMD combine
+
 // note: the "clamp" parameter would generally be false, unless you're working with
 // input colors that need to be clamped (i.e. if you have a r value of >255 or <0, etc.
 // if your input is LICE_pixel only then use false, and it will clamp as needed depending 
@@ -13,7 +13,6 @@
 extern "C" {
 
 #include "../giflib/gif_lib.h"
-int _GifError;
 };
 
 static void applyGifFrameToBitmap(LICE_IBitmap *bmp, GifFileType *fp, int transparent_pix, bool clear)
@@ -6,6 +6,7 @@
 */
 
 #include "lice.h"
+#include "lice_simd.h"
 
 #include <stdio.h>
 
@@ -15,10 +16,25 @@
 extern "C" {
 
 #include "../giflib/gif_lib.h"
-//int _GifError;
 };
 
 
+struct liceGifDither
+{
+  int mode; // LICE_GIF_DITHER_* for the current frame
+  int x0, y0; // frame position on the canvas
+  int *err; // LICE_GIF_DITHER_FLOYD: error diffused into the current and next line, r,g,b per pixel, 1/16 units
+  int err_alloc;
+  LICE_pixel *line; // LICE_GIF_DITHER_ORDERED: the current line with the pattern applied
+  int line_alloc;
+
+  // dithered colors are often not in the octree, which only finds the colors it was built from. 
+  // nearest palette entry+1 for each 15 bit color, 0 if not searched yet, valid for nearest_gen
+  unsigned short *nearest;
+  const struct liceGifWriteRec *nearest_src;
+  int nearest_gen;
+};
+
 struct liceGifWriteRec
 {
   GifFileType *f;
@@ -28,24 +44,40 @@ struct liceGifWriteRec
   LICE_IBitmap *prevframe; // used when multiframe, transalpha<0
   void *last_octree;
   LICE_pixel last_palette[256];
+  int last_palette_sz, last_palette_gen;
   unsigned char from15to8bit[32][32][32];//r,g,b
+  unsigned int from15to8valid[32*32*32/32]; // bit per from15to8bit entry, set once it has been looked up in last_octree
 
   int transalpha;
   int w,h;
+  int dither; // LICE_GIF_DITHER_*
+  liceGifDither dither_state;
+  int lossy; // LZW tolerance, 0 for lossless
   bool append;
-  bool dither;
   bool has_had_frame;
   bool has_global_cmap; 
 
-  bool has_from15to8bit; // set when last_octree has been generated into from15to8bit
+  bool has_from15to8bit; // set when from15to8bit maps to the current palette (entries are filled on first use)
+  bool from15to8bit_full; // every entry of from15to8bit is valid, the table is read-only and can be shared by threads
 };
 
+static GifPixelType QuantPixelFill(liceGifWriteRec *wr, int r, int g, int b)
+{
+  const int idx = (r<<10)|(g<<5)|b;
+  wr->from15to8valid[idx>>5] |= 1u<<(idx&31);
+  return wr->from15to8bit[r][g][b] = LICE_FindInOctree(wr->last_octree, LICE_RGBA(r<<3,g<<3,b<<3,0));
+}
+
 static inline GifPixelType QuantPixel(LICE_pixel p, liceGifWriteRec *wr)
 {
-  return wr->from15to8bit[LICE_GETR(p)>>3][LICE_GETG(p)>>3][LICE_GETB(p)>>3];
+  const int r = LICE_GETR(p)>>3, g = LICE_GETG(p)>>3, b = LICE_GETB(p)>>3, idx = (r<<10)|(g<<5)|b;
+  if (WDL_unlikely(!(wr->from15to8valid[idx>>5] & (1u<<(idx&31))))) return QuantPixelFill(wr,r,g,b);
+  return wr->from15to8bit[r][g][b];
 }
 
-static int generate_palette_from_octree(void *ww, void *octree, int numcolors)
+// global is false for a per-image palette, has_global_cmap is only ever set (never toggled) so that
+// LICE_WriteGIFPrepareFrame() on other threads can read it
+static int generate_palette_from_octree(void *ww, void *octree, int numcolors, bool global)
 {
   liceGifWriteRec  *wr = (liceGifWriteRec *)ww;
   if (!octree||!ww||numcolors>256) return 0;
@@ -73,17 +105,30 @@ static int generate_palette_from_octree(void *ww, void *octree, int numcolors)
     }
   }
 
+  wr->last_palette_sz = palette_sz;
+  wr->last_palette_gen++;
   wr->has_from15to8bit = false;
-  wr->has_global_cmap=true;
+  wr->from15to8bit_full = false;
+  if (global) wr->has_global_cmap=true;
 
   return palette_sz;
 }
 
-static void generate15to8(void *ww, void *octree)
+// a per-frame palette only needs the entries for the colors the frame has, so unless full is set the 
+// table starts empty and QuantPixel() looks up entries in last_octree as they are used
+static void generate15to8(void *ww, void *octree, bool full)
 {
   liceGifWriteRec  *wr = (liceGifWriteRec *)ww;
   if (!octree||!ww) return;
 
+  wr->has_from15to8bit=true;
+  if (!full && octree == wr->last_octree)
+  {
+    wr->from15to8bit_full=false;
+    memset(wr->from15to8valid,0,sizeof(wr->from15to8valid));
+    return;
+  }
+
   // map palette to 16 bit
   unsigned char r,g,b;
   for(r=0;r<32;r++)  
@@ -100,16 +145,344 @@ static void generate15to8(void *ww, void *octree)
       }
     }
   }
-  wr->has_from15to8bit=true;
+  memset(wr->from15to8valid,0xff,sizeof(wr->from15to8valid));
+  wr->from15to8bit_full=true;
 }
 
 int LICE_SetGIFColorMapFromOctree(void *ww, void *octree, int numcolors)
 {
-  const int rv = generate_palette_from_octree(ww,octree,numcolors);
-  generate15to8(ww,octree);
+  const int rv = generate_palette_from_octree(ww,octree,numcolors,true);
+  generate15to8(ww,octree,true);
+  return rv;
+}
+
+int LICE_SetGIFColorMapFromHistogram(void *ww, void *hist)
+{
+  liceGifWriteRec *wr = (liceGifWriteRec *)ww;
+  if (!wr || !hist || wr->has_had_frame) return 0;
+
+  const int ccnt = 256 - (wr->transalpha?1:0);
+  void* octree = wr->last_octree;
+  if (!octree) wr->last_octree = octree = LICE_CreateOctree(ccnt,LICE_OCTREE_FLAG_POOL);
+  else LICE_ResetOctree(octree,ccnt);
+  if (!octree) return 0;
+
+  LICE_BuildOctreeFromHistogram(octree, hist);
+  const int rv = LICE_SetGIFColorMapFromOctree(wr, octree, ccnt);
+  int pcnt = rv;
+  if (pcnt < 256 && wr->transalpha) pcnt++;
+  int nb = 1;
+  while (nb < 8 && (1<<nb) < pcnt) nb++;
+  wr->cmap->ColorCount = 1<<nb;
+  wr->cmap->BitsPerPixel=nb;
   return rv;
 }
 
+// graphic control extension, looping extension (first frame only) and image descriptor. cmap=NULL uses the global colormap
+static void write_frame_header(liceGifWriteRec *wr, ColorMapObject *cmap, int xpos, int ypos, int usew, int useh, 
+                               int frame_delay, int nreps, bool isFirst, unsigned char transparent_pix)
+{
+  unsigned char gce[4] = { 0, };
+  if (wr->transalpha)
+  {
+    gce[0] |= 1;
+    gce[3] = transparent_pix;
+  }
+
+  int a = frame_delay/10;
+  if(a<1&&frame_delay)a=1;
+  else if (a>60000) a=60000;
+  gce[1]=(a)&255;
+  gce[2]=(a)>>8;
+
+  if (isFirst && frame_delay && nreps!=1 && !wr->append)
+  {
+    int nr = nreps > 1 && nreps <= 65536 ? nreps-1 : 0;
+    unsigned char ext[]={0xB, 'N','E','T','S','C','A','P','E','2','.','0',3,1,(unsigned char) (nr&0xff), (unsigned char) ((nr>>8)&0xff)};
+    EGifPutExtension(wr->f,0xFF, sizeof(ext),ext);
+  }
+
+  if (gce[0]||gce[1]||gce[2])
+    EGifPutExtension(wr->f, 0xF9, sizeof(gce), gce);
+
+  if (wr->lossy) EGifSetLossy(wr->f, wr->lossy, wr->transalpha ? transparent_pix : -1);
+  EGifPutImageDesc(wr->f, xpos, ypos, usew,useh, 0, cmap); 
+}
+
+static void dither_begin(liceGifDither *d, const liceGifWriteRec *src, int mode, int xpos, int ypos, int usew)
+{
+  d->x0 = xpos;
+  d->y0 = ypos;
+  if (mode != LICE_GIF_DITHER_NONE)
+  {
+    if (!d->nearest) d->nearest = (unsigned short *)malloc(32768*sizeof(unsigned short));
+    if (!d->nearest) mode = LICE_GIF_DITHER_NONE;
+    else if (d->nearest_src != src || d->nearest_gen != src->last_palette_gen)
+    {
+      memset(d->nearest,0,32768*sizeof(unsigned short));
+      d->nearest_src = src;
+      d->nearest_gen = src->last_palette_gen;
+    }
+  }
+  if (mode == LICE_GIF_DITHER_FLOYD)
+  {
+    const int sz = (usew+2)*3*2; // one pixel of padding on either side
+    if (d->err_alloc < sz)
+    {
+      free(d->err);
+      d->err = (int *)malloc(sz*sizeof(int));
+      d->err_alloc = d->err ? sz : 0;
+    }
+    if (d->err) memset(d->err,0,sz*sizeof(int));
+    else mode = LICE_GIF_DITHER_NONE;
+  }
+  else if (mode == LICE_GIF_DITHER_ORDERED)
+  {
+    if (d->line_alloc < usew)
+    {
+      free(d->line);
+      d->line = (LICE_pixel *)malloc(usew*sizeof(LICE_pixel));
+      d->line_alloc = d->line ? usew : 0;
+    }
+    if (!d->line) mode = LICE_GIF_DITHER_NONE;
+  }
+  else mode = LICE_GIF_DITHER_NONE;
+  d->mode = mode;
+}
+
+static void dither_free(liceGifDither *d)
+{
+  free(d->err);
+  free(d->line);
+  free(d->nearest);
+  memset(d,0,sizeof(*d));
+}
+
+static const unsigned char s_bayer8[8][8] =
+{
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+// adds the Bayer pattern (-16..+15, same for r,g,b, saturated) to line y of the frame, alpha is kept
+static void dither_ordered_line(const liceGifDither *d, const LICE_pixel *in, LICE_pixel *out, int usew, int y)
+{
+  LICE_pixel add[8], sub[8];
+  const unsigned char *row = s_bayer8[(d->y0+y)&7];
+  int x;
+  for (x=0;x<8;x++)
+  {
+    const int v = (row[(d->x0+x)&7]>>1) - 16;
+    add[x] = v > 0 ? LICE_RGBA(v,v,v,0) : 0;
+    sub[x] = v < 0 ? LICE_RGBA(-v,-v,-v,0) : 0;
+  }
+
+  x=0;
+#ifdef LICE_SIMD_HAVE_SSE2
+  if (LICE_SIMD_GetCaps()&LICE_SIMD_SSE2)
+  {
+    const __m128i a0 = _mm_loadu_si128((const __m128i*)add), a1 = _mm_loadu_si128((const __m128i*)(add+4));
+    const __m128i s0 = _mm_loadu_si128((const __m128i*)sub), s1 = _mm_loadu_si128((const __m128i*)(sub+4));
+    for (;x<=usew-8;x+=8)
+    {
+      const __m128i p0 = _mm_loadu_si128((const __m128i*)(in+x)), p1 = _mm_loadu_si128((const __m128i*)(in+x+4));
+      _mm_storeu_si128((__m128i*)(out+x),_mm_subs_epu8(_mm_adds_epu8(p0,a0),s0));
+      _mm_storeu_si128((__m128i*)(out+x+4),_mm_subs_epu8(_mm_adds_epu8(p1,a1),s1));
+    }
+  }
+#elif defined(LICE_SIMD_HAVE_NEON)
+  if (LICE_SIMD_GetCaps()&LICE_SIMD_NEON)
+  {
+    const uint8x16_t a0 = vld1q_u8((const uint8_t*)add), a1 = vld1q_u8((const uint8_t*)(add+4));
+    const uint8x16_t s0 = vld1q_u8((const uint8_t*)sub), s1 = vld1q_u8((const uint8_t*)(sub+4));
+    for (;x<=usew-8;x+=8)
+    {
+      const uint8x16_t p0 = vld1q_u8((const uint8_t*)(in+x)), p1 = vld1q_u8((const uint8_t*)(in+x+4));
+      vst1q_u8((uint8_t*)(out+x),vqsubq_u8(vqaddq_u8(p0,a0),s0));
+      vst1q_u8((uint8_t*)(out+x+4),vqsubq_u8(vqaddq_u8(p1,a1),s1));
+    }
+  }
+#endif
+  for (;x<usew;x++)
+  {
+    const LICE_pixel p = in[x], a = add[x&7], s = sub[x&7];
+    int r = LICE_GETR(p) + LICE_GETR(a), g = LICE_GETG(p) + LICE_GETG(a), b = LICE_GETB(p) + LICE_GETB(a);
+    r = wdl_min(r,255) - LICE_GETR(s);
+    g = wdl_min(g,255) - LICE_GETG(s);
+    b = wdl_min(b,255) - LICE_GETB(s);
+    out[x] = LICE_RGBA(wdl_max(r,0),wdl_max(g,0),wdl_max(b,0),LICE_GETA(p));
+  }
+}
+
+static inline int dither_clamp(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+static inline int dither_dist(LICE_pixel a, LICE_pixel b)
+{
+  const int dr = LICE_GETR(a)-LICE_GETR(b), dg = LICE_GETG(a)-LICE_GETG(b), db = LICE_GETB(a)-LICE_GETB(b);
+  return dr*dr + dg*dg + db*db;
+}
+
+static GifPixelType dither_find(liceGifDither *d, liceGifWriteRec *wr, void *use_octree, LICE_pixel p)
+{
+  const int cell = ((LICE_GETR(p)>>3)<<10) | ((LICE_GETG(p)>>3)<<5) | (LICE_GETB(p)>>3);
+  int n = d->nearest[cell];
+  if (!n)
+  {
+    // exhaustive search from the center of the cell
+    const LICE_pixel c = LICE_RGBA((cell>>7)|4, ((cell>>2)&0xf8)|4, ((cell<<3)&0xf8)|4, 0);
+    int i, bestd = 0x7fffffff;
+    n = 1;
+    for (i = 0; i < wr->last_palette_sz; i ++)
+    {
+      const int dd = dither_dist(c,wr->last_palette[i]);
+      if (dd < bestd) { bestd = dd; n = i+1; }
+    }
+    d->nearest[cell] = n;
+  }
+
+  // colors that are in the octree map exactly (the cell may contain more than one palette entry)
+  const GifPixelType t = use_octree ? LICE_FindInOctree(use_octree,p) : QuantPixel(p,wr);
+  if (t != n-1 && (int)t < wr->last_palette_sz && dither_dist(p,wr->last_palette[t]) <= dither_dist(p,wr->last_palette[n-1])) return t;
+  return n-1;
+}
+
+// quantizes a line one pixel at a time with the current dither mode (serpentine for LICE_GIF_DITHER_FLOYD).
+// if prev is set (transalpha<0), pixels that match prev are transparent (or an exact color, with pix_stats),
+// otherwise pixels below the alpha threshold are. transparent pixels don't pass on any error.
+static void dither_line(liceGifWriteRec *wr, liceGifDither *d, const LICE_pixel *in, const LICE_pixel *prev, 
+                        LICE_pixel trans_mask, int *pix_stats, GifPixelType *linebuf, int usew, int y, 
+                        void *use_octree, unsigned char transparent_pix)
+{
+  const bool fs = d->mode == LICE_GIF_DITHER_FLOYD;
+  int *cur=NULL, *nxt=NULL;
+  int x=0, dir=1;
+  if (fs)
+  {
+    const int n = (usew+2)*3;
+    cur = d->err + ((y&1) ? n : 0) + 3;
+    nxt = d->err + ((y&1) ? 0 : n) + 3;
+    memset(nxt-3,0,n*sizeof(int));
+    if (y&1) { x=usew-1; dir=-1; }
+  }
+  else
+  {
+    dither_ordered_line(d,in,d->line,usew,y);
+  }
+
+  const LICE_pixel al = wr->transalpha>0 ? (wr->transalpha&0xff) : 0;
+  const LICE_pixel out_mask = prev ? trans_mask : LICE_RGBA(255,255,255,255);
+  LICE_pixel last_exact=0;
+  int last_exact_idx=-1, cnt;
+  for (cnt=usew; cnt--; x+=dir)
+  {
+    const LICE_pixel s = in[x];
+    if (prev ? (s&trans_mask) == (prev[x]&trans_mask) : LICE_GETA(s) < al)
+    {
+      GifPixelType idx = transparent_pix;
+      if (pix_stats)
+      {
+        const LICE_pixel sm = s&trans_mask;
+        const GifPixelType np = use_octree ? LICE_FindInOctree(use_octree,sm) : QuantPixel(sm,wr);
+        if (sm == (wr->last_palette[np]&trans_mask) && pix_stats[transparent_pix] <= pix_stats[np]) idx = np;
+        pix_stats[idx]++;
+      }
+      linebuf[x] = idx;
+      continue;
+    }
+
+    // colors that the palette has (within rounding) are not dithered, so flat areas and text stay clean 
+    // and compress as well as without dithering. they don't pass on any error either.
+    const LICE_pixel sm = s&out_mask;
+    if (last_exact_idx < 0 || sm != last_exact)
+    {
+      const GifPixelType t = use_octree ? LICE_FindInOctree(use_octree,sm) : QuantPixel(sm,wr);
+      last_exact = sm;
+      last_exact_idx = (int)t < wr->last_palette_sz && dither_dist(sm,wr->last_palette[t]) < 16 ? t : -1;
+    }
+    if (last_exact_idx >= 0)
+    {
+      linebuf[x] = (GifPixelType)last_exact_idx;
+      if (pix_stats) pix_stats[last_exact_idx]++;
+      continue;
+    }
+
+    LICE_pixel p;
+    if (fs)
+    {
+      const int *e = cur + x*3;
+      p = LICE_RGBA(dither_clamp(LICE_GETR(s) + ((e[0]+8)>>4)),
+                    dither_clamp(LICE_GETG(s) + ((e[1]+8)>>4)),
+                    dither_clamp(LICE_GETB(s) + ((e[2]+8)>>4)),
+                    LICE_GETA(s)) & out_mask;
+    }
+    else p = d->line[x] & out_mask;
+
+    const GifPixelType idx = dither_find(d,wr,use_octree,p);
+    linebuf[x] = idx;
+    if (pix_stats) pix_stats[idx]++;
+
+    if (fs)
+    {
+      const LICE_pixel c = wr->last_palette[idx];
+      const int er = LICE_GETR(p) - LICE_GETR(c), eg = LICE_GETG(p) - LICE_GETG(c), eb = LICE_GETB(p) - LICE_GETB(c);
+      int *e = cur + (x+dir)*3;
+      e[0] += er*7; e[1] += eg*7; e[2] += eb*7;
+      e = nxt + (x-dir)*3;
+      e[0] += er*3; e[1] += eg*3; e[2] += eb*3;
+      e = nxt + x*3;
+      e[0] += er*5; e[1] += eg*5; e[2] += eb*5;
+      e = nxt + (x+dir)*3;
+      e[0] += er; e[1] += eg; e[2] += eb;
+    }
+  }
+}
+
+// quantizes a line when there's no previous frame involved (transalpha >= 0)
+static void quantize_line(liceGifWriteRec *wr, liceGifDither *d, const LICE_pixel *in, GifPixelType *linebuf, int usew, 
+                          int y, void *use_octree, unsigned char transparent_pix)
+{
+  if (d->mode != LICE_GIF_DITHER_NONE)
+  {
+    dither_line(wr,d,in,NULL,0,NULL,linebuf,usew,y,use_octree,transparent_pix);
+    return;
+  }
+
+  int x;
+  if (wr->transalpha>0)
+  {
+    const int al = wr->transalpha&0xff;
+    if (use_octree) for(x=0;x<usew;x++)
+    {
+      const LICE_pixel p = in[x];
+      if (LICE_GETA(p)<al) linebuf[x]=transparent_pix;
+      else linebuf[x] = LICE_FindInOctree(use_octree,p);
+    }
+    else for(x=0;x<usew;x++)
+    {
+      const LICE_pixel p = in[x];
+      if (LICE_GETA(p)<al) linebuf[x]=transparent_pix;
+      else linebuf[x] = QuantPixel(p,wr);
+    }
+  }
+  else
+  {
+    if (use_octree) for(x=0;x<usew;x++) linebuf[x] = LICE_FindInOctree(use_octree,in[x]);
+    else for(x=0;x<usew;x++) linebuf[x] = QuantPixel(in[x],wr);
+  }
+}
+
+void LICE_WriteGIFSetDither(void *handle, int mode)
+{
+  liceGifWriteRec *wr = (liceGifWriteRec*)handle;
+  if (wr) wr->dither = mode;
+}
+
 unsigned int LICE_WriteGIFGetSize(void *handle)
 {
   if (handle)
@@ -135,14 +508,13 @@ bool LICE_WriteGIFFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, b
     {
       const int ccnt = 256 - (wr->transalpha?1:0);
       void* octree = wr->last_octree;
-      if (!octree) wr->last_octree = octree = LICE_CreateOctree(ccnt);
+      if (!octree) wr->last_octree = octree = LICE_CreateOctree(ccnt,LICE_OCTREE_FLAG_POOL);
       else LICE_ResetOctree(octree,ccnt);
 
       if (octree) 
       {
         LICE_BuildOctree(octree, frame);
-        // sets has_global_cmap
-        int pcnt = generate_palette_from_octree(wr, octree, ccnt);
+        int pcnt = generate_palette_from_octree(wr, octree, ccnt, true);
 
         if (pcnt < 256 && wr->transalpha) pcnt++;
         int nb = 1;
@@ -171,7 +543,7 @@ bool LICE_WriteGIFFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, b
   {
     const int ccnt = 256 - (wr->transalpha?1:0);
     void* octree = wr->last_octree;
-    if (!octree) wr->last_octree = octree = LICE_CreateOctree(ccnt);
+    if (!octree) wr->last_octree = octree = LICE_CreateOctree(ccnt,LICE_OCTREE_FLAG_POOL);
     else LICE_ResetOctree(octree,ccnt);
     if (octree) 
     {
@@ -186,10 +558,8 @@ bool LICE_WriteGIFFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, b
       else
         LICE_BuildOctree(octree, frame);
 
-        // sets has_global_cmap (clear below)
-      int pcnt = generate_palette_from_octree(wr, octree, ccnt);
+      int pcnt = generate_palette_from_octree(wr, octree, ccnt, false);
 
-      wr->has_global_cmap=false;
       if (pcnt < 256 && wr->transalpha) pcnt++;
       int nb = 1;
       while (nb < 8 && (1<<nb) < pcnt) nb++;
@@ -200,40 +570,18 @@ bool LICE_WriteGIFFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, b
 
   if (!wr->has_from15to8bit && pixcnt > 40000 && wr->last_octree)
   {
-    generate15to8(wr,wr->last_octree);
+    // a global colormap is used by every frame (and by LICE_WriteGIFPrepareFrame() on other threads)
+    generate15to8(wr,wr->last_octree,wr->has_global_cmap);
   }
 
   const unsigned char transparent_pix = wr->cmap->ColorCount-1;
-  unsigned char gce[4] = { 0, };
-  if (wr->transalpha)
-  {
-    gce[0] |= 1;
-    gce[3] = transparent_pix;
-  }
-
-  int a = frame_delay/10;
-  if(a<1&&frame_delay)a=1;
-  else if (a>60000) a=60000;
-  gce[1]=(a)&255;
-  gce[2]=(a)>>8;
-
-  if (isFirst && frame_delay && nreps!=1 && !wr->append)
-  {
-    int nr = nreps > 1 && nreps <= 65536 ? nreps-1 : 0;
-    unsigned char ext[]={0xB, 'N','E','T','S','C','A','P','E','2','.','0',3,1,(unsigned char) (nr&0xff), (unsigned char) ((nr>>8)&0xff)};
-    EGifPutExtension(wr->f,0xFF, sizeof(ext),ext);
-  }
-
-  if (gce[0]||gce[1]||gce[2])
-    EGifPutExtension(wr->f, 0xF9, sizeof(gce), gce);
-
-
-  EGifPutImageDesc(wr->f, xpos, ypos, usew,useh, 0, wr->has_global_cmap ? NULL : wr->cmap); 
+  write_frame_header(wr, wr->has_global_cmap ? NULL : wr->cmap, xpos, ypos, usew, useh, frame_delay, nreps, isFirst, transparent_pix);
 
   GifPixelType *linebuf = wr->linebuf;
   int y;
 
   void *use_octree = wr->has_from15to8bit ? NULL : wr->last_octree;
+  dither_begin(&wr->dither_state, wr, wr->dither, xpos, ypos, usew);
 
   if ((!isFirst || frame_delay) && wr->transalpha<0)
   {
@@ -263,7 +611,12 @@ bool LICE_WriteGIFFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, b
       const LICE_pixel *in2 = tmp.getBits() + rdy2*tmp.getRowSpan();
       int x;
 
-      if (advanced_trans_stats)
+      if (wr->dither_state.mode != LICE_GIF_DITHER_NONE)
+      {
+        dither_line(wr, &wr->dither_state, in, ignFr ? NULL : in2, trans_mask, advanced_trans_stats ? pix_stats : NULL,
+                    linebuf, usew, y, use_octree, transparent_pix);
+      }
+      else if (advanced_trans_stats)
       {
         if (use_octree) for(x=0;x<usew;x++)
         {
@@ -338,50 +691,157 @@ bool LICE_WriteGIFFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, b
     LICE_Blit(&tmp,frame,0,0,0,0,usew,useh,1.0f,LICE_BLIT_MODE_COPY);
     
   }
-  else if (wr->transalpha>0)
-  {
-    const int al = wr->transalpha&0xff;
-    for(y=0;y<useh;y++)
-    {
-      int rdy=y;
-      if (frame->isFlipped()) rdy = frame->getHeight()-1-y;
-      const LICE_pixel *in = frame->getBits() + rdy*frame->getRowSpan();
-      int x;
-      if (use_octree) for(x=0;x<usew;x++)
-      {
-        const LICE_pixel p = in[x];
-        if (LICE_GETA(p)<al) linebuf[x]=transparent_pix;
-        else linebuf[x] = LICE_FindInOctree(use_octree,p);
-      }
-      else for(x=0;x<usew;x++)
-      {
-        const LICE_pixel p = in[x];
-        if (LICE_GETA(p)<al) linebuf[x]=transparent_pix;
-        else linebuf[x] = QuantPixel(p,wr);
-      }
-      EGifPutLine(wr->f, linebuf, usew);
-    }
-  }
   else for(y=0;y<useh;y++)
   {
     int rdy=y;
     if (frame->isFlipped()) rdy = frame->getHeight()-1-y;
-    const LICE_pixel *in = frame->getBits() + rdy*frame->getRowSpan();
-    int x;
-    if (use_octree) for(x=0;x<usew;x++) linebuf[x] = LICE_FindInOctree(use_octree,in[x]);
-    else for(x=0;x<usew;x++) linebuf[x] = QuantPixel(in[x],wr);
+    quantize_line(wr, &wr->dither_state, frame->getBits() + rdy*frame->getRowSpan(), linebuf, usew, y, use_octree, transparent_pix);
     EGifPutLine(wr->f, linebuf, usew);
   }
 
   return true;
 }
 
+
+struct liceGifPreparedFrame
+{
+  liceGifWriteRec q; // per-image palette state, only cmap, last_octree, last_palette, from15to8bit/valid, transalpha, dither_state and has_* are used
+  GifPixelType *pix;
+  int pix_alloc;
+  int xpos, ypos, w, h;
+  bool own_cmap; // false if the writer's global colormap is used
+};
+
+void *LICE_WriteGIFPrepareFrame(void *handle, LICE_IBitmap *frame, int xpos, int ypos, bool perImageColorMap, void *reuse)
+{
+  liceGifWriteRec *wr = (liceGifWriteRec*)handle;
+  liceGifPreparedFrame *pf = (liceGifPreparedFrame *)reuse;
+  if (!wr || !frame) return NULL;
+
+  // inter-frame transparency needs the previous frame, and the first frame may define the global colormap
+  if (wr->transalpha < 0 || (!perImageColorMap && !wr->has_global_cmap)) return NULL;
+
+  int usew=frame->getWidth(), useh=frame->getHeight();
+  if (xpos+usew > wr->w) usew = wr->w-xpos;
+  if (ypos+useh > wr->h) useh = wr->h-ypos;
+  if (usew<1||useh<1) return NULL;
+
+  int pixcnt=usew*useh;
+  liceGifWriteRec *src = wr;
+  const bool own_cmap = !wr->has_global_cmap;
+  if (!own_cmap && !wr->from15to8bit_full && (pixcnt > 40000 || !wr->last_octree || wr->has_from15to8bit)) return NULL; // would modify the writer's tables
+
+  if (!pf)
+  {
+    pf = (liceGifPreparedFrame *)calloc(sizeof(liceGifPreparedFrame),1);
+    if (!pf) return NULL;
+    pf->q.cmap = (ColorMapObject*)calloc(sizeof(ColorMapObject)+256*sizeof(GifColorType),1);
+    if (!pf->q.cmap) { free(pf); return NULL; }
+    pf->q.cmap->Colors = (GifColorType*)(pf->q.cmap+1);
+  }
+  if (pf->pix_alloc < pixcnt)
+  {
+    free(pf->pix);
+    pf->pix = (GifPixelType *)malloc(pixcnt*sizeof(GifPixelType));
+    pf->pix_alloc = pf->pix ? pixcnt : 0;
+    if (!pf->pix) { if (pf != reuse) LICE_WriteGIFFreePreparedFrame(pf); return NULL; }
+  }
+  pf->xpos=xpos;
+  pf->ypos=ypos;
+  pf->w=usew;
+  pf->h=useh;
+  pf->own_cmap = own_cmap;
+
+  if (own_cmap)
+  {
+    // same as LICE_WriteGIFFrame() with perImageColorMap
+    src = &pf->q;
+    src->transalpha = wr->transalpha;
+    const int ccnt = 256 - (src->transalpha?1:0);
+    void* octree = src->last_octree;
+    if (!octree) src->last_octree = octree = LICE_CreateOctree(ccnt,LICE_OCTREE_FLAG_POOL);
+    else LICE_ResetOctree(octree,ccnt);
+    if (!octree) { if (pf != reuse) LICE_WriteGIFFreePreparedFrame(pf); return NULL; }
+
+    if (src->transalpha>0)
+      pixcnt=LICE_BuildOctreeForAlpha(octree, frame,src->transalpha&0xff);
+    else
+      LICE_BuildOctree(octree, frame);
+
+    int pcnt = generate_palette_from_octree(src, octree, ccnt, false);
+    if (pcnt < 256 && src->transalpha) pcnt++;
+    int nb = 1;
+    while (nb < 8 && (1<<nb) < pcnt) nb++;
+    src->cmap->ColorCount = 1<<nb;
+    src->cmap->BitsPerPixel=nb;
+
+    if (pixcnt > 40000) generate15to8(src,octree,false);
+  }
+
+  void *use_octree = src->has_from15to8bit ? NULL : src->last_octree;
+  const unsigned char transparent_pix = src->cmap->ColorCount-1;
+  liceGifDither *dither = &pf->q.dither_state; // not the writer's, this may run on several threads
+  dither_begin(dither, src, wr->dither, xpos, ypos, usew);
+  int y;
+  for(y=0;y<useh;y++)
+  {
+    int rdy=y;
+    if (frame->isFlipped()) rdy = frame->getHeight()-1-y;
+    quantize_line(src, dither, frame->getBits() + rdy*frame->getRowSpan(), pf->pix + y*usew, usew, y, use_octree, transparent_pix);
+  }
+  return pf;
+}
+
+bool LICE_WriteGIFCanPrepareFrames(void *handle, bool perImageColorMap)
+{
+  liceGifWriteRec *wr = (liceGifWriteRec*)handle;
+  if (!wr || wr->transalpha < 0) return false;
+
+  // a per-image palette only uses the prepared frame's own tables, a global one must be complete: once it is, 
+  // LICE_WriteGIFFrame() no longer changes it
+  if (!wr->has_global_cmap) return perImageColorMap;
+  return wr->from15to8bit_full;
+}
+
+bool LICE_WriteGIFPreparedFrame(void *handle, void *prepared, int frame_delay, int nreps)
+{
+  liceGifWriteRec *wr = (liceGifWriteRec*)handle;
+  liceGifPreparedFrame *pf = (liceGifPreparedFrame *)prepared;
+  if (!wr || !pf || pf->own_cmap == wr->has_global_cmap) return false;
+
+  bool isFirst=false;
+  if (!wr->has_had_frame)
+  {
+    wr->has_had_frame=true;
+    isFirst=true;
+    if (!wr->append) EGifPutScreenDesc(wr->f,wr->w,wr->h,8,0,wr->has_global_cmap ? wr->cmap : 0);
+  }
+
+  ColorMapObject *cmap = pf->own_cmap ? pf->q.cmap : wr->cmap;
+  write_frame_header(wr, pf->own_cmap ? cmap : NULL, pf->xpos, pf->ypos, pf->w, pf->h, frame_delay, nreps, isFirst, cmap->ColorCount-1);
+
+  int y;
+  for (y=0;y<pf->h;y++) EGifPutLine(wr->f, pf->pix + y*pf->w, pf->w);
+  return true;
+}
+
+void LICE_WriteGIFFreePreparedFrame(void *prepared)
+{
+  liceGifPreparedFrame *pf = (liceGifPreparedFrame *)prepared;
+  if (!pf) return;
+  if (pf->q.last_octree) LICE_DestroyOctree(pf->q.last_octree);
+  dither_free(&pf->q.dither_state);
+  free(pf->q.cmap);
+  free(pf->pix);
+  free(pf);
+}
+
 static int writefunc_fh(GifFileType *fh, const GifByteType *buf, int sz) 
 {  
   return ((WDL_FileWrite *)fh->UserData)->Write(buf,sz);
 }
 
-void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transparent_alpha, bool dither, bool is_append)
+void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transparent_alpha, bool dither, bool is_append, int lossy_tolerance)
 {
   WDL_FileWrite *fp = new WDL_FileWrite(filename,1,65536,16,16,is_append);
   if (!fp->IsOpen()) 
@@ -391,21 +851,20 @@ void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transpar
   }
 
 
-  EGifSetGifVersion("89a");
-
-  
   GifFileType *f = EGifOpen(fp,writefunc_fh);
   if (!f) 
   {
     delete fp;
     return NULL;
   }
+  EGifSetGifVersion(f,"89a");
 
   liceGifWriteRec *wr = (liceGifWriteRec*)calloc(sizeof(liceGifWriteRec),1);
   wr->f = f;
   wr->fh = fp;
   wr->append = is_append;
-  wr->dither = dither;
+  wr->dither = dither ? LICE_GIF_DITHER_FLOYD : LICE_GIF_DITHER_NONE;
+  wr->lossy = wdl_max(lossy_tolerance,0);
   wr->w=w;
   wr->h=h;
   wr->cmap = (ColorMapObject*)calloc(sizeof(ColorMapObject)+256*sizeof(GifColorType),1);
@@ -415,6 +874,7 @@ void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transpar
   wr->has_had_frame=false;
   wr->has_global_cmap=false;
   wr->has_from15to8bit=false;
+  wr->from15to8bit_full=false;
   wr->last_octree=NULL;
 
   wr->linebuf = (GifPixelType*)malloc(wr->w*sizeof(GifPixelType));
@@ -442,6 +902,7 @@ bool LICE_WriteGIFEnd(void *handle)
   int ret = EGifCloseFile(wr->f);
 
   free(wr->linebuf);
+  dither_free(&wr->dither_state);
   free(wr->cmap);
   if (wr->last_octree) LICE_DestroyOctree(wr->last_octree);
 
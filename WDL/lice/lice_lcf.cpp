@@ -2,12 +2,20 @@
 #include <stdlib.h>
 
 #include "lice_lcf.h"
+#include "lice_simd.h"
 
 #include "../filewrite.h"
 #include "../fileread.h"
 
 
 #define LCF_VERSION 0x11CEb001
+#define LCF_VERSION2 0x11CEb002 // groups of slices are deflated as independent substreams, sizes follow the frame delays
+
+// table of contents, written after the last block:
+//   LCF_TOC, block count, length (ms), per block: offset (low, high), start time (ms), frame count
+// followed by a 12 byte trailer: TOC offset (low, high), LCF_TOC. 
+// readers that don't know about it stop at the TOC since it doesn't look like a block header.
+#define LCF_TOC 0x11CEb0C0
 
 LICECaptureCompressor::LICECaptureCompressor(const char *outfn, int w, int h, int interval, int bsize_w, int bsize_h)
 {
@@ -40,22 +48,253 @@ LICECaptureCompressor::LICECaptureCompressor(const char *outfn, int w, int h, in
   m_numrows = (m_h+bsize_h-1)/ (bsize_h>0?bsize_h:1);
 
   m_current_block_srcsize=0;
+
+  m_async_max=0;
+  m_async_dropped=m_async_stalled=m_async_dropped_delta=0;
+  m_async_block=m_async_kill=m_async_dropped_full=false;
+  m_toc_length_ms=0;
+  m_toc_first_delay=0;
+
+  m_pool=NULL;
+}
+
+bool LICECaptureCompressor::SetParallel(int nthreads, int ngroups)
+{
+  if (!m_file || m_inframes || m_pool || nthreads<2) return false;
+
+  const int nslices = m_numcols*m_numrows;
+  if (ngroups<1) ngroups = nthreads*2; // a few more groups than threads balances uneven slices
+  if (ngroups > nslices) ngroups = nslices;
+  if (ngroups < 1) return false;
+
+  int x;
+  for (x=0;x<ngroups;x++)
+  {
+    compressGroup *g = new compressGroup;
+    memset(&g->strm,0,sizeof(g->strm));
+    if (deflateInit(&g->strm,9)!=Z_OK)
+    {
+      delete g;
+      m_groups.Empty(true,FreeGroup);
+      return false;
+    }
+    g->srcsize=0;
+    g->slice_start = (int) ((x * (WDL_INT64)nslices) / ngroups);
+    g->slice_end = (int) (((x+1) * (WDL_INT64)nslices) / ngroups);
+    m_groups.Add(g);
+  }
+  m_pool = new LICE_ThreadPool(nthreads); // all workers, the capture thread only waits at the next block
+  return true;
+}
+
+void LICECaptureCompressor::FreeGroup(void *p)
+{
+  compressGroup *g = (compressGroup *)p;
+  deflateEnd(&g->strm);
+  delete g;
+}
+
+bool LICECaptureCompressor::SetAsync(int max_queued_frames, bool block_when_full)
+{
+  if (!m_file || m_inframes || m_async_thread.IsRunning()) return false;
+
+  m_async_max = max_queued_frames > 0 ? max_queued_frames : 1;
+  m_async_block = block_when_full;
+  m_async_kill = false;
+  if (!m_async_thread.Start(AsyncThreadProc,this))
+  {
+    m_async_max=0;
+    return false;
+  }
+  return true;
+}
+
+int LICECaptureCompressor::GetQueuedFrames()
+{
+  WDL_MutexLock lock(&m_async_mutex);
+  return m_async_queue.GetSize();
+}
+
+unsigned int LICECaptureCompressor::AsyncThreadProc(void *p)
+{
+  LICECaptureCompressor *_this = (LICECaptureCompressor *)p;
+  for (;;)
+  {
+    _this->m_async_mutex.Enter();
+    if (_this->m_async_kill)
+    {
+      _this->m_async_mutex.Leave();
+      break;
+    }
+    asyncFrame *f = _this->m_async_queue.Get(0);
+    if (f) 
+    {
+      // m_proc_mutex is taken before the frame leaves the queue, so a flush that sees an empty queue 
+      // can't run ahead of the frame being compressed
+      _this->m_proc_mutex.Enter();
+      _this->m_async_queue.Delete(0);
+    }
+    _this->m_async_mutex.Leave();
+
+    if (!f) 
+    {
+      _this->m_async_signal.Wait(20);
+      continue;
+    }
+
+    static const RECT s_nodirty = { 0, 0, 0, 0 }; // not NULL, which would mean the whole frame
+    _this->ProcessFrame(&f->bm,f->delta_t_ms,
+      f->full ? NULL : f->dirty.GetSize() ? f->dirty.Get() : &s_nodirty, f->dirty.GetSize());
+    _this->m_proc_mutex.Leave();
+
+    _this->m_async_mutex.Enter();
+    _this->m_async_free.Add(f);
+    _this->m_async_mutex.Leave();
+  }
+  return 0;
 }
 
 void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
+{
+  OnFrame(fr,delta_t_ms,NULL,0);
+}
+
+void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms, const RECT *dirty, int ndirty)
+{
+  if (!m_async_thread.IsRunning())
+  {
+    ProcessFrame(fr,delta_t_ms,dirty,ndirty);
+    return;
+  }
+
+  if (!fr)
+  {
+    // flush: wait for the worker to drain the queue, then finish the block from this thread
+    for (;;)
+    {
+      m_async_mutex.Enter();
+      const int qs = m_async_queue.GetSize();
+      if (!qs) m_proc_mutex.Enter();
+      m_async_mutex.Leave();
+      if (!qs) break;
+      m_async_signal.Set();
+      LICE_Thread::Sleep(1);
+    }
+    ProcessFrame(NULL,0,NULL,0);
+    m_proc_mutex.Leave();
+    return;
+  }
+
+  if (fr->getWidth()!=m_w || fr->getHeight()!=m_h) return;
+
+  asyncFrame *f = NULL;
+  bool stalled=false;
+  for (;;)
+  {
+    m_async_mutex.Enter();
+    if (m_async_queue.GetSize() < m_async_max)
+    {
+      const int nfree = m_async_free.GetSize();
+      if (nfree)
+      {
+        f = m_async_free.Get(nfree-1);
+        m_async_free.Delete(nfree-1);
+      }
+      else 
+      {
+        f = new asyncFrame;
+      }
+    }
+    m_async_mutex.Leave();
+
+    if (f || !m_async_block) break;
+    if (!stalled) m_async_stalled++;
+    stalled=true;
+    m_async_signal.Set();
+    LICE_Thread::Sleep(1);
+  }
+
+  if (!f)
+  {
+    m_async_dropped++;
+    m_async_dropped_delta += delta_t_ms;
+    if (!dirty) m_async_dropped_full=true;
+    else if (!m_async_dropped_full && ndirty>0) m_async_dropped_dirty.Add(dirty,ndirty);
+    return;
+  }
+
+  LICE_Copy(&f->bm,fr);
+  f->delta_t_ms = delta_t_ms + m_async_dropped_delta;
+  f->full = !dirty || m_async_dropped_full;
+  f->dirty.Resize(0,false);
+  if (!f->full)
+  {
+    f->dirty.Add(m_async_dropped_dirty.Get(),m_async_dropped_dirty.GetSize());
+    if (ndirty>0) f->dirty.Add(dirty,ndirty);
+  }
+  m_async_dropped_delta=0;
+  m_async_dropped_dirty.Resize(0,false);
+  m_async_dropped_full=false;
+
+  m_async_mutex.Enter();
+  m_async_queue.Add(f);
+  m_async_mutex.Leave();
+  m_async_signal.Set();
+}
+
+void LICECaptureCompressor::ProcessFrame(LICE_IBitmap *fr, int delta_t_ms, const RECT *dirty, int ndirty)
 {
   if (fr) 
   {
     if (fr->getWidth()!=m_w || fr->getHeight()!=m_h) return;
 
+    const int nslices = m_numcols*m_numrows;
     frameRec *rec = m_framelists[m_which].Get(m_state);
     if (!rec)
     {
-      rec = new frameRec(m_w*m_h);
+      rec = new frameRec(m_w*m_h,nslices);
       m_framelists[m_which].Add(rec);
     }
     rec->delta_t_ms=delta_t_ms;
-    BitmapToFrameRec(fr,rec);
+
+    // the previous frame is needed for any slice that isn't converted
+    WDL_PtrList<frameRec> *prevlist = m_framelists + (m_state ? m_which : !m_which);
+    const int prevcnt = m_state ? m_state : prevlist->GetSize();
+
+    if (!dirty || !prevcnt)
+    {
+      memset(rec->valid,1,nslices);
+      BitmapToFrameRec(fr,rec,true);
+    }
+    else
+    {
+      MarkDirtySlices(rec,dirty,ndirty);
+      if (!m_state)
+      {
+        // the first frame of a block is stored in full, take the unchanged slices from the last frame that has them
+        int x;
+        for (x=0;x<nslices;x++)
+        {
+          if (rec->valid[x]) continue;
+          int i = prevcnt-1;
+          while (i>0 && !prevlist->Get(i)->valid[x]) i--;
+
+          const int xpos = (x%m_numcols) * m_bsize_w, ypos = (x/m_numcols) * m_bsize_h;
+          const int wid = wdl_min(m_w-xpos,m_bsize_w);
+          int hei = wdl_min(m_h-ypos,m_bsize_h);
+          const unsigned short *rd = prevlist->Get(i)->data + xpos + ypos*m_w;
+          unsigned short *wr = rec->data + xpos + ypos*m_w;
+          while (hei--)
+          {
+            memcpy(wr,rd,wid*sizeof(short));
+            wr+=m_w;
+            rd+=m_w;
+          }
+          rec->valid[x]=1;
+        }
+      }
+      BitmapToFrameRec(fr,rec,false);
+    }
     m_state++;
     m_inframes++;
   }
@@ -63,7 +302,7 @@ void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
 
   bool isLastBlock = m_state >= m_interval || !fr;
 
-  if (m_framelists[!m_which].GetSize())
+  if (m_framelists[!m_which].GetSize() && !m_pool)
   {
     int compressTo;
     if (isLastBlock) compressTo = m_numcols*m_numrows;
@@ -76,60 +315,7 @@ void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
     int chunkpos = m_outchunkpos;
     while (chunkpos < compressTo)
     {
-      int xpos = (chunkpos%m_numcols) * m_bsize_w;
-      int ypos = (chunkpos/m_numcols) * m_bsize_h;
-
-      int wid = m_w-xpos;
-      int hei = m_h-ypos;
-      if (wid > m_bsize_w) wid=m_bsize_w;
-      if (hei > m_bsize_h) hei=m_bsize_h;
-
-      int i;
-      int rdoffs = xpos + ypos*m_w;
-      int rdspan = m_w;
-
-      int repeat_cnt=0;
-
-      for(i=0;i<list_size; i++)
-      {
-        unsigned short *rd = list[i]->data + rdoffs;
-        if (i&&repeat_cnt<255)
-        {
-          unsigned short *rd1=rd;
-          unsigned short *rd2=list[i-1]->data+rdoffs;
-          int a=hei;
-          while(a--)
-          {
-            if (memcmp(rd1,rd2,wid*sizeof(short))) break;
-            rd1+=rdspan;
-            rd2+=rdspan;
-          }
-          if (a<0)
-          {
-            repeat_cnt++;
-            continue;
-          }          
-        }
-
-        if (i || repeat_cnt)
-        {
-          unsigned char c = (unsigned char)repeat_cnt;
-          DeflateBlock(&c,1,false);
-          repeat_cnt=0;
-        }
-        int a=hei;
-        while (a--)
-        {
-          DeflateBlock(rd,wid*sizeof(short),false);
-          rd+=rdspan;
-        }
-      }
-      if (repeat_cnt)
-      {
-        unsigned char c = (unsigned char)repeat_cnt;
-        DeflateBlock(&c,1,false);
-      }
-
+      EncodeSlice(NULL,chunkpos,list,list_size);
       chunkpos++;
     }
     m_outchunkpos=chunkpos;
@@ -141,12 +327,32 @@ void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
     {
       m_outframes += m_framelists[!m_which].GetSize();
 
-      DeflateBlock(NULL,0,true);
+      int sz=0, uncomp_sz=0;
+      if (m_pool)
+      {
+        m_pool->Wait(); // groups were started when this block filled
+
+        int x;
+        for (x=0;x<m_groups.GetSize();x++)
+        {
+          compressGroup *g = m_groups.Get(x);
+          sz += g->data.Available();
+          uncomp_sz += g->srcsize;
+          m_inbytes += g->srcsize;
+          m_outsize += g->data.Available();
+        }
+      }
+      else
+      {
+        DeflateBlock(NULL,0,true);
 
-      deflateReset(&m_compstream);
+        deflateReset(&m_compstream);
+        sz = m_current_block.Available();
+        uncomp_sz = m_current_block_srcsize;
+      }
 
       m_hdrqueue.Clear();
-      AddHdrInt(LCF_VERSION);
+      AddHdrInt(m_pool ? LCF_VERSION2 : LCF_VERSION);
       AddHdrInt(16);
       AddHdrInt(m_w);
       AddHdrInt(m_h);
@@ -154,11 +360,9 @@ void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
       AddHdrInt(m_bsize_h);
       int nf = m_framelists[!m_which].GetSize();
       AddHdrInt(nf);
-      int sz = m_current_block.Available();
       AddHdrInt(sz);
-
-      int uncomp_sz = m_current_block_srcsize;
       AddHdrInt(uncomp_sz);
+      if (m_pool) AddHdrInt(m_groups.GetSize());
 
       {
         int x;
@@ -166,16 +370,54 @@ void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
         {
           AddHdrInt(m_framelists[!m_which].Get(x)->delta_t_ms);
         }
+        // LCF_VERSION2: compressed/uncompressed size of each substream
+        for (x=0;m_pool && x<m_groups.GetSize();x++)
+        {
+          AddHdrInt(m_groups.Get(x)->data.Available());
+          AddHdrInt(m_groups.Get(x)->srcsize);
+        }
       }
 
 
+      {
+        int *ent = m_toc.Add(NULL,4);
+        if (ent)
+        {
+          // start time and length are accumulated the same way as in the decompressor's scan of legacy files
+          unsigned int mst = m_toc_length_ms;
+          if (m_toc.GetSize() > 4) mst += m_framelists[!m_which].Get(0)->delta_t_ms - m_toc_first_delay;
+          else m_toc_first_delay = m_framelists[!m_which].Get(0)->delta_t_ms;
+
+          const WDL_INT64 pos = m_file->GetPosition();
+          ent[0] = (int) (pos & 0xffffffff);
+          ent[1] = (int) (pos >> 32);
+          ent[2] = (int) mst;
+          ent[3] = nf;
+        }
+        int x;
+        for (x=0;x<nf;x++) m_toc_length_ms += m_framelists[!m_which].Get(x)->delta_t_ms;
+      }
+
       m_file->Write(m_hdrqueue.Get(),m_hdrqueue.Available());
       m_outsize += m_hdrqueue.Available();
-      m_file->Write(m_current_block.Get(),sz);
+      if (m_pool)
+      {
+        int x;
+        for (x=0;x<m_groups.GetSize();x++)
+        {
+          compressGroup *g = m_groups.Get(x);
+          m_file->Write(g->data.Get(),g->data.Available());
+          g->data.Clear();
+          g->srcsize=0;
+        }
+      }
+      else
+      {
+        m_file->Write(m_current_block.Get(),sz);
+        m_current_block.Clear();
+        m_current_block_srcsize=0;
+      }
       m_outsize += sz;
-
-      m_current_block.Clear();
-      m_current_block_srcsize=0;
     }
 
 
@@ -184,13 +426,21 @@ void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
     m_outchunkpos=0;
     m_which=!m_which;
 
-
     if (old_state>0 && !fr)
     {
       while (m_framelists[!m_which].GetSize() > old_state)
         m_framelists[!m_which].Delete(m_framelists[!m_which].GetSize()-1,true);
+    }
 
-      OnFrame(NULL,0);
+    if (old_state>0 && m_pool)
+    {
+      // compress the block that just filled in the background while the next one is captured
+      m_pool->Start(m_groups.GetSize(),CompressGroupJob,this);
+    }
+
+    if (old_state>0 && !fr)
+    {
+      ProcessFrame(NULL,0,NULL,0);
     }
 
     if (!fr)
@@ -201,7 +451,273 @@ void LICECaptureCompressor::OnFrame(LICE_IBitmap *fr, int delta_t_ms)
   }
 }
 
-void LICECaptureCompressor::BitmapToFrameRec(LICE_IBitmap *fr, frameRec *dest)
+void LICECaptureCompressor::CompressGroupJob(void *ctx, int job)
+{
+  LICECaptureCompressor *_this = (LICECaptureCompressor *)ctx;
+  compressGroup *g = _this->m_groups.Get(job);
+  if (!g) return;
+
+  // runs while m_which fills, so the list being compressed is !m_which
+  frameRec **list = _this->m_framelists[!_this->m_which].GetList();
+  const int list_size = _this->m_framelists[!_this->m_which].GetSize();
+
+  int x;
+  for (x=g->slice_start;x<g->slice_end;x++) _this->EncodeSlice(g,x,list,list_size);
+  DeflateGroup(g,NULL,0,Z_FINISH);
+  deflateReset(&g->strm);
+}
+
+void LICECaptureCompressor::EncodeSlice(compressGroup *g, int chunkpos, frameRec **list, int list_size)
+{
+  int xpos = (chunkpos%m_numcols) * m_bsize_w;
+  int ypos = (chunkpos/m_numcols) * m_bsize_h;
+
+  int wid = m_w-xpos;
+  int hei = m_h-ypos;
+  if (wid > m_bsize_w) wid=m_bsize_w;
+  if (hei > m_bsize_h) hei=m_bsize_h;
+
+  int i;
+  int rdoffs = xpos + ypos*m_w;
+  int rdspan = m_w;
+
+  int repeat_cnt=0;
+  int src=0; // most recent frame that has this slice's data, the frames after it are unchanged
+
+  for(i=0;i<list_size; i++)
+  {
+    const bool has_data = !i || list[i]->valid[chunkpos];
+    unsigned short *rd = list[has_data ? i : src]->data + rdoffs;
+    if (i&&repeat_cnt<255)
+    {
+      if (!has_data)
+      {
+        repeat_cnt++;
+        continue;
+      }
+
+      unsigned short *rd1=rd;
+      unsigned short *rd2=list[src]->data+rdoffs;
+      int a=hei;
+      while(a--)
+      {
+        if (memcmp(rd1,rd2,wid*sizeof(short))) break;
+        rd1+=rdspan;
+        rd2+=rdspan;
+      }
+      if (a<0)
+      {
+        repeat_cnt++;
+        continue;
+      }          
+    }
+    if (has_data) src=i;
+
+    if (i || repeat_cnt)
+    {
+      unsigned char c = (unsigned char)repeat_cnt;
+      EmitData(g,&c,1);
+      repeat_cnt=0;
+    }
+    int a=hei;
+    while (a--)
+    {
+      EmitData(g,rd,wid*sizeof(short));
+      rd+=rdspan;
+    }
+  }
+  if (repeat_cnt)
+  {
+    unsigned char c = (unsigned char)repeat_cnt;
+    EmitData(g,&c,1);
+  }
+}
+
+// 8888 <-> 565 row conversion. the SIMD versions produce exactly the same output as the scalar ones.
+// 565 layout (as stored in LCF): r>>3 in bits 0-4, g>>2 in bits 5-10, b>>3 in bits 11-15
+
+static void RowTo565(const LICE_pixel *sp, unsigned short *outptr, int w)
+{
+  while (w--)
+  {
+    LICE_pixel pix = *sp++;
+    *outptr++ = (((int)LICE_GETR(pix)&0xF8)>>3) | (((int)LICE_GETG(pix)&0xFC)<<3) | (((int)LICE_GETB(pix)&0xF8)<<8);
+  }
+}
+
+static void RowFrom565(const unsigned short *rdptr, LICE_pixel *wr, int w)
+{
+  while (w--)
+  {
+    unsigned short px = *rdptr++;
+    *wr++ = LICE_RGBA((px<<3)&0xF8,(px>>3)&0xFC,(px>>8)&0xF8,255);
+  }
+}
+
+#ifdef LICE_SIMD_HAVE_SSE2
+static void RowTo565_SSE2(const LICE_pixel *sp, unsigned short *outptr, int w)
+{
+  const __m128i rmask = _mm_set1_epi32(0x1f), gmask = _mm_set1_epi32(0x7e0), bmask = _mm_set1_epi32(0xf800);
+  while (w >= 8)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *)sp);
+    __m128i b = _mm_loadu_si128((const __m128i *)(sp+4));
+    a = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(a,19),rmask),
+                                  _mm_and_si128(_mm_srli_epi32(a,5),gmask)),
+                                  _mm_and_si128(_mm_slli_epi32(a,8),bmask));
+    b = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(b,19),rmask),
+                                  _mm_and_si128(_mm_srli_epi32(b,5),gmask)),
+                                  _mm_and_si128(_mm_slli_epi32(b,8),bmask));
+    // sign extend the low 16 bits so the signed saturating pack is lossless
+    a = _mm_srai_epi32(_mm_slli_epi32(a,16),16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b,16),16);
+    _mm_storeu_si128((__m128i *)outptr,_mm_packs_epi32(a,b));
+    sp+=8;
+    outptr+=8;
+    w-=8;
+  }
+  RowTo565(sp,outptr,w);
+}
+
+static void RowFrom565_SSE2(const unsigned short *rdptr, LICE_pixel *wr, int w)
+{
+  const __m128i zero = _mm_setzero_si128(), amask = _mm_set1_epi32(0xff000000),
+                bmask = _mm_set1_epi32(0xf8), gmask = _mm_set1_epi32(0xfc00), rmask = _mm_set1_epi32(0xf80000);
+  while (w >= 8)
+  {
+    const __m128i v = _mm_loadu_si128((const __m128i *)rdptr);
+    __m128i a = _mm_unpacklo_epi16(v,zero), b = _mm_unpackhi_epi16(v,zero);
+    a = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(a,8),bmask),
+                                  _mm_and_si128(_mm_slli_epi32(a,5),gmask)),
+                     _mm_or_si128(_mm_and_si128(_mm_slli_epi32(a,19),rmask),amask));
+    b = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(b,8),bmask),
+                                  _mm_and_si128(_mm_slli_epi32(b,5),gmask)),
+                     _mm_or_si128(_mm_and_si128(_mm_slli_epi32(b,19),rmask),amask));
+    _mm_storeu_si128((__m128i *)wr,a);
+    _mm_storeu_si128((__m128i *)(wr+4),b);
+    rdptr+=8;
+    wr+=8;
+    w-=8;
+  }
+  RowFrom565(rdptr,wr,w);
+}
+#endif
+
+#ifdef LICE_SIMD_HAVE_AVX2
+LICE_SIMD_TARGET_AVX2 static void RowTo565_AVX2(const LICE_pixel *sp, unsigned short *outptr, int w)
+{
+  const __m256i rmask = _mm256_set1_epi32(0x1f), gmask = _mm256_set1_epi32(0x7e0), bmask = _mm256_set1_epi32(0xf800);
+  while (w >= 16)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i *)sp);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(sp+8));
+    a = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(a,19),rmask),
+                                        _mm256_and_si256(_mm256_srli_epi32(a,5),gmask)),
+                                        _mm256_and_si256(_mm256_slli_epi32(a,8),bmask));
+    b = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(b,19),rmask),
+                                        _mm256_and_si256(_mm256_srli_epi32(b,5),gmask)),
+                                        _mm256_and_si256(_mm256_slli_epi32(b,8),bmask));
+    // packus works within 128-bit lanes, restore pixel order afterwards
+    _mm256_storeu_si256((__m256i *)outptr,_mm256_permute4x64_epi64(_mm256_packus_epi32(a,b),0xD8));
+    sp+=16;
+    outptr+=16;
+    w-=16;
+  }
+  _mm256_zeroupper(); // the SSE2 code is not VEX encoded
+  RowTo565_SSE2(sp,outptr,w);
+}
+
+LICE_SIMD_TARGET_AVX2 static void RowFrom565_AVX2(const unsigned short *rdptr, LICE_pixel *wr, int w)
+{
+  const __m256i amask = _mm256_set1_epi32(0xff000000),
+                bmask = _mm256_set1_epi32(0xf8), gmask = _mm256_set1_epi32(0xfc00), rmask = _mm256_set1_epi32(0xf80000);
+  while (w >= 8)
+  {
+    __m256i a = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)rdptr));
+    a = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(a,8),bmask),
+                                        _mm256_and_si256(_mm256_slli_epi32(a,5),gmask)),
+                        _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(a,19),rmask),amask));
+    _mm256_storeu_si256((__m256i *)wr,a);
+    rdptr+=8;
+    wr+=8;
+    w-=8;
+  }
+  RowFrom565(rdptr,wr,w);
+}
+#endif
+
+#ifdef LICE_SIMD_HAVE_NEON
+static void RowTo565_NEON(const LICE_pixel *sp, unsigned short *outptr, int w)
+{
+  const uint32x4_t rmask = vdupq_n_u32(0x1f), gmask = vdupq_n_u32(0x7e0), bmask = vdupq_n_u32(0xf800);
+  while (w >= 8)
+  {
+    uint32x4_t a = vld1q_u32(sp), b = vld1q_u32(sp+4);
+    a = vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(a,19),rmask),vandq_u32(vshrq_n_u32(a,5),gmask)),vandq_u32(vshlq_n_u32(a,8),bmask));
+    b = vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(b,19),rmask),vandq_u32(vshrq_n_u32(b,5),gmask)),vandq_u32(vshlq_n_u32(b,8),bmask));
+    vst1q_u16(outptr,vcombine_u16(vmovn_u32(a),vmovn_u32(b)));
+    sp+=8;
+    outptr+=8;
+    w-=8;
+  }
+  RowTo565(sp,outptr,w);
+}
+
+static void RowFrom565_NEON(const unsigned short *rdptr, LICE_pixel *wr, int w)
+{
+  const uint32x4_t amask = vdupq_n_u32(0xff000000), bmask = vdupq_n_u32(0xf8), gmask = vdupq_n_u32(0xfc00), rmask = vdupq_n_u32(0xf80000);
+  while (w >= 8)
+  {
+    const uint16x8_t v = vld1q_u16(rdptr);
+    uint32x4_t a = vmovl_u16(vget_low_u16(v)), b = vmovl_u16(vget_high_u16(v));
+    a = vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(a,8),bmask),vandq_u32(vshlq_n_u32(a,5),gmask)),vorrq_u32(vandq_u32(vshlq_n_u32(a,19),rmask),amask));
+    b = vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(b,8),bmask),vandq_u32(vshlq_n_u32(b,5),gmask)),vorrq_u32(vandq_u32(vshlq_n_u32(b,19),rmask),amask));
+    vst1q_u32(wr,a);
+    vst1q_u32(wr+4,b);
+    rdptr+=8;
+    wr+=8;
+    w-=8;
+  }
+  RowFrom565(rdptr,wr,w);
+}
+#endif
+
+typedef void (*RowTo565Func)(const LICE_pixel *, unsigned short *, int);
+typedef void (*RowFrom565Func)(const unsigned short *, LICE_pixel *, int);
+
+static RowTo565Func GetRowTo565Func()
+{
+  const int caps = LICE_SIMD_GetCaps();
+#ifdef LICE_SIMD_HAVE_AVX2
+  if (caps & LICE_SIMD_AVX2) return RowTo565_AVX2;
+#endif
+#ifdef LICE_SIMD_HAVE_SSE2
+  if (caps & LICE_SIMD_SSE2) return RowTo565_SSE2;
+#endif
+#ifdef LICE_SIMD_HAVE_NEON
+  if (caps & LICE_SIMD_NEON) return RowTo565_NEON;
+#endif
+  (void)caps;
+  return RowTo565;
+}
+
+static RowFrom565Func GetRowFrom565Func()
+{
+  const int caps = LICE_SIMD_GetCaps();
+#ifdef LICE_SIMD_HAVE_AVX2
+  if (caps & LICE_SIMD_AVX2) return RowFrom565_AVX2;
+#endif
+#ifdef LICE_SIMD_HAVE_SSE2
+  if (caps & LICE_SIMD_SSE2) return RowFrom565_SSE2;
+#endif
+#ifdef LICE_SIMD_HAVE_NEON
+  if (caps & LICE_SIMD_NEON) return RowFrom565_NEON;
+#endif
+  (void)caps;
+  return RowFrom565;
+}
+
+void LICECaptureCompressor::BitmapToFrameRec(LICE_IBitmap *fr, frameRec *dest, bool all_slices)
 {
   unsigned short *outptr = dest->data;
   const LICE_pixel *p = fr->getBits();
@@ -212,16 +728,90 @@ void LICECaptureCompressor::BitmapToFrameRec(LICE_IBitmap *fr, frameRec *dest)
     span=-span;
   }
   int h = fr->getHeight(),w=fr->getWidth();
-  while (h--)
+  RowTo565Func conv = GetRowTo565Func();
+  if (all_slices)
+  {
+    while (h--)
+    {
+      conv(p,outptr,w);
+      outptr += w;
+      p += span;
+    }
+    return;
+  }
+
+  // only the slices flagged in dest->valid, runs of adjacent slices are converted together
+  const unsigned char *valid = dest->valid;
+  int ypos;
+  for (ypos=0; ypos<h; ypos+=m_bsize_h, valid+=m_numcols)
+  {
+    const int hei = wdl_min(h-ypos,m_bsize_h);
+    int col=0;
+    while (col < m_numcols)
+    {
+      if (!valid[col]) { col++; continue; }
+      int endcol=col+1;
+      while (endcol < m_numcols && valid[endcol]) endcol++;
+
+      const int xpos = col*m_bsize_w;
+      const int wid = wdl_min(w,endcol*m_bsize_w) - xpos;
+      const LICE_pixel *rd = p + xpos + ypos*span;
+      unsigned short *wr = outptr + xpos + ypos*w;
+      int y;
+      for (y=0;y<hei;y++)
+      {
+        conv(rd,wr,wid);
+        rd += span;
+        wr += w;
+      }
+      col=endcol;
+    }
+  }
+}
+
+void LICECaptureCompressor::MarkDirtySlices(frameRec *dest, const RECT *dirty, int ndirty)
+{
+  memset(dest->valid,0,m_numcols*m_numrows);
+  while (ndirty-- > 0)
   {
-    int x=w;
-    const LICE_pixel *sp = p;
-    while (x--)
+    const int l = wdl_max(dirty->left,0), t = wdl_max(dirty->top,0);
+    const int r = wdl_min(dirty->right,m_w), b = wdl_min(dirty->bottom,m_h);
+    dirty++;
+    if (r <= l || b <= t) continue;
+
+    const int c1 = (r-1)/m_bsize_w;
+    int row;
+    for (row = t/m_bsize_h; row <= (b-1)/m_bsize_h; row++)
     {
-      LICE_pixel pix = *sp++;
-      *outptr++ = (((int)LICE_GETR(pix)&0xF8)>>3) | (((int)LICE_GETG(pix)&0xFC)<<3) | (((int)LICE_GETB(pix)&0xF8)<<8);
+      int c;
+      for (c = l/m_bsize_w; c <= c1; c++) dest->valid[row*m_numcols + c] = 1;
     }
-    p += span;
+  }
+}
+
+void LICECaptureCompressor::EmitData(compressGroup *g, void *data, int data_size)
+{
+  if (g) DeflateGroup(g,data,data_size,Z_NO_FLUSH);
+  else DeflateBlock(data,data_size,false);
+}
+
+void LICECaptureCompressor::DeflateGroup(compressGroup *g, void *data, int data_size, int flushmode)
+{
+  g->srcsize += data_size;
+  g->strm.next_in = (unsigned char *)data;
+  g->strm.avail_in = data_size;
+  for (;;)
+  {
+    int add_sz = data_size+32768;
+    g->strm.next_out = (unsigned char *)g->data.Add(NULL,add_sz);
+    g->strm.avail_out = add_sz;
+
+    int e = deflate(&g->strm,flushmode);
+
+    g->data.Add(NULL,-(int)g->strm.avail_out);
+
+    if (e != Z_OK) break;
+    if (!g->strm.avail_in && (flushmode==Z_NO_FLUSH || add_sz==(int)g->strm.avail_out)) break;
   }
 }
 
@@ -260,6 +850,28 @@ void LICECaptureCompressor::DeflateBlock(void *data, int data_size, bool flush)
 
 
 
+void LICECaptureCompressor::WriteTOC()
+{
+  const int nblocks = m_toc.GetSize()/4;
+  if (!nblocks) return;
+
+  const WDL_INT64 tocpos = m_file->GetPosition();
+  m_hdrqueue.Clear();
+  AddHdrInt(LCF_TOC);
+  AddHdrInt(nblocks);
+  AddHdrInt((int)m_toc_length_ms);
+  int x;
+  for (x=0;x<nblocks*4;x++) AddHdrInt(m_toc.Get()[x]);
+  AddHdrInt((int) (tocpos & 0xffffffff));
+  AddHdrInt((int) (tocpos >> 32));
+  AddHdrInt(LCF_TOC);
+
+  m_file->Write(m_hdrqueue.Get(),m_hdrqueue.Available());
+  m_outsize += m_hdrqueue.Available();
+  m_hdrqueue.Clear();
+  m_toc.Resize(0);
+}
+
 LICECaptureCompressor::~LICECaptureCompressor()
 {
   // process any pending frames
@@ -267,8 +879,20 @@ LICECaptureCompressor::~LICECaptureCompressor()
   {
     OnFrame(NULL,0);
     deflateEnd(&m_compstream);
+    WriteTOC();
   }
 
+  m_async_mutex.Enter();
+  m_async_kill=true;
+  m_async_mutex.Leave();
+  m_async_signal.Set();
+  m_async_thread.Join();
+  m_async_queue.Empty(true);
+  m_async_free.Empty(true);
+
+  delete m_pool;
+  m_groups.Empty(true,FreeGroup);
+
   delete m_file;
   m_framelists[0].Empty(true);
   m_framelists[1].Empty(true);
@@ -296,8 +920,15 @@ LICECaptureDecompressor::LICECaptureDecompressor(const char *fn, bool want_seeka
 {
   m_bytes_read=0;
   m_file_length_ms=0;
+  m_pool=NULL;
+  m_inflate_which=0;
   m_rd_which=0;
   m_frameidx=0;
+  m_blockidx=0;
+  m_rd_pending=false;
+  m_rd_hdrpos=m_rd_nextpos=0;
+  m_cache_bytes=m_cache_max_bytes=0;
+  m_prefetch=NULL;
   memset(&m_compstream,0,sizeof(m_compstream));
   memset(&m_curhdr,0,sizeof(m_curhdr));
   m_file = new WDL_FileRead(fn,2,1024*1024);
@@ -310,15 +941,22 @@ LICECaptureDecompressor::LICECaptureDecompressor(const char *fn, bool want_seeka
     }
     if (m_file)
     {
-      m_file_frame_info.Clear();
+      m_toc.Resize(0);
       m_file_length_ms=0;
-      if (want_seekable)
+      if (want_seekable && !ReadTOC())
       {
-        unsigned int lastpos = 0;
+        // legacy file, scan all block headers
+        m_toc.Resize(0);
+        m_file_length_ms=0;
+        m_file->SetPosition(0);
+
+        WDL_INT64 lastpos = 0;
         int first_frame_delay = 0;
         while (ReadHdr(0))
         {
-          m_file_frame_info.Add(&lastpos,1);
+          tocEntry ent;
+          ent.offset = lastpos;
+          ent.nframes = m_frame_deltas[0].GetSize();
           unsigned int mst = m_file_length_ms;
           if (m_frame_deltas[0].GetSize()) 
           {
@@ -327,7 +965,8 @@ LICECaptureDecompressor::LICECaptureDecompressor(const char *fn, bool want_seeka
             else
               first_frame_delay = m_frame_deltas[0].Get()[0];
           }
-          m_file_frame_info.Add(&mst,1);         
+          ent.start_ms = mst;
+          m_toc.Add(ent);
 
           int x;
           for(x=0;x<m_frame_deltas[0].GetSize();x++)
@@ -335,7 +974,7 @@ LICECaptureDecompressor::LICECaptureDecompressor(const char *fn, bool want_seeka
             m_file_length_ms+=m_frame_deltas[0].Get()[x];
           }
 
-          m_file->SetPosition(lastpos = (unsigned int)(m_file->GetPosition() + m_curhdr[0].cdata_left));
+          m_file->SetPosition(lastpos = m_file->GetPosition() + m_curhdr[0].cdata_left);
         }
       }
 
@@ -353,48 +992,145 @@ LICECaptureDecompressor::LICECaptureDecompressor(const char *fn, bool want_seeka
 
 LICECaptureDecompressor::~LICECaptureDecompressor()
 {
+  delete m_prefetch;
+  m_cache.Empty(true);
+  delete m_pool;
   inflateEnd(&m_compstream);
   delete m_file;
 }
 
+void LICECaptureDecompressor::SetThreadCount(int nthreads)
+{
+  WaitPrefetch();
+  delete m_pool;
+  m_pool = nthreads > 1 ? new LICE_ThreadPool(nthreads-1) : NULL;
+}
+
+void LICECaptureDecompressor::SetFrameCache(int max_mb)
+{
+  m_cache_max_bytes = max_mb > 0 ? (int) wdl_min(max_mb,2047) << 20 : 0;
+  while (m_cache.GetSize() && m_cache_bytes > m_cache_max_bytes)
+  {
+    m_cache_bytes -= m_cache.Get(0)->bytes;
+    m_cache.Delete(0,true);
+  }
+}
+
+void LICECaptureDecompressor::SetPrefetch(bool enable)
+{
+  if (enable == !!m_prefetch) return;
+  if (enable)
+  {
+    m_prefetch = new LICE_ThreadPool(1);
+    if (!m_rd_pending) StartPrefetch();
+  }
+  else
+  {
+    delete m_prefetch; // waits for any running job
+    m_prefetch=NULL;
+  }
+}
+
+void LICECaptureDecompressor::StartPrefetch()
+{
+  if (m_prefetch && m_curhdr[!m_rd_which].bpp) m_prefetch->Start(1,PrefetchJob,this);
+}
+
+void LICECaptureDecompressor::PrefetchJob(void *ctx, int job)
+{
+  LICECaptureDecompressor *_this = (LICECaptureDecompressor *)ctx;
+  _this->DecompressBlock(!_this->m_rd_which,1.0);
+}
+
+bool LICECaptureDecompressor::ReadPendingBlock(WDL_INT64 pos)
+{
+  m_rd_hdrpos = pos;
+  m_rd_pending = false;
+  m_file->SetPosition(pos);
+  if (!ReadHdr(m_rd_which)) return false;
+  m_rd_pending = true;
+
+  // skip the compressed data, but read the next header so its first frame delay is known
+  m_file->SetPosition(m_rd_nextpos = m_file->GetPosition() + m_curhdr[m_rd_which].cdata_left);
+  if (!ReadHdr(!m_rd_which))
+    memset(&m_curhdr[!m_rd_which],0,sizeof(m_curhdr[!m_rd_which]));
+  return true;
+}
+
+bool LICECaptureDecompressor::ActivateBlock()
+{
+  m_rd_pending = false;
+  m_file->SetPosition(m_rd_hdrpos);
+  if (!ReadHdr(m_rd_which) || !DecompressBlock(m_rd_which,1.0))
+  {
+    memset(&m_curhdr,0,sizeof(m_curhdr));
+    return false;
+  }
+  if (!ReadHdr(!m_rd_which))
+    memset(&m_curhdr[!m_rd_which],0,sizeof(m_curhdr[!m_rd_which]));
+  DecodeSlices();
+  StartPrefetch();
+  return true;
+}
+
 bool LICECaptureDecompressor::NextFrame() // TRUE if out of frames
 {
   if (++m_frameidx >= m_frame_deltas[m_rd_which].GetSize())
   {
+    m_blockidx++;
+    m_frameidx=0;
+    if (m_rd_pending)
+    {
+      // the current block was never inflated, move on to the next one without inflating either
+      if (!m_curhdr[!m_rd_which].bpp || !ReadPendingBlock(m_rd_nextpos))
+      {
+        m_rd_pending=false;
+        memset(&m_curhdr[m_rd_which],0,sizeof(m_curhdr[m_rd_which]));
+      }
+      return false;
+    }
+
+    WaitPrefetch();
     m_rd_which=!m_rd_which;
 
     DecompressBlock(m_rd_which,1.0);
     if (!ReadHdr(!m_rd_which))
       memset(&m_curhdr[!m_rd_which],0,sizeof(m_curhdr[!m_rd_which]));
-    m_frameidx=0;
     if (!m_curhdr[m_rd_which].bpp) return false;
     DecodeSlices();
+    StartPrefetch();
   }
-  else
+  else if (!m_rd_pending && !m_prefetch)
     DecompressBlock(!m_rd_which,m_frameidx/(double)m_frame_deltas[m_rd_which].GetSize());
   return false;
 }
 
 int LICECaptureDecompressor::Seek(unsigned int offset_ms)
 {
-
+  WaitPrefetch();
+  m_rd_pending=false;
   memset(m_curhdr,0,sizeof(m_curhdr));
   if (!m_file) return -1;
 
   int rval=0;
 
-  unsigned int seekpos=0;
+  WDL_INT64 seekpos=0;
+  int blockidx=0;
   m_frameidx=0;
-  if (offset_ms>0&&m_file_frame_info.GetSize())
+  if (offset_ms>0&&m_toc.GetSize())
   {
-    int x;
-    for(x=0;x<m_file_frame_info.GetSize()-2;x+=2)
+    // last block starting at or before offset_ms (the first block always qualifies)
+    const tocEntry *toc = m_toc.Get();
+    int lo=0, hi=m_toc.GetSize()-1;
+    while (lo < hi)
     {
-      if (offset_ms < m_file_frame_info.Get()[x+2+1]) break;
+      const int mid = (lo+hi+1)/2;
+      if (offset_ms < toc[mid].start_ms) hi=mid-1;
+      else lo=mid;
     }
-    seekpos = m_file_frame_info.Get()[x];
-    offset_ms -= m_file_frame_info.Get()[x+1];
-    // figure out the best place to seek
+    seekpos = toc[lo].offset;
+    offset_ms -= toc[lo].start_ms;
+    blockidx = lo;
   }
   else 
   {
@@ -403,8 +1139,8 @@ int LICECaptureDecompressor::Seek(unsigned int offset_ms)
   }
 
   m_rd_which=0;
-  m_file->SetPosition(seekpos);
-  if (!ReadHdr(m_rd_which)||!DecompressBlock(m_rd_which,1.0)) 
+  m_blockidx=blockidx;
+  if (!ReadPendingBlock(seekpos))
   {
     rval=-1;
     memset(&m_curhdr,0,sizeof(m_curhdr));
@@ -425,16 +1161,69 @@ int LICECaptureDecompressor::Seek(unsigned int offset_ms)
       }
       m_frameidx=x-1;
     }
-    if (!ReadHdr(!m_rd_which))
-        memset(&m_curhdr[!m_rd_which],0,sizeof(m_curhdr[!m_rd_which]));
 
-    DecodeSlices();
+    int x;
+    for (x=m_cache.GetSize()-1;x>=0;x--)
+    {
+      const cachedFrame *cf = m_cache.Get(x);
+      if (cf->block == m_blockidx && cf->frame == m_frameidx) break;
+    }
+    if (x<0 && !ActivateBlock()) rval=-1;
   }
 
   return rval;
 }
 
 
+bool LICECaptureDecompressor::ReadTOC()
+{
+  const WDL_INT64 fsize = m_file->GetSize();
+  if (fsize < 24) return false;
+
+  int trailer[3];
+  m_file->SetPosition(fsize-12);
+  if (m_file->Read(trailer,12)!=12) return false;
+  WDL_Queue::WDL_Queue__bswap_buffer(trailer,4);
+  WDL_Queue::WDL_Queue__bswap_buffer(trailer+1,4);
+  WDL_Queue::WDL_Queue__bswap_buffer(trailer+2,4);
+  if (trailer[2] != LCF_TOC) return false;
+
+  const WDL_INT64 tocpos = (WDL_INT64) (unsigned int)trailer[0] | ((WDL_INT64)trailer[1] << 32);
+  if (tocpos < 0 || tocpos > fsize-24) return false;
+  const WDL_INT64 tocsize = fsize - 12 - tocpos;
+  if ((tocsize-12)%16) return false;
+  const int nblocks = (int) ((tocsize-12)/16);
+  if (nblocks < 1) return false;
+
+  WDL_TypedBuf<int> buf;
+  int *rd = buf.Resize((int)(tocsize/4),false);
+  if (buf.GetSize() != (int)(tocsize/4)) return false;
+
+  m_file->SetPosition(tocpos);
+  if (m_file->Read(rd,(int)tocsize)!=(int)tocsize) return false;
+  int x;
+  for (x=0;x<buf.GetSize();x++) WDL_Queue::WDL_Queue__bswap_buffer(rd+x,4);
+  if (rd[0] != LCF_TOC || rd[1] != nblocks) return false;
+
+  const unsigned int length_ms = (unsigned int)rd[2];
+  rd += 3;
+  tocEntry *toc = m_toc.Resize(nblocks,false);
+  if (m_toc.GetSize() != nblocks) return false;
+  for (x=0;x<nblocks;x++)
+  {
+    toc[x].offset = (WDL_INT64) (unsigned int)rd[0] | ((WDL_INT64)rd[1] << 32);
+    toc[x].start_ms = (unsigned int)rd[2];
+    toc[x].nframes = rd[3];
+    rd += 4;
+
+    // must be in order and point at blocks before the TOC, the first block at the start of the file
+    if (x ? (toc[x].offset <= toc[x-1].offset || toc[x].start_ms < toc[x-1].start_ms) : toc[x].offset != 0) return false;
+    if (toc[x].offset >= tocpos || toc[x].nframes < 1) return false;
+  }
+  m_file_length_ms = length_ms;
+  return true;
+}
+
 bool LICECaptureDecompressor::ReadHdr(int whdr) // todo: eventually make this read/decompress the next header as it goes
 {
   m_tmp.Clear();
@@ -443,7 +1232,7 @@ bool LICECaptureDecompressor::ReadHdr(int whdr) // todo: eventually make this re
   m_bytes_read+=hdr_sz;
   int ver=0;
   m_tmp.GetTFromLE(&ver);
-  if (ver !=LCF_VERSION) return false;
+  if (ver !=LCF_VERSION && ver != LCF_VERSION2) return false;
   m_tmp.GetTFromLE(&m_curhdr[whdr].bpp);
   m_tmp.GetTFromLE(&m_curhdr[whdr].w);
   m_tmp.GetTFromLE(&m_curhdr[whdr].h);
@@ -456,6 +1245,15 @@ bool LICECaptureDecompressor::ReadHdr(int whdr) // todo: eventually make this re
 
   int dsize=0;
   m_tmp.GetTFromLE(&dsize);
+
+  int ngroups=0;
+  if (ver == LCF_VERSION2)
+  {
+    if (m_file->Read(&ngroups,4)!=4) return false;
+    m_bytes_read+=4;
+    WDL_Queue::WDL_Queue__bswap_buffer(&ngroups,4);
+    if (ngroups<1 || ngroups > 65536) return false;
+  }
   
   if (nf<1 || nf > 1024) return false;
 
@@ -471,6 +1269,39 @@ bool LICECaptureDecompressor::ReadHdr(int whdr) // todo: eventually make this re
     WDL_Queue::WDL_Queue__bswap_buffer(m_frame_deltas[whdr].Get()+x,4);
   }
   m_curhdr[whdr].cdata_left = csize;
+  m_curhdr[whdr].ngroups = ngroups;
+  m_curhdr[whdr].groups_done = 0;
+  m_curhdr[whdr].groups_err = false;
+
+  if (ngroups)
+  {
+    // read substream sizes, convert to offsets
+    int *go = m_group_offs[whdr].Resize(ngroups*4,false);
+    if (m_group_offs[whdr].GetSize() != ngroups*4) return false;
+    int x, coffs=0, doffs=0;
+    for (x=0;x<ngroups;x++)
+    {
+      int sz[2];
+      if (m_file->Read(sz,8)!=8) return false;
+      m_bytes_read+=8;
+      WDL_Queue::WDL_Queue__bswap_buffer(sz,4);
+      WDL_Queue::WDL_Queue__bswap_buffer(sz+1,4);
+      if (sz[0]<0 || sz[1]<0) return false;
+      go[0]=coffs;
+      go[1]=sz[0];
+      go[2]=doffs;
+      go[3]=sz[1];
+      go+=4;
+      coffs+=sz[0];
+      doffs+=sz[1];
+    }
+    if (coffs != csize || doffs != dsize) return false;
+
+    m_compstream.avail_out = 0; // the shared stream is only used for LCF_VERSION
+    m_decompdata[whdr].Resize(dsize,false);
+    if (m_decompdata[whdr].GetSize()!=dsize) return false;
+    return true;
+  }
 
   inflateReset(&m_compstream);
   m_compstream.avail_out = dsize;
@@ -481,8 +1312,62 @@ bool LICECaptureDecompressor::ReadHdr(int whdr) // todo: eventually make this re
   return true;
 }
   
+void LICECaptureDecompressor::InflateGroupJob(void *ctx, int job)
+{
+  LICECaptureDecompressor *_this = (LICECaptureDecompressor *)ctx;
+  const int whdr = _this->m_inflate_which;
+  hdrType *hdr = _this->m_curhdr + whdr;
+  const int *go = _this->m_group_offs[whdr].Get() + (hdr->groups_done + job)*4;
+
+  z_stream strm;
+  memset(&strm,0,sizeof(strm));
+  bool ok = inflateInit(&strm)==Z_OK;
+  if (ok)
+  {
+    strm.next_in = (unsigned char *)_this->m_cdata[whdr].Get() + go[0];
+    strm.avail_in = go[1];
+    strm.next_out = (unsigned char *)_this->m_decompdata[whdr].Get() + go[2];
+    strm.avail_out = go[3];
+    const int e = inflate(&strm,Z_FINISH);
+    ok = (e == Z_STREAM_END || e == Z_OK) && !strm.avail_out;
+    inflateEnd(&strm);
+  }
+  if (!ok) hdr->groups_err = true;
+}
+
 bool LICECaptureDecompressor::DecompressBlock(int whdr, double percent)
 {
+  hdrType *hdr = m_curhdr + whdr;
+  if (hdr->ngroups)
+  {
+    if (hdr->cdata_left > 0)
+    {
+      const int csize = hdr->cdata_left;
+      m_cdata[whdr].Resize(csize,false);
+      if (m_cdata[whdr].GetSize() != csize) return false;
+      const int rd = m_file->Read(m_cdata[whdr].Get(),csize);
+      m_bytes_read += rd;
+      hdr->cdata_left = 0;
+      if (rd != csize) hdr->groups_err = true;
+    }
+
+    // substreams are independent: inflate a share of them as the previous block plays, the rest in parallel
+    int target = hdr->ngroups;
+    if (percent < 1.0) target = (int) (percent * hdr->ngroups);
+    if (!hdr->groups_err && target > hdr->groups_done)
+    {
+      m_inflate_which = whdr;
+      if (m_pool) m_pool->Run(target - hdr->groups_done,InflateGroupJob,this);
+      else
+      {
+        int x;
+        for (x=0;x<target - hdr->groups_done;x++) InflateGroupJob(this,x);
+      }
+      hdr->groups_done = target;
+    }
+    return !hdr->groups_err;
+  }
+
   if (m_compstream.avail_out) 
   {
     unsigned char buf[16384];
@@ -606,6 +1491,55 @@ void LICECaptureDecompressor::DecodeSlices()
 
 
 LICE_IBitmap *LICECaptureDecompressor::GetCurrentFrame()
+{
+  if (!m_curhdr[m_rd_which].bpp) return NULL;
+
+  if (!m_cache_max_bytes)
+  {
+    if (m_rd_pending && !ActivateBlock()) return NULL;
+    return DecodeFrame(&m_workbm) ? &m_workbm : NULL;
+  }
+
+  int x;
+  for (x=m_cache.GetSize()-1;x>=0;x--)
+  {
+    cachedFrame *cf = m_cache.Get(x);
+    if (cf->block == m_blockidx && cf->frame == m_frameidx)
+    {
+      m_cache.Delete(x);
+      m_cache.Add(cf);
+      return &cf->bm;
+    }
+  }
+
+  if (m_rd_pending && !ActivateBlock()) return NULL;
+
+  // evict least recently used frames, reusing the last one evicted. always keeps the new frame, even if it alone exceeds the limit
+  const int bytes = m_curhdr[m_rd_which].w * m_curhdr[m_rd_which].h * (int)sizeof(LICE_pixel);
+  cachedFrame *cf = NULL;
+  while (m_cache.GetSize() && m_cache_bytes + bytes > m_cache_max_bytes)
+  {
+    delete cf;
+    cf = m_cache.Get(0);
+    m_cache.Delete(0);
+    m_cache_bytes -= cf->bytes;
+  }
+  if (!cf) cf = new cachedFrame;
+
+  if (!DecodeFrame(&cf->bm))
+  {
+    delete cf;
+    return NULL;
+  }
+  cf->block = m_blockidx;
+  cf->frame = m_frameidx;
+  cf->bytes = bytes;
+  m_cache.Add(cf);
+  m_cache_bytes += bytes;
+  return &cf->bm;
+}
+
+bool LICECaptureDecompressor::DecodeFrame(LICE_MemBitmap *bm)
 {
   int nf = m_frame_deltas[m_rd_which].GetSize();
   int fidx = m_frameidx;
@@ -618,22 +1552,23 @@ LICE_IBitmap *LICECaptureDecompressor::GetCurrentFrame()
     int ns_frame = ns_x*ns_y;
 
     if (m_slices.GetSize() != ns_frame*nf)
-      return NULL; // invalid slices
+      return false; // invalid slices
 
     if (hdr->bpp == 16)
     {
-      m_workbm.resize(hdr->w,hdr->h);
+      bm->resize(hdr->w,hdr->h);
       //unsigned short *
       // format of m_decompdata is:
       // nf frames of slice1, nf frames of slice2, etc
 
-      LICE_pixel *pout = m_workbm.getBits();
-      int span = m_workbm.getRowSpan();
+      LICE_pixel *pout = bm->getBits();
+      int span = bm->getRowSpan();
 
       int ypos,
           toth=hdr->h,
           totw=hdr->w;
       void **sliceptr = m_slices.Get() + ns_frame * fidx;
+      RowFrom565Func conv = GetRowFrom565Func();
 
       for (ypos = 0; ypos < toth; ypos+=hdr->bsize_h)
       {
@@ -653,21 +1588,16 @@ LICE_IBitmap *LICECaptureDecompressor::GetCurrentFrame()
           int y;
           for (y=0;y<hei;y++)
           {
-            int x=wid;
-            LICE_pixel *wr = dest;
-            while (x--)
-            {
-              unsigned short px = *rdptr++;
-              *wr++ = LICE_RGBA((px<<3)&0xF8,(px>>3)&0xFC,(px>>8)&0xF8,255);
-            }
+            conv(rdptr,dest,wid);
+            rdptr+=wid;
             dest+=span;
-          }         
+          }
         }
       }
 
 
-      return &m_workbm;
+      return true;
     }
   }
-  return NULL;
+  return false;
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 
 #include "../ptrlist.h"
 #include "../queue.h"
+#include "../mutex.h"
+#include "lice_thread.h"
 class WDL_FileWrite;
 class WDL_FileRead;
 
@@ -17,7 +19,26 @@ public:
   ~LICECaptureCompressor();
 
   bool IsOpen() { return !!m_file; }
-  void OnFrame(LICE_IBitmap *fr, int delta_t_ms);
+  void OnFrame(LICE_IBitmap *fr, int delta_t_ms); // fr=NULL flushes all pending frames
+
+  // dirty is a list of rectangles (in fr's coordinates) outside of which fr is known to be identical to the 
+  // previous frame, e.g. from LICE_BitmapCmpEx() or an OS damage source. slices that don't intersect 
+  // the list are stored as repeats without being converted or compared. dirty=NULL means the whole frame.
+  void OnFrame(LICE_IBitmap *fr, int delta_t_ms, const RECT *dirty, int ndirty);
+
+  // asynchronous mode: OnFrame() copies the frame into a bounded queue, and the 565 conversion and 
+  // compression run on a worker thread. call before the first OnFrame(). if block_when_full is false,
+  // frames that arrive while the queue is full are dropped (their time is added to the next frame).
+  bool SetAsync(int max_queued_frames=4, bool block_when_full=false); 
+  int GetQueuedFrames(); // back-pressure: frames waiting for the worker
+  int GetDroppedFrames() { return m_async_dropped; }
+  int GetStalledFrames() { return m_async_stalled; } // number of OnFrame() calls that had to wait for a free slot
+
+  // writes LCF_VERSION2 blocks: the slices are split into ngroups groups that are deflated as independent 
+  // substreams by nthreads threads, in the background while the next block is being captured.
+  // call before the first OnFrame(). ngroups=0 picks a default based on nthreads. fails for nthreads<2,
+  // the file is then written as LCF_VERSION, which older decoders can also read.
+  bool SetParallel(int nthreads, int ngroups=0);
 
   WDL_INT64 GetOutSize() { return m_outsize; }
   WDL_INT64 GetInSize() { return m_inbytes; }
@@ -32,9 +53,10 @@ private:
 
   struct frameRec
   {
-    frameRec(int sz) { data=(unsigned short *)malloc(sz*sizeof(short)); delta_t_ms=0; }
-    ~frameRec() { free(data); }
+    frameRec(int sz, int nslices) { data=(unsigned short *)malloc(sz*sizeof(short)); valid=(unsigned char *)malloc(nslices); delta_t_ms=0; }
+    ~frameRec() { free(data); free(valid); }
     unsigned short *data; // shorts
+    unsigned char *valid; // per slice, 0 if the slice was outside the dirty region and data was not updated
     int delta_t_ms; // time (ms) since last frame
   };
   WDL_PtrList<frameRec> m_framelists[2];
@@ -46,10 +68,51 @@ private:
 
   z_stream m_compstream;
 
-  void BitmapToFrameRec(LICE_IBitmap *fr, frameRec *dest);
+  struct compressGroup
+  {
+    z_stream strm;
+    WDL_Queue data;
+    int srcsize;
+    int slice_start, slice_end;
+  };
+  WDL_PtrList<compressGroup> m_groups; // only used with SetParallel()
+  LICE_ThreadPool *m_pool;
+
+  void ProcessFrame(LICE_IBitmap *fr, int delta_t_ms, const RECT *dirty, int ndirty);
+  void BitmapToFrameRec(LICE_IBitmap *fr, frameRec *dest, bool all_slices);
+  void MarkDirtySlices(frameRec *dest, const RECT *dirty, int ndirty);
+  void EncodeSlice(compressGroup *g, int chunkpos, frameRec **list, int list_size); // g=NULL for m_compstream
+  void EmitData(compressGroup *g, void *data, int data_size);
   void DeflateBlock(void *data, int data_size, bool flush);
+  static void DeflateGroup(compressGroup *g, void *data, int data_size, int flushmode);
+  static void CompressGroupJob(void *ctx, int job);
+  static void FreeGroup(void *g);
   void AddHdrInt(int a) { m_hdrqueue.AddToLE(&a); }
 
+  WDL_TypedBuf<int> m_toc; // per block: offset (low, high), start time (ms), frame count
+  unsigned int m_toc_length_ms;
+  int m_toc_first_delay;
+  void WriteTOC();
+
+  struct asyncFrame
+  {
+    asyncFrame() : bm(0,0,1) { delta_t_ms=0; full=true; }
+    LICE_MemBitmap bm;
+    int delta_t_ms;
+    WDL_TypedBuf<RECT> dirty;
+    bool full; // ignore dirty
+  };
+
+  WDL_PtrList<asyncFrame> m_async_queue, m_async_free; // protected by m_async_mutex
+  WDL_Mutex m_async_mutex, m_proc_mutex; // m_proc_mutex is held while a frame is being compressed
+  LICE_Thread m_async_thread;
+  LICE_Event m_async_signal;
+  int m_async_max, m_async_dropped, m_async_stalled, m_async_dropped_delta;
+  WDL_TypedBuf<RECT> m_async_dropped_dirty; // dirty regions of dropped frames are merged into the next frame
+  bool m_async_block, m_async_dropped_full;
+  bool m_async_kill; // protected by m_async_mutex once the thread is running
+
+  static unsigned int AsyncThreadProc(void *p);
 
 };
 
@@ -63,17 +126,26 @@ public:
 
   bool IsOpen() { return !!m_file; }
 
-  // only supported if want_seekable=true
+  // only supported if want_seekable=true. files that end with a table of contents open without scanning every block
   int GetLength() { return m_file_length_ms; } // length in ms
   int Seek(unsigned int offset_ms); // return -1 on fail (out of range), or >0 to tell you how far into the frame you seeked (0=exact hit)
 
   bool NextFrame(); // TRUE if out of frames
-  LICE_IBitmap *GetCurrentFrame(); // can return NULL if error
+  LICE_IBitmap *GetCurrentFrame(); // can return NULL if error. the bitmap is valid until the next call
   int GetTimeToNextFrame(); // delta in ms
 
   int GetWidth(){ return m_curhdr[m_rd_which].w; }
   int GetHeight(){ return m_curhdr[m_rd_which].h; }
 
+  void SetThreadCount(int nthreads); // LCF_VERSION2 blocks are inflated with up to nthreads threads
+
+  // keeps up to max_mb of decoded frames, most recently used first. Seek() to a cached frame doesn't 
+  // inflate its block, and neither does NextFrame() while the frames it reaches are cached. 0 disables
+  void SetFrameCache(int max_mb);
+
+  // inflates the next block on a worker thread while the current block is being played
+  void SetPrefetch(bool enable);
+
   int m_bytes_read; // increases for statistics, caller can clear 
 
 private:
@@ -85,10 +157,36 @@ private:
     int w, h;
     int bsize_w, bsize_h;
     int cdata_left;
+    int ngroups; // LCF_VERSION2 only
+    int groups_done; // number of substreams inflated
+    bool groups_err;
   } m_curhdr[2];
 
   int m_rd_which;
   int m_frameidx;
+  int m_blockidx; // index of the current block in the file
+
+  // a block is pending when only its header (and the next block's) was read, it is inflated on demand
+  bool m_rd_pending;
+  WDL_INT64 m_rd_hdrpos, m_rd_nextpos;
+
+  struct cachedFrame
+  {
+    cachedFrame() : bm(0,0,1) { block=frame=bytes=0; }
+    LICE_MemBitmap bm;
+    int block, frame, bytes;
+  };
+  WDL_PtrList<cachedFrame> m_cache; // least recently used first
+  int m_cache_bytes, m_cache_max_bytes;
+
+  LICE_ThreadPool *m_prefetch;
+
+  bool ReadPendingBlock(WDL_INT64 pos);
+  bool ActivateBlock();
+  bool DecodeFrame(LICE_MemBitmap *bm);
+  void StartPrefetch();
+  void WaitPrefetch() { if (m_prefetch) m_prefetch->Wait(); }
+  static void PrefetchJob(void *ctx, int job);
 
   bool ReadHdr(int whdr);
   bool DecompressBlock(int whdr, double percent=1.0);
@@ -99,13 +197,27 @@ private:
   WDL_FileRead *m_file;
 
   unsigned int m_file_length_ms;
-  WDL_TypedQueue<unsigned int> m_file_frame_info; //pairs of offset_bytes, offset_ms
+
+  struct tocEntry
+  {
+    WDL_INT64 offset;
+    unsigned int start_ms; // time of the first frame, not counting the first frame's delay in the file
+    int nframes;
+  };
+  WDL_TypedBuf<tocEntry> m_toc; // sorted by offset and start_ms
+  bool ReadTOC();
 
   WDL_TypedBuf<int> m_frame_deltas[2];
   WDL_HeapBuf m_decompdata[2];
   WDL_TypedBuf<void *> m_slices; // indexed by [frame][slice]
 
+  WDL_HeapBuf m_cdata[2]; // LCF_VERSION2: compressed block
+  WDL_TypedBuf<int> m_group_offs[2]; // LCF_VERSION2: per substream: compressed offset, compressed size, decompressed offset, decompressed size
+  LICE_ThreadPool *m_pool;
+  int m_inflate_which;
+
   void DecodeSlices();
+  static void InflateGroupJob(void *ctx, int job);
 };
 
 #endif
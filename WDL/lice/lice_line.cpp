@@ -1,6 +1,7 @@
 #include "lice.h"
 #include "lice_combine.h"
 #include "lice_extended.h"
+#include "../wdltypes.h"
 #include <math.h>
 #include <stdio.h>
 //#include <assert.h>
@@ -159,6 +160,37 @@ static bool ClipFLine(float* x1, float* y1, float* x2, float*y2, int w, int h)
 }
 
 
+// clip[] is {x0,y0,x1,y1} in physical coordinates, right/bottom exclusive
+static inline bool PtInClip(const int *clip, int x, int y)
+{
+  return x >= clip[0] && x < clip[2] && y >= clip[1] && y < clip[3];
+}
+
+// narrow [*ilo,*ihi] to the steps i where p+i*dir, or its neighbour one further along, can be within [lo,hi)
+static void ClipSteps(int p, int dir, int lo, int hi, int *ilo, int *ihi)
+{
+  const int a = dir > 0 ? lo-1-p : p-hi;
+  const int b = dir > 0 ? hi-p : p-lo+1;
+  if (*ilo < a) *ilo = a;
+  if (*ihi > b) *ihi = b;
+}
+
+static bool GetPhysicalClip(LICE_IBitmap *dest, const RECT *cliprect, int *clip)
+{
+  const int w = dest->getWidth(), h = dest->getHeight();
+  int y0 = cliprect->top, y1 = cliprect->bottom;
+  if (dest->isFlipped())
+  {
+    y0 = h-cliprect->bottom;
+    y1 = h-cliprect->top;
+  }
+  clip[0] = lice_max(cliprect->left,0);
+  clip[1] = lice_max(y0,0);
+  clip[2] = lice_min(cliprect->right,w);
+  clip[3] = lice_min(y1,h);
+  return clip[0] < clip[2] && clip[1] < clip[3];
+}
+
 inline static void LICE_DiagLineFAST(LICE_pixel *px, int span, int n, int xstep, int ystep, LICE_pixel color, bool aa)
 {
   int step = xstep+ystep;
@@ -186,6 +218,36 @@ inline static void LICE_DiagLineFAST(LICE_pixel *px, int span, int n, int xstep,
   }
 }
 
+static void LICE_DiagLineFASTClipped(LICE_pixel *bits, int span, const int *clip, int x, int y, int n, int sx, int sy, LICE_pixel color, bool aa)
+{
+  int i = 0, ie = n;
+  ClipSteps(x, sx, clip[0], clip[2], &i, &ie);
+  ClipSteps(y, sy, clip[1], clip[3], &i, &ie);
+  if (aa)
+  {
+    LICE_pixel color75 = ((color>>1)&0x7f7f7f7f)+((color>>2)&0x3f3f3f3f);
+    LICE_pixel color25 = (color>>2)&0x3f3f3f3f;
+    for (; i <= ie; ++i)
+    {
+      const int px = x+i*sx, py = y+i*sy;
+      if (PtInClip(clip, px, py)) _LICE_CombinePixelsThreeQuarterMix2FAST::doPixFAST(bits+py*span+px, color75);
+      if (i < n)
+      {
+        if (PtInClip(clip, px+sx, py)) _LICE_CombinePixelsQuarterMix2FAST::doPixFAST(bits+py*span+px+sx, color25);
+        if (PtInClip(clip, px, py+sy)) _LICE_CombinePixelsQuarterMix2FAST::doPixFAST(bits+(py+sy)*span+px, color25);
+      }
+    }
+  }
+  else
+  {
+    for (; i <= ie; ++i)
+    {
+      const int px = x+i*sx, py = y+i*sy;
+      if (PtInClip(clip, px, py)) bits[py*span+px] = color;
+    }
+  }
+}
+
 inline static void LICE_DottedVertLineFAST(LICE_IBitmap* dest, int x, int y1, int y2, LICE_pixel color)
 {
   int span = dest->getRowSpan();
@@ -317,6 +379,45 @@ public:
     }
     COMBFUNC::doPix((LICE_pixel_chan*) px, r, g, b, a, iw);
   }
+
+  // diagonal lines starting at (x,y) restricted to clip, same pixels/weights as above
+  static void LICE_DiagLineClipped(LICE_pixel *bits, int span, const int *clip, int x, int y, int n, int sx, int sy, LICE_pixel color, int aw)
+  {
+    int r = LICE_GETR(color), g = LICE_GETG(color), b = LICE_GETB(color), a = LICE_GETA(color);
+    int i = 0, ie = n;
+    ClipSteps(x, sx, clip[0], clip[2], &i, &ie);
+    ClipSteps(y, sy, clip[1], clip[3], &i, &ie);
+    for (; i <= ie; ++i)
+    {
+      const int px = x+i*sx, py = y+i*sy;
+      if (PtInClip(clip, px, py)) COMBFUNC::doPix((LICE_pixel_chan*) (bits+py*span+px), r, g, b, a, aw);
+    }
+  }
+  static void LICE_DiagLineAAClipped(LICE_pixel *bits, int span, const int *clip, int x, int y, int n, int sx, int sy, LICE_pixel color, int aw)
+  {
+    int r = LICE_GETR(color), g = LICE_GETG(color), b = LICE_GETB(color), a = LICE_GETA(color);
+
+#if DO_AA_GAMMA_CORRECT
+    int iw = aw*AA_GAMMA_CORRECT[256*3/4]/256;
+    int dw = aw*AA_GAMMA_CORRECT[256/4]/256;
+#else
+    int iw = aw*3/4;
+    int dw = aw/4;
+#endif
+    int i = 0, ie = n;
+    ClipSteps(x, sx, clip[0], clip[2], &i, &ie);
+    ClipSteps(y, sy, clip[1], clip[3], &i, &ie);
+    for (; i <= ie; ++i)
+    {
+      const int px = x+i*sx, py = y+i*sy;
+      if (PtInClip(clip, px, py)) COMBFUNC::doPix((LICE_pixel_chan*) (bits+py*span+px), r, g, b, a, iw);
+      if (i < n)
+      {
+        if (PtInClip(clip, px+sx, py)) COMBFUNC::doPix((LICE_pixel_chan*) (bits+py*span+px+sx), r, g, b, a, dw);
+        if (PtInClip(clip, px, py+sy)) COMBFUNC::doPix((LICE_pixel_chan*) (bits+(py+sy)*span+px), r, g, b, a, dw);
+      }
+    }
+  }
 };
 
 
@@ -465,6 +566,107 @@ public:
     }
   }
 
+  // LICE_LineImpl restricted to clip, with the position of each step computed directly so that
+  // every pixel inside clip comes out exactly as the unclipped draw would have it.
+  // (ax,ay)/(ex,ey) are the pixels px/px2 point to, bsign the direction of bstep
+  static void LICE_LineImplClipped(LICE_pixel *bits, int span, const int *clip, int ax, int ay, int ex, int ey,
+                                   bool xmajor, int bsign, int derr, int da, LICE_pixel color, int aw, bool aa
+#ifdef LICE_FAVOR_SIZE
+                          , LICE_COMBINEFUNC combFunc
+#endif
+    )
+  {
+    int r = LICE_GETR(color), g = LICE_GETG(color), b = LICE_GETB(color), a = LICE_GETA(color);
+
+    const int adx = xmajor ? 1 : 0, ady = xmajor ? 0 : 1;
+    const int bdx = xmajor ? 0 : bsign, bdy = xmajor ? bsign : 0;
+    const int lo = xmajor ? clip[0] : clip[1], hi = xmajor ? clip[2] : clip[3];
+    const int n = (da+1)/2;
+    int i, ie;
+
+#define CLIPPIX(x,y,al) if (PtInClip(clip,x,y)) DOPIX((LICE_pixel_chan*)(bits+(y)*span+(x)), r, g, b, a, al)
+
+    if (aa)
+    {
+      CLIPPIX(ax, ay, aw)
+      CLIPPIX(ex, ey, aw)
+
+      // steps 1..n-1 from each end, plus the middle step for even lengths
+      i = 1;
+      ie = (da%2) ? n-1 : n;
+      ClipSteps(xmajor ? ax : ay, 1, lo, hi, &i, &ie);
+      for (; i <= ie; ++i)
+      {
+        const WDL_INT64 e = (WDL_INT64)i*derr;
+        const int bo = (int)(e>>16), x = ax+i*adx+bo*bdx, y = ay+i*ady+bo*bdy;
+        int wt, iwt;
+        if (aw == 256) GetAAPxWeightFAST((int)(e&65535), &wt, &iwt);
+        else GetAAPxWeight((int)(e&65535), aw, &wt, &iwt);
+        CLIPPIX(x, y, wt)
+        CLIPPIX(x+bdx, y+bdy, iwt)
+      }
+      i = 1;
+      ie = n-1;
+      ClipSteps(xmajor ? ex : ey, -1, lo, hi, &i, &ie);
+      for (; i <= ie; ++i)
+      {
+        const WDL_INT64 e = (WDL_INT64)i*derr;
+        const int bo = (int)(e>>16), x = ex-i*adx-bo*bdx, y = ey-i*ady-bo*bdy;
+        int wt, iwt;
+        if (aw == 256) GetAAPxWeightFAST((int)(e&65535), &wt, &iwt);
+        else GetAAPxWeight((int)(e&65535), aw, &wt, &iwt);
+        CLIPPIX(x, y, wt)
+        CLIPPIX(x-bdx, y-bdy, iwt)
+      }
+    }
+    else
+    {
+      i = 0;
+      ie = (da%2) ? n-1 : n;
+      ClipSteps(xmajor ? ax : ay, 1, lo, hi, &i, &ie);
+      for (; i <= ie; ++i)
+      {
+        const int bo = (int)(((WDL_INT64)i*derr+65536/2)>>16);
+        CLIPPIX(ax+i*adx+bo*bdx, ay+i*ady+bo*bdy, aw)
+      }
+      i = 0;
+      ie = n-1;
+      ClipSteps(xmajor ? ex : ey, -1, lo, hi, &i, &ie);
+      for (; i <= ie; ++i)
+      {
+        const int bo = (int)(((WDL_INT64)i*derr+65536/2)>>16);
+        CLIPPIX(ex-i*adx-bo*bdx, ey-i*ady-bo*bdy, aw)
+      }
+    }
+  }
+
+  // LICE_FLineImpl restricted to clip, (x,y) is the pixel px points to
+  static void LICE_FLineImplClipped(LICE_pixel *bits, int span, const int *clip, int x, int y, int n, int err, int derr,
+                                    bool xmajor, int bsign, LICE_pixel color, int aw
+#ifdef LICE_FAVOR_SIZE
+                          , LICE_COMBINEFUNC combFunc
+#endif
+    )
+  {
+    int r = LICE_GETR(color), g = LICE_GETG(color), b = LICE_GETB(color), a = LICE_GETA(color);
+
+    const int adx = xmajor ? 1 : 0, ady = xmajor ? 0 : 1;
+    const int bdx = xmajor ? 0 : bsign, bdy = xmajor ? bsign : 0;
+    int i = 0, ie = n;
+    ClipSteps(xmajor ? x : y, 1, xmajor ? clip[0] : clip[1], xmajor ? clip[2] : clip[3], &i, &ie);
+    for (; i <= ie; ++i)
+    {
+      const WDL_INT64 e = err+(WDL_INT64)i*derr;
+      const int bo = (int)(e>>16), px = x+i*adx+bo*bdx, py = y+i*ady+bo*bdy;
+      int wt, iwt;
+      if (aw == 256) GetAAPxWeightFAST((int)(e&65535), &wt, &iwt);
+      else GetAAPxWeight((int)(e&65535), aw, &wt, &iwt);
+      CLIPPIX(px, py, wt)
+      CLIPPIX(px+bdx, py+bdy, iwt)
+    }
+  }
+#undef CLIPPIX
+
   static void LICE_FLineImpl(LICE_pixel *px, int n , int err, int derr, int astep, int bstep, LICE_pixel color, int aw
 #ifdef LICE_FAVOR_SIZE
                           , LICE_COMBINEFUNC combFunc
@@ -517,18 +719,9 @@ public:
 };
 
 
-void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel color, float alpha, int mode, bool aa)
+// clip is NULL or a physical clip rectangle inside the bitmap
+static void __LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel color, float alpha, int mode, bool aa, const int *clip)
 {
-  if (!dest) return;
-
-#ifndef DISABLE_LICE_EXTENSIONS
-  if (dest->Extended(LICE_EXT_SUPPORTS_ID, (void*) LICE_EXT_LINE_ACCEL))
-  {
-    LICE_Ext_Line_acceldata data(x1, y1, x2, y2, color, alpha, mode, aa);
-    if (dest->Extended(LICE_EXT_LINE_ACCEL, &data)) return;
-  }
-#endif
-
 	int w = dest->getWidth();
   int h = dest->getHeight();
   if (dest->isFlipped()) 
@@ -543,6 +736,13 @@ void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel co
     if (y1 == y2) // horizontal line optimizations 
     {
       if (x1 > x2) SWAP(x1, x2);
+      if (clip)
+      {
+        if (y1 < clip[1] || y1 >= clip[3]) return;
+        x1 = lice_max(x1, clip[0]);
+        x2 = lice_min(x2, clip[2]-1);
+        if (x1 > x2) return;
+      }
       int span = dest->getRowSpan();
       LICE_pixel* px = dest->getBits()+y1*span+x1;
       int n=x2-x1+1;
@@ -577,6 +777,13 @@ void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel co
     else if (!xdiff)  // vertical line optimizations
     {
       if (y1 > y2) SWAP(y1, y2);
+      if (clip)
+      {
+        if (x1 < clip[0] || x1 >= clip[2]) return;
+        y1 = lice_max(y1, clip[1]);
+        y2 = lice_min(y2, clip[3]-1);
+        if (y1 > y2) return;
+      }
       int len=y2+1-y1;
       int span = dest->getRowSpan();
       LICE_pixel* px = dest->getBits()+y1*span+x1;
@@ -614,7 +821,28 @@ void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel co
       int aw = (int)(256.0f*alpha);
       int xstep = (x2 > x1 ? 1 : -1);
       int ystep = (y2 > y1 ? span : -span);
-      if ((mode&LICE_BLIT_MODE_MASK) == LICE_BLIT_MODE_COPY && alpha == 1.0f)
+      if (clip)
+      {
+        LICE_pixel* bits = dest->getBits();
+        const int sy = (y2 > y1 ? 1 : -1);
+        if ((mode&LICE_BLIT_MODE_MASK) == LICE_BLIT_MODE_COPY && alpha == 1.0f)
+        {
+          LICE_DiagLineFASTClipped(bits, span, clip, x1, y1, xdiff, xstep, sy, color, aa);
+        }
+        else if (aa)
+        {
+#define __LICE__ACTION(COMBFUNC) __LICE_LineClassSimple<COMBFUNC>::LICE_DiagLineAAClipped(bits, span, clip, x1, y1, xdiff, xstep, sy, color, aw)
+          __LICE_ACTION_NOSRCALPHA(mode, aw, false);
+#undef __LICE__ACTION
+        }
+        else
+        {
+#define __LICE__ACTION(COMBFUNC) __LICE_LineClassSimple<COMBFUNC>::LICE_DiagLineClipped(bits, span, clip, x1, y1, xdiff, xstep, sy, color, aw)
+          __LICE_ACTION_CONSTANTALPHA(mode, aw, false);
+#undef __LICE__ACTION
+        }
+      }
+      else if ((mode&LICE_BLIT_MODE_MASK) == LICE_BLIT_MODE_COPY && alpha == 1.0f)
       {
         LICE_DiagLineFAST(px,span, xdiff, xstep, ystep, color, aa);        
       }
@@ -648,8 +876,9 @@ void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel co
       int astep, bstep;
       int dx = x2-x1;
       int dy = y2-y1;
+      const bool xmajor = abs(dx) > abs(dy);
 
-      if (abs(dx) > abs(dy))
+      if (xmajor)
       {
         da = dx;
         db = dy;
@@ -669,7 +898,10 @@ void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel co
         da = -da;
         db = -db;
         SWAP(px, px2);
+        SWAP(x1, x2);
+        SWAP(y1, y2);
       }
+      const int bsign = db < 0 ? -1 : 1;
       if (db < 0) 
       {
         db = -db;
@@ -686,7 +918,9 @@ void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel co
       #define __LICE__ACTION(comb) blitfunc=comb::doPix;
 
 #else
-      #define __LICE__ACTION(COMBFUNC) __LICE_LineClass<COMBFUNC>::LICE_LineImpl(px,px2, derr, astep, da, bstep, color, aw, aa)	
+      #define __LICE__ACTION(COMBFUNC) \
+        if (clip) __LICE_LineClass<COMBFUNC>::LICE_LineImplClipped(dest->getBits(), span, clip, x1, y1, x2, y2, xmajor, bsign, derr, da, color, aw, aa); \
+        else __LICE_LineClass<COMBFUNC>::LICE_LineImpl(px,px2, derr, astep, da, bstep, color, aw, aa)
 #endif
             if (aa) 
             {
@@ -700,21 +934,40 @@ void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel co
       #undef __LICE__ACTION
 
 #ifdef LICE_FAVOR_SIZE
-        if (blitfunc) __LICE_LineClass::LICE_LineImpl(px,px2, derr, astep, da, bstep, color, aw, aa, blitfunc);
+        if (blitfunc)
+        {
+          if (clip) __LICE_LineClass::LICE_LineImplClipped(dest->getBits(), span, clip, x1, y1, x2, y2, xmajor, bsign, derr, da, color, aw, aa, blitfunc);
+          else __LICE_LineClass::LICE_LineImpl(px,px2, derr, astep, da, bstep, color, aw, aa, blitfunc);
+        }
 #endif
 		}
 	}
 }
 
-void LICE_FLine(LICE_IBitmap* dest, float x1, float y1, float x2, float y2, LICE_pixel color, float alpha, int mode, bool aa)
+void LICE_Line(LICE_IBitmap *dest, int x1, int y1, int x2, int y2, LICE_pixel color, float alpha, int mode, bool aa)
 {
   if (!dest) return;
-  if (!aa)
+
+#ifndef DISABLE_LICE_EXTENSIONS
+  if (dest->Extended(LICE_EXT_SUPPORTS_ID, (void*) LICE_EXT_LINE_ACCEL))
   {
-    LICE_Line(dest,(int)x1,(int)y1,(int)x2,(int)y2,color,alpha,mode,false);
-    return;
+    LICE_Ext_Line_acceldata data(x1, y1, x2, y2, color, alpha, mode, aa);
+    if (dest->Extended(LICE_EXT_LINE_ACCEL, &data)) return;
   }
+#endif
 
+  __LICE_Line(dest, x1, y1, x2, y2, color, alpha, mode, aa, NULL);
+}
+
+void LICE_ClippedLine(LICE_IBitmap *dest, const RECT *cliprect, int x1, int y1, int x2, int y2, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  int clip[4];
+  if (!dest || !cliprect || !GetPhysicalClip(dest, cliprect, clip)) return;
+  __LICE_Line(dest, x1, y1, x2, y2, color, alpha, mode, aa, clip);
+}
+
+static void __LICE_FLine(LICE_IBitmap* dest, float x1, float y1, float x2, float y2, LICE_pixel color, float alpha, int mode, const int *clip)
+{
   int w = dest->getWidth();
   int h = dest->getHeight();
   if (dest->isFlipped()) 
@@ -734,8 +987,9 @@ void LICE_FLine(LICE_IBitmap* dest, float x1, float y1, float x2, float y2, LICE
       int astep, bstep;
       float dx = x2-x1;
       float dy = y2-y1;
+      const bool xmajor = fabs(dx) > fabs(dy);
 
-      if (fabs(dx) > fabs(dy))
+      if (xmajor)
       {
         a1 = x1;
         a2 = x2;
@@ -784,6 +1038,10 @@ void LICE_FLine(LICE_IBitmap* dest, float x1, float y1, float x2, float y2, LICE
 
       if (bstep < 0) px -= bstep;
 
+      // pixel px points to, for the clipped version
+      const int bsign = bstep < 0 ? -1 : 1;
+      const int pa = (int)ta, pb = (int)tb + (bstep < 0 ? 1 : 0);
+
 #ifdef LICE_FAVOR_SIZE
 
       LICE_COMBINEFUNC blitfunc=NULL;      
@@ -791,13 +1049,19 @@ void LICE_FLine(LICE_IBitmap* dest, float x1, float y1, float x2, float y2, LICE
 
 #else
 
-      #define __LICE__ACTION(COMBFUNC) __LICE_LineClass<COMBFUNC>::LICE_FLineImpl(px,n,err,derr,astep,bstep, color, aw)
+      #define __LICE__ACTION(COMBFUNC) \
+        if (clip) __LICE_LineClass<COMBFUNC>::LICE_FLineImplClipped(dest->getBits(), span, clip, xmajor ? pa : pb, xmajor ? pb : pa, n, err, derr, xmajor, bsign, color, aw); \
+        else __LICE_LineClass<COMBFUNC>::LICE_FLineImpl(px,n,err,derr,astep,bstep, color, aw)
 #endif
 
       __LICE_ACTION_NOSRCALPHA(mode, aw, false);    
 
 #ifdef LICE_FAVOR_SIZE
-      if (blitfunc) __LICE_LineClass::LICE_FLineImpl(px,n,err,derr,astep,bstep, color, aw, blitfunc);
+      if (blitfunc)
+      {
+        if (clip) __LICE_LineClass::LICE_FLineImplClipped(dest->getBits(), span, clip, xmajor ? pa : pb, xmajor ? pb : pa, n, err, derr, xmajor, bsign, color, aw, blitfunc);
+        else __LICE_LineClass::LICE_FLineImpl(px,n,err,derr,astep,bstep, color, aw, blitfunc);
+      }
 #endif
 
   #undef __LICE__ACTION
@@ -805,6 +1069,25 @@ void LICE_FLine(LICE_IBitmap* dest, float x1, float y1, float x2, float y2, LICE
   }
 }
 
+void LICE_FLine(LICE_IBitmap* dest, float x1, float y1, float x2, float y2, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  if (!dest) return;
+  if (!aa)
+  {
+    LICE_Line(dest,(int)x1,(int)y1,(int)x2,(int)y2,color,alpha,mode,false);
+    return;
+  }
+  __LICE_FLine(dest, x1, y1, x2, y2, color, alpha, mode, NULL);
+}
+
+void LICE_ClippedFLine(LICE_IBitmap* dest, const RECT *cliprect, float x1, float y1, float x2, float y2, LICE_pixel color, float alpha, int mode, bool aa)
+{
+  int clip[4];
+  if (!dest || !cliprect || !GetPhysicalClip(dest, cliprect, clip)) return;
+  if (!aa) __LICE_Line(dest, (int)x1, (int)y1, (int)x2, (int)y2, color, alpha, mode, false, clip);
+  else __LICE_FLine(dest, x1, y1, x2, y2, color, alpha, mode, clip);
+}
+
 void LICE_DashedLine(LICE_IBitmap* dest, int x1, int y1, int x2, int y2, int pxon, int pxoff, LICE_pixel color, float alpha, int mode, bool aa) 
 {  
   if (!dest) return;
@@ -1526,7 +1809,7 @@ void LICE_FillConvexPolygon(LICE_IBitmap* dest, const int* x, const int* y, int
 
   int i;
   {
-    int min_x=dest->getWidth(),max_x=0;
+    int min_x=x[0],max_x=x[0];
     for (i = 0; i < npoints; ++i)
     {
       int tx = x[i];
@@ -15,6 +15,17 @@ struct ONode
   ONode* children[8];
 };
 
+// LICE_OCTREE_FLAG_POOL: same tree, but the nodes live in one array and refer to each other by index
+struct PNode
+{
+  int childflag;    // 0=leaf, >0=index of single child, <0=branch
+  int children[8];  // indices into OTree::pool, 0=none (the trunk is never a child)
+  int next;         // for OTree::pool_branches and pool_spares, -1=none
+  int leafidx;      // populated at the end
+  WDL_INT64 colorcount;
+  WDL_INT64 sumrgb[3];
+};
+
 struct OTree
 {
   int maxcolors;
@@ -24,13 +35,22 @@ struct OTree
   ONode* spares;
   LICE_pixel* palette;  // populated at the end
   bool palette_valid;
+
+  PNode *pool; // non-NULL if LICE_OCTREE_FLAG_POOL, pool[0] is the trunk (trunk/branches/spares are unused)
+  int pool_used, pool_alloc, pool_spares;
+  int pool_branches[OCTREE_DEPTH];
+
+  // leaf for each 15-bit color (OCTREE_DEPTH is 5), as pool_gen<<16 | node. leaves only go away when
+  // the tree is pruned, which increments pool_gen. the pool never has more than 37449 nodes
+  unsigned int *pool_cache;
+  unsigned int pool_gen;
 };
 
 
 
 int LICE_BuildPalette(LICE_IBitmap* bmp, LICE_pixel* palette, int maxcolors)
 {
-  void* tree = LICE_CreateOctree(maxcolors);
+  void* tree = LICE_CreateOctree(maxcolors,LICE_OCTREE_FLAG_POOL);
   LICE_BuildOctree(tree, bmp);
   int sz = LICE_ExtractOctreePalette(tree, palette);
   LICE_DestroyOctree(tree);
@@ -38,19 +58,39 @@ int LICE_BuildPalette(LICE_IBitmap* bmp, LICE_pixel* palette, int maxcolors)
 }
 
 
-static void AddColorToTree(OTree*, const LICE_pixel_chan *rgb);
+static void AddColorToTree(OTree*, const LICE_pixel_chan *rgb, WDL_INT64 cnt=1, const WDL_INT64 *sumrgb=NULL);
 static int FindColorInTree(OTree*, const LICE_pixel_chan *rgb);
 static int PruneTree(OTree*);
 static void DeleteNode(OTree*, ONode*, ONode **delete_to);
+static void ResetPool(OTree*);
+static void NextPoolGen(OTree*);
+static int AllocPoolNode(OTree*);
+static void DeletePoolNode(OTree*, int, PNode *sum_to);
+static int CollectPoolNodeLeaves(PNode* pool, int node, LICE_pixel* palette, int colorcount);
 static int CollectLeaves(OTree*);
 static int CollectNodeLeaves(ONode* node, LICE_pixel* palette, int colorcount);
 
 
-void* LICE_CreateOctree(int maxcolors)
+void* LICE_CreateOctree(int maxcolors, int flags)
 {
   OTree* tree = new OTree;
   memset(tree, 0, sizeof(OTree));
   tree->maxcolors = maxcolors;
+  if (flags & LICE_OCTREE_FLAG_POOL)
+  {
+    tree->pool_alloc = 64+maxcolors*4;
+    tree->pool = (PNode *)malloc(tree->pool_alloc*sizeof(PNode));
+    tree->pool_cache = (unsigned int *)calloc(32768,sizeof(unsigned int));
+    if (!tree->pool || !tree->pool_cache)
+    {
+      free(tree->pool);
+      free(tree->pool_cache);
+      delete tree;
+      return NULL;
+    }
+    ResetPool(tree);
+    return tree;
+  }
   tree->trunk = new ONode;
   memset(tree->trunk, 0, sizeof(ONode));
   tree->spares = NULL;
@@ -69,6 +109,14 @@ void LICE_ResetOctree(void *octree, int maxc)
     tree->palette=0;
   }
 
+  if (tree->pool)
+  {
+    tree->maxcolors = maxc;
+    tree->palette_valid=false;
+    ResetPool(tree); // keeps the array
+    return;
+  }
+
   DeleteNode(tree, tree->trunk, &tree->spares);
   tree->leafcount = 0;
   tree->maxcolors = maxc;
@@ -87,6 +135,15 @@ void LICE_DestroyOctree(void* octree)
   OTree* tree = (OTree*)octree;
   if (!tree) return;
 
+  if (tree->pool)
+  {
+    free(tree->pool);
+    free(tree->pool_cache);
+    free(tree->palette);
+    delete tree;
+    return;
+  }
+
   DeleteNode(tree, tree->trunk, NULL);
 
   ONode *p = tree->spares;
@@ -102,6 +159,16 @@ void LICE_DestroyOctree(void* octree)
 }
 
 
+// runs of identical pixels are added at once, the resulting tree is the same as adding them one at a time
+// (only the first pixel of a run can create a leaf and cause pruning)
+static void AddRunToTree(OTree *tree, LICE_pixel col, int cnt)
+{
+  AddColorToTree(tree, (const LICE_pixel_chan*)&col, cnt);
+  if (tree->leafcount > tree->maxcolors) PruneTree(tree);
+}
+
+#define RUN_MASK LICE_RGBA(255,255,255,0)
+
 int LICE_BuildOctree(void* octree, LICE_IBitmap* bmp)
 {
   OTree* tree = (OTree*)octree;
@@ -114,17 +181,25 @@ int LICE_BuildOctree(void* octree, LICE_IBitmap* bmp)
   const int w=bmp->getWidth();
   const int rowspan = bmp->getRowSpan();
   const LICE_pixel *bits = bmp->getBits();
+  LICE_pixel run=0;
+  int runlen=0;
   for (y = 0; y < h; ++y)
   {
     const LICE_pixel *px = bits+y*rowspan;
     int x=w;
     while (x--)
     {    
-      AddColorToTree(tree, (const LICE_pixel_chan*)px);      
-      if (tree->leafcount > tree->maxcolors) PruneTree(tree);
-      px++;
+      const LICE_pixel p = *px++;
+      if (runlen && !((p^run)&RUN_MASK)) runlen++;
+      else
+      {
+        if (runlen) AddRunToTree(tree, run, runlen);
+        run=p;
+        runlen=1;
+      }
     }
   }
+  if (runlen) AddRunToTree(tree, run, runlen);
 
   return tree->leafcount;
 }
@@ -142,21 +217,29 @@ int LICE_BuildOctreeForAlpha(void* octree, LICE_IBitmap* bmp, int minalpha)
   const int rowspan = bmp->getRowSpan();
   const LICE_pixel *bits = bmp->getBits();
   int pxcnt=0;
+  LICE_pixel run=0;
+  int runlen=0;
   for (y = 0; y < h; ++y)
   {
     const LICE_pixel *px = bits+y*rowspan;
     int x=w;
     while (x--)
     {    
-      if (px[LICE_PIXEL_A] >= minalpha)
+      const LICE_pixel p = *px++;
+      if ((int)LICE_GETA(p) >= minalpha)
       {
-        AddColorToTree(tree, (const LICE_pixel_chan*)px);      
-        if (tree->leafcount > tree->maxcolors) PruneTree(tree);
+        if (runlen && !((p^run)&RUN_MASK)) runlen++;
+        else
+        {
+          if (runlen) AddRunToTree(tree, run, runlen);
+          run=p;
+          runlen=1;
+        }
         pxcnt++;
       }
-      px++;
     }
   }
+  if (runlen) AddRunToTree(tree, run, runlen);
 
   return pxcnt;
 }
@@ -191,6 +274,8 @@ int LICE_BuildOctreeForDiff(void* octree, LICE_IBitmap* bmp, LICE_IBitmap* refbm
   }
 
   int pxcnt=0;
+  LICE_pixel run=0;
+  int runlen=0;
   for (y = 0; y < h; ++y)
   {
     const LICE_pixel * px = bits+y*rowspan;
@@ -198,21 +283,170 @@ int LICE_BuildOctreeForDiff(void* octree, LICE_IBitmap* bmp, LICE_IBitmap* refbm
     int x=w;
     while (x--)
     {    
-      if ((*px ^ *px2) & mask)
+      const LICE_pixel p = *px++;
+      if ((p ^ *px2++) & mask)
       {
-        AddColorToTree(tree, (const LICE_pixel_chan *)px);
-        if (tree->leafcount > tree->maxcolors) PruneTree(tree);
+        if (runlen && !((p^run)&RUN_MASK)) runlen++;
+        else
+        {
+          if (runlen) AddRunToTree(tree, run, runlen);
+          run=p;
+          runlen=1;
+        }
         pxcnt++;
       }
-      px++;
-      px2++;
     }
   }
+  if (runlen) AddRunToTree(tree, run, runlen);
 
   return pxcnt;
 }
 
 
+struct histBucket
+{
+  WDL_INT64 colorcount;
+  WDL_INT64 sumrgb[3];
+};
+
+void *LICE_CreateHistogram()
+{
+  return calloc(32768,sizeof(histBucket));
+}
+
+void LICE_DestroyHistogram(void *hist)
+{
+  free(hist);
+}
+
+void LICE_AddToHistogram(void *hist, LICE_IBitmap *bmp)
+{
+  if (!hist || !bmp) return;
+
+  int y;
+  const int h=bmp->getHeight();
+  const int w=bmp->getWidth();
+  const int rowspan = bmp->getRowSpan();
+  const LICE_pixel *bits = bmp->getBits();
+  for (y = 0; y < h; ++y)
+  {
+    const LICE_pixel *px = bits+y*rowspan;
+    int x=w;
+    while (x--)
+    {
+      const LICE_pixel p = *px++;
+      const unsigned int r = LICE_GETR(p), g = LICE_GETG(p), b = LICE_GETB(p);
+      histBucket *hb = (histBucket *)hist + (((r>>3)<<10) | ((g>>3)<<5) | (b>>3));
+      hb->colorcount++;
+      hb->sumrgb[0] += r;
+      hb->sumrgb[1] += g;
+      hb->sumrgb[2] += b;
+    }
+  }
+}
+
+static WDL_INT64 PoolSubtreeCount(const PNode *pool, int node)
+{
+  const PNode *p = pool + node;
+  if (!p->childflag) return p->colorcount;
+  if (p->childflag > 0) return PoolSubtreeCount(pool, p->children[p->childflag-1]);
+  WDL_INT64 cnt = 0;
+  int i;
+  for (i = 0; i < 8; ++i) if (p->children[i]) cnt += PoolSubtreeCount(pool, p->children[i]);
+  return cnt;
+}
+
+static int sortByCount(const void *a, const void *b)
+{
+  const WDL_INT64 *ea = (const WDL_INT64 *)a, *eb = (const WDL_INT64 *)b;
+  if (ea[0] != eb[0]) return ea[0] < eb[0] ? -1 : 1;
+  return ea[1] < eb[1] ? -1 : ea[1] > eb[1] ? 1 : 0;
+}
+
+int LICE_BuildOctreeFromHistogram(void *octree, void *hist)
+{
+  OTree* tree = (OTree*)octree;
+  if (!tree || !hist) return 0;
+
+  tree->palette_valid = false;
+
+  // every bucket is a full-depth leaf, so all of the colors fit in the tree before reducing it
+  int i;
+  for (i = 0; i < 32768; ++i)
+  {
+    const histBucket *hb = (const histBucket *)hist + i;
+    if (hb->colorcount)
+    {
+      const LICE_pixel col = LICE_RGBA((i>>7)&0xf8,(i>>2)&0xf8,(i<<3)&0xf8,255);
+      AddColorToTree(tree, (const LICE_pixel_chan *)&col, hb->colorcount, hb->sumrgb);
+    }
+  }
+
+  // PruneTree() takes branches in list order, order each level by count so the least used
+  // colors are the ones that get merged (ties keep their order, so both node types prune the same)
+  WDL_TypedBuf<WDL_INT64> order; // count, list position
+  WDL_TypedBuf<ONode*> nodes;
+  WDL_TypedBuf<int> pnodes;
+  for (i = 0; i < OCTREE_DEPTH; ++i)
+  {
+    int n=0, x;
+    if (tree->pool)
+    {
+      PNode *pool = tree->pool;
+      int p;
+      for (p = tree->pool_branches[i]; p >= 0; p = pool[p].next) n++;
+      if (n < 2 || !order.ResizeOK(n*2,false) || !pnodes.ResizeOK(n,false)) continue;
+
+      for (n=0, p = tree->pool_branches[i]; p >= 0; p = pool[p].next, n++)
+      {
+        order.Get()[n*2] = PoolSubtreeCount(pool, p);
+        order.Get()[n*2+1] = n;
+        pnodes.Get()[n] = p;
+      }
+      qsort(order.Get(),n,2*sizeof(WDL_INT64),sortByCount);
+
+      int *last = &tree->pool_branches[i];
+      for (x = 0; x < n; ++x)
+      {
+        *last = pnodes.Get()[order.Get()[x*2+1]];
+        last = &pool[*last].next;
+      }
+      *last = -1;
+    }
+    else
+    {
+      ONode *p;
+      for (p = tree->branches[i]; p; p = p->next) n++;
+      if (n < 2 || !order.ResizeOK(n*2,false) || !nodes.ResizeOK(n,false)) continue;
+
+      for (n=0, p = tree->branches[i]; p; p = p->next, n++)
+      {
+        order.Get()[n*2] = p->colorcount;
+        order.Get()[n*2+1] = n;
+        nodes.Get()[n] = p;
+      }
+      qsort(order.Get(),n,2*sizeof(WDL_INT64),sortByCount);
+
+      ONode **last = &tree->branches[i];
+      for (x = 0; x < n; ++x)
+      {
+        *last = nodes.Get()[order.Get()[x*2+1]];
+        last = &(*last)->next;
+      }
+      *last = NULL;
+    }
+  }
+
+  while (tree->leafcount > tree->maxcolors)
+  {
+    const int lc = tree->leafcount;
+    if (PruneTree(tree) >= lc) break;
+  }
+
+  return tree->leafcount;
+}
+
+
 int LICE_FindInOctree(void* octree, LICE_pixel color)
 {
   OTree* tree = (OTree*)octree;
@@ -269,15 +503,93 @@ void LICE_TestPalette(LICE_IBitmap* bmp, LICE_pixel* palette, int numcolors)
 }
 
 
-void AddColorToTree(OTree* tree, const LICE_pixel_chan *rgb)
+// returns the leaf for the color, adding nodes as needed (or -1 if out of memory)
+static int FindPoolLeaf(OTree* tree, unsigned char r, unsigned char g, unsigned char b)
 {
-  ONode* p = tree->trunk;
-  p->colorcount++;
+  const int ci = ((r>>3)<<10) | ((g>>3)<<5) | (b>>3);
+  const unsigned int ce = tree->pool_cache[ci];
+  if ((ce>>16) == tree->pool_gen) return ce&0xffff;
+
+  int p = 0;
+  int i;
+  for (i = OCTREE_DEPTH-1; i >= 0; --i)
+  {
+    const int j = i+8-OCTREE_DEPTH;
+    const unsigned char idx = (((r>>(j-2))&4))|(((g>>(j-1))&2))|((b>>j)&1);
+
+    int np = tree->pool[p].children[idx];
+    if (np)
+    {
+      if (!tree->pool[np].childflag) // existing leaf
+      {
+        p = np;
+        break;
+      }
+    }
+    else // add node
+    {
+      np = AllocPoolNode(tree); // can move tree->pool
+      if (np < 0) return -1;
+
+      PNode *pp = tree->pool + p;
+      if (!pp->childflag) // first time down this path
+      {
+        pp->childflag=idx+1;
+      }
+      else if (pp->childflag > 0)  // creating a new branch
+      {    
+        pp->childflag = -1;
+        pp->next = tree->pool_branches[i];
+        tree->pool_branches[i] = p;
+      }
+      pp->children[idx] = np;
+    }
+
+    p=np; // continue downward
+  }
+
+  if (i < 0) tree->leafcount++; // p is a new leaf at the bottom
+  tree->pool_cache[ci] = (tree->pool_gen<<16) | p;
+  return p;
+}
 
+// unlike ONode, only the leaves of the pool keep counts and sums, a branch collects its subtree's when it is pruned
+static void AddColorToPool(OTree* tree, unsigned char r, unsigned char g, unsigned char b, WDL_INT64 cnt, const WDL_INT64 *sums)
+{
+  const int p = FindPoolLeaf(tree, r, g, b);
+  if (p < 0) return;
+
+  PNode *n = tree->pool + p;
+  n->sumrgb[0] += sums[0];
+  n->sumrgb[1] += sums[1];
+  n->sumrgb[2] += sums[2];
+  n->colorcount+=cnt;
+}
+
+void AddColorToTree(OTree* tree, const LICE_pixel_chan *rgb, WDL_INT64 cnt, const WDL_INT64 *sumrgb)
+{
   int i;
   const unsigned char r = rgb[LICE_PIXEL_R];
   const unsigned char g = rgb[LICE_PIXEL_G];
   const unsigned char b = rgb[LICE_PIXEL_B];
+  WDL_INT64 sums[3];
+  if (sumrgb) memcpy(sums,sumrgb,sizeof(sums));
+  else
+  {
+    sums[0] = r*cnt;
+    sums[1] = g*cnt;
+    sums[2] = b*cnt;
+  }
+
+  if (tree->pool)
+  {
+    AddColorToPool(tree, r, g, b, cnt, sums);
+    return;
+  }
+
+  ONode* p = tree->trunk;
+  p->colorcount+=cnt;
+
   for (i = OCTREE_DEPTH-1; i >= 0; --i)
   {
     const int j = i+8-OCTREE_DEPTH;
@@ -312,10 +624,10 @@ void AddColorToTree(OTree* tree, const LICE_pixel_chan *rgb)
       memset(np, 0, sizeof(ONode));    
     }
 
-    np->sumrgb[0] += r;
-    np->sumrgb[1] += g;
-    np->sumrgb[2] += b;
-    np->colorcount++;
+    np->sumrgb[0] += sums[0];
+    np->sumrgb[1] += sums[1];
+    np->sumrgb[2] += sums[2];
+    np->colorcount+=cnt;
 
     if (isleaf) return;
 
@@ -328,12 +640,26 @@ void AddColorToTree(OTree* tree, const LICE_pixel_chan *rgb)
 
 int FindColorInTree(OTree* tree, const LICE_pixel_chan *rgb)
 {
-  ONode* p = tree->trunk;
-
   int i;
   const unsigned char r=rgb[LICE_PIXEL_R];
   const unsigned char g=rgb[LICE_PIXEL_G];
   const unsigned char b=rgb[LICE_PIXEL_B];
+
+  if (tree->pool)
+  {
+    const PNode *pool = tree->pool;
+    int p = 0;
+    for (i = OCTREE_DEPTH-1; i >= 0 && pool[p].childflag; --i)
+    { 
+      const int j = i+8-OCTREE_DEPTH;
+      const int np = pool[p].children[(((r>>(j-2))&4))|(((g>>(j-1))&2))|((b>>j)&1)];
+      if (!np) break; 
+      p = np;
+    }
+    return pool[p].leafidx;
+  }
+
+  ONode* p = tree->trunk;
   for (i = OCTREE_DEPTH-1; i >= 0; --i)
   { 
     if (!p->childflag) break;
@@ -353,8 +679,37 @@ int FindColorInTree(OTree* tree, const LICE_pixel_chan *rgb)
 
 int PruneTree(OTree* tree)
 {
-  ONode* branch=0;
   int i;
+  if (tree->pool)
+  {
+    for (i = 0; i < OCTREE_DEPTH; ++i) // prune at the furthest level from the trunk
+    {
+      const int branch = tree->pool_branches[i];
+      if (branch >= 0)
+      {
+        PNode *b = tree->pool + branch;
+        tree->pool_branches[i] = b->next;
+        b->next=-1;
+
+        int c;
+        for (c = 0; c < 8; ++c)
+        {
+          if (b->children[c])
+          {
+            DeletePoolNode(tree, b->children[c], b);
+            b->children[c]=0;
+          }
+        }
+        b->childflag=0; // now it's a leaf
+        tree->leafcount++;
+        NextPoolGen(tree);
+        break;
+      }
+    }
+    return tree->leafcount;
+  }
+
+  ONode* branch=0;
   for (i = 0; i < OCTREE_DEPTH; ++i) // prune at the furthest level from the trunk
   {
     branch = tree->branches[i];
@@ -390,7 +745,7 @@ int CollectLeaves(OTree* tree)
 
   if (!tree->palette) return 0;
 
-  int sz = CollectNodeLeaves(tree->trunk, tree->palette, 0);
+  int sz = tree->pool ? CollectPoolNodeLeaves(tree->pool, 0, tree->palette, 0) : CollectNodeLeaves(tree->trunk, tree->palette, 0);
   memset(tree->palette+sz, 0, (tree->maxcolors-sz)*sizeof(LICE_pixel));
   tree->palette_valid = true;
 
@@ -468,3 +823,107 @@ void DeleteNode(OTree* tree, ONode* p, ONode **delete_to)
   }
 }
 
+
+void NextPoolGen(OTree* tree)
+{
+  if (++tree->pool_gen >= 0x10000)
+  {
+    memset(tree->pool_cache, 0, 32768*sizeof(unsigned int));
+    tree->pool_gen = 1;
+  }
+}
+
+void ResetPool(OTree* tree)
+{
+  NextPoolGen(tree);
+  tree->leafcount = 0;
+  tree->pool_used = 1;
+  tree->pool_spares = -1;
+  memset(tree->pool, 0, sizeof(PNode));
+  tree->pool[0].next = -1;
+  int i;
+  for (i = 0; i < OCTREE_DEPTH; ++i) tree->pool_branches[i] = -1;
+}
+
+int AllocPoolNode(OTree* tree)
+{
+  int n = tree->pool_spares;
+  if (n >= 0) 
+  {
+    tree->pool_spares = tree->pool[n].next;
+  }
+  else
+  {
+    if (tree->pool_used >= tree->pool_alloc)
+    {
+      const int na = tree->pool_alloc*2;
+      PNode *np = (PNode *)realloc(tree->pool, na*sizeof(PNode));
+      if (!np) return -1;
+      tree->pool = np;
+      tree->pool_alloc = na;
+    }
+    n = tree->pool_used++;
+  }
+  memset(tree->pool+n, 0, sizeof(PNode));
+  tree->pool[n].next = -1;
+  return n;
+}
+
+void DeletePoolNode(OTree* tree, int node, PNode *sum_to)
+{
+  PNode *p = tree->pool + node;
+  if (!p->childflag)
+  {
+    tree->leafcount--;
+    sum_to->colorcount += p->colorcount;
+    sum_to->sumrgb[0] += p->sumrgb[0];
+    sum_to->sumrgb[1] += p->sumrgb[1];
+    sum_to->sumrgb[2] += p->sumrgb[2];
+  }
+  else if (p->childflag > 0)
+  {
+    DeletePoolNode(tree, p->children[p->childflag-1], sum_to);
+  }
+  else
+  {
+    int i;
+    for (i = 0; i < 8; ++i)
+    {
+      if (p->children[i]) DeletePoolNode(tree, p->children[i], sum_to);
+    } 
+  }
+
+  p->next = tree->pool_spares;
+  tree->pool_spares = node;
+}
+
+int CollectPoolNodeLeaves(PNode* pool, int node, LICE_pixel* palette, int colorcount)
+{  
+  PNode *p = pool + node;
+  if (!p->childflag)
+  {
+    p->leafidx = colorcount;
+    int r = (int)((double)p->sumrgb[0]/(double)p->colorcount);
+    int g = (int)((double)p->sumrgb[1]/(double)p->colorcount);
+    int b = (int)((double)p->sumrgb[2]/(double)p->colorcount);
+    palette[colorcount++] = LICE_RGBA(r, g, b, 255);
+  }
+  else 
+  {
+    if (p->childflag > 0)
+    {
+      colorcount = CollectPoolNodeLeaves(pool, p->children[p->childflag-1], palette, colorcount);
+    }
+    else
+    {
+      int i;
+      for (i = 0; i < 8; ++i)
+      {
+        if (p->children[i]) colorcount = CollectPoolNodeLeaves(pool, p->children[i], palette, colorcount);
+      }
+    }
+    p->leafidx = colorcount-1; // see CollectNodeLeaves()
+  }
+
+  return colorcount;
+}
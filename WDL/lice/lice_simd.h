@@ -0,0 +1,101 @@
+#ifndef _LICE_SIMD_H_
+#define _LICE_SIMD_H_
+
+// compile-time availability and runtime detection of the vector instruction sets used by
+// LICE's optional SIMD code paths. every SIMD path has a scalar equivalent that produces
+// identical output, LICE_SIMD_SetMask() can be used to force the scalar code (for testing).
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define LICE_SIMD_HAVE_SSE2
+    #include <emmintrin.h>
+  #endif
+
+  #if defined(LICE_SIMD_HAVE_SSE2) && !defined(LICE_SIMD_NO_AVX2) && \
+      ((defined(_MSC_VER) && _MSC_VER >= 1700) || \
+       (defined(__clang__) && (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8))) || \
+       (!defined(__clang__) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+    #define LICE_SIMD_HAVE_AVX2
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+      #define LICE_SIMD_TARGET_AVX2
+    #else
+      #define LICE_SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+  #endif
+
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #elif defined(LICE_SIMD_HAVE_SSE2)
+    #include <cpuid.h>
+  #endif
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__BIG_ENDIAN__)
+  #define LICE_SIMD_HAVE_NEON
+  #include <arm_neon.h>
+#endif
+
+#define LICE_SIMD_SSE2 1
+#define LICE_SIMD_AVX2 2
+#define LICE_SIMD_NEON 4
+
+#ifdef LICE_SIMD_HAVE_AVX2
+inline int LICE_SIMD_DetectAVX2()
+{
+  unsigned int r[4] = { 0, };
+#ifdef _MSC_VER
+  int ri[4];
+  __cpuid(ri,0);
+  if (ri[0] < 7) return 0;
+  __cpuid(ri,1);
+  if ((ri[2] & (3<<27)) != (3<<27)) return 0; // OSXSAVE, AVX
+  if ((_xgetbv(0) & 6) != 6) return 0; // OS saves XMM/YMM state
+  __cpuidex(ri,7,0);
+  r[1]=(unsigned int)ri[1];
+#else
+  if (__get_cpuid_max(0,NULL) < 7) return 0;
+  __cpuid(1,r[0],r[1],r[2],r[3]);
+  if ((r[2] & (3<<27)) != (3<<27)) return 0;
+  unsigned int xcr0_lo, xcr0_hi;
+  __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0)); // xgetbv
+  if ((xcr0_lo & 6) != 6) return 0;
+  __cpuid_count(7,0,r[0],r[1],r[2],r[3]);
+#endif
+  return (r[1] & (1<<5)) ? LICE_SIMD_AVX2 : 0;
+}
+#endif
+
+inline int *LICE_SIMD_CapsPtr() // not static, so the state is shared by all translation units
+{
+  static int caps = -1;
+  return &caps;
+}
+
+// returns the set of LICE_SIMD_* flags that are compiled in and supported by this CPU
+inline int LICE_SIMD_GetCaps()
+{
+  int *caps = LICE_SIMD_CapsPtr();
+  if (*caps < 0)
+  {
+    int c = 0;
+#ifdef LICE_SIMD_HAVE_SSE2
+    c |= LICE_SIMD_SSE2;
+#endif
+#ifdef LICE_SIMD_HAVE_AVX2
+    c |= LICE_SIMD_DetectAVX2();
+#endif
+#ifdef LICE_SIMD_HAVE_NEON
+    c |= LICE_SIMD_NEON;
+#endif
+    *caps = c; // benign race, every thread computes the same value
+  }
+  return *caps;
+}
+
+// restricts the SIMD paths used (0 = scalar only, ~0 = everything detected)
+inline void LICE_SIMD_SetMask(int mask)
+{
+  *LICE_SIMD_CapsPtr() = -1;
+  *LICE_SIMD_CapsPtr() = LICE_SIMD_GetCaps() & mask;
+}
+
+#endif
@@ -53,6 +53,11 @@ class LICE_IFont
 
 #ifndef LICE_TEXT_NO_DECLARE_CACHEDFONT
 
+// glyphs are shared between all LICE_CachedFonts with the same face/size/flags (any thread), least recently
+// used glyphs are freed once the total exceeds maxbytes (default 4MB). a single LICE_CachedFont instance
+// should still only be used by one thread at a time.
+void LICE_SetGlyphCacheSize(int maxbytes);
+
 class LICE_CachedFont : public LICE_IFont
 {
   public:
@@ -79,6 +84,9 @@ class LICE_CachedFont : public LICE_IFont
 
     void SetLineSpacingAdjust(int amt) { m_lsadj=amt; }
 
+    struct glyphFace;
+    struct layoutCache;
+
   protected:
 
     virtual bool DrawGlyph(LICE_IBitmap *bm, unsigned short c, int xpos, int ypos, RECT *clipR);
@@ -95,21 +103,22 @@ class LICE_CachedFont : public LICE_IFont
     int m_line_height,m_lsadj;
     struct charEnt
     {
-      int base_offset; // offset in m_cachestore+1, so 1=offset0, 0=unset, -1=failed to render
+      unsigned char *bits; // width*height coverage, owned by the glyph face
+      int state; // 1=rendered, 0=unset (or evicted), -1=failed to render
       int width, height;
       int advance;
-      int charid; // used by m_extracharlist
+      int charid; // used by glyphFace::extrachars
       int left_extra;
+      unsigned int lastuse; // glyphFace::stamp when last drawn
     };
     charEnt *findChar(unsigned short c);
+    charEnt *getChar(unsigned short c); // renders if needed, m_face must be in use (glyphFace::useLock)
 
-    charEnt m_lowchars[128]; // first 128 chars cached here
-    WDL_TypedBuf<charEnt> m_extracharlist;
-    WDL_TypedBuf<unsigned char> m_cachestore;
-    
     static int _charSortFunc(const void *a, const void *b);
 
     HFONT m_font;
+    glyphFace *m_face; // shared glyph cache, NULL if no font set
+    layoutCache *m_layouts; // recently drawn strings
 
 };
 
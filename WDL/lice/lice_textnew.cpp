@@ -10,6 +10,9 @@
 #include "lice_combine.h"
 #include "lice_extended.h"
 
+#include "../mutex.h"
+#include "../ptrlist.h"
+
 #if defined(_WIN32) && defined(WDL_SUPPORT_WIN9X)
 static char __1ifNT2if98=0; // 2 for iswin98
 #endif
@@ -76,11 +79,292 @@ static int utf8char(const char *ptr, unsigned short *charOut) // returns char le
 
 
 
-//not threadsafe ----
+// s_tempbitmap/s_nativerender_tempbitmap/s_glyphscratch are only touched with s_render_mutex held
+static WDL_Mutex s_render_mutex;
 static LICE_SysBitmap *s_tempbitmap; // keep a sysbitmap around for rendering fonts
 static LICE_SysBitmap *s_nativerender_tempbitmap; 
+static WDL_TypedBuf<unsigned char> s_glyphscratch;
 static int s_tempbitmap_refcnt;
 
+// glyph faces are shared by every font with the same key. a face's glyphs are only accessed with a useLock
+// (once per DrawText() call), or by trim() with s_faces_mutex held while the face is not in use. lock order
+// is face mutex -> s_render_mutex -> s_faces_mutex
+struct LICE_CachedFont::glyphFace
+{
+  struct key_t
+  {
+#ifdef _WIN32
+    LOGFONT lf;
+#else
+    char face[64];
+    TEXTMETRIC tm;
+#endif
+    HFONT font; // only set if the face could not be identified by the above
+    int flags; // rendering flags only
+  };
+
+  glyphFace(const key_t *k)
+  {
+    key=*k;
+    refcnt=1;
+    busy=0;
+    stamp=0;
+    memset(lowchars,0,sizeof(lowchars));
+  }
+  ~glyphFace()
+  {
+    int x;
+    for (x=0;x<128;x++) freeChar(lowchars+x);
+    for (x=0;x<extrachars.GetSize();x++) freeChar(extrachars.Get()+x);
+  }
+
+  static glyphFace *Acquire(const key_t *key);
+  static void Release(glyphFace *f);
+
+  void freeChar(charEnt *ent);
+  void trim();
+
+  // holds the face's mutex and marks it busy, so trim() from other faces leaves its glyphs alone
+  class useLock
+  {
+    public:
+      useLock(glyphFace *f);
+      ~useLock();
+    private:
+      glyphFace *m_f;
+  };
+
+  key_t key;
+  int refcnt, busy; // s_faces_mutex
+  WDL_Mutex mutex;
+  unsigned int stamp; // s_glyphcache_stamp when the current DrawText() started
+  charEnt lowchars[128]; // first 128 chars cached here
+  WDL_TypedBuf<charEnt> extrachars; // sorted by charid
+};
+
+static WDL_Mutex s_faces_mutex;
+static WDL_PtrList<LICE_CachedFont::glyphFace> s_faces;
+static int s_glyphcache_size, s_glyphcache_max=4<<20; // bytes of glyph bits, s_faces_mutex
+static unsigned int s_glyphcache_stamp; // incremented per DrawText() call, s_faces_mutex
+
+void LICE_SetGlyphCacheSize(int maxbytes)
+{
+  WDL_MutexLock lock(&s_faces_mutex);
+  s_glyphcache_max = maxbytes;
+}
+
+LICE_CachedFont::glyphFace *LICE_CachedFont::glyphFace::Acquire(const key_t *key)
+{
+  WDL_MutexLock lock(&s_faces_mutex);
+  int x;
+  for (x=0;x<s_faces.GetSize();x++)
+  {
+    glyphFace *f = s_faces.Get(x);
+    if (!memcmp(&f->key,key,sizeof(*key)))
+    {
+      f->refcnt++;
+      return f;
+    }
+  }
+  glyphFace *f = new glyphFace(key);
+  s_faces.Add(f);
+  return f;
+}
+
+void LICE_CachedFont::glyphFace::Release(glyphFace *f)
+{
+  if (!f) return;
+  WDL_MutexLock lock(&s_faces_mutex);
+  if (--f->refcnt > 0) return;
+  s_faces.DeletePtr(f);
+  delete f;
+}
+
+LICE_CachedFont::glyphFace::useLock::useLock(glyphFace *f)
+{
+  m_f=f;
+  f->mutex.Enter();
+  WDL_MutexLock lock(&s_faces_mutex);
+  f->busy++;
+  f->stamp = ++s_glyphcache_stamp;
+}
+
+LICE_CachedFont::glyphFace::useLock::~useLock()
+{
+  s_faces_mutex.Enter();
+  m_f->busy--;
+  s_faces_mutex.Leave();
+  m_f->mutex.Leave();
+}
+
+void LICE_CachedFont::glyphFace::freeChar(charEnt *ent)
+{
+  if (ent->bits)
+  {
+    s_faces_mutex.Enter();
+    s_glyphcache_size -= ent->width*ent->height;
+    s_faces_mutex.Leave();
+    free(ent->bits);
+    ent->bits=NULL;
+  }
+  if (ent->state>0) ent->state=0;
+}
+
+// while over budget, frees the least recently drawn glyphs of this face (which must be in use by the
+// caller) and of any face not in use. glyphs used by the current DrawText() are kept, as are precalculated
+// fonts (their HFONT may no longer exist to re-render). faces in use on other threads are skipped rather
+// than waited for, their glyphs go once they are idle and this is over budget again
+void LICE_CachedFont::glyphFace::trim()
+{
+  WDL_MutexLock lock(&s_faces_mutex);
+  while (s_glyphcache_size > s_glyphcache_max)
+  {
+    charEnt *oldest=NULL;
+    glyphFace *oldest_face=NULL;
+    unsigned int oldest_age=0;
+    int i;
+    for (i=0;i<s_faces.GetSize();i++)
+    {
+      glyphFace *f = s_faces.Get(i);
+      if ((f != this && f->busy) || (f->key.flags&LICE_FONT_FLAG_PRECALCALL)) continue;
+      int x;
+      for (x=0;x<128+f->extrachars.GetSize();x++)
+      {
+        charEnt *ent = x<128 ? f->lowchars+x : f->extrachars.Get()+x-128;
+        if (!ent->bits || (f == this && ent->lastuse == stamp)) continue;
+        const unsigned int age = s_glyphcache_stamp - ent->lastuse;
+        if (!oldest || age > oldest_age) { oldest=ent; oldest_face=f; oldest_age=age; }
+      }
+    }
+    if (!oldest) return;
+    oldest_face->freeChar(oldest);
+  }
+}
+
+// recently laid out strings, so repeated labels skip utf-8 decoding, glyph lookup and measuring
+struct LICE_CachedFont::layoutCache
+{
+  enum { NSLOTS=8, MAXLEN=256 };
+  struct glyphPos { int charid, x, y; };
+  struct ent
+  {
+    WDL_TypedBuf<char> str;
+    int flags, lsadj; // DT_SINGLELINE, m_lsadj
+    int w, h; // DT_CALCRECT extents
+    WDL_TypedBuf<glyphPos> glyphs; // draw offsets
+  };
+
+  layoutCache() { next=0; }
+
+  ent *get(LICE_CachedFont *font, const char *str, int strcnt, UINT dtFlags); // font->m_face must be in use (useLock)
+
+  ent slots[NSLOTS+1]; // last slot is for strings too long to cache
+  int next;
+};
+
+LICE_CachedFont::layoutCache::ent *LICE_CachedFont::layoutCache::get(LICE_CachedFont *font, const char *str, int strcnt, UINT dtFlags)
+{
+  const int flags = dtFlags&DT_SINGLELINE;
+  int len=0, cnt=strcnt;
+  while (str[len] && cnt)
+  {
+    const int charlen = utf8char(str+len,NULL);
+    len += charlen;
+    if (cnt>0)
+    {
+      cnt -= charlen;
+      if (cnt<0) cnt=0;
+    }
+  }
+
+  int x;
+  ent *e;
+  if (len > MAXLEN) e = slots+NSLOTS;
+  else
+  {
+    for (x=0;x<NSLOTS;x++)
+    {
+      e = slots+x;
+      if (e->str.GetSize() == len+1 && e->flags == flags && e->lsadj == font->m_lsadj &&
+          !memcmp(e->str.Get(),str,len)) return e;
+    }
+    e = slots+next;
+    next = (next+1)%NSLOTS;
+  }
+
+  char *p = e->str.Resize(len+1,false);
+  if (e->str.GetSize() != len+1) return NULL;
+  memcpy(p,str,len);
+  p[len]=0;
+  e->flags = flags;
+  e->lsadj = font->m_lsadj;
+  e->glyphs.Resize(0,false);
+
+  const int fflags = font->m_flags;
+  const bool isVertRev = (fflags&(LICE_FONT_FLAG_VERTICAL|LICE_FONT_FLAG_VERTICAL_BOTTOMUP)) == (LICE_FONT_FLAG_VERTICAL|LICE_FONT_FLAG_VERTICAL_BOTTOMUP);
+  int xpos=0, ypos=0, max_xpos=0, max_ypos=0;
+  int dy=0; // draw position differs from the measured one for bottom-up text
+  while (*p)
+  {
+    unsigned short c=' ';
+    p += utf8char(p,&c);
+
+    if (c == '\r') continue;
+    if (c == '\n')
+    {
+      if (flags & DT_SINGLELINE) c=' ';
+      else
+      {
+        if (fflags&LICE_FONT_FLAG_VERTICAL) 
+        {
+          xpos+=font->m_line_height+font->m_lsadj;
+          ypos=dy=0;
+        }
+        else
+        {
+          ypos+=font->m_line_height+font->m_lsadj;
+          dy=ypos;
+          xpos=0;
+        }
+        continue;
+      }
+    }
+
+    const charEnt *ch = font->getChar(c);
+    if (!ch) continue;
+
+    glyphPos g = { c, xpos, dy };
+    if (fflags&LICE_FONT_FLAG_VERTICAL) 
+    {
+      if (isVertRev) 
+      {
+        g.y -= ch->height;
+        dy += -ch->advance;
+      }
+      else dy += ch->advance;
+
+      const int yext = ypos + ch->height - ch->left_extra;
+      ypos += ch->advance;
+      if (xpos+ch->width>max_xpos) max_xpos=xpos+ch->width;
+      if (ypos>max_ypos) max_ypos=ypos;
+      if (yext>max_ypos) max_ypos=yext;
+    }
+    else
+    {
+      const int xext = xpos + ch->width - ch->left_extra;
+      xpos += ch->advance;
+      if (ypos+ch->height>max_ypos) max_ypos=ypos+ch->height;         
+      if (xpos>max_xpos) max_xpos=xpos;
+      if (xext>max_xpos) max_xpos=xext;
+    }
+    e->glyphs.Add(g);
+  }
+  e->w = max_xpos;
+  e->h = max_ypos;
+  if (e == slots+NSLOTS) e->str.Resize(0,false); // never matches
+  return e;
+}
+
 
 int LICE_CachedFont::_charSortFunc(const void *a, const void *b)
 {
@@ -89,9 +373,11 @@ int LICE_CachedFont::_charSortFunc(const void *a, const void *b)
   return aa->charid - bb->charid;
 }
 
-LICE_CachedFont::LICE_CachedFont() : m_cachestore(65536)
+LICE_CachedFont::LICE_CachedFont()
 {
+  s_render_mutex.Enter();
   s_tempbitmap_refcnt++;
+  s_render_mutex.Leave();
   m_fg=0;
   m_effectcol=m_bg=LICE_RGBA(255,255,255,255); 
   m_comb=0;
@@ -101,7 +387,8 @@ LICE_CachedFont::LICE_CachedFont() : m_cachestore(65536)
   m_line_height=0;
   m_lsadj=0;
   m_font=0;
-  memset(m_lowchars,0,sizeof(m_lowchars));
+  m_face=NULL;
+  m_layouts=NULL;
 }
 
 LICE_CachedFont::~LICE_CachedFont()
@@ -109,12 +396,17 @@ LICE_CachedFont::~LICE_CachedFont()
   if ((m_flags&LICE_FONT_FLAG_OWNS_HFONT) && m_font) {
     DeleteObject(m_font);
   }
+  glyphFace::Release(m_face);
+  delete m_layouts;
+
+  WDL_MutexLock lock(&s_render_mutex);
   if (!--s_tempbitmap_refcnt)
   {
     delete s_tempbitmap;
     s_tempbitmap=0;
     delete s_nativerender_tempbitmap;
     s_nativerender_tempbitmap=0;
+    s_glyphscratch.Resize(0);
   }
 }
 
@@ -127,8 +419,13 @@ void LICE_CachedFont::SetFromHFont(HFONT font, int flags)
 
   m_flags=flags;
   m_font=font;
+
+  glyphFace::key_t key;
+  memset(&key,0,sizeof(key));
+  key.flags = flags & ~(LICE_FONT_FLAG_OWNS_HFONT|LICE_FONT_FLAG_FORCE_NATIVE);
   if (font)
   {
+    WDL_MutexLock lock(&s_render_mutex);
     if (!s_tempbitmap) s_tempbitmap=new LICE_SysBitmap;
 
     if (s_tempbitmap->getWidth() < 256 || s_tempbitmap->getHeight() < 256)
@@ -143,25 +440,48 @@ void LICE_CachedFont::SetFromHFont(HFONT font, int flags)
     HGDIOBJ oldFont = 0;
     if (font) oldFont = SelectObject(s_tempbitmap->getDC(),font);
     GetTextMetrics(s_tempbitmap->getDC(),&tm);
+#ifdef _WIN32
+    if (GetObject(font,sizeof(key.lf),&key.lf))
+    {
+      // bytes past the name's terminator are not necessarily cleared
+      const int l = (int)strlen(key.lf.lfFaceName) + 1;
+      if (l < LF_FACESIZE) memset(key.lf.lfFaceName+l,0,LF_FACESIZE-l);
+    }
+    else
+    {
+      memset(&key.lf,0,sizeof(key.lf));
+      key.font = font;
+    }
+#else
+    GetTextFace(s_tempbitmap->getDC(),sizeof(key.face)-1,key.face);
+    key.tm = tm;
+    if (!key.face[0]) key.font = font;
+#endif
     if (oldFont) SelectObject(s_tempbitmap->getDC(),oldFont);
 
     m_line_height = tm.tmHeight;
   }
 
-  memset(m_lowchars,0,sizeof(m_lowchars));
-  m_extracharlist.Resize(0,false);
-  m_cachestore.Resize(0);
+  // acquire before releasing so resetting the same font keeps its glyphs
+  glyphFace *oldface = m_face;
+  m_face = glyphFace::Acquire(&key);
+  glyphFace::Release(oldface);
+
+  delete m_layouts;
+  m_layouts = NULL;
+
   if (flags&LICE_FONT_FLAG_PRECALCALL)
   {
+    glyphFace::useLock lock(m_face);
     int x;
     for(x=0;x<128;x++)
-      RenderGlyph(x);
+      if (!m_face->lowchars[x].state) RenderGlyph(x);
   }
 }
 
-bool LICE_CachedFont::RenderGlyph(unsigned short idx) // return TRUE if ok
+bool LICE_CachedFont::RenderGlyph(unsigned short idx) // return TRUE if ok, m_face must be in use (glyphFace::useLock)
 {
-  if (m_line_height >= ABSOLUTELY_NO_GLYPHS_HIGHER_THAN) return false;
+  if (m_line_height >= ABSOLUTELY_NO_GLYPHS_HIGHER_THAN || !m_face) return false;
 
   bool needSort=false;
   charEnt *ent;
@@ -177,15 +497,20 @@ bool LICE_CachedFont::RenderGlyph(unsigned short idx) // return TRUE if ok
     {
       if (m_flags & LICE_FONT_FLAG_PRECALCALL) return false;
 
-      int oldsz=m_extracharlist.GetSize();
-      ent = m_extracharlist.Resize(oldsz+1) + oldsz;
+      int oldsz=m_face->extrachars.GetSize();
+      ent = m_face->extrachars.Resize(oldsz+1) + oldsz;
+      if (m_face->extrachars.GetSize() != oldsz+1) return false;
       memset(ent,0,sizeof(*ent));
       ent->charid = idx;
 
       needSort=true;
     }
   }
-  else ent = m_lowchars+idx;
+  else ent = m_face->lowchars+idx;
+
+  m_face->freeChar(ent);
+
+  WDL_MutexLock lock(&s_render_mutex);
 
   const int bmsz=lice_max(m_line_height,1) * 2 + 8;
 
@@ -249,7 +574,7 @@ bool LICE_CachedFont::RenderGlyph(unsigned short idx) // return TRUE if ok
 
   if (advance < 1 || r.bottom < 1) 
   {
-    ent->base_offset=-1;
+    ent->state=-1;
     ent->left_extra=ent->advance=ent->width=ent->height=0;
   }
   else
@@ -263,12 +588,11 @@ bool LICE_CachedFont::RenderGlyph(unsigned short idx) // return TRUE if ok
     LICE_pixel *srcbuf = s_tempbitmap->getBits();
     int span=s_tempbitmap->getRowSpan();
 
-    ent->base_offset=m_cachestore.GetSize()+1;
-    int newsz = ent->base_offset-1+r.right*r.bottom;
-    unsigned char *destbuf = m_cachestore.Resize(newsz) + ent->base_offset-1;
-    if (m_cachestore.GetSize() != newsz)
+    const int newsz = r.right*r.bottom;
+    unsigned char *destbuf = s_glyphscratch.Resize(newsz,false);
+    if (s_glyphscratch.GetSize() != newsz)
     {
-      ent->base_offset=-1;
+      ent->state=-1;
       ent->advance=ent->width=ent->height=0;
     }
     else
@@ -332,8 +656,7 @@ bool LICE_CachedFont::RenderGlyph(unsigned short idx) // return TRUE if ok
           rdptr += r.right;
         }
         r.right = neww;
-        newsz = ent->base_offset-1+r.right*r.bottom;
-        destbuf = m_cachestore.Resize(newsz,false) + ent->base_offset-1;
+        destbuf = s_glyphscratch.Get();
       }
 
       if (flags&LICE_FONT_FLAG_VERTICAL)
@@ -435,9 +758,25 @@ bool LICE_CachedFont::RenderGlyph(unsigned short idx) // return TRUE if ok
       ent->left_extra=left_extra_pad-min_x;
       ent->width = r.right;
       ent->height = r.bottom;
+      ent->bits = (unsigned char *)malloc(wdl_max(r.right*r.bottom,1));
+      if (ent->bits)
+      {
+        memcpy(ent->bits,s_glyphscratch.Get(),r.right*r.bottom);
+        ent->state=1;
+        s_faces_mutex.Enter();
+        s_glyphcache_size += r.right*r.bottom;
+        s_faces_mutex.Leave();
+      }
+      else
+      {
+        ent->state=-1;
+        ent->advance=ent->width=ent->height=0;
+      }
     }
   }
-  if (needSort&&m_extracharlist.GetSize()>1) qsort(m_extracharlist.Get(),m_extracharlist.GetSize(),sizeof(charEnt),_charSortFunc);
+  ent->lastuse = m_face->stamp;
+  if (needSort&&m_face->extrachars.GetSize()>1) qsort(m_face->extrachars.Get(),m_face->extrachars.GetSize(),sizeof(charEnt),_charSortFunc);
+  if (ent->state>0) m_face->trim();
 
   return true;
 }
@@ -523,11 +862,25 @@ public:
 
 LICE_CachedFont::charEnt *LICE_CachedFont::findChar(unsigned short c)
 {
-  if (c<128) return m_lowchars+c;
-  if (!m_extracharlist.GetSize()) return 0;
+  if (!m_face) return 0;
+  if (c<128) return m_face->lowchars+c;
+  if (!m_face->extrachars.GetSize()) return 0;
   charEnt a={0,};
   a.charid=c;
-  return (charEnt *)bsearch(&a,m_extracharlist.Get(),m_extracharlist.GetSize(),sizeof(charEnt),_charSortFunc);
+  return (charEnt *)bsearch(&a,m_face->extrachars.Get(),m_face->extrachars.GetSize(),sizeof(charEnt),_charSortFunc);
+}
+
+LICE_CachedFont::charEnt *LICE_CachedFont::getChar(unsigned short c)
+{
+  charEnt *ent = findChar(c);
+  if (!ent || !ent->state)
+  {
+    RenderGlyph(c);
+    ent = findChar(c);
+  }
+  if (!ent || ent->state<=0) return 0;
+  ent->lastuse = m_face->stamp;
+  return ent;
 }
 
 bool LICE_CachedFont::DrawGlyph(LICE_IBitmap *bm, unsigned short c, 
@@ -535,7 +888,7 @@ bool LICE_CachedFont::DrawGlyph(LICE_IBitmap *bm, unsigned short c,
 {
   charEnt *ch = findChar(c);
 
-  if (!ch) return false;
+  if (!ch || !ch->bits) return false;
 
   if (m_flags&LICE_FONT_FLAG_VERTICAL) 
   {
@@ -554,7 +907,7 @@ bool LICE_CachedFont::DrawGlyph(LICE_IBitmap *bm, unsigned short c,
       xpos+ch->width <= clipR->left || 
       ypos+ch->height <= clipR->top) return false;
 
-  unsigned char *gsrc = m_cachestore.Get() + ch->base_offset-1;
+  unsigned char *gsrc = ch->bits;
   int src_span = ch->width;
   int width = ch->width;
   int height = ch->height;
@@ -809,6 +1162,7 @@ int LICE_CachedFont::DrawTextImpl(LICE_IBitmap *bm, const char *str, int strcnt,
     {
       // use temp buffer -- we could optionally enable this if non-1 alpha was desired, though this only works for BLIT_MODE_COPY anyway (since it will end up compositing the whole rectangle, ugh)
       isTmp=true;
+      s_render_mutex.Enter(); // released at finish_up_native_render
 
       if (!s_nativerender_tempbitmap)
         s_nativerender_tempbitmap = new LICE_SysBitmap;
@@ -947,6 +1301,7 @@ int LICE_CachedFont::DrawTextImpl(LICE_IBitmap *bm, const char *str, int strcnt,
 
 finish_up_native_render:
     if (hdc) SelectObject(hdc, oldfont);
+    if (isTmp) s_render_mutex.Leave();
 #ifdef _WIN32
     if (wtmp!=wtmpbuf) free(wtmp);
 #endif
@@ -955,83 +1310,20 @@ finish_up_native_render:
 #endif
 
 
-  if (dtFlags & DT_CALCRECT)
-  {
-    int xpos=0;
-    int ypos=0;
-    int max_xpos=0;
-    int max_ypos=0;
-    while (*str && strcnt)
-    {
-      unsigned short c=' ';
-      int charlen = utf8char(str,&c);
-      str += charlen;
-      if (strcnt>0)
-      {
-        strcnt -= charlen;
-        if (strcnt<0) strcnt=0;
-      }
+  if (!m_face) return 0;
 
-      if (c == '\r') continue;
-      if (c == '\n')
-      {
-        if (dtFlags & DT_SINGLELINE) c=' ';
-        else
-        {
-          if (m_flags&LICE_FONT_FLAG_VERTICAL) 
-          {
-            xpos+=m_line_height+m_lsadj;
-            ypos=0;
-          }
-          else
-          {
-            ypos+=m_line_height+m_lsadj;
-            xpos=0;
-          }
-          continue;
-        }
-      }
+  glyphFace::useLock lock(m_face);
 
-      charEnt *ent = findChar(c);
-      if (!ent) 
-      {
-        const int os=m_extracharlist.GetSize();
-        RenderGlyph(c);
-        if (m_extracharlist.GetSize()!=os)
-          ent = findChar(c);
-      }
-
-      if (ent && ent->base_offset>=0)
-      {
-        if (ent->base_offset == 0) RenderGlyph(c);      
-
-        if (ent->base_offset > 0)
-        {
-          if (m_flags&LICE_FONT_FLAG_VERTICAL) 
-          {
-            const int yext = ypos + ent->height - ent->left_extra;
-            ypos += ent->advance;
-            if (xpos+ent->width>max_xpos) max_xpos=xpos+ent->width;
-            if (ypos>max_ypos) max_ypos=ypos;
-            if (yext>max_ypos) max_ypos=yext;
-          }
-          else
-          {
-            const int xext = xpos + ent->width - ent->left_extra;
-            xpos += ent->advance;
-            if (ypos+ent->height>max_ypos) max_ypos=ypos+ent->height;         
-            if (xpos>max_xpos) max_xpos=xpos;
-            if (xext>max_xpos) max_xpos=xext;
-          }
-        }
-      }
-    }
-
-    rect->right = rect->left+max_xpos;
-    rect->bottom = rect->top+max_ypos;
+  if (!m_layouts) m_layouts = new layoutCache;
+  const layoutCache::ent *layout = m_layouts->get(this,str,strcnt,dtFlags);
+  if (!layout) return 0;
 
+  if (dtFlags & DT_CALCRECT)
+  {
+    rect->right = rect->left+layout->w;
+    rect->bottom = rect->top+layout->h;
 
-    return (m_flags&LICE_FONT_FLAG_VERTICAL) ? max_xpos : max_ypos;
+    return (m_flags&LICE_FONT_FLAG_VERTICAL) ? layout->w : layout->h;
   }
   float alphaSave  = m_alpha;
 
@@ -1057,8 +1349,7 @@ finish_up_native_render:
 
   if (dtFlags & (DT_CENTER|DT_VCENTER|DT_RIGHT|DT_BOTTOM))
   {
-    RECT tr={0,};
-    DrawTextImpl(bm,str,strcnt,&tr,DT_CALCRECT|(dtFlags & DT_SINGLELINE)|(forceWantAlpha?LICE_DT_NEEDALPHA:0));
+    const RECT tr={0,0,layout->w,layout->h};
     if (dtFlags & DT_CENTER)
     {
       xpos += (use_rect.right-use_rect.left-tr.right)/2;
@@ -1081,9 +1372,7 @@ finish_up_native_render:
   }
   else if (isVertRev) 
   {
-    RECT tr={0,};
-    DrawTextImpl(bm,str,strcnt,&tr,DT_CALCRECT|(dtFlags & DT_SINGLELINE)|(forceWantAlpha?LICE_DT_NEEDALPHA:0));
-    ypos += tr.bottom;
+    ypos += layout->h;
   }
 
 
@@ -1116,71 +1405,28 @@ finish_up_native_render:
   // thought: calculate length of "...", then when pos+length+widthofnextchar >= right, switch
   // might need to precalc size to make sure it's needed, though
 
-  while (*str && strcnt)
+  const layoutCache::glyphPos *gp = layout->glyphs.Get();
+  int n = layout->glyphs.GetSize();
+  while (n-- > 0)
   {
-    unsigned short c=' ';
-    int charlen = utf8char(str,&c);
-    str += charlen;
-    if (strcnt>0)
-    {
-      strcnt -= charlen;
-      if (strcnt<0) strcnt=0;
-    }
-    if (c == '\r') continue;
-    if (c == '\n')
-    {
-      if (dtFlags & DT_SINGLELINE) c=' ';
-      else
-      {
-        if (m_flags&LICE_FONT_FLAG_VERTICAL) 
-        {
-          xpos+=m_line_height+m_lsadj;
-          ypos=start_y;
-        }
-        else
-        {
-          ypos+=m_line_height+m_lsadj;
-          xpos=start_x;
-        }
-        continue;
-      }
-    }
-
-    charEnt *ent = findChar(c);
-    if (!ent) 
+    const charEnt *ent = getChar(gp->charid);
+    if (ent)
     {
-      const int os=m_extracharlist.GetSize();
-      RenderGlyph(c);
-      if (m_extracharlist.GetSize()!=os)
-        ent = findChar(c);
-    }
+      xpos = start_x + gp->x;
+      ypos = start_y + gp->y;
 
-    if (ent && ent->base_offset>=0)
-    {
-      if (ent->base_offset==0) RenderGlyph(c);
+      bool drawn = DrawGlyph(bm,gp->charid,xpos,ypos,&use_rect);
 
-      if (ent->base_offset > 0 && ent->base_offset < m_cachestore.GetSize())
+      if (m_flags&LICE_FONT_FLAG_VERTICAL) 
       {
-        if (isVertRev) ypos -= ent->height;
-       
-        bool drawn = DrawGlyph(bm,c,xpos,ypos,&use_rect);
-
-        if (m_flags&LICE_FONT_FLAG_VERTICAL) 
-        {
-          if (!isVertRev)
-          {
-            ypos += ent->advance;
-          }
-          else ypos += ent->height - ent->advance;
-          if (drawn && xpos+ent->width > max_xpos) max_xpos=xpos;
-        }
-        else
-        {
-          xpos += ent->advance;
-          if (drawn && ypos+ent->height>max_ypos) max_ypos=ypos+ent->height;         
-        }
+        if (drawn && xpos+ent->width > max_xpos) max_xpos=xpos;
+      }
+      else
+      {
+        if (drawn && ypos+ent->height>max_ypos) max_ypos=ypos+ent->height;         
       }
     }
+    gp++;
   }
 
   m_alpha=alphaSave;
@@ -0,0 +1,304 @@
+#ifndef _LICE_THREAD_H_
+#define _LICE_THREAD_H_
+
+// minimal portable thread/event wrappers for LICE's optional worker threads
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <errno.h>
+#endif
+
+#include "../wdltypes.h"
+#include "../mutex.h"
+#include "../ptrlist.h"
+
+
+class LICE_Thread
+{
+public:
+  LICE_Thread() { m_thread=0; m_func=0; m_parm=0; }
+  ~LICE_Thread() { Join(); }
+
+  bool IsRunning() const { return !!m_thread; }
+
+  bool Start(unsigned int (*func)(void *), void *parm)
+  {
+    if (m_thread) return false;
+    m_func=func;
+    m_parm=parm;
+#ifdef _WIN32
+    unsigned id;
+    m_thread=(HANDLE)_beginthreadex(NULL,0,ThreadProc,(void *)this,0,&id);
+    return !!m_thread;
+#else
+    pthread_t t;
+    if (pthread_create(&t,NULL,ThreadProc,(void*)this)) return false;
+    m_th=t;
+    m_thread=1;
+    return true;
+#endif
+  }
+
+  void Join()
+  {
+    if (!m_thread) return;
+#ifdef _WIN32
+    WaitForSingleObject(m_thread,INFINITE);
+    CloseHandle(m_thread);
+#else
+    void *p;
+    pthread_join(m_th,&p);
+#endif
+    m_thread=0;
+  }
+
+  static int GetCPUCount()
+  {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+  }
+
+  static void Sleep(int ms)
+  {
+#ifdef _WIN32
+    ::Sleep(ms);
+#else
+    usleep(ms*1000);
+#endif
+  }
+
+private:
+#ifdef _WIN32
+  static unsigned WINAPI ThreadProc(void *p)
+  {
+    LICE_Thread *_this = (LICE_Thread *)p;
+    return _this->m_func(_this->m_parm);
+  }
+  HANDLE m_thread;
+#else
+  static void *ThreadProc(void *p)
+  {
+    LICE_Thread *_this = (LICE_Thread *)p;
+    _this->m_func(_this->m_parm);
+    return NULL;
+  }
+  pthread_t m_th;
+  int m_thread;
+#endif
+  unsigned int (*m_func)(void *);
+  void *m_parm;
+
+  // not copyable
+  LICE_Thread(const LICE_Thread &cp);
+  LICE_Thread &operator=(const LICE_Thread &cp);
+};
+
+
+class LICE_Event // auto-reset
+{
+public:
+  LICE_Event()
+  {
+#ifdef _WIN32
+    m_ev = CreateEvent(NULL,FALSE,FALSE,NULL);
+#else
+    m_sig=false;
+    pthread_mutex_init(&m_mutex,NULL);
+    pthread_cond_init(&m_cond,NULL);
+#endif
+  }
+  ~LICE_Event()
+  {
+#ifdef _WIN32
+    CloseHandle(m_ev);
+#else
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+#endif
+  }
+
+  void Set()
+  {
+#ifdef _WIN32
+    SetEvent(m_ev);
+#else
+    pthread_mutex_lock(&m_mutex);
+    m_sig=true;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+#endif
+  }
+
+  bool Wait(int ms) // returns true if signalled, ms<0 waits forever
+  {
+#ifdef _WIN32
+    return WaitForSingleObject(m_ev,ms<0 ? INFINITE : (DWORD)ms) == WAIT_OBJECT_0;
+#else
+    pthread_mutex_lock(&m_mutex);
+    if (!m_sig)
+    {
+      if (ms<0)
+      {
+        while (!m_sig) pthread_cond_wait(&m_cond,&m_mutex);
+      }
+      else
+      {
+        struct timeval tv;
+        gettimeofday(&tv,NULL);
+        struct timespec ts;
+        WDL_INT64 ns = (WDL_INT64)tv.tv_usec*1000 + (WDL_INT64)ms*1000000;
+        ts.tv_sec = tv.tv_sec + (time_t)(ns/1000000000);
+        ts.tv_nsec = (long)(ns%1000000000);
+        while (!m_sig && pthread_cond_timedwait(&m_cond,&m_mutex,&ts) != ETIMEDOUT);
+      }
+    }
+    const bool rv = m_sig;
+    m_sig=false;
+    pthread_mutex_unlock(&m_mutex);
+    return rv;
+#endif
+  }
+
+private:
+#ifdef _WIN32
+  HANDLE m_ev;
+#else
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_cond;
+  bool m_sig;
+#endif
+
+  LICE_Event(const LICE_Event &cp);
+  LICE_Event &operator=(const LICE_Event &cp);
+};
+
+
+// runs batches of independent jobs on a set of worker threads. the thread calling Wait()/Run() 
+// also processes jobs, so a pool with 0 workers runs everything on the caller.
+class LICE_ThreadPool
+{
+public:
+  LICE_ThreadPool(int nworkers)
+  {
+    m_func=0;
+    m_ctx=0;
+    m_njobs=m_nextjob=m_done=0;
+    m_kill=false;
+    int x;
+    for (x=0;x<nworkers;x++)
+    {
+      workerRec *w = new workerRec;
+      w->pool=this;
+      if (!w->th.Start(WorkerProc,w)) { delete w; break; }
+      m_workers.Add(w);
+    }
+  }
+  ~LICE_ThreadPool()
+  {
+    Wait();
+    m_mutex.Enter();
+    m_kill=true;
+    m_mutex.Leave();
+    int x;
+    for (x=0;x<m_workers.GetSize();x++) m_workers.Get(x)->ev.Set();
+    m_workers.Empty(true);
+  }
+
+  int GetThreadCount() { return m_workers.GetSize()+1; }
+
+  // starts jobs 0..njobs-1 on the workers and returns immediately, finish with Wait()
+  void Start(int njobs, void (*func)(void *ctx, int job), void *ctx)
+  {
+    Wait();
+    m_mutex.Enter();
+    m_func=func;
+    m_ctx=ctx;
+    m_njobs=njobs;
+    m_nextjob=m_done=0;
+    m_mutex.Leave();
+    int x;
+    for (x=0;x<m_workers.GetSize() && x<njobs;x++) m_workers.Get(x)->ev.Set();
+  }
+
+  void Wait() // helps with any jobs not yet started, then waits for the rest
+  {
+    RunJobs();
+    for (;;)
+    {
+      m_mutex.Enter();
+      const bool done = m_done >= m_njobs;
+      m_mutex.Leave();
+      if (done) break;
+      m_done_ev.Wait(100);
+    }
+  }
+
+  void Run(int njobs, void (*func)(void *ctx, int job), void *ctx) { Start(njobs,func,ctx); Wait(); }
+
+private:
+  struct workerRec
+  {
+    LICE_Event ev; // declared before th so the thread is joined before ev goes away
+    LICE_Thread th;
+    LICE_ThreadPool *pool;
+  };
+
+  void RunJobs()
+  {
+    for (;;)
+    {
+      m_mutex.Enter();
+      if (m_nextjob >= m_njobs) { m_mutex.Leave(); break; }
+      const int job = m_nextjob++;
+      void (*func)(void *, int) = m_func;
+      void *ctx = m_ctx;
+      m_mutex.Leave();
+
+      func(ctx,job);
+
+      m_mutex.Enter();
+      const bool last = ++m_done >= m_njobs;
+      m_mutex.Leave();
+      if (last) m_done_ev.Set();
+    }
+  }
+
+  static unsigned int WorkerProc(void *p)
+  {
+    workerRec *w = (workerRec *)p;
+    for (;;)
+    {
+      w->ev.Wait(-1);
+      w->pool->m_mutex.Enter();
+      const bool kill = w->pool->m_kill;
+      w->pool->m_mutex.Leave();
+      if (kill) break;
+      w->pool->RunJobs();
+    }
+    return 0;
+  }
+
+  WDL_PtrList<workerRec> m_workers;
+  WDL_Mutex m_mutex;
+  LICE_Event m_done_ev;
+  void (*m_func)(void *ctx, int job);
+  void *m_ctx;
+  int m_njobs, m_nextjob, m_done;
+  bool m_kill;
+
+  LICE_ThreadPool(const LICE_ThreadPool &cp);
+  LICE_ThreadPool &operator=(const LICE_ThreadPool &cp);
+};
+
+#endif
@@ -0,0 +1,417 @@
+// writes animated PNGs with lice_apng_write.cpp and reads them back with a decoder that only shares zlib with it:
+// the signature, IHDR and acTL, every chunk's CRC, fcTL/fdAT sequence numbers counting up from 0 with the first
+// frame's IDAT, frame rectangles being the bounding box of what changed, delays (unchanged frames merged into
+// the previous one), and each frame's zlib stream inflating to exactly its filtered rows with the adler32 in the
+// trailer matching them. the frames are unfiltered and composited with their blend op, the canvas must then match
+// the source frame. covers RGB and RGBA, every row filter, zlib levels and strategies, bottom-up sources, and
+// frames big enough to be split into bands on 2-4 threads, whose deflate pieces are joined with adler32_combine().
+//
+// usage: apngcheck [tempfile]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lice.h"
+#include "../../ptrlist.h"
+#include "../../zlib/zlib.h"
+
+static unsigned int rng_state=1;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state >> 8;
+}
+
+static unsigned int get32(const unsigned char *p) { return ((unsigned int)p[0]<<24) | (p[1]<<16) | (p[2]<<8) | p[3]; }
+
+#define NFRAMES 12
+
+// frame contents and delays. frames 2, 3 and 9 don't change anything the writer looks at (3 only changes alpha)
+static void MakeFrames(WDL_PtrList<LICE_MemBitmap> *frames, int *delays, int w, int h)
+{
+  int f;
+  for (f=0;f<NFRAMES;f++)
+  {
+    LICE_MemBitmap *bm = new LICE_MemBitmap(w,h);
+    frames->Add(bm);
+    delays[f] = f ? 10+f*7 : 70000; // the first doesn't fit in 16 bits of ms
+    LICE_pixel *p = bm->getBits();
+    const int span = bm->getRowSpan();
+    int x, y;
+    if (!f)
+    {
+      for (y=0;y<h;y++)
+        for (x=0;x<w;x++)
+          p[y*span+x] = (x/8+y/8)&1 ? LICE_RGBA(200,210,220,255) : LICE_RGBA(rng()&255,x&255,y&255,255);
+      continue;
+    }
+    LICE_Copy(bm,frames->Get(f-1));
+    switch (f)
+    {
+      case 1: LICE_FillRect(bm,w/3,h/4,w/5+1,h/6+1,LICE_RGBA(255,0,0,255),1.0f,LICE_BLIT_MODE_COPY); break;
+      case 2: case 9: break;
+      case 3: for (y=0;y<h;y+=3) for (x=0;x<w;x++) p[y*span+x] &= LICE_RGBA(255,255,255,0); break;
+      case 4: p[(h-1)*span+w-1] ^= LICE_RGBA(1,0,0,0); break;
+      case 5: case 8: case 11: // (nearly) everything
+        for (y=f==8;y<h;y++)
+          for (x=0;x<w;x++)
+            p[y*span+x] = LICE_RGBA((x*f+(int)(rng()%6))&255,(y*3+f)&255,(x^y)&255,255);
+      break;
+      case 6: p[2*span+3] = LICE_RGBA(0,0,0,255); p[(h-3)*span+w-5] = LICE_RGBA(255,255,255,255); break;
+      case 7: LICE_FillRect(bm,1,h/2,w-2,1,LICE_RGBA(10,20,30,255),1.0f,LICE_BLIT_MODE_COPY); break;
+      case 10: p[0] ^= LICE_RGBA(0,0,128,0); break;
+    }
+  }
+}
+
+struct apngCase
+{
+  const char *name;
+  int w, h;
+  bool transparent;
+  int level, strategy, filter, nthreads, nreps;
+  bool flipped;
+};
+
+static const apngCase s_cases[] = {
+  { "rgba, adaptive", 173, 97, true, 6, Z_DEFAULT_STRATEGY, LICE_APNG_FILTER_ADAPTIVE, 1, 0, false },
+  { "rgb, adaptive", 173, 97, false, 6, Z_DEFAULT_STRATEGY, LICE_APNG_FILTER_ADAPTIVE, 1, 3, false },
+  { "rgba, filter 0", 61, 45, true, 6, Z_DEFAULT_STRATEGY, 0, 1, 0, false },
+  { "rgba, filter 1", 61, 45, true, 6, Z_DEFAULT_STRATEGY, 1, 1, 0, false },
+  { "rgba, filter 2", 61, 45, true, 6, Z_DEFAULT_STRATEGY, 2, 1, 0, false },
+  { "rgba, filter 3", 61, 45, true, 6, Z_DEFAULT_STRATEGY, 3, 1, 0, false },
+  { "rgba, filter 4", 61, 45, true, 6, Z_DEFAULT_STRATEGY, 4, 1, 0, false },
+  { "rgb, filter 3", 61, 45, false, 6, Z_DEFAULT_STRATEGY, 3, 1, 0, false },
+  { "rgb, filter 4", 61, 45, false, 6, Z_DEFAULT_STRATEGY, 4, 1, 0, false },
+  { "rgba, level 1, huffman only", 173, 97, true, 1, Z_HUFFMAN_ONLY, LICE_APNG_FILTER_ADAPTIVE, 1, 0, false },
+  { "rgb, level 9, rle", 173, 97, false, 9, Z_RLE, LICE_APNG_FILTER_ADAPTIVE, 1, 0, false },
+  { "rgba, bottom-up source", 173, 97, true, 6, Z_DEFAULT_STRATEGY, LICE_APNG_FILTER_ADAPTIVE, 1, 0, true },
+  { "rgba, 2 threads", 400, 263, true, 6, Z_DEFAULT_STRATEGY, LICE_APNG_FILTER_ADAPTIVE, 2, 0, false },
+  { "rgba, 3 threads", 400, 263, true, 6, Z_DEFAULT_STRATEGY, LICE_APNG_FILTER_ADAPTIVE, 3, 0, false },
+  { "rgb, 4 threads", 400, 263, false, 6, Z_DEFAULT_STRATEGY, LICE_APNG_FILTER_ADAPTIVE, 4, 0, false },
+  { "rgba, 4 threads, level 0", 400, 263, true, 0, Z_DEFAULT_STRATEGY, 2, 4, 0, false },
+  { "rgba, 4 threads, bottom-up source", 400, 263, true, 6, Z_DEFAULT_STRATEGY, 4, 4, 0, true },
+};
+#define NCASES ((int)(sizeof(s_cases)/sizeof(s_cases[0])))
+
+static bool WriteCase(const apngCase *c, WDL_PtrList<LICE_MemBitmap> *frames, const int *delays, const char *fn)
+{
+  void *wr = LICE_WriteAPNGBegin(fn,c->w,c->h,c->transparent,c->nreps);
+  if (!wr) return false;
+  LICE_WriteAPNGSetCompression(wr,c->level,c->strategy,c->filter,c->nthreads);
+  WDL_TypedBuf<LICE_pixel> flipbuf;
+  int f;
+  for (f=0;f<frames->GetSize();f++)
+  {
+    LICE_MemBitmap *bm = frames->Get(f);
+    if (c->flipped)
+    {
+      // the same image, stored bottom-up
+      LICE_pixel *p = flipbuf.Resize(c->w*c->h,false);
+      int y;
+      for (y=0;y<c->h;y++) memcpy(p+(c->h-1-y)*c->w,bm->getBits()+y*bm->getRowSpan(),c->w*sizeof(LICE_pixel));
+      LICE_WrapperBitmap wb(p,c->w,c->h,c->w,true);
+      LICE_WriteAPNGFrame(wr,&wb,delays[f]);
+    }
+    else LICE_WriteAPNGFrame(wr,bm,delays[f]);
+  }
+  return LICE_WriteAPNGEnd(wr);
+}
+
+// what a viewer shows: the canvas after each frame and how long for
+struct apngDecoded
+{
+  apngDecoded() { w=h=bpp=nframes=nplays=0; }
+  ~apngDecoded() { canvases.Empty(true); }
+  int w, h, bpp, nframes, nplays;
+  WDL_PtrList<LICE_MemBitmap> canvases;
+  WDL_TypedBuf<int> rects; // x,y,w,h per frame
+  WDL_TypedBuf<int> delays; // ms
+};
+
+static int unfilter_paeth(int a, int b, int c)
+{
+  const int p = a+b-c;
+  const int pa = abs(p-a), pb = abs(p-b), pc = abs(p-c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+// inflates, unfilters and composites one frame, returns an error or NULL
+static const char *DecodeFrame(apngDecoded *d, const unsigned char *fctl, const WDL_TypedBuf<unsigned char> *zdata)
+{
+  const int fw = get32(fctl+4), fh = get32(fctl+8), fx = get32(fctl+12), fy = get32(fctl+16);
+  const int dnum = (fctl[20]<<8)|fctl[21], dden = (fctl[22]<<8)|fctl[23];
+  if (fw < 1 || fh < 1 || fx < 0 || fy < 0 || fx+fw > d->w || fy+fh > d->h) return "fcTL rectangle out of bounds";
+  if (!d->canvases.GetSize() && (fx || fy || fw != d->w || fh != d->h)) return "first fcTL is not the full image";
+  if (fctl[24] != 0) return "dispose op is not NONE";
+  if (fctl[25] > 1) return "bad blend op";
+  if (!zdata->GetSize()) return "frame without image data";
+
+  const int rowsz = 1+fw*d->bpp;
+  WDL_TypedBuf<unsigned char> raw;
+  unsigned char *rp = raw.Resize(rowsz*fh+1,false); // one spare byte so extra output is noticed
+  if (!rp) return "out of memory";
+
+  z_stream zs;
+  memset(&zs,0,sizeof(zs));
+  if (inflateInit(&zs) != Z_OK) return "inflateInit failed";
+  zs.next_in = (Bytef *)zdata->Get();
+  zs.avail_in = zdata->GetSize();
+  zs.next_out = rp;
+  zs.avail_out = raw.GetSize();
+  const int rv = inflate(&zs,Z_FINISH);
+  const int outlen = raw.GetSize() - zs.avail_out;
+  const int leftover = zs.avail_in;
+  inflateEnd(&zs);
+  if (rv == Z_DATA_ERROR && outlen == rowsz*fh) return "zlib stream does not check out (adler32?)";
+  if (rv != Z_STREAM_END) return "zlib stream is truncated or corrupt";
+  if (outlen != rowsz*fh) return "zlib stream inflates to the wrong size";
+  if (leftover) return "data after the end of the zlib stream";
+  if (adler32(adler32(0,NULL,0),rp,outlen) != get32(zdata->Get()+zdata->GetSize()-4)) return "adler32 trailer mismatch";
+
+  // unfilter in place
+  const int bpp = d->bpp, n = fw*bpp;
+  int x, y;
+  for (y=0;y<fh;y++)
+  {
+    unsigned char *row = rp + y*rowsz + 1;
+    const unsigned char *prev = y ? row - rowsz : NULL;
+    const int ft = row[-1];
+    for (x=0;x<n;x++)
+    {
+      const int a = x>=bpp ? row[x-bpp] : 0, b = prev ? prev[x] : 0, c = prev && x>=bpp ? prev[x-bpp] : 0;
+      switch (ft)
+      {
+        case 0: break;
+        case 1: row[x] += a; break;
+        case 2: row[x] += b; break;
+        case 3: row[x] += (a+b)>>1; break;
+        case 4: row[x] += unfilter_paeth(a,b,c); break;
+        default: return "bad row filter";
+      }
+    }
+  }
+
+  // composite onto the previous canvas (transparent black at first)
+  LICE_MemBitmap *cv = new LICE_MemBitmap(d->w,d->h);
+  if (d->canvases.GetSize()) LICE_Copy(cv,d->canvases.Get(d->canvases.GetSize()-1));
+  else LICE_Clear(cv,0);
+  d->canvases.Add(cv);
+  for (y=0;y<fh;y++)
+  {
+    const unsigned char *s = rp + y*rowsz + 1;
+    LICE_pixel *o = cv->getBits() + (fy+y)*cv->getRowSpan() + fx;
+    for (x=0;x<fw;x++)
+    {
+      const int a = bpp == 4 ? s[3] : 255;
+      if (a != 0 && a != 255) return "partially transparent pixel";
+      if (fctl[25] == 0 || a) o[x] = LICE_RGBA(s[0],s[1],s[2],a);
+      s += bpp;
+    }
+  }
+
+  d->rects.Add(fx);
+  d->rects.Add(fy);
+  d->rects.Add(fw);
+  d->rects.Add(fh);
+  d->delays.Add(dnum * 1000 / (dden ? dden : 100));
+  return NULL;
+}
+
+static const char *DecodeAPNG(const char *fn, apngDecoded *d)
+{
+  WDL_TypedBuf<unsigned char> file;
+  FILE *fp = fopen(fn,"rb");
+  if (!fp) return "can't open output";
+  fseek(fp,0,SEEK_END);
+  const int sz = (int)ftell(fp);
+  fseek(fp,0,SEEK_SET);
+  const int rd = (int)fread(file.Resize(sz,false),1,sz,fp);
+  fclose(fp);
+  if (sz < 8 || rd != sz) return "can't read output";
+
+  static const unsigned char sig[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+  const unsigned char *buf = file.Get();
+  if (memcmp(buf,sig,8)) return "bad signature";
+
+  WDL_TypedBuf<unsigned char> zdata;
+  unsigned char fctl[26];
+  bool have_fctl=false, have_actl=false, have_idat=false, have_iend=false, idat_done=false;
+  unsigned int seq=0;
+  int pos=8, nchunks=0;
+  while (pos < sz)
+  {
+    if (have_iend) return "data after IEND";
+    if (pos+12 > sz) return "truncated chunk header";
+    const unsigned int len = get32(buf+pos);
+    if (len > (unsigned int)(sz-pos-12)) return "chunk length past end of file";
+    const unsigned char *type = buf+pos+4, *data = buf+pos+8;
+    if (crc32(crc32(0,NULL,0),type,4+len) != get32(data+len)) return "chunk CRC mismatch";
+    pos += 12+len;
+    nchunks++;
+
+    if (nchunks == 1 && memcmp(type,"IHDR",4)) return "first chunk is not IHDR";
+    if (!memcmp(type,"IDAT",4) || !memcmp(type,"fdAT",4))
+    {
+      if (!d->w) return "image data before IHDR";
+      if (!have_actl) return "image data before acTL";
+      if (!have_fctl) return "image data without fcTL";
+      const bool isidat = type[0] == 'I';
+      if (isidat != !d->canvases.GetSize()) return isidat ? "IDAT after the first frame" : "fdAT in the first frame";
+      if (isidat && idat_done) return "IDAT chunks not consecutive";
+      if (!isidat)
+      {
+        if (len < 4) return "fdAT too short";
+        if (get32(data) != seq++) return "fdAT sequence number out of order";
+        data += 4;
+      }
+      const int dlen = isidat ? (int)len : (int)len-4, osz = zdata.GetSize();
+      unsigned char *zp = zdata.Resize(osz+dlen,false);
+      if (zdata.GetSize() != osz+dlen) return "out of memory";
+      memcpy(zp+osz,data,dlen);
+      if (isidat) have_idat=true;
+      continue;
+    }
+    if (have_idat) idat_done=true;
+
+    if (!memcmp(type,"IHDR",4))
+    {
+      if (nchunks != 1 || len != 13) return "bad IHDR";
+      d->w = get32(data);
+      d->h = get32(data+4);
+      if (data[8] != 8 || (data[9] != 2 && data[9] != 6) || data[10] || data[11] || data[12]) return "unexpected IHDR format";
+      d->bpp = data[9] == 6 ? 4 : 3;
+    }
+    else if (!memcmp(type,"acTL",4))
+    {
+      if (len != 8 || have_actl || have_fctl) return "bad or misplaced acTL";
+      have_actl=true;
+      d->nframes = get32(data);
+      d->nplays = get32(data+4);
+    }
+    else if (!memcmp(type,"fcTL",4))
+    {
+      if (len != 26 || !have_actl) return "bad or misplaced fcTL";
+      if (get32(data) != seq++) return "fcTL sequence number out of order";
+      if (have_fctl)
+      {
+        const char *err = DecodeFrame(d,fctl,&zdata);
+        if (err) return err;
+      }
+      else if (have_idat) return "IDAT before the first fcTL";
+      memcpy(fctl,data,26);
+      have_fctl=true;
+      zdata.Resize(0,false);
+    }
+    else if (!memcmp(type,"IEND",4))
+    {
+      if (len) return "bad IEND";
+      have_iend=true;
+    }
+    else if (!(type[0]&32)) return "unknown critical chunk";
+  }
+  if (!have_iend) return "no IEND";
+  if (!have_idat) return "no IDAT";
+  if (have_fctl)
+  {
+    const char *err = DecodeFrame(d,fctl,&zdata);
+    if (err) return err;
+  }
+  if (d->nframes != d->canvases.GetSize()) return "acTL frame count does not match the fcTL chunks";
+  return NULL;
+}
+
+// bounding box of the RGB changes, false if none
+static bool ChangedRect(LICE_IBitmap *a, LICE_IBitmap *b, int *r)
+{
+  int x, y, x0=a->getWidth(), y0=a->getHeight(), x1=-1, y1=-1;
+  for (y=0;y<a->getHeight();y++)
+    for (x=0;x<a->getWidth();x++)
+      if ((LICE_GetPixel(a,x,y) ^ LICE_GetPixel(b,x,y)) & LICE_RGBA(255,255,255,0))
+      {
+        if (x<x0) x0=x;
+        if (x>x1) x1=x;
+        if (y<y0) y0=y;
+        if (y>y1) y1=y;
+      }
+  if (x1<0) return false;
+  r[0]=x0; r[1]=y0; r[2]=x1-x0+1; r[3]=y1-y0+1;
+  return true;
+}
+
+static int CheckCase(const apngCase *c, const char *fn)
+{
+  WDL_PtrList<LICE_MemBitmap> frames;
+  int delays[NFRAMES];
+  rng_state = 1;
+  MakeFrames(&frames,delays,c->w,c->h);
+
+  apngDecoded d;
+  const char *err = WriteCase(c,&frames,delays,fn) ? DecodeAPNG(fn,&d) : "writer failed";
+  int f, nf=0;
+  if (!err && (d.w != c->w || d.h != c->h || d.bpp != (c->transparent ? 4 : 3) || d.nplays != c->nreps)) err = "IHDR/acTL don't match the writer's arguments";
+
+  // frames that change nothing are merged into the previous one
+  for (f=0;f<NFRAMES && !err;f++)
+  {
+    int rect[4] = { 0, 0, c->w, c->h }, tmp[4];
+    if (f && !ChangedRect(frames.Get(f-1),frames.Get(f),rect)) continue;
+    int delay = delays[f], f2;
+    for (f2=f+1;f2<NFRAMES && !ChangedRect(frames.Get(f),frames.Get(f2),tmp);f2++) delay += delays[f2];
+
+    if (nf >= d.canvases.GetSize()) { err = "fewer frames than expected"; break; }
+    LICE_MemBitmap *cv = d.canvases.Get(nf);
+    const int *dr = d.rects.Get()+nf*4;
+    int x, y;
+    for (y=0;y<c->h && !err;y++)
+      for (x=0;x<c->w;x++)
+        if ((LICE_GetPixel(cv,x,y) ^ LICE_GetPixel(frames.Get(f),x,y)) & LICE_RGBA(255,255,255,0) || LICE_GETA(LICE_GetPixel(cv,x,y)) != 255)
+        {
+          printf("%s: frame %d differs at %d,%d\n",c->name,nf,x,y);
+          err = "decoded frame differs from the source";
+          break;
+        }
+    if (!err && memcmp(dr,rect,sizeof(rect)))
+    {
+      printf("%s: frame %d is %d,%d %dx%d, changed area %d,%d %dx%d\n",c->name,nf,dr[0],dr[1],dr[2],dr[3],rect[0],rect[1],rect[2],rect[3]);
+      err = "frame rectangle is not the changed area";
+    }
+    if (!err && d.delays.Get()[nf] != delay)
+    {
+      printf("%s: frame %d delay %dms, expected %dms\n",c->name,nf,d.delays.Get()[nf],delay);
+      err = "wrong delay";
+    }
+    nf++;
+  }
+  if (!err && nf != d.canvases.GetSize()) err = "more frames than expected";
+
+  printf("%-40s %2d frames, %s\n",c->name,d.canvases.GetSize(),err ? err : "ok");
+  frames.Empty(true);
+  return err ? 1 : 0;
+}
+
+// a writer given no frames still writes a (blank) image
+static int CheckEmpty(const char *fn)
+{
+  void *wr = LICE_WriteAPNGBegin(fn,19,7);
+  apngDecoded d;
+  const char *err = wr && LICE_WriteAPNGEnd(wr) ? DecodeAPNG(fn,&d) : "writer failed";
+  if (!err && (d.canvases.GetSize() != 1 || LICE_GetPixel(d.canvases.Get(0),18,6) != (LICE_pixel)LICE_RGBA(0,0,0,255))) err = "expected one black frame";
+  printf("%-40s %2d frames, %s\n","no frames",d.canvases.GetSize(),err ? err : "ok");
+  return err ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *fn = argc > 1 ? argv[1] : "apngcheck.tmp.png";
+  int fails=0, x;
+  for (x=0;x<NCASES;x++) fails += CheckCase(s_cases+x,fn);
+  fails += CheckEmpty(fn);
+  remove(fn);
+
+  printf("%d files, %d failed\n",NCASES+1,fails);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+// draws with each of the functions LICE_SetThreadCount() splits into bands (LICE_ScaledBlit, LICE_Blur,
+// LICE_RotatedBlit, LICE_DeltaBlit, LICE_GradRect, LICE_TransformBlit and LICE_TransformBlit2) with one thread
+// and with several, and checks that every destination pixel is the same. covers the blend modes, the filters,
+// alpha, flipped and clipped rectangles, scaling up and down, and a source that is the destination (run serially).
+//
+// usage: bandcheck [max threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lice.h"
+
+static unsigned int rng_state=1;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state >> 8 ^ rng_state << 13;
+}
+
+#define DEST_W 411
+#define DEST_H 307
+
+// smooth areas, hard edges and noise, with varying alpha
+static void fillImage(LICE_IBitmap *bm, unsigned int seed)
+{
+  const int w = bm->getWidth(), h = bm->getHeight();
+  int x, y;
+  rng_state = seed;
+  for (y=0;y<h;y++)
+  {
+    LICE_pixel *p = bm->getBits() + y*bm->getRowSpan();
+    for (x=0;x<w;x++)
+    {
+      const unsigned int n = rng();
+      if (((x/23) ^ (y/17)) & 1) p[x] = LICE_RGBA(x*255/w,y*255/h,(x+y)&255,(x*3)&255);
+      else p[x] = LICE_RGBA(n&255,(n>>8)&255,(n>>16)&255,(n>>4)&255);
+    }
+  }
+}
+
+#define NMODES 7
+static const int s_modes[NMODES] = {
+  LICE_BLIT_MODE_COPY,
+  LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA,
+  LICE_BLIT_MODE_ADD,
+  LICE_BLIT_MODE_MUL|LICE_BLIT_USE_ALPHA,
+  LICE_BLIT_MODE_DODGE,
+  LICE_BLIT_MODE_OVERLAY,
+  LICE_BLIT_MODE_HSVADJ,
+};
+static const float s_alphas[2] = { 1.0f, 0.6f };
+
+// a variant is a mode, an alpha and a filter (where the function has one)
+#define NVARIANTS (NMODES*2*2)
+static int variantMode(int v, bool filters)
+{
+  int mode = s_modes[v%NMODES];
+  if (filters && (v/(NMODES*2))) mode |= LICE_BLIT_FILTER_BILINEAR;
+  return mode;
+}
+static float variantAlpha(int v) { return s_alphas[(v/NMODES)&1]; }
+
+static void drawScaled(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom)
+{
+  const int mode = variantMode(v,true);
+  const float a = variantAlpha(v);
+  switch (geom)
+  {
+    case 0: LICE_ScaledBlit(dest,src,0,0,DEST_W,DEST_H,0,0,(float)src->getWidth(),(float)src->getHeight(),a,mode); break; // up
+    case 1: LICE_ScaledBlit(dest,src,-13,-7,DEST_W+40,DEST_H+11,3.3f,1.7f,150.2f,101.9f,a,mode); break; // clipped
+    case 2: LICE_ScaledBlit(dest,src,5,290,400,-280,200.0f,0.0f,-190.0f,130.0f,a,mode); break; // flipped both ways
+    case 3: LICE_ScaledBlit(dest,dest,0,0,DEST_W,DEST_H,10.0f,10.0f,200.0f,150.0f,a,mode); break; // in place
+    case 4: LICE_ScaledBlit(dest,src,0,0,DEST_W,DEST_H,0.5f,0.25f,(float)src->getWidth()-1.0f,(float)src->getHeight()-0.5f,a,
+                            (mode&~LICE_BLIT_FILTER_MASK)|((v/(NMODES*2)) ? LICE_BLIT_FILTER_LANCZOS : LICE_BLIT_FILTER_AREA)); break;
+  }
+}
+
+static void drawBlur(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom)
+{
+  if (v) return; // no mode
+  switch (geom)
+  {
+    case 0: LICE_Blur(dest,src,0,0,0,0,src->getWidth(),src->getHeight()); break;
+    case 1: LICE_Blur(dest,src,-5,-9,3,2,src->getWidth(),src->getHeight()); break;
+    case 2: LICE_Blur(dest,dest,20,10,0,0,300,250); break; // in place
+  }
+}
+
+static void drawRotated(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom)
+{
+  const int mode = variantMode(v,true);
+  const float a = variantAlpha(v);
+  switch (geom)
+  {
+    case 0: LICE_RotatedBlit(dest,src,0,0,DEST_W,DEST_H,0,0,(float)src->getWidth(),(float)src->getHeight(),0.7f,true,a,mode); break;
+    case 1: LICE_RotatedBlit(dest,src,-20,-10,DEST_W+60,DEST_H+30,10.5f,5.25f,150.0f,120.0f,-2.1f,false,a,mode,12.0f,-7.5f); break;
+    case 2: LICE_RotatedBlit(dest,dest,0,0,DEST_W,DEST_H,0,0,DEST_W,DEST_H,0.2f,true,a,mode); break; // in place
+  }
+}
+
+static void drawDelta(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom)
+{
+  const int mode = variantMode(v,true);
+  const float a = variantAlpha(v);
+  switch (geom)
+  {
+    case 0: LICE_DeltaBlit(dest,src,0,0,DEST_W,DEST_H,0,0,(float)src->getWidth(),(float)src->getHeight(),
+                           0.6,0.05,-0.04,0.7,0.0002,-0.0001,true,a,mode); break;
+    case 1: LICE_DeltaBlit(dest,src,-17,-3,DEST_W+30,DEST_H+20,150.0f,120.0f,-140.0f,-110.0f,
+                           -0.5,0.1,0.2,-0.45,-0.0003,0.0004,false,a,mode); break;
+  }
+}
+
+static void drawGrad(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom)
+{
+  if (v >= 4) return; // copy or add, and alpha
+  const int mode = (v&1) ? LICE_BLIT_MODE_ADD : LICE_BLIT_MODE_COPY;
+  const float da = (v&2) ? -0.002f : 0.0f;
+  switch (geom)
+  {
+    case 0: LICE_GradRect(dest,0,0,DEST_W,DEST_H,0.1f,0.9f,0.3f,1.0f,0.002f,-0.002f,0.001f,da,0.001f,0.0005f,-0.001f,da,mode); break;
+    case 1: LICE_GradRect(dest,-30,-20,DEST_W+10,DEST_H+50,1.2f,-0.1f,0.5f,0.8f,-0.004f,0.003f,0.0f,da,0.0f,0.002f,0.0015f,da,mode); break;
+  }
+}
+
+// a wavy grid over the source, the float and double versions with the same points
+static void makeGrid(double *pts, int div_w, int div_h, int sw, int sh, int geom)
+{
+  int x, y;
+  for (y=0;y<div_h;y++)
+    for (x=0;x<div_w;x++)
+    {
+      const double fx = x/(double)(div_w-1), fy = y/(double)(div_h-1);
+      pts[(y*div_w+x)*2] = fx*sw + (geom ? 9.5*((x+y)%3-1) : 0.0) + (geom == 2 ? -20.0 : 0.0);
+      pts[(y*div_w+x)*2+1] = fy*sh + (geom ? 7.25*((x*2+y)%3-1) : 0.0);
+    }
+}
+
+static void drawTransform(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom, bool dbl)
+{
+  const int mode = variantMode(v,true);
+  const float a = variantAlpha(v);
+  double pts[5*7*2];
+  float fpts[5*7*2];
+  const int div_w = geom ? 5 : 2, div_h = geom ? 7 : 2;
+  makeGrid(pts,div_w,div_h,src->getWidth(),src->getHeight(),geom);
+  int x;
+  for (x=0;x<div_w*div_h*2;x++) fpts[x] = (float)pts[x];
+
+  const int dx = geom == 2 ? -25 : 0, dy = geom == 2 ? -15 : 0;
+  if (dbl) LICE_TransformBlit2(dest,src,dx,dy,DEST_W+30,DEST_H+20,pts,div_w,div_h,a,mode);
+  else LICE_TransformBlit(dest,src,dx,dy,DEST_W,DEST_H,fpts,div_w,div_h,a,mode);
+}
+static void drawTransformF(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom) { drawTransform(dest,src,v,geom,false); }
+static void drawTransformD(LICE_IBitmap *dest, LICE_IBitmap *src, int v, int geom) { drawTransform(dest,src,v,geom,true); }
+
+static const struct
+{
+  const char *name;
+  void (*draw)(LICE_IBitmap *dest, LICE_IBitmap *src, int variant, int geom);
+  int ngeom;
+  bool bigsrc; // a source larger than the destination, blur copies at 1:1 and small ones aren't split
+} s_funcs[] = {
+  { "LICE_ScaledBlit", drawScaled, 5, false },
+  { "LICE_Blur", drawBlur, 3, true },
+  { "LICE_RotatedBlit", drawRotated, 3, false },
+  { "LICE_DeltaBlit", drawDelta, 2, false },
+  { "LICE_GradRect", drawGrad, 2, false },
+  { "LICE_TransformBlit", drawTransformF, 3, false },
+  { "LICE_TransformBlit2", drawTransformD, 3, false },
+};
+#define NFUNCS ((int)(sizeof(s_funcs)/sizeof(s_funcs[0])))
+
+static int firstDiff(LICE_IBitmap *a, LICE_IBitmap *b, int *xo, int *yo)
+{
+  int x, y;
+  for (y=0;y<a->getHeight();y++)
+  {
+    const LICE_pixel *pa = a->getBits() + y*a->getRowSpan(), *pb = b->getBits() + y*b->getRowSpan();
+    for (x=0;x<a->getWidth();x++) if (pa[x] != pb[x])
+    {
+      *xo=x;
+      *yo=y;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  const int maxthreads = argc > 1 ? atoi(argv[1]) : 5;
+  if (maxthreads < 2)
+  {
+    printf("usage: bandcheck [max threads]\n");
+    return 1;
+  }
+
+  LICE_MemBitmap src(163,131), bigsrc(DEST_W+40,DEST_H+30), dest0(DEST_W,DEST_H), ref(DEST_W,DEST_H), out(DEST_W,DEST_H);
+  fillImage(&src,1);
+  fillImage(&bigsrc,3);
+  fillImage(&dest0,2);
+
+  int fails=0, tests=0, f;
+  for (f=0;f<NFUNCS;f++)
+  {
+    LICE_IBitmap *fsrc = s_funcs[f].bigsrc ? &bigsrc : &src;
+    int nf=0, nt=0, v, geom, nthreads;
+    for (geom=0;geom<s_funcs[f].ngeom;geom++)
+    {
+      for (v=0;v<NVARIANTS;v++)
+      {
+        LICE_SetThreadCount(1);
+        LICE_Copy(&ref,&dest0);
+        s_funcs[f].draw(&ref,fsrc,v,geom);
+        if (!memcmp(ref.getBits(),dest0.getBits(),DEST_W*DEST_H*sizeof(LICE_pixel)) && v) continue; // not a variant of this function
+
+        for (nthreads=2;nthreads<=maxthreads;nthreads++)
+        {
+          LICE_SetThreadCount(nthreads);
+          LICE_Copy(&out,&dest0);
+          s_funcs[f].draw(&out,fsrc,v,geom);
+          int x, y;
+          if (firstDiff(&ref,&out,&x,&y))
+          {
+            if (nf < 5) printf("%s: %d threads differ at %d,%d, case %d mode %x alpha %.1f: %08x vs %08x\n",s_funcs[f].name,
+                               nthreads,x,y,geom,variantMode(v,true),variantAlpha(v),out.getBits()[y*out.getRowSpan()+x],
+                               ref.getBits()[y*ref.getRowSpan()+x]);
+            nf++;
+          }
+          nt++;
+        }
+      }
+    }
+    printf("%-24s %5d tests, %d failed\n",s_funcs[f].name,nt,nf);
+    fails += nf;
+    tests += nt;
+  }
+  LICE_SetThreadCount(1);
+
+  printf("%d tests, %d failed\n",tests,fails);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
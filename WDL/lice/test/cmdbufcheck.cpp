@@ -0,0 +1,337 @@
+// checks that LICE_CmdBuf::Render() draws exactly what the same calls made directly on the bitmap draw: random
+// lines, float lines, rectangles, convex polygons, arcs and text, antialiased or not, in several modes, partly or
+// entirely outside the bitmap, for several tile sizes, with and without worker threads, into a LICE_MemBitmap and
+// into a LICE_SubBitmap. pixels outside the dirty rects Render() reports must not change.
+// LICE_ClippedLine, LICE_ClippedFLine and LICE_ClippedArc are also checked on their own: drawn in pieces into random
+// rectangles covering the bitmap they must match the unclipped call, and they must not touch pixels outside the rect.
+//
+// usage: cmdbufcheck [scenes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lice.h"
+#include "../lice_cmdbuf.h"
+
+static unsigned int rng_state=1;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state >> 8 ^ rng_state << 13;
+}
+static int rrange(int lo, int hi) { return lo + (int)(rng()%(unsigned int)(hi-lo+1)); }
+static float frange(float lo, float hi) { return lo + (hi-lo)*(rng()%100001)/100000.0f; }
+
+#define BM_W 301
+#define BM_H 233
+
+static const int s_modes[] = {
+  LICE_BLIT_MODE_COPY, LICE_BLIT_MODE_ADD, LICE_BLIT_MODE_MUL, LICE_BLIT_MODE_DODGE, LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA
+};
+#define NMODES ((int)(sizeof(s_modes)/sizeof(s_modes[0])))
+
+static void fillBackground(LICE_IBitmap *bm, unsigned int seed)
+{
+  int x, y;
+  for (y=0;y<bm->getHeight();y++)
+  {
+    LICE_pixel *p = bm->getBits() + y*bm->getRowSpan();
+    for (x=0;x<bm->getWidth();x++)
+    {
+      seed = seed*1664525 + 1013904223;
+      p[x] = LICE_RGBA((x*7)&255,(y*5)&255,seed>>24,(x+y)&255);
+    }
+  }
+}
+
+enum { P_LINE, P_FLINE, P_FILLRECT, P_POLY, P_ARC, P_TEXT, P_MAX };
+
+struct prim
+{
+  int type, mode;
+  LICE_pixel color;
+  float alpha;
+  bool aa;
+  int ip[8], npts; // line/fillrect: x,y,x2/w,y2/h, poly: x[4],y[4]
+  float fp[5];
+  char str[16];
+};
+
+// coordinates reach past the edges, so clipped and offscreen primitives are included
+static void randomPrim(prim *p, int w, int h)
+{
+  memset(p,0,sizeof(*p));
+  p->type = rng()%P_MAX;
+  p->mode = s_modes[rng()%NMODES];
+  p->color = LICE_RGBA(rng()&255,rng()&255,rng()&255,rng()&255);
+  p->alpha = (rng()&3) ? 1.0f : frange(0.1f,0.9f);
+  p->aa = !!(rng()&1);
+  int i;
+  switch (p->type)
+  {
+    case P_LINE:
+      for (i=0;i<4;i++) p->ip[i] = rrange(-40,(i&1 ? h : w)+40);
+      if (!(rng()%6)) p->ip[2] = p->ip[0]; // vertical
+      if (!(rng()%6)) p->ip[3] = p->ip[1]; // horizontal
+    break;
+    case P_FLINE:
+      for (i=0;i<4;i++) p->fp[i] = frange(-40.0f,(i&1 ? h : w)+40.0f);
+    break;
+    case P_FILLRECT:
+      p->ip[0] = rrange(-30,w);
+      p->ip[1] = rrange(-30,h);
+      p->ip[2] = rrange(1,120);
+      p->ip[3] = rrange(1,90);
+    break;
+    case P_POLY:
+    {
+      // a convex quad around a center, sometimes degenerate (1 pixel high)
+      const int cx = rrange(-20,w+20), cy = rrange(-20,h+20), rx = rrange(0,70), ry = (rng()%5) ? rrange(0,60) : 0;
+      p->npts = 4;
+      p->ip[0] = cx-rx; p->ip[4] = cy;
+      p->ip[1] = cx;    p->ip[5] = cy-ry;
+      p->ip[2] = cx+rx; p->ip[6] = cy;
+      p->ip[3] = cx;    p->ip[7] = cy+ry;
+    }
+    break;
+    case P_ARC:
+      p->fp[0] = frange(-30.0f,w+30.0f);
+      p->fp[1] = frange(-30.0f,h+30.0f);
+      p->fp[2] = (rng()&3) ? frange(0.5f,90.0f) : frange(0.5f,6.0f); // small ones use cached circles
+      p->fp[3] = frange(-7.0f,7.0f);
+      p->fp[4] = p->fp[3] + frange(0.0f,7.0f);
+    break;
+    case P_TEXT:
+    {
+      p->ip[0] = rrange(-40,w);
+      p->ip[1] = rrange(-10,h);
+      const int len = rrange(1,(int)sizeof(p->str)-1);
+      for (i=0;i<len;i++) p->str[i] = (char)rrange(32,126);
+    }
+    break;
+  }
+}
+
+static void drawImmediate(LICE_IBitmap *bm, const prim *p)
+{
+  switch (p->type)
+  {
+    case P_LINE: LICE_Line(bm,p->ip[0],p->ip[1],p->ip[2],p->ip[3],p->color,p->alpha,p->mode,p->aa); break;
+    case P_FLINE: LICE_FLine(bm,p->fp[0],p->fp[1],p->fp[2],p->fp[3],p->color,p->alpha,p->mode,p->aa); break;
+    case P_FILLRECT: LICE_FillRect(bm,p->ip[0],p->ip[1],p->ip[2],p->ip[3],p->color,p->alpha,p->mode); break;
+    case P_POLY: LICE_FillConvexPolygon(bm,p->ip,p->ip+4,p->npts,p->color,p->alpha,p->mode); break;
+    case P_ARC: LICE_Arc(bm,p->fp[0],p->fp[1],p->fp[2],p->fp[3],p->fp[4],p->color,p->alpha,p->mode,p->aa); break;
+    case P_TEXT: LICE_DrawText(bm,p->ip[0],p->ip[1],p->str,p->color,p->alpha,p->mode); break;
+  }
+}
+
+static void record(LICE_CmdBuf *cb, const prim *p)
+{
+  switch (p->type)
+  {
+    case P_LINE: cb->Line(p->ip[0],p->ip[1],p->ip[2],p->ip[3],p->color,p->alpha,p->mode,p->aa); break;
+    case P_FLINE: cb->FLine(p->fp[0],p->fp[1],p->fp[2],p->fp[3],p->color,p->alpha,p->mode,p->aa); break;
+    case P_FILLRECT: cb->FillRect(p->ip[0],p->ip[1],p->ip[2],p->ip[3],p->color,p->alpha,p->mode); break;
+    case P_POLY: cb->FillConvexPolygon(p->ip,p->ip+4,p->npts,p->color,p->alpha,p->mode); break;
+    case P_ARC: cb->Arc(p->fp[0],p->fp[1],p->fp[2],p->fp[3],p->fp[4],p->color,p->alpha,p->mode,p->aa); break;
+    case P_TEXT: cb->DrawText(p->ip[0],p->ip[1],p->str,p->color,p->alpha,p->mode); break;
+  }
+}
+
+static bool findDiff(LICE_IBitmap *a, LICE_IBitmap *b, int *xo, int *yo)
+{
+  int x, y;
+  for (y=0;y<a->getHeight();y++)
+  {
+    const LICE_pixel *pa = a->getBits() + y*a->getRowSpan(), *pb = b->getBits() + y*b->getRowSpan();
+    for (x=0;x<a->getWidth();x++) if (pa[x] != pb[x])
+    {
+      *xo=x;
+      *yo=y;
+      return true;
+    }
+  }
+  return false;
+}
+
+static const char *s_prim_names[P_MAX] = { "line", "fline", "fillrect", "poly", "arc", "text" };
+
+// a scene of n primitives, drawn directly and through a LICE_CmdBuf
+static int checkScene(int n, int tilesize, bool sub, int *ntests)
+{
+  static prim prims[64];
+  int i, fails=0;
+  for (i=0;i<n;i++) randomPrim(prims+i,BM_W,BM_H);
+
+  // the sub-bitmap case draws into the middle of a larger bitmap, which must stay untouched around it
+  LICE_MemBitmap ref_big(BM_W+20,BM_H+14), out_big(BM_W+20,BM_H+14), orig(BM_W+20,BM_H+14);
+  const unsigned int seed = rng();
+  fillBackground(&orig,seed);
+  LICE_Copy(&ref_big,&orig);
+  LICE_Copy(&out_big,&orig);
+  LICE_SubBitmap ref_sub(&ref_big,11,5,BM_W,BM_H), out_sub(&out_big,11,5,BM_W,BM_H);
+  LICE_IBitmap *ref = sub ? (LICE_IBitmap *)&ref_sub : &ref_big, *out = sub ? (LICE_IBitmap *)&out_sub : &out_big;
+
+  LICE_CmdBuf cb(tilesize);
+  for (i=0;i<n;i++)
+  {
+    drawImmediate(ref,prims+i);
+    record(&cb,prims+i);
+  }
+  cb.Render(out);
+  (*ntests)++;
+
+  int x, y;
+  if (findDiff(&ref_big,&out_big,&x,&y))
+  {
+    // find the first primitive that gets it wrong on its own
+    LICE_MemBitmap a(BM_W,BM_H), b(BM_W,BM_H);
+    for (i=0;i<n;i++)
+    {
+      fillBackground(&a,seed);
+      LICE_Copy(&b,&a);
+      drawImmediate(&a,prims+i);
+      LICE_CmdBuf one(tilesize);
+      record(&one,prims+i);
+      one.Render(&b);
+      if (findDiff(&a,&b,&x,&y)) break;
+    }
+    if (i < n)
+    {
+      const prim *p = prims+i;
+      printf("tile %d%s: %s differs at %d,%d (mode %x alpha %.2f aa %d, %d,%d,%d,%d %.2f,%.2f,%.2f,%.2f,%.2f)\n",tilesize,
+             sub ? " sub" : "",s_prim_names[p->type],x,y,p->mode,p->alpha,p->aa,p->ip[0],p->ip[1],p->ip[2],p->ip[3],
+             p->fp[0],p->fp[1],p->fp[2],p->fp[3],p->fp[4]);
+    }
+    else printf("tile %d%s: scene of %d differs at %d,%d, but no single primitive does\n",tilesize,sub ? " sub" : "",n,x,y);
+    fails++;
+  }
+
+  // nothing outside the reported dirty rects may change
+  int ndirty;
+  const RECT *dirty = cb.GetDirtyRects(&ndirty);
+  for (y=0;y<BM_H && !fails;y++)
+  {
+    for (x=0;x<BM_W;x++)
+    {
+      const LICE_pixel a = LICE_GetPixel(out,x,y);
+      if (a == orig.getBits()[(y+(sub?5:0))*orig.getRowSpan()+x+(sub?11:0)]) continue;
+      for (i=0;i<ndirty;i++)
+        if (x >= dirty[i].left && x < dirty[i].right && y >= dirty[i].top && y < dirty[i].bottom) break;
+      if (i == ndirty)
+      {
+        printf("tile %d%s: pixel %d,%d changed outside the %d dirty rects\n",tilesize,sub ? " sub" : "",x,y,ndirty);
+        fails++;
+        break;
+      }
+    }
+  }
+  return fails;
+}
+
+// LICE_Clipped* in pieces over a random grid of rectangles vs the unclipped call
+static int checkClipped(int type, int *ntests)
+{
+  LICE_MemBitmap orig(BM_W,BM_H), ref(BM_W,BM_H), out(BM_W,BM_H), one(BM_W,BM_H);
+  prim p;
+  do randomPrim(&p,BM_W,BM_H); while (p.type != type);
+  fillBackground(&orig,rng());
+  LICE_Copy(&ref,&orig);
+  LICE_Copy(&out,&orig);
+  drawImmediate(&ref,&p);
+
+  int xs[6], ys[6], nx = rrange(1,4), ny = rrange(1,4), i, j, x, y, fails=0;
+  xs[0]=ys[0]=0;
+  for (i=1;i<nx;i++) xs[i] = rrange(xs[i-1],BM_W);
+  for (i=1;i<ny;i++) ys[i] = rrange(ys[i-1],BM_H);
+  xs[nx]=BM_W;
+  ys[ny]=BM_H;
+
+  for (j=0;j<ny;j++)
+  {
+    for (i=0;i<nx;i++)
+    {
+      const RECT r = { xs[i], ys[j], xs[i+1], ys[j+1] };
+      LICE_Copy(&one,&orig);
+      switch (type)
+      {
+        case P_LINE:
+          LICE_ClippedLine(&out,&r,p.ip[0],p.ip[1],p.ip[2],p.ip[3],p.color,p.alpha,p.mode,p.aa);
+          LICE_ClippedLine(&one,&r,p.ip[0],p.ip[1],p.ip[2],p.ip[3],p.color,p.alpha,p.mode,p.aa);
+        break;
+        case P_FLINE:
+          LICE_ClippedFLine(&out,&r,p.fp[0],p.fp[1],p.fp[2],p.fp[3],p.color,p.alpha,p.mode,p.aa);
+          LICE_ClippedFLine(&one,&r,p.fp[0],p.fp[1],p.fp[2],p.fp[3],p.color,p.alpha,p.mode,p.aa);
+        break;
+        case P_ARC:
+          LICE_ClippedArc(&out,&r,p.fp[0],p.fp[1],p.fp[2],p.fp[3],p.fp[4],p.color,p.alpha,p.mode,p.aa);
+          LICE_ClippedArc(&one,&r,p.fp[0],p.fp[1],p.fp[2],p.fp[3],p.fp[4],p.color,p.alpha,p.mode,p.aa);
+        break;
+      }
+      (*ntests)++;
+      for (y=0;y<BM_H && !fails;y++)
+      {
+        for (x=0;x<BM_W;x++)
+        {
+          const bool in = x >= r.left && x < r.right && y >= r.top && y < r.bottom;
+          if (LICE_GetPixel(&one,x,y) != LICE_GetPixel(in ? &ref : &orig,x,y))
+          {
+            printf("%s: %d,%d %s clip %d,%d-%d,%d (mode %x alpha %.2f aa %d, %d,%d,%d,%d %.2f,%.2f,%.2f,%.2f,%.2f)\n",
+                   s_prim_names[type],x,y,in ? "differs inside" : "changed outside",r.left,r.top,r.right,r.bottom,
+                   p.mode,p.alpha,p.aa,p.ip[0],p.ip[1],p.ip[2],p.ip[3],p.fp[0],p.fp[1],p.fp[2],p.fp[3],p.fp[4]);
+            fails++;
+            break;
+          }
+        }
+      }
+    }
+  }
+  (*ntests)++;
+  if (!fails && findDiff(&ref,&out,&x,&y))
+  {
+    printf("%s: pieces differ from the whole at %d,%d\n",s_prim_names[type],x,y);
+    fails++;
+  }
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  const int nscenes = argc > 1 ? atoi(argv[1]) : 200;
+  if (nscenes < 1)
+  {
+    printf("usage: cmdbufcheck [scenes]\n");
+    return 1;
+  }
+
+  static const int tilesizes[] = { 8, 37, 64 };
+  int fails=0, tests=0, s, t, th;
+  for (th=0;th<2;th++)
+  {
+    LICE_SetThreadCount(th ? 4 : 1);
+    int nf=0, nt=0;
+    for (t=0;t<(int)(sizeof(tilesizes)/sizeof(tilesizes[0]));t++)
+      for (s=0;s<nscenes && nf<10;s++) nf += checkScene(rrange(1,(s&1) ? 64 : 8),tilesizes[t],!!(s&2),&nt);
+    printf("LICE_CmdBuf, %d thread%s: %5d scenes, %d failed\n",LICE_GetThreadCount(),th ? "s" : "",nt,nf);
+    fails += nf;
+    tests += nt;
+  }
+  LICE_SetThreadCount(1);
+
+  static const struct { int type; const char *name; } clipped[] = {
+    { P_LINE, "LICE_ClippedLine" }, { P_FLINE, "LICE_ClippedFLine" }, { P_ARC, "LICE_ClippedArc" }
+  };
+  for (t=0;t<3;t++)
+  {
+    int nf=0, nt=0;
+    for (s=0;s<nscenes*5 && nf<10;s++) nf += checkClipped(clipped[t].type,&nt);
+    printf("%-26s %5d rects, %d failed\n",clipped[t].name,nt,nf);
+    fails += nf;
+    tests += nt;
+  }
+
+  printf("%d tests, %d failed\n",tests,fails);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+// compares the span versions of the blit combiners in lice_combine.h (_LICE_CombineSpan, _LICE_CombineSpanFAST)
+// against the per-pixel loops they must match bit for bit: every combiner with a span specialization, odd span
+// lengths, unaligned rows, alpha 0, 0.5 and 1 plus random and out of range alphas, solid colors in and out of
+// the 0..255 range, and in-place rows overlapping in either direction. the vector code only runs if it is
+// compiled in for this target and supported by this CPU, the NEON versions are only checked when built for ARM.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../lice.h"
+#include "../lice_combine.h"
+
+static unsigned int rng_state=1;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state >> 8 ^ rng_state << 13;
+}
+
+#define MAXW 1025
+#define BUFSZ (MAXW+32)
+#define BASE 12 // room for the rows that start before the destination
+
+static LICE_pixel s_src[BUFSZ], s_d1[BUFSZ], s_d2[BUFSZ];
+
+static const int s_widths[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 13, 15, 16, 17, 19, 23, 31, 33, 37, 63, 65, 255, 257, 1023, MAXW };
+#define NWIDTHS ((int)(sizeof(s_widths)/sizeof(s_widths[0])))
+
+// 0, 0.5 and 1 first, the rest take the vector code at other scales or keep it out (ia<=0, ia>256)
+static const int s_alphas[] = { 0, 128, 256, 1, 2, 64, 127, 129, 192, 255, -1, -300, 257, 512 };
+#define NALPHAS ((int)(sizeof(s_alphas)/sizeof(s_alphas[0])))
+#define NRANDALPHAS 6
+
+static void fillRandom(LICE_pixel *p, int n)
+{
+  int x;
+  for (x=0;x<n;x++)
+  {
+    LICE_pixel v = rng();
+    switch (rng()%8)
+    {
+      case 0: v &= 0x00ffffff; break; // transparent
+      case 1: v |= 0xff000000; break; // opaque
+      case 2: v = (rng()&1) ? 0xffffffff : 0; break;
+    }
+    p[x]=v;
+  }
+}
+
+// source row for each overlap mode, the destination row always starts at BASE+offs
+#define NOVERLAP 5
+static const char *s_overlap_names[NOVERLAP] = { "separate", "in place", "src-1", "src+1", "src-5" };
+static const int s_overlap_shift[NOVERLAP] = { 0, 0, -1, 1, -5 };
+
+template<class COMBFUNC> static int checkComb(const char *name, int *ntests)
+{
+  int fails=0, tests=0, wi, ai, offs, ov;
+  for (wi=0;wi<NWIDTHS;wi++)
+  {
+    const int w = s_widths[wi];
+    for (ai=0;ai<NALPHAS+NRANDALPHAS;ai++)
+    {
+      const int ia = ai < NALPHAS ? s_alphas[ai] : 1 + (int)(rng()%256);
+      for (offs=0;offs<4;offs++)
+      {
+        for (ov=0;ov<NOVERLAP;ov++)
+        {
+          fillRandom(s_src,BUFSZ);
+          fillRandom(s_d1,BUFSZ);
+          memcpy(s_d2,s_d1,sizeof(s_d1));
+          LICE_pixel *o1 = s_d1+BASE+offs, *o2 = s_d2+BASE+offs;
+          const LICE_pixel *i1 = ov ? o1+s_overlap_shift[ov] : s_src+BASE+((offs+1)&3);
+          const LICE_pixel *i2 = ov ? o2+s_overlap_shift[ov] : i1;
+
+          _LICE_CombineSpanScalar<COMBFUNC>::blitRow((LICE_pixel_chan *)o1,(const LICE_pixel_chan *)i1,w,ia);
+          _LICE_CombineSpan<COMBFUNC>::blitRow((LICE_pixel_chan *)o2,(const LICE_pixel_chan *)i2,w,ia);
+          if (memcmp(s_d1,s_d2,sizeof(s_d1)))
+          {
+            if (fails < 5) printf("%s: blit mismatch, width %d ia %d offset %d %s\n",name,w,ia,offs,s_overlap_names[ov]);
+            fails++;
+          }
+          tests++;
+        }
+
+        // solid colors, including out of range channels (clamped or wrapped by the scalar code only)
+        int c;
+        for (c=0;c<4;c++)
+        {
+          int r = rng()&255, g = rng()&255, b = rng()&255, a = rng()&255;
+          if (c == 1) { r = 0; g = 255; b = 0; a = 255; }
+          else if (c == 2) { r = 300; g = -5; }
+          else if (c == 3) a = 256;
+          fillRandom(s_d1,BUFSZ);
+          memcpy(s_d2,s_d1,sizeof(s_d1));
+          _LICE_CombineSpanScalar<COMBFUNC>::solidRow((LICE_pixel_chan *)(s_d1+BASE+offs),w,r,g,b,a,ia);
+          _LICE_CombineSpan<COMBFUNC>::solidRow((LICE_pixel_chan *)(s_d2+BASE+offs),w,r,g,b,a,ia);
+          if (memcmp(s_d1,s_d2,sizeof(s_d1)))
+          {
+            if (fails < 5) printf("%s: solid mismatch, width %d ia %d offset %d color %d,%d,%d,%d\n",name,w,ia,offs,r,g,b,a);
+            fails++;
+          }
+          tests++;
+        }
+      }
+    }
+  }
+  printf("%-56s %6d tests, %d failed\n",name,tests,fails);
+  *ntests += tests;
+  return fails;
+}
+
+template<class COMBFUNC> static int checkCombFAST(const char *name, int *ntests)
+{
+  int fails=0, tests=0, wi, offs, ov, c;
+  for (wi=0;wi<NWIDTHS;wi++)
+  {
+    const int w = s_widths[wi];
+    for (offs=0;offs<4;offs++)
+    {
+      for (ov=0;ov<NOVERLAP;ov++)
+      {
+        fillRandom(s_src,BUFSZ);
+        fillRandom(s_d1,BUFSZ);
+        memcpy(s_d2,s_d1,sizeof(s_d1));
+        LICE_pixel *o1 = s_d1+BASE+offs, *o2 = s_d2+BASE+offs;
+        const LICE_pixel *i1 = ov ? o1+s_overlap_shift[ov] : s_src+BASE+((offs+1)&3);
+        const LICE_pixel *i2 = ov ? o2+s_overlap_shift[ov] : i1;
+
+        _LICE_CombineSpanScalarFAST<COMBFUNC>::blitRow(o1,i1,w);
+        _LICE_CombineSpanFAST<COMBFUNC>::blitRow(o2,i2,w);
+        if (memcmp(s_d1,s_d2,sizeof(s_d1)))
+        {
+          if (fails < 5) printf("%s: blit mismatch, width %d offset %d %s\n",name,w,offs,s_overlap_names[ov]);
+          fails++;
+        }
+        tests++;
+      }
+      for (c=0;c<4;c++)
+      {
+        const LICE_pixel color = c == 0 ? 0 : c == 1 ? 0xffffffff : rng();
+        fillRandom(s_d1,BUFSZ);
+        memcpy(s_d2,s_d1,sizeof(s_d1));
+        _LICE_CombineSpanScalarFAST<COMBFUNC>::solidRow(s_d1+BASE+offs,w,color);
+        _LICE_CombineSpanFAST<COMBFUNC>::solidRow(s_d2+BASE+offs,w,color);
+        if (memcmp(s_d1,s_d2,sizeof(s_d1)))
+        {
+          if (fails < 5) printf("%s: solid mismatch, width %d offset %d color %08x\n",name,w,offs,color);
+          fails++;
+        }
+        tests++;
+      }
+    }
+  }
+  printf("%-56s %6d tests, %d failed\n",name,tests,fails);
+  *ntests += tests;
+  return fails;
+}
+
+#define CHECK(comb) fails += checkComb<comb>(#comb,&tests)
+#define CHECK_FAST(comb) fails += checkCombFAST<comb>(#comb,&tests)
+
+int main(int argc, char **argv)
+{
+  int fails=0, tests=0;
+
+#if (defined(LICE_SIMD_HAVE_SSE2) || defined(LICE_SIMD_HAVE_NEON)) && LICE_PIXEL_A == 3 && !defined(LICE_NO_SIMD_COMBINE)
+  const int caps = LICE_SIMD_GetCaps();
+  #ifdef LICE_SIMD_HAVE_SSE2
+    if (!(caps & LICE_SIMD_SSE2)) printf("SSE2 not supported by this CPU, only the scalar spans are checked\n");
+  #else
+    if (!(caps & LICE_SIMD_NEON)) printf("NEON not supported by this CPU, only the scalar spans are checked\n");
+  #endif
+#else
+  printf("no SIMD span combiners for this target, only the scalar spans are checked\n");
+#endif
+
+  CHECK(_LICE_CombinePixelsCopyNoClamp);
+  CHECK(_LICE_CombinePixelsCopyClamp);
+  CHECK(_LICE_CombinePixelsCopySourceAlphaNoClamp);
+  CHECK(_LICE_CombinePixelsCopySourceAlphaClamp);
+  CHECK(_LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParmNoClamp);
+  CHECK(_LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParmClamp);
+  CHECK(_LICE_CombinePixelsHalfMixNoClamp);
+  CHECK(_LICE_CombinePixelsHalfMixClamp);
+#ifndef LICE_DISABLE_BLEND_ADD
+  CHECK(_LICE_CombinePixelsAdd);
+#endif
+#ifndef LICE_DISABLE_BLEND_MUL
+  CHECK(_LICE_CombinePixelsMulNoClamp);
+  CHECK(_LICE_CombinePixelsMulClamp);
+#endif
+
+  CHECK_FAST(_LICE_CombinePixelsClobberFAST);
+  CHECK_FAST(_LICE_CombinePixelsHalfMixFAST);
+  CHECK_FAST(_LICE_CombinePixelsHalfMix2FAST);
+  CHECK_FAST(_LICE_CombinePixelsQuarterMix2FAST);
+  CHECK_FAST(_LICE_CombinePixelsThreeQuarterMix2FAST);
+
+  printf("%d tests, %d failed\n",tests,fails);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+// writes a set of GIFs without dithering and checks that every file is byte for byte what the GIF writer
+// produced before dithering was implemented (the dither argument used to be ignored). covers single images,
+// a transparency threshold, animations with per-frame and global palettes, sub-rectangle frames and
+// intra-frame transparency as licecap uses it. the expected sizes and hashes come from the original
+// lice_gif_write.cpp/giflib/octree code, "gifoutputcheck -p" prints the table for the current code.
+// the animations are also written with frames prepared on other threads (LICE_WriteGIFPrepareFrame()) while
+// earlier ones are written, which must give the same files. make gifoutputcheck-tsan builds it with ThreadSanitizer.
+//
+// usage: gifoutputcheck [-p] [tempfile]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lice.h"
+#include "../lice_thread.h"
+
+static unsigned int rng_state;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state >> 8;
+}
+
+#define SCENE_ALPHA_HOLES 1 // some pixels fully transparent
+#define SCENE_JITTER 2 // low bits of a strip change every frame
+
+// something like a screen: flat window areas, a gradient, rows of "text" and a noisy photo-like block
+static void DrawScene(LICE_IBitmap *bm, int frame, int flags)
+{
+  const int w = bm->getWidth(), h = bm->getHeight();
+  int x, y;
+  rng_state = 1234;
+  LICE_FillRect(bm,0,0,w,h,LICE_RGBA(236,233,216,255),1.0f,LICE_BLIT_MODE_COPY);
+  LICE_GradRect(bm,0,0,w,20,0.1f,0.2f,0.6f,1.0f,0.0005f,0.0005f,0.0f,0.0f,0.0f,0.0f,0.0f,0.0f,LICE_BLIT_MODE_COPY);
+  for (y=30;y<h-10;y+=9)
+    for (x=10;x<w/2;x+=5+(int)(rng()%4))
+      LICE_FillRect(bm,x,y,3,6,LICE_RGBA(20,20,(y*3)&255,255),1.0f,LICE_BLIT_MODE_COPY);
+  for (y=40;y<h-20;y++)
+    for (x=w/2+10;x<w-10;x++)
+      bm->getBits()[y*bm->getRowSpan()+x] = LICE_RGBA((x*5+y)&255,(y*3+(int)(rng()%24))&255,(x^y)&255,255);
+
+  // a window that moves and changes color
+  const int bx = 20 + frame*13 % (w-80), by = 40 + frame*7 % (h-70);
+  LICE_FillRect(bm,bx,by,60,30,LICE_RGBA(frame*40&255,128,255-frame*30,255),1.0f,LICE_BLIT_MODE_COPY);
+  LICE_Line(bm,bx,by,bx+59,by+29,LICE_RGBA(0,0,0,255),1.0f,LICE_BLIT_MODE_COPY,false);
+
+  if (flags & SCENE_ALPHA_HOLES)
+    for (y=0;y<h;y+=7)
+      for (x=(y/7)&3;x<w;x+=11)
+        bm->getBits()[y*bm->getRowSpan()+x] &= LICE_RGBA(255,255,255,0);
+  if (flags & SCENE_JITTER)
+    for (y=h-30;y<h-10;y++)
+      for (x=10;x<w/2;x++)
+        bm->getBits()[y*bm->getRowSpan()+x] ^= LICE_RGBA((x+frame)&3,(y+frame)&7,frame&1,0);
+}
+
+static unsigned int HashFile(const char *fn, int *size)
+{
+  FILE *fp = fopen(fn,"rb");
+  unsigned int hash = 2166136261u; // FNV-1a
+  *size = -1;
+  if (!fp) return 0;
+  int c;
+  *size = 0;
+  while ((c = fgetc(fp)) != EOF)
+  {
+    hash = (hash ^ (unsigned int)c) * 16777619u;
+    (*size)++;
+  }
+  fclose(fp);
+  return hash;
+}
+
+#define W 301
+#define H 167
+#define NFRAMES 6
+
+// the arguments of a LICE_WriteGIFFrame() call
+struct gifFrame
+{
+  gifFrame() : bm(W,H) { x=y=delay=nreps=0; per_image=false; prepared=NULL; }
+  LICE_MemBitmap bm; // resized for sub-rectangles
+  int x, y, delay, nreps;
+  bool per_image;
+  void *prepared;
+};
+
+static int AnimTransAlpha(int idx) { return idx == 5 ? (-1)&~7 : idx == 6 ? -1 : 0; }
+
+static void GetAnimFrame(int idx, int f, gifFrame *out)
+{
+  out->x=out->y=out->nreps=0;
+  out->bm.resize(W,H);
+  switch (idx)
+  {
+    case 2: // animation, a palette per frame
+    case 3: // animation, the first frame's palette for all of them
+      DrawScene(&out->bm,f,0);
+      out->per_image = idx == 2;
+      out->delay = 100+f*10;
+    break;
+    case 4: // changed sub-rectangles, like licecap writes
+      DrawScene(&out->bm,f,0);
+      out->per_image = true;
+      out->delay = 50;
+      if (!f) out->nreps = 3;
+      else
+      {
+        LICE_MemBitmap tmp(97,61);
+        LICE_Blit(&tmp,&out->bm,0,0,f*17,f*11,97,61,1.0f,LICE_BLIT_MODE_COPY);
+        LICE_Copy(&out->bm,&tmp);
+        out->x = f*17;
+        out->y = f*11;
+      }
+    break;
+    case 5: // intra-frame transparency (unchanged pixels), with licecap's mask
+    case 6: // intra-frame transparency, without a mask
+      DrawScene(&out->bm,f,SCENE_JITTER);
+      out->per_image = true;
+      out->delay = 80;
+    break;
+    case 7: // global palette from an octree over all frames
+      DrawScene(&out->bm,f,0);
+      out->per_image = false;
+      out->delay = 100;
+    break;
+  }
+}
+
+// the frames of a batch are prepared on the pool while the previous batch is written, like licecap_cli's gifPipeline
+struct gifBatch
+{
+  gifFrame frames[2];
+  int cnt;
+  void *wr;
+  bool prepare; // LICE_WriteGIFCanPrepareFrames() when the batch was started
+};
+
+static void PrepareJob(void *ctx, int job)
+{
+  gifBatch *b = (gifBatch *)ctx;
+  gifFrame *f = b->frames+job;
+  if (b->prepare) f->prepared = LICE_WriteGIFPrepareFrame(b->wr,&f->bm,f->x,f->y,f->per_image);
+}
+
+static bool WriteAnim(int idx, const char *fn, LICE_ThreadPool *pool, int *nprepared)
+{
+  void *wr = LICE_WriteGIFBeginNoFrame(fn,W,H,AnimTransAlpha(idx),false);
+  if (!wr) return false;
+  if (idx == 7)
+  {
+    LICE_MemBitmap bm(W,H);
+    void *oct = LICE_CreateOctree(256);
+    if (!oct) { LICE_WriteGIFEnd(wr); return false; }
+    int f;
+    for (f=0;f<NFRAMES;f++)
+    {
+      DrawScene(&bm,f,0);
+      LICE_BuildOctree(oct,&bm);
+    }
+    LICE_SetGIFColorMapFromOctree(wr,oct,256);
+    LICE_DestroyOctree(oct);
+  }
+
+  if (!pool)
+  {
+    gifFrame fr;
+    int f;
+    for (f=0;f<NFRAMES;f++)
+    {
+      GetAnimFrame(idx,f,&fr);
+      LICE_WriteGIFFrame(wr,&fr.bm,fr.x,fr.y,fr.per_image,fr.delay,fr.nreps);
+    }
+    return LICE_WriteGIFEnd(wr);
+  }
+
+  static gifBatch sets[2];
+  const int bsize = (int) (sizeof(sets[0].frames)/sizeof(sets[0].frames[0]));
+  int k, f=0;
+  for (k=0;;k++)
+  {
+    gifBatch *b = &sets[k&1], *prev = &sets[(k+1)&1];
+    b->cnt=0;
+    b->wr=wr;
+    while (b->cnt < bsize && f < NFRAMES) GetAnimFrame(idx,f++,&b->frames[b->cnt++]);
+    b->prepare = LICE_WriteGIFCanPrepareFrames(wr,b->frames[0].per_image);
+    if (b->cnt) pool->Start(b->cnt,PrepareJob,b);
+
+    // write the previous batch while this one is prepared
+    int x;
+    for (x=0;x<(k ? prev->cnt : 0);x++)
+    {
+      gifFrame *fr = prev->frames+x;
+      if (fr->prepared)
+      {
+        LICE_WriteGIFPreparedFrame(wr,fr->prepared,fr->delay,fr->nreps);
+        LICE_WriteGIFFreePreparedFrame(fr->prepared);
+        fr->prepared=NULL;
+        (*nprepared)++;
+      }
+      else LICE_WriteGIFFrame(wr,&fr->bm,fr->x,fr->y,fr->per_image,fr->delay,fr->nreps);
+    }
+    pool->Wait();
+    if (!b->cnt) break;
+  }
+  return LICE_WriteGIFEnd(wr);
+}
+
+static bool WriteCase(int idx, const char *fn)
+{
+  if (idx >= 2)
+  {
+    int n=0;
+    return WriteAnim(idx,fn,NULL,&n);
+  }
+
+  LICE_MemBitmap bm(W,H);
+  DrawScene(&bm,idx,idx ? SCENE_ALPHA_HOLES : 0);
+  // single image, transparent below alpha 128 for the second
+  return LICE_WriteGIF(fn,&bm,idx ? 128 : 0,false);
+}
+
+#define NCASES 8
+static const char *s_case_names[NCASES] = {
+  "single", "single, transparent", "anim, per-frame palette", "anim, first palette",
+  "anim, sub-rects", "anim, intra-frame masked", "anim, intra-frame", "anim, octree palette"
+};
+
+// from the GIF writer before dithering was implemented
+static const struct { int size; unsigned int hash; } s_expected[NCASES] = {
+  { 11182, 0x28cf1875 }, // single
+  { 12325, 0x35aad1f2 }, // single, transparent
+  { 67294, 0x209495a9 }, // anim, per-frame palette
+  { 63451, 0xba27bbfb }, // anim, first palette
+  { 18101, 0x90650a39 }, // anim, sub-rects
+  { 14717, 0x57d00843 }, // anim, intra-frame masked
+  { 16839, 0xb803e356 }, // anim, intra-frame
+  { 63451, 0xe368d1b3 }, // anim, octree palette
+};
+
+int main(int argc, char **argv)
+{
+  const bool print = argc > 1 && !strcmp(argv[1],"-p");
+  const char *fn = argc > 1+print ? argv[1+print] : "gifoutputcheck.tmp.gif";
+  int fails=0, x;
+
+  for (x=0;x<NCASES;x++)
+  {
+    int size=-1;
+    unsigned int hash=0;
+    if (WriteCase(x,fn)) hash = HashFile(fn,&size);
+    if (print)
+    {
+      printf("  { %d, 0x%08x }, // %s\n",size,hash,s_case_names[x]);
+    }
+    else if (size != s_expected[x].size || hash != s_expected[x].hash)
+    {
+      printf("%s: %d bytes, hash %08x, expected %d bytes, hash %08x\n",s_case_names[x],size,hash,
+             s_expected[x].size,s_expected[x].hash);
+      fails++;
+    }
+  }
+  if (print)
+  {
+    remove(fn);
+    return 0;
+  }
+
+  // the animations again, written while the frames after them are prepared on other threads. the output must be
+  // the same, the global colormap cases only start preparing once the writer's palette tables are complete
+  LICE_ThreadPool pool(2);
+  int nfiles=NCASES;
+  for (x=2;x<NCASES;x++)
+  {
+    int size=-1, nprepared=0;
+    unsigned int hash=0;
+    if (WriteAnim(x,fn,&pool,&nprepared)) hash = HashFile(fn,&size);
+    printf("%s, pipelined: %d of %d frames prepared\n",s_case_names[x],nprepared,NFRAMES);
+    if (size != s_expected[x].size || hash != s_expected[x].hash)
+    {
+      printf("%s, pipelined: %d bytes, hash %08x, expected %d bytes, hash %08x\n",s_case_names[x],size,hash,
+             s_expected[x].size,s_expected[x].hash);
+      fails++;
+    }
+    else if (!nprepared && AnimTransAlpha(x) >= 0)
+    {
+      printf("%s, pipelined: no frames were prepared\n",s_case_names[x]);
+      fails++;
+    }
+    nfiles++;
+  }
+  remove(fn);
+
+  printf("%d files, %d differ\n",nfiles,fails);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
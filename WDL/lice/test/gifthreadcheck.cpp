@@ -0,0 +1,229 @@
+// encodes and decodes GIFs in memory with giflib on several threads at once and checks that every result
+// matches a single-threaded run: the encoded bytes, the decoded pixels and the error code of each file.
+// some of the files are made to fail in different ways (line too long, write failure, truncated or
+// corrupt data), so an error from one file showing up on another would be caught.
+//
+// usage: gifthreadcheck [threads] [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../giflib/gif_lib.h"
+#include "../../heapbuf.h"
+#include "../lice_thread.h"
+
+enum { MODE_OK=0, MODE_87A_LOSSY, MODE_LINE_TOO_LONG, MODE_WRITE_FAILS, MODE_TRUNCATED, MODE_CORRUPT, MODE_MAX };
+static const char *s_mode_names[MODE_MAX] = { "ok", "87a+lossy", "line too long", "write fails", "truncated", "corrupt" };
+
+#define NUM_JOBS 48
+
+struct jobResult
+{
+  WDL_TypedBuf<unsigned char> data; // encoded file
+  int enc_err;
+  int dec_err;
+  unsigned int dec_sum; // of the decoded lines, up to the error
+};
+
+struct writeCtx
+{
+  WDL_TypedBuf<unsigned char> *out;
+  int limit; // fail writes past this many bytes, -1 for no limit
+};
+
+static int WriteFunc(GifFileType *gf, const GifByteType *buf, int len)
+{
+  writeCtx *ctx = (writeCtx *)gf->UserData;
+  const int sz = ctx->out->GetSize();
+  if (ctx->limit >= 0 && sz+len > ctx->limit) return 0;
+  if (!ctx->out->Add(buf,len)) return 0;
+  return len;
+}
+
+struct readCtx
+{
+  const unsigned char *data;
+  int len, pos;
+};
+
+static int ReadFunc(GifFileType *gf, GifByteType *buf, int len)
+{
+  readCtx *ctx = (readCtx *)gf->UserData;
+  if (len > ctx->len - ctx->pos) len = ctx->len - ctx->pos;
+  if (len < 0) len = 0;
+  memcpy(buf,ctx->data+ctx->pos,len);
+  ctx->pos += len;
+  return len;
+}
+
+static unsigned int JobRand(unsigned int *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+static void RunJob(int job, jobResult *res)
+{
+  const int mode = job % MODE_MAX;
+  unsigned int seed = 1 + job*7919;
+  const int w = 17 + JobRand(&seed)%300, h = 9 + JobRand(&seed)%200;
+  const int bpp = 1 + job%8, ncol = 1<<bpp;
+
+  res->data.Resize(0,false);
+  res->enc_err = res->dec_err = 0;
+  res->dec_sum = 0;
+
+  ColorMapObject *cmap = MakeMapObject(ncol,NULL);
+  if (!cmap) { res->enc_err = -1; return; }
+  int x, y;
+  for (x=0;x<ncol;x++)
+  {
+    cmap->Colors[x].Red = (GifByteType)(x*37);
+    cmap->Colors[x].Green = (GifByteType)(x*91);
+    cmap->Colors[x].Blue = (GifByteType)(255-x);
+  }
+
+  writeCtx wctx = { &res->data, mode == MODE_WRITE_FAILS ? 200 + job*3 : -1 };
+  GifFileType *gf = EGifOpen(&wctx,WriteFunc);
+  if (!gf) { FreeMapObject(cmap); res->enc_err = -1; return; }
+
+  EGifSetGifVersion(gf, mode == MODE_87A_LOSSY ? "87a" : "89a");
+  if (mode == MODE_87A_LOSSY) EGifSetLossy(gf,8+job%16,-1);
+
+  WDL_TypedBuf<GifPixelType> line;
+  GifPixelType *lp = line.ResizeOK(w+1,false);
+  bool ok = lp &&
+            EGifPutScreenDesc(gf,w,h,bpp,0,cmap) != GIF_ERROR &&
+            EGifPutImageDesc(gf,0,0,w,h,FALSE,NULL) != GIF_ERROR;
+  for (y=0;y<h && ok;y++)
+  {
+    // runs of noise and flat areas, so that both short and long LZW codes are written
+    for (x=0;x<w;x++) lp[x] = (GifPixelType) (((x/7 + y/5) & 3) ? (x^y^job)&(ncol-1) : JobRand(&seed)&(ncol-1));
+    lp[w] = 0;
+    const int len = mode == MODE_LINE_TOO_LONG && y == h/2 ? w+1 : w; // fails at the last line
+    if (EGifPutLine(gf,lp,len) == GIF_ERROR) ok = false;
+  }
+  res->enc_err = gf->Error;
+  EGifCloseFile(gf);
+  FreeMapObject(cmap);
+  if (!ok) return;
+
+  readCtx rctx = { res->data.Get(), res->data.GetSize(), 0 };
+  WDL_TypedBuf<unsigned char> damaged;
+  if (mode == MODE_TRUNCATED) rctx.len = rctx.len*2/3;
+  else if (mode == MODE_CORRUPT)
+  {
+    unsigned char *p = damaged.ResizeOK(rctx.len,false);
+    if (!p) { res->dec_err = -1; return; }
+    memcpy(p,rctx.data,rctx.len);
+    for (x=rctx.len/3;x<rctx.len-1;x+=5) p[x] ^= 0x5a; // LZW data and sub-block sizes
+    rctx.data = p;
+  }
+
+  gf = DGifOpen(&rctx,ReadFunc);
+  if (!gf) { res->dec_err = -1; return; }
+  GifRecordType rt;
+  unsigned int sum = 0;
+  ok = DGifGetRecordType(gf,&rt) != GIF_ERROR && rt == IMAGE_DESC_RECORD_TYPE &&
+       DGifGetImageDesc(gf) != GIF_ERROR && gf->Image.Width == w && gf->Image.Height == h;
+  for (y=0;y<h && ok;y++)
+  {
+    if (DGifGetLine(gf,lp,w) == GIF_ERROR) ok = false;
+    else for (x=0;x<w;x++) sum = sum*31 + lp[x];
+  }
+  res->dec_err = ok ? gf->Error : (gf->Error ? gf->Error : -2);
+  res->dec_sum = sum;
+  DGifCloseFile(gf);
+}
+
+static jobResult s_ref[NUM_JOBS];
+
+struct threadCtx
+{
+  LICE_Thread thread;
+  int idx, rounds;
+  int mismatches;
+};
+
+static unsigned int ThreadProc(void *p)
+{
+  threadCtx *ctx = (threadCtx *)p;
+  jobResult res;
+  int r, j;
+  for (r=0;r<ctx->rounds;r++)
+  {
+    for (j=0;j<NUM_JOBS;j++)
+    {
+      const int job = (j + ctx->idx*7 + r) % NUM_JOBS; // threads work on different files at any time
+      RunJob(job,&res);
+      const jobResult *ref = s_ref+job;
+      if (res.enc_err != ref->enc_err || res.dec_err != ref->dec_err || res.dec_sum != ref->dec_sum ||
+          res.data.GetSize() != ref->data.GetSize() || memcmp(res.data.Get(),ref->data.Get(),res.data.GetSize()))
+      {
+        if (ctx->mismatches++ < 5)
+          printf("thread %d: file %d (%s) differs: errors %d/%d, expected %d/%d\n",ctx->idx,job,s_mode_names[job%MODE_MAX],
+                 res.enc_err,res.dec_err,ref->enc_err,ref->dec_err);
+      }
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  const int nthreads = argc > 1 ? atoi(argv[1]) : 8;
+  const int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  if (nthreads < 1 || rounds < 1)
+  {
+    printf("usage: gifthreadcheck [threads] [rounds]\n");
+    return 1;
+  }
+
+  // single-threaded reference, and the error each failure mode must produce
+  int errs[MODE_MAX][2], j, fails=0;
+  memset(errs,0,sizeof(errs));
+  for (j=0;j<NUM_JOBS;j++)
+  {
+    RunJob(j,s_ref+j);
+    const int mode = j%MODE_MAX;
+    const jobResult *r = s_ref+j;
+    const bool bad = mode == MODE_LINE_TOO_LONG ? r->enc_err != E_GIF_ERR_DATA_TOO_BIG :
+                     mode == MODE_WRITE_FAILS ? (r->enc_err != E_GIF_ERR_WRITE_FAILED && r->enc_err != E_GIF_ERR_DISK_IS_FULL) :
+                     mode == MODE_TRUNCATED ? r->enc_err || r->dec_err <= 0 :
+                     mode == MODE_CORRUPT ? r->enc_err || !r->dec_err :
+                     r->enc_err || r->dec_err;
+    if (bad)
+    {
+      printf("file %d (%s): unexpected errors %d/%d\n",j,s_mode_names[mode],r->enc_err,r->dec_err);
+      fails++;
+    }
+    if (j < MODE_MAX)
+    {
+      errs[mode][0] = r->enc_err;
+      errs[mode][1] = r->dec_err;
+    }
+  }
+  for (j=0;j<MODE_MAX;j++) printf("%-14s encode error %3d, decode error %3d\n",s_mode_names[j],errs[j][0],errs[j][1]);
+
+  threadCtx *ctx = new threadCtx[nthreads];
+  for (j=0;j<nthreads;j++)
+  {
+    ctx[j].idx = j;
+    ctx[j].rounds = rounds;
+    ctx[j].mismatches = 0;
+    ctx[j].thread.Start(ThreadProc,ctx+j);
+  }
+  int mismatches = 0;
+  for (j=0;j<nthreads;j++)
+  {
+    ctx[j].thread.Join();
+    mismatches += ctx[j].mismatches;
+  }
+  delete [] ctx;
+
+  printf("%d threads x %d rounds x %d files: %d mismatches\n",nthreads,rounds,NUM_JOBS,mismatches);
+  fails += mismatches;
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+// compares the SIMD 8888<->565 row converters in lice_lcf.cpp against the scalar ones: random rows at
+// odd widths and unaligned offsets, and every 565 value. only the versions compiled in for this target
+// and supported by this CPU are run, the NEON versions are only checked when built for ARM.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../lice_lcf.cpp" // the converters are static
+
+static unsigned int rng_state=1;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state;
+}
+
+#define MAXW 4111
+
+static int checkFuncs(const char *name, RowTo565Func to, RowFrom565Func from)
+{
+  static LICE_pixel src[MAXW+4], d1[MAXW+4], d2[MAXW+4];
+  static unsigned short s1[MAXW+4], s2[MAXW+4], src16[MAXW+4];
+  static const int bigw[] = { 255, 257, 1023, 1025, 4095, MAXW };
+  int fails=0, tests=0, x;
+
+  for (int pass = 0; pass < 80; pass ++)
+  {
+    const int w = pass < 74 ? pass : bigw[pass-74];
+    for (int offs = 0; offs < 4; offs ++)
+    {
+      for (x = 0; x < MAXW+4; x ++)
+      {
+        src[x] = rng();
+        src16[x] = (unsigned short)(rng()>>8);
+      }
+
+      // guard values past the end must be left alone
+      memset(s1,0xAB,sizeof(s1));
+      memset(s2,0xAB,sizeof(s2));
+      RowTo565(src+offs,s1+offs,w);
+      to(src+offs,s2+offs,w);
+      if (memcmp(s1,s2,sizeof(s1)))
+      {
+        if (fails < 10) printf("%s: to565 mismatch, width %d offset %d\n",name,w,offs);
+        fails++;
+      }
+
+      memset(d1,0xAB,sizeof(d1));
+      memset(d2,0xAB,sizeof(d2));
+      RowFrom565(src16+offs,d1+offs,w);
+      from(src16+offs,d2+offs,w);
+      if (memcmp(d1,d2,sizeof(d1)))
+      {
+        if (fails < 10) printf("%s: from565 mismatch, width %d offset %d\n",name,w,offs);
+        fails++;
+      }
+      tests += 2;
+    }
+  }
+
+  // every 565 value, and back
+  for (int base = 0; base < 65536; base += 4096)
+  {
+    for (x = 0; x < 4096; x ++) src16[x] = (unsigned short)(base+x);
+    RowFrom565(src16,d1,4096);
+    from(src16,d2,4096);
+    to(d2,s2,4096);
+    if (memcmp(d1,d2,4096*sizeof(LICE_pixel)) || memcmp(src16,s2,4096*sizeof(unsigned short)))
+    {
+      if (fails < 10) printf("%s: 565 values %d..%d do not match\n",name,base,base+4095);
+      fails++;
+    }
+    tests++;
+  }
+
+  printf("%s: %d tests, %d failed\n",name,tests,fails);
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  const int caps = LICE_SIMD_GetCaps();
+  int fails=0, nchecked=0;
+
+#ifdef LICE_SIMD_HAVE_SSE2
+  if (caps & LICE_SIMD_SSE2) { fails += checkFuncs("SSE2",RowTo565_SSE2,RowFrom565_SSE2); nchecked++; }
+  else printf("SSE2: not supported by this CPU, skipped\n");
+#endif
+#ifdef LICE_SIMD_HAVE_AVX2
+  if (caps & LICE_SIMD_AVX2) { fails += checkFuncs("AVX2",RowTo565_AVX2,RowFrom565_AVX2); nchecked++; }
+  else printf("AVX2: not supported by this CPU, skipped\n");
+#endif
+#ifdef LICE_SIMD_HAVE_NEON
+  if (caps & LICE_SIMD_NEON) { fails += checkFuncs("NEON",RowTo565_NEON,RowFrom565_NEON); nchecked++; }
+  else printf("NEON: not supported by this CPU, skipped\n");
+#endif
+
+  if (!nchecked) printf("no SIMD converters for this target\n");
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
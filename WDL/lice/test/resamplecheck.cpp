@@ -0,0 +1,309 @@
+// checks LICE_ScaledBlit with LICE_BLIT_FILTER_AREA and LICE_BLIT_FILTER_LANCZOS:
+//  - the SIMD row functions and the band-parallel passes give the same pixels as the scalar code on one thread, for
+//    scaling up and down by various ratios, odd widths, mirroring, clipping, bottom-up bitmaps, blend modes and in place
+//  - a solid source stays solid, and AREA at 2:1 or with a half pixel offset averages the covered pixels
+//  - the 1:1 shortcut: without a filter, or at integer source positions, a same-size ScaledBlit is a LICE_Blit.
+//    AREA and LANCZOS at a fractional position are resampled like any other size, not rounded to a LICE_Blit.
+// the SIMD code only runs if it is compiled in for this target and supported by this CPU.
+//
+// usage: resamplecheck [max threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../lice.h"
+#include "../lice_simd.h"
+
+static unsigned int rng_state=1;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state >> 8 ^ rng_state << 13;
+}
+
+// noise, hard edges and gradients, with varying alpha (the resampler filters all 4 channels)
+static void fillImage(LICE_IBitmap *bm, unsigned int seed)
+{
+  const int w = bm->getWidth(), h = bm->getHeight();
+  int x, y;
+  rng_state = seed;
+  for (y=0;y<h;y++)
+  {
+    for (x=0;x<w;x++)
+    {
+      const unsigned int n = rng();
+      LICE_pixel p;
+      if (((x/13) ^ (y/9)) & 1) p = LICE_RGBA(x*255/w,y*255/h,((x/4+y/4)&1)*255,255-(x*255/w));
+      else p = LICE_RGBA(n&255,(n>>8)&255,(n>>16)&255,(n>>4)&255);
+      LICE_PutPixel(bm,x,y,p,1.0f,LICE_BLIT_MODE_COPY);
+    }
+  }
+}
+
+static bool findDiff(LICE_IBitmap *a, LICE_IBitmap *b, int tol, int *xo, int *yo)
+{
+  int x, y;
+  for (y=0;y<a->getHeight();y++)
+  {
+    for (x=0;x<a->getWidth();x++)
+    {
+      const LICE_pixel pa = LICE_GetPixel(a,x,y), pb = LICE_GetPixel(b,x,y);
+      if (pa == pb) continue;
+      if (tol && abs((int)LICE_GETR(pa)-(int)LICE_GETR(pb)) <= tol && abs((int)LICE_GETG(pa)-(int)LICE_GETG(pb)) <= tol &&
+                 abs((int)LICE_GETB(pa)-(int)LICE_GETB(pb)) <= tol && abs((int)LICE_GETA(pa)-(int)LICE_GETA(pb)) <= tol) continue;
+      *xo=x;
+      *yo=y;
+      return true;
+    }
+  }
+  return false;
+}
+
+struct blitCase
+{
+  int srcw, srch; // source bitmap size
+  int dx, dy, dw, dh;
+  float sx, sy, sw, sh;
+  const char *desc;
+};
+
+static const blitCase s_cases[] = {
+  { 640, 480, 0, 0, 201, 151, 0, 0, 640, 480, "down 3.2:1" },
+  { 640, 480, 3, 2, 317, 239, 0.5f, 0.25f, 639, 479, "down ~2:1, offset" },
+  { 1000, 40, 0, 0, 3, 17, 0, 0, 1000, 40, "down 333:1 x, up y" },
+  { 97, 61, 0, 0, 411, 300, 0, 0, 97, 61, "up 4.2:1" },
+  { 97, 61, -20, -11, 411, 300, 10.3f, 5.7f, 50.5f, 40.25f, "up, clipped" },
+  { 300, 200, 0, 0, 257, 173, 300, 0, -300, 200, "mirrored x" },
+  { 300, 200, 1, 1, 255, 171, 0, 200, 300, -200, "mirrored y" },
+  { 301, 203, 0, 0, 301, 203, 0.5f, 0.5f, 301, 203, "1:1, half pixel" },
+  { 64, 64, 5, 5, 1, 1, 0, 0, 64, 64, "to one pixel" },
+  { 33, 17, 0, 0, 67, 35, -5.0f, -3.0f, 43, 23, "source rect past the edges" },
+};
+#define NCASES ((int)(sizeof(s_cases)/sizeof(s_cases[0])))
+
+static const int s_modes[] = {
+  LICE_BLIT_MODE_COPY, LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA, LICE_BLIT_MODE_ADD, LICE_BLIT_MODE_MUL,
+};
+#define NMODES ((int)(sizeof(s_modes)/sizeof(s_modes[0])))
+
+#define DEST_W 420
+#define DEST_H 310
+
+// every case, filter, mode and alpha with the given SIMD mask and thread count
+static void drawAll(LICE_IBitmap **out, int simdmask, int nthreads, bool inplace)
+{
+  LICE_SIMD_SetMask(simdmask);
+  LICE_SetThreadCount(nthreads);
+  int c, f, m, a, idx=0;
+  for (c=0;c<NCASES;c++)
+  {
+    const blitCase *bc = s_cases+c;
+    // a bottom-up source for some cases
+    LICE_MemBitmap srcbuf(bc->srcw,bc->srch);
+    LICE_WrapperBitmap src(srcbuf.getBits(),bc->srcw,bc->srch,srcbuf.getRowSpan(),c%3 == 1);
+    fillImage(&src,c+1);
+    for (f=0;f<2;f++)
+      for (m=0;m<NMODES;m++)
+        for (a=0;a<2;a++)
+        {
+          LICE_IBitmap *bm = out[idx++];
+          fillImage(bm,100+c);
+          const int mode = s_modes[m] | (f ? LICE_BLIT_FILTER_LANCZOS : LICE_BLIT_FILTER_AREA);
+          if (inplace)
+          {
+            // in place: the source is a part of the destination
+            LICE_ScaledBlit(bm,bm,bc->dx,bc->dy,bc->dw,bc->dh,bc->sx,bc->sy,
+                            bc->sw < DEST_W ? bc->sw : DEST_W,bc->sh < DEST_H ? bc->sh : DEST_H,a ? 0.6f : 1.0f,mode);
+          }
+          else LICE_ScaledBlit(bm,&src,bc->dx,bc->dy,bc->dw,bc->dh,bc->sx,bc->sy,bc->sw,bc->sh,a ? 0.6f : 1.0f,mode);
+        }
+  }
+  LICE_SIMD_SetMask(~0);
+  LICE_SetThreadCount(1);
+}
+#define NOUT (NCASES*2*NMODES*2)
+
+static int checkPaths(int maxthreads, int *ntests)
+{
+  static LICE_MemBitmap *bufs[NOUT*2];
+  static LICE_IBitmap *ref[NOUT], *out[NOUT];
+  int fails=0, i, pass, inplace;
+  for (i=0;i<NOUT;i++)
+  {
+    // bottom-up destinations for every other case, like a LICE_SysBitmap on some platforms
+    const bool flip = !!((i/(2*NMODES*2))&1);
+    bufs[i*2] = new LICE_MemBitmap(DEST_W,DEST_H);
+    bufs[i*2+1] = new LICE_MemBitmap(DEST_W,DEST_H);
+    ref[i] = new LICE_WrapperBitmap(bufs[i*2]->getBits(),DEST_W,DEST_H,bufs[i*2]->getRowSpan(),flip);
+    out[i] = new LICE_WrapperBitmap(bufs[i*2+1]->getBits(),DEST_W,DEST_H,bufs[i*2+1]->getRowSpan(),flip);
+  }
+
+  for (inplace=0;inplace<2;inplace++)
+  {
+    drawAll(ref,0,1,!!inplace);
+    for (pass=0;pass<3;pass++)
+    {
+      // SIMD on one thread, SIMD on several, scalar on several
+      const int mask = pass == 2 ? 0 : ~0, nthreads = pass ? maxthreads : 1;
+      drawAll(out,mask,nthreads,!!inplace);
+      for (i=0;i<NOUT;i++)
+      {
+        int x, y;
+        (*ntests)++;
+        if (findDiff(ref[i],out[i],0,&x,&y))
+        {
+          const int c = i/(2*NMODES*2), f = (i/(NMODES*2))&1, m = (i/2)%NMODES;
+          if (fails < 10)
+            printf("%s%s, %s mode %x alpha %.1f: %s, %d thread%s differ from scalar at %d,%d: %08x vs %08x\n",
+                   s_cases[c].desc,inplace ? " (in place)" : "",f ? "lanczos" : "area",s_modes[m],(i&1) ? 0.6f : 1.0f,
+                   mask ? "SIMD" : "scalar",nthreads,nthreads>1 ? "s" : "",x,y,LICE_GetPixel(out[i],x,y),LICE_GetPixel(ref[i],x,y));
+          fails++;
+        }
+      }
+    }
+  }
+  for (i=0;i<NOUT;i++)
+  {
+    delete ref[i];
+    delete out[i];
+    delete bufs[i*2];
+    delete bufs[i*2+1];
+  }
+  printf("SIMD and threads vs scalar:  %5d blits, %d differ\n",*ntests,fails);
+  return fails;
+}
+
+static int checkValues(int *ntests)
+{
+  int fails=0, f, x, y;
+  LICE_MemBitmap src(200,120), out(100,60), out2(199,119);
+
+  // a solid source stays solid, whatever the ratio or filter (the weights add up to exactly 1)
+  const LICE_pixel solid = LICE_RGBA(12,200,99,180);
+  LICE_Clear(&src,solid);
+  for (f=0;f<2;f++)
+  {
+    const int filter = f ? LICE_BLIT_FILTER_LANCZOS : LICE_BLIT_FILTER_AREA;
+    static const float sizes[][4] = { { 0, 0, 200, 120 }, { 3.3f, 1.1f, 17.9f, 110.2f }, { 150, 20, 10.5f, 3.25f } };
+    int s;
+    for (s=0;s<3;s++)
+    {
+      LICE_Clear(&out,0);
+      LICE_ScaledBlit(&out,&src,0,0,100,60,sizes[s][0],sizes[s][1],sizes[s][2],sizes[s][3],1.0f,LICE_BLIT_MODE_COPY|filter);
+      (*ntests)++;
+      for (y=0;y<60;y++)
+        for (x=0;x<100;x++)
+          if (LICE_GetPixel(&out,x,y) != solid)
+          {
+            if (fails < 10) printf("%s: solid source not solid at %d,%d: %08x\n",f ? "lanczos" : "area",x,y,LICE_GetPixel(&out,x,y));
+            fails++;
+            y=60;
+            break;
+          }
+    }
+  }
+
+  // AREA 2:1 is the average of each 2x2 block, with a half pixel offset at 1:1 the average of 2x2 neighbours.
+  // each pass rounds, so allow 1
+  fillImage(&src,7);
+  LICE_MemBitmap avg(100,60), avg2(199,119);
+  for (y=0;y<119;y++)
+  {
+    for (x=0;x<199;x++)
+    {
+      const LICE_pixel p0 = LICE_GetPixel(&src,x,y), p1 = LICE_GetPixel(&src,x+1,y),
+                       p2 = LICE_GetPixel(&src,x,y+1), p3 = LICE_GetPixel(&src,x+1,y+1);
+      #define AVG4(ch) ((ch(p0)+ch(p1)+ch(p2)+ch(p3)+2)/4)
+      const LICE_pixel v = LICE_RGBA(AVG4(LICE_GETR),AVG4(LICE_GETG),AVG4(LICE_GETB),AVG4(LICE_GETA));
+      #undef AVG4
+      LICE_PutPixel(&avg2,x,y,v,1.0f,LICE_BLIT_MODE_COPY);
+      if (!(x&1) && !(y&1)) LICE_PutPixel(&avg,x/2,y/2,v,1.0f,LICE_BLIT_MODE_COPY);
+    }
+  }
+  LICE_ScaledBlit(&out,&src,0,0,100,60,0,0,200,120,1.0f,LICE_BLIT_MODE_COPY|LICE_BLIT_FILTER_AREA);
+  LICE_ScaledBlit(&out2,&src,0,0,199,119,0.5f,0.5f,199,119,1.0f,LICE_BLIT_MODE_COPY|LICE_BLIT_FILTER_AREA);
+  (*ntests) += 2;
+  if (findDiff(&out,&avg,1,&x,&y))
+  {
+    printf("area 2:1: %d,%d is %08x, the 2x2 average is %08x\n",x,y,LICE_GetPixel(&out,x,y),LICE_GetPixel(&avg,x,y));
+    fails++;
+  }
+  if (findDiff(&out2,&avg2,1,&x,&y))
+  {
+    printf("area 1:1, half pixel offset: %d,%d is %08x, the 2x2 average is %08x\n",x,y,LICE_GetPixel(&out2,x,y),LICE_GetPixel(&avg2,x,y));
+    fails++;
+  }
+  printf("filter values:               %5d blits, %d wrong\n",*ntests,fails);
+  return fails;
+}
+
+// a same-size LICE_ScaledBlit vs LICE_Blit of the rounded source rect
+static int checkShortcut(int *ntests)
+{
+  int fails=0, f, o, x, y;
+  LICE_MemBitmap src(150,110), out(140,100), ref(140,100);
+  fillImage(&src,11);
+
+  static const int filters[] = { LICE_BLIT_FILTER_NONE, LICE_BLIT_FILTER_BILINEAR, LICE_BLIT_FILTER_AREA, LICE_BLIT_FILTER_LANCZOS };
+  static const char *names[] = { "none", "bilinear", "area", "lanczos" };
+  static const float offs[][2] = { { 5, 3 }, { 5.02f, 2.98f }, { 0, 0 }, { 5.3f, 3 }, { 5, 3.5f }, { 4.6f, 2.51f } };
+  for (f=0;f<4;f++)
+  {
+    for (o=0;o<(int)(sizeof(offs)/sizeof(offs[0]));o++)
+    {
+      const float sx = offs[o][0], sy = offs[o][1];
+      const bool frac = fabs(sx-floor(sx+0.5f)) >= 0.03 || fabs(sy-floor(sy+0.5f)) >= 0.03;
+      fillImage(&out,12);
+      fillImage(&ref,12);
+      LICE_ScaledBlit(&out,&src,-3,2,140,100,sx,sy,140,100,0.75f,LICE_BLIT_MODE_COPY|filters[f]);
+      const RECT sr = { (int)(sx+0.5f), (int)(sy+0.5f), (int)(sx+0.5f)+140, (int)(sy+0.5f)+100 };
+      LICE_Blit(&ref,&src,-3,2,&sr,0.75f,LICE_BLIT_MODE_COPY|filters[f]);
+
+      // no filter, or no fractional position: same as LICE_Blit. bilinear, area and lanczos at a fractional
+      // position filter (a noisy source can't come out the same)
+      const bool want_same = filters[f] == LICE_BLIT_FILTER_NONE || !frac;
+      const bool same = !findDiff(&out,&ref,0,&x,&y);
+      (*ntests)++;
+      if (same != want_same)
+      {
+        if (same) printf("1:1 %s at %.2f,%.2f: same as LICE_Blit, should be filtered\n",names[f],sx,sy);
+        else printf("1:1 %s at %.2f,%.2f: differs from LICE_Blit at %d,%d\n",names[f],sx,sy,x,y);
+        fails++;
+      }
+    }
+  }
+  printf("1:1 shortcut:                %5d blits, %d wrong\n",*ntests,fails);
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  const int maxthreads = argc > 1 ? atoi(argv[1]) : 4;
+  if (maxthreads < 2)
+  {
+    printf("usage: resamplecheck [max threads]\n");
+    return 1;
+  }
+
+#if defined(LICE_SIMD_HAVE_SSE2) || defined(LICE_SIMD_HAVE_NEON)
+  const int caps = LICE_SIMD_GetCaps();
+  #ifdef LICE_SIMD_HAVE_SSE2
+    if (!(caps & LICE_SIMD_SSE2)) printf("SSE2 not supported by this CPU, the SIMD rows are not checked\n");
+  #else
+    if (!(caps & LICE_SIMD_NEON)) printf("NEON not supported by this CPU, the SIMD rows are not checked\n");
+  #endif
+#else
+  printf("no SIMD resampling for this target, only the threads are checked\n");
+#endif
+
+  int fails=0, t1=0, t2=0, t3=0;
+  fails += checkPaths(maxthreads,&t1);
+  fails += checkValues(&t2);
+  fails += checkShortcut(&t3);
+
+  printf("%d tests, %d failed\n",t1+t2+t3,fails);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
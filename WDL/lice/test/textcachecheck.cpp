@@ -0,0 +1,417 @@
+// checks the glyph cache shared by LICE_CachedFonts (lice_textnew.cpp) against a stand-in for the GDI/SWELL text
+// functions, which rasterizes every glyph as a fixed pattern and counts how often it is asked to. covers:
+// - fonts with the same face sharing glyphs, and draws being identical with a glyph budget of 0, a few glyphs and
+//   plenty: vertical, shadow, outline, precalculated, utf-8, multiline, alignment, DT_CALCRECT and the string
+//   layout cache (strings are drawn repeatedly from a pool bigger than a font's layout slots)
+// - eviction being least recently used across faces: an idle face's glyphs go before the working set of the face
+//   that is drawing
+// - the same draws from several threads at once, each with its own fonts on the shared faces, with a budget that
+//   keeps evicting glyphs of faces in use elsewhere. make textcachecheck-tsan builds it with ThreadSanitizer.
+//
+// usage: textcachecheck
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lice_text.h"
+#include "../lice_thread.h"
+#include "../../swell/swell.h"
+
+static unsigned int rng_state=1;
+static unsigned int rng()
+{
+  rng_state = rng_state*1664525 + 1013904223;
+  return rng_state >> 8;
+}
+
+// the GDI side: an HFONT is a fakeFont, an HDC a fakeDC of a LICE_SysBitmap
+struct fakeFont
+{
+  const char *name;
+  int height, seed;
+};
+
+struct fakeDC
+{
+  LICE_SysBitmap *bm;
+  HGDIOBJ font;
+};
+
+static int s_nrasterized; // glyphs drawn by SWELL_DrawText(), only changed with lice_textnew.cpp's s_render_mutex held
+
+static int GlyphAdvance(const fakeFont *f, int c) { return 3 + (c*7 + f->seed)%6 + f->height/4; }
+static bool GlyphSpills(int c) { return c%5 == 0; } // one column left of the advance has ink
+
+// bytes the glyph takes in the cache, only for fonts without effects
+static int GlyphBytes(const fakeFont *f, int c) { return (GlyphAdvance(f,c) + GlyphSpills(c)) * f->height; }
+
+LICE_SysBitmap::LICE_SysBitmap(int w, int h)
+{
+  m_width=m_height=m_allocw=m_alloch=0;
+  m_bits=NULL;
+  fakeDC *dc = new fakeDC;
+  dc->bm=this;
+  dc->font=NULL;
+  m_dc = (HDC)dc;
+  __resize(w,h);
+}
+
+LICE_SysBitmap::~LICE_SysBitmap()
+{
+  delete (fakeDC *)m_dc;
+  free(m_bits);
+}
+
+bool LICE_SysBitmap::__resize(int w, int h)
+{
+  if (w == m_width && h == m_height) return false;
+  free(m_bits);
+  m_bits = (LICE_pixel *)calloc(wdl_max(w*h,1),sizeof(LICE_pixel));
+  m_width=m_allocw=w;
+  m_height=m_alloch=h;
+  return true;
+}
+
+HGDIOBJ SelectObject(HDC ctx, HGDIOBJ obj)
+{
+  fakeDC *dc = (fakeDC *)ctx;
+  HGDIOBJ old = dc->font;
+  dc->font = obj;
+  return old;
+}
+
+void DeleteObject(HGDIOBJ obj) { }
+void SetTextColor(HDC ctx, int col) { }
+void SetBkColor(HDC ctx, int col) { }
+void SetBkMode(HDC ctx, int col) { }
+void SWELL_PushClipRegion(HDC ctx) { }
+void SWELL_SetClipRegion(HDC ctx, const RECT *r) { }
+void SWELL_PopClipRegion(HDC ctx) { }
+
+BOOL GetTextMetrics(HDC ctx, TEXTMETRIC *tm)
+{
+  const fakeFont *f = (const fakeFont *)((fakeDC *)ctx)->font;
+  memset(tm,0,sizeof(*tm));
+  if (!f) return FALSE;
+  tm->tmHeight = f->height;
+  tm->tmAscent = f->height*3/4;
+  tm->tmDescent = f->height-tm->tmAscent;
+  tm->tmAveCharWidth = f->height/2;
+  return TRUE;
+}
+
+int GetTextFace(HDC ctx, int nCount, LPTSTR lpFaceName)
+{
+  const fakeFont *f = (const fakeFont *)((fakeDC *)ctx)->font;
+  if (nCount < 1) return 0;
+  snprintf(lpFaceName,nCount,"%s",f ? f->name : "");
+  return (int)strlen(lpFaceName);
+}
+
+// one character, as RenderGlyph() asks for them
+int SWELL_DrawText(HDC ctx, const char *buf, int len, RECT *r, int align)
+{
+  fakeDC *dc = (fakeDC *)ctx;
+  const fakeFont *f = (const fakeFont *)dc->font;
+  if (!f) return 0;
+  const unsigned char *p = (const unsigned char *)buf;
+  int c = p[0];
+  if (c >= 0xE0) c = ((c&0xf)<<12) | ((p[1]&0x3f)<<6) | (p[2]&0x3f);
+  else if (c >= 0xC0) c = ((c&0x1f)<<6) | (p[1]&0x3f);
+
+  const int adv = GlyphAdvance(f,c);
+  if (align & DT_CALCRECT)
+  {
+    r->right = r->left+adv;
+    r->bottom = r->top+f->height;
+    return f->height;
+  }
+  s_nrasterized++;
+  LICE_IBitmap *bm = dc->bm;
+  int x, y;
+  for (y=0;y<f->height;y++)
+    for (x=GlyphSpills(c) ? -1 : 0;x<adv;x++)
+    {
+      const int v = (c*31 + x*17 + y*13 + f->seed*7) % 5 ? ((c + x*y + f->seed)*37) & 255 : 0;
+      LICE_PutPixel(bm,r->left+x,r->top+y,LICE_RGBA(v,v,v,255),1.0f,LICE_BLIT_MODE_COPY);
+    }
+  return f->height;
+}
+
+#undef DrawText // from here on LICE_CachedFont::DrawText()
+
+#define NFONTS 8
+static fakeFont s_fakefonts[NFONTS] = {
+  { "Alpha", 13, 1 }, { "Alpha", 13, 1 }, { "Beta", 17, 2 }, { "Alpha", 13, 1 },
+  { "Beta", 17, 2 }, { "Gamma", 11, 3 }, { "Alpha", 13, 1 }, { "Beta", 17, 2 },
+};
+static const int s_fontflags[NFONTS] = {
+  0, 0, 0, LICE_FONT_FLAG_VERTICAL,
+  LICE_FONT_FLAG_FX_SHADOW, LICE_FONT_FLAG_PRECALCALL, LICE_FONT_FLAG_FX_OUTLINE,
+  LICE_FONT_FLAG_VERTICAL|LICE_FONT_FLAG_VERTICAL_BOTTOMUP
+}; // fonts 0/1 (and 1/3/6, 2/4/7 apart from the flags) have the same face
+
+static void CreateFonts(LICE_CachedFont **fonts)
+{
+  int x;
+  for (x=0;x<NFONTS;x++)
+  {
+    fonts[x] = new LICE_CachedFont;
+    fonts[x]->SetFromHFont((HFONT)(s_fakefonts+x),s_fontflags[x]);
+    if (x == 2) fonts[x]->SetLineSpacingAdjust(2);
+  }
+}
+
+static void DeleteFonts(LICE_CachedFont **fonts)
+{
+  int x;
+  for (x=0;x<NFONTS;x++) delete fonts[x];
+}
+
+#define NSTRINGS 20 // more than a font's layout slots
+static char s_strings[NSTRINGS][64];
+
+static void MakeStrings()
+{
+  static const char *pieces[] = { "a", "b", "Q", "x", "7", " ", ".", "W", "#", "g", "\xc3\xa9", "\xc3\x9f", "\xce\xa9", "\xe2\x82\xac", "\n" };
+  int x;
+  for (x=0;x<NSTRINGS;x++)
+  {
+    const int n = 1 + (int)(rng()%14);
+    s_strings[x][0]=0;
+    int i;
+    for (i=0;i<n;i++) strcat(s_strings[x],pieces[rng()%(sizeof(pieces)/sizeof(pieces[0]))]);
+  }
+}
+
+struct drawSpec
+{
+  int font, str, fmt, bkmode, comb;
+  LICE_pixel fg, bg;
+  float alpha;
+  RECT r;
+};
+
+static void MakeDraw(drawSpec *d)
+{
+  static const int fmts[] = { 0, DT_SINGLELINE, DT_CENTER, DT_RIGHT|DT_BOTTOM, DT_CENTER|DT_VCENTER|DT_SINGLELINE, DT_CALCRECT, DT_CALCRECT|DT_SINGLELINE };
+  static const int combs[] = { LICE_BLIT_MODE_COPY, LICE_BLIT_MODE_ADD, LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA };
+  d->font = rng()%NFONTS;
+  d->str = rng()%NSTRINGS;
+  d->fmt = fmts[rng()%(sizeof(fmts)/sizeof(fmts[0]))];
+  d->bkmode = rng()%4 ? TRANSPARENT : OPAQUE;
+  d->comb = combs[rng()%(sizeof(combs)/sizeof(combs[0]))];
+  d->fg = rng()|LICE_RGBA(0,0,0,255);
+  d->bg = rng();
+  d->alpha = rng()%3 ? 1.0f : 0.5f;
+  d->r.left = rng()%20;
+  d->r.top = rng()%16;
+  d->r.right = d->r.left + 40 + rng()%100;
+  d->r.bottom = d->r.top + 20 + rng()%40;
+}
+
+#define BM_W 180
+#define BM_H 90
+
+// draws into bm (cleared first) and returns a hash of the pixels, the return value and the rectangle
+static unsigned int Draw(LICE_CachedFont **fonts, const drawSpec *d, LICE_IBitmap *bm)
+{
+  LICE_CachedFont *font = fonts[d->font];
+  LICE_Clear(bm,LICE_RGBA(40,60,80,255));
+  font->SetTextColor(d->fg);
+  font->SetBkColor(d->bg);
+  font->SetEffectColor(d->bg^0xffffff);
+  font->SetBkMode(d->bkmode);
+  font->SetCombineMode(d->comb,d->alpha);
+  RECT r = d->r;
+  const int ret = font->DrawText(bm,s_strings[d->str],-1,&r,d->fmt);
+
+  unsigned int hash = 2166136261u; // FNV-1a
+  const int v[5] = { ret, r.left, r.top, r.right, r.bottom };
+  int x, y;
+  for (x=0;x<5;x++) hash = (hash ^ (unsigned int)v[x]) * 16777619u;
+  for (y=0;y<bm->getHeight();y++)
+  {
+    const LICE_pixel *p = bm->getBits() + y*bm->getRowSpan();
+    for (x=0;x<bm->getWidth();x++) hash = (hash ^ p[x]) * 16777619u;
+  }
+  return hash;
+}
+
+#define NDRAWS 400
+
+static int checkBudgets(int *ntests)
+{
+  static drawSpec draws[NDRAWS];
+  static unsigned int ref[NDRAWS];
+  static const int budgets[] = { 64<<20, 0, 1, 600, 3000, 20000 };
+  int fails=0, tests=0, x, b;
+  for (x=0;x<NDRAWS;x++) MakeDraw(draws+x);
+
+  LICE_MemBitmap bm(BM_W,BM_H);
+  for (b=0;b<(int)(sizeof(budgets)/sizeof(budgets[0]));b++)
+  {
+    LICE_SetGlyphCacheSize(budgets[b]);
+    LICE_CachedFont *fonts[NFONTS];
+    CreateFonts(fonts);
+    for (x=0;x<NDRAWS;x++)
+    {
+      const unsigned int hash = Draw(fonts,draws+x,&bm);
+      if (!b) ref[x]=hash;
+      else
+      {
+        if (hash != ref[x])
+        {
+          if (fails < 5) printf("budget %d: draw %d (font %d, \"%s\", format %x) differs\n",budgets[b],x,draws[x].font,
+                                s_strings[draws[x].str],draws[x].fmt);
+          fails++;
+        }
+        tests++;
+      }
+    }
+    DeleteFonts(fonts);
+  }
+  LICE_SetGlyphCacheSize(64<<20);
+
+  // a font on an existing face renders nothing new
+  LICE_CachedFont *fonts[NFONTS];
+  CreateFonts(fonts);
+  RECT r = { 0, 0, BM_W, BM_H };
+  fonts[0]->DrawText(&bm,"shared face",-1,&r,0);
+  const int n = s_nrasterized;
+  fonts[1]->DrawText(&bm,"face shared",-1,&r,0);
+  if (s_nrasterized != n)
+  {
+    printf("shared face: the second font rendered %d glyphs\n",s_nrasterized-n);
+    fails++;
+  }
+  tests++;
+  DeleteFonts(fonts);
+
+  printf("%-40s %6d tests, %d failed\n","budgets, shared faces",tests,fails);
+  *ntests += tests;
+  return fails;
+}
+
+static int checkLRU(int *ntests)
+{
+  static fakeFont idle_font = { "Idle", 15, 4 }, busy_font = { "Busy", 15, 5 };
+  static const char idle_str[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+-*/=<>()[]{}";
+  static const char busy_str[2][16] = { "abcdefghij", "klmnopqrst" };
+  int fails=0, tests=0, x;
+
+  LICE_SetGlyphCacheSize(64<<20);
+  LICE_CachedFont idle, busy;
+  idle.SetFromHFont((HFONT)&idle_font);
+  busy.SetFromHFont((HFONT)&busy_font);
+  LICE_MemBitmap bm(BM_W,BM_H);
+  RECT r = { 0, 0, BM_W, BM_H };
+  idle.DrawText(&bm,idle_str,-1,&r,DT_SINGLELINE);
+
+  // room for both of the busy font's strings, not for the idle font's glyphs as well
+  int busy_bytes=0;
+  for (x=0;busy_str[0][x];x++) busy_bytes += GlyphBytes(&busy_font,busy_str[0][x]) + GlyphBytes(&busy_font,busy_str[1][x]);
+  LICE_SetGlyphCacheSize(busy_bytes + GlyphBytes(&busy_font,'a')/2);
+
+  for (x=0;x<4;x++) busy.DrawText(&bm,busy_str[x&1],-1,&r,DT_SINGLELINE);
+  int n = s_nrasterized;
+  for (x=0;x<20;x++) busy.DrawText(&bm,busy_str[x&1],-1,&r,DT_SINGLELINE);
+  if (s_nrasterized != n)
+  {
+    printf("lru: alternating strings of the drawing face rendered %d glyphs, the idle face's should have gone\n",s_nrasterized-n);
+    fails++;
+  }
+  tests++;
+
+  n = s_nrasterized;
+  idle.DrawText(&bm,idle_str,-1,&r,DT_SINGLELINE);
+  if (s_nrasterized-n != (int)strlen(idle_str))
+  {
+    printf("lru: the idle face rendered %d of %d glyphs again\n",s_nrasterized-n,(int)strlen(idle_str));
+    fails++;
+  }
+  tests++;
+  LICE_SetGlyphCacheSize(64<<20);
+
+  printf("%-40s %6d tests, %d failed\n","lru across faces",tests,fails);
+  *ntests += tests;
+  return fails;
+}
+
+#define NTHREADS 4
+#define NTHREADDRAWS 300
+
+struct threadCtx
+{
+  drawSpec draws[NTHREADS][NTHREADDRAWS];
+  unsigned int ref[NTHREADS][NTHREADDRAWS], out[NTHREADS][NTHREADDRAWS];
+};
+
+static void DrawJob(void *p, int job)
+{
+  threadCtx *ctx = (threadCtx *)p;
+  LICE_CachedFont *fonts[NFONTS];
+  CreateFonts(fonts);
+  LICE_MemBitmap bm(BM_W,BM_H);
+  int x;
+  for (x=0;x<NTHREADDRAWS;x++) ctx->out[job][x] = Draw(fonts,ctx->draws[job]+x,&bm);
+  DeleteFonts(fonts);
+}
+
+static int checkThreads(int *ntests)
+{
+  static threadCtx ctx;
+  static const int budgets[] = { 64<<20, 0, 2000, 8000 };
+  int fails=0, tests=0, x, t, b, round;
+  for (t=0;t<NTHREADS;t++) for (x=0;x<NTHREADDRAWS;x++) MakeDraw(ctx.draws[t]+x);
+
+  LICE_SetGlyphCacheSize(64<<20);
+  for (t=0;t<NTHREADS;t++)
+  {
+    DrawJob(&ctx,t);
+    memcpy(ctx.ref[t],ctx.out[t],sizeof(ctx.ref[t]));
+  }
+
+  LICE_ThreadPool pool(NTHREADS);
+  for (round=0;round<3;round++)
+  {
+    for (b=0;b<(int)(sizeof(budgets)/sizeof(budgets[0]));b++)
+    {
+      LICE_SetGlyphCacheSize(budgets[b]);
+      memset(ctx.out,0,sizeof(ctx.out));
+      pool.Run(NTHREADS,DrawJob,&ctx);
+      for (t=0;t<NTHREADS;t++)
+        for (x=0;x<NTHREADDRAWS;x++)
+        {
+          if (ctx.out[t][x] != ctx.ref[t][x])
+          {
+            const drawSpec *d = ctx.draws[t]+x;
+            if (fails < 5) printf("threads, budget %d: thread %d draw %d (font %d, \"%s\", format %x) differs\n",budgets[b],t,x,
+                                  d->font,s_strings[d->str],d->fmt);
+            fails++;
+          }
+          tests++;
+        }
+    }
+  }
+  LICE_SetGlyphCacheSize(64<<20);
+
+  printf("%-40s %6d tests, %d failed\n","concurrent DrawText",tests,fails);
+  *ntests += tests;
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int fails=0, tests=0;
+  MakeStrings();
+
+  fails += checkBudgets(&tests);
+  fails += checkLRU(&tests);
+  fails += checkThreads(&tests);
+
+  printf("%d tests, %d failed\n",tests,fails);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}
@@ -395,3 +395,13 @@ bool GetAsyncNSWindowRect(HWND hwnd, RECT *r)
 
 }
 
+// the capture thread in licecap_ui.cpp wraps each frame in a pool, so the cursor images etc. don't pile up
+void *CaptureThread_PushPool()
+{
+  return [[NSAutoreleasePool alloc] init];
+}
+
+void CaptureThread_PopPool(void *pool)
+{
+  [(NSAutoreleasePool *)pool release];
+}
@@ -0,0 +1,362 @@
+/*
+    LICEcap
+    Copyright (C) 2010 Cockos Incorporated
+
+    LICEcap is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    LICEcap is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LICEcap; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// screen capture for X11 (SWELL/GDK builds), the counterpart of capturewindow.mm.
+// link with -lX11 -lXext -lXfixes. XDamage is loaded at runtime if present.
+//
+// bitmaps from CreateScreenBitmap() are backed by MIT-SHM segments, GetScreenData() reads
+// the screen straight into them with XShmGetImage(). other bitmaps (or servers without MIT-SHM)
+// fall back to XGetImage() and a copy. all functions are called from the capture thread, except
+// CreateScreenBitmap() which is serialized with them.
+
+#include <string.h>
+#include <dlfcn.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xfixes.h>
+
+#include "../WDL/swell/swell.h"
+#include "../WDL/lice/lice.h"
+#include "../WDL/ptrlist.h"
+#include "../WDL/heapbuf.h"
+#include "../WDL/mutex.h"
+
+// Xdamage.h isn't always installed, the few entry points needed are declared here
+typedef XID Damage;
+#define XDamageReportNonEmpty 3
+
+static struct
+{
+  bool tried, ok;
+  int event_base, error_base;
+  Bool (*QueryExtension)(Display *, int *, int *);
+  Damage (*Create)(Display *, Drawable, int);
+  void (*Subtract)(Display *, Damage, XserverRegion, XserverRegion);
+  void (*Destroy)(Display *, Damage);
+} s_xdamage;
+
+static WDL_Mutex s_mutex;
+static Display *s_dpy;
+static bool s_has_shm, s_has_fixes;
+static int s_scr_w, s_scr_h;
+
+static Damage s_damage;
+static XserverRegion s_damage_region;
+static int s_damage_pos[4]; // x, y, w, h of the previous GetScreenData() with damage tracking
+static WDL_TypedBuf<RECT> s_damage_rects; // for the last GetScreenData(), in bitmap coordinates
+static int s_damage_cnt; // -1 if unknown
+static RECT s_cursor_last; // screen coordinates of the cursor drawn by the previous DoMouseCursor()
+static bool s_cursor_last_valid;
+
+class ShmBitmap : public LICE_WrapperBitmap
+{
+public:
+  ShmBitmap(XImage *img, const XShmSegmentInfo &si) :
+    LICE_WrapperBitmap((LICE_pixel *)img->data,img->width,img->height,img->bytes_per_line/4,false)
+  {
+    m_img=img;
+    m_si=si;
+    m_img->obdata=(char *)&m_si; // XShmGetImage() finds the segment here
+  }
+  virtual ~ShmBitmap()
+  {
+    WDL_MutexLock lock(&s_mutex);
+    if (s_dpy) XShmDetach(s_dpy,&m_si);
+    shmdt(m_si.shmaddr);
+    m_img->data=m_img->obdata=NULL; // not owned by Xlib
+    XDestroyImage(m_img);
+    s_bitmaps.DeletePtr(this);
+  }
+
+  XImage *m_img;
+  XShmSegmentInfo m_si;
+
+  static WDL_PtrList<ShmBitmap> s_bitmaps; // lets GetScreenData() recognize its own bitmaps
+
+  static ShmBitmap *Find(LICE_IBitmap *bm)
+  {
+    int x;
+    for (x=0;x<s_bitmaps.GetSize();x++) if (s_bitmaps.Get(x) == bm) return s_bitmaps.Get(x);
+    return NULL;
+  }
+};
+WDL_PtrList<ShmBitmap> ShmBitmap::s_bitmaps;
+
+static bool s_x_error;
+static int ErrorHandler(Display *dpy, XErrorEvent *ev)
+{
+  s_x_error=true;
+  return 0;
+}
+
+static bool IsCompatibleVisual(Visual *v, int depth)
+{
+  // LICE_pixel in memory is B,G,R,A, which is what a little-endian 24/32 bit TrueColor server sends
+  return (depth == 24 || depth == 32) &&
+         v->red_mask == 0xff0000 && v->green_mask == 0xff00 && v->blue_mask == 0xff &&
+         ImageByteOrder(s_dpy) == LSBFirst && LICE_PIXEL_B == 0;
+}
+
+static bool OpenDisplay() // s_mutex must be held
+{
+  if (s_dpy) return true;
+  s_dpy = XOpenDisplay(NULL);
+  if (!s_dpy) return false;
+
+  s_scr_w = DisplayWidth(s_dpy,DefaultScreen(s_dpy));
+  s_scr_h = DisplayHeight(s_dpy,DefaultScreen(s_dpy));
+
+  s_has_shm = XShmQueryExtension(s_dpy) &&
+              IsCompatibleVisual(DefaultVisual(s_dpy,DefaultScreen(s_dpy)),DefaultDepth(s_dpy,DefaultScreen(s_dpy)));
+
+  int ev_base, err_base;
+  s_has_fixes = !!XFixesQueryExtension(s_dpy,&ev_base,&err_base);
+
+  if (!s_xdamage.tried)
+  {
+    s_xdamage.tried=true;
+    void *lib = dlopen("libXdamage.so.1",RTLD_NOW);
+    if (lib)
+    {
+      *(void **)&s_xdamage.QueryExtension = dlsym(lib,"XDamageQueryExtension");
+      *(void **)&s_xdamage.Create = dlsym(lib,"XDamageCreate");
+      *(void **)&s_xdamage.Subtract = dlsym(lib,"XDamageSubtract");
+      *(void **)&s_xdamage.Destroy = dlsym(lib,"XDamageDestroy");
+      s_xdamage.ok = s_xdamage.QueryExtension && s_xdamage.Create && s_xdamage.Subtract && s_xdamage.Destroy;
+    }
+  }
+  if (s_xdamage.ok && s_has_fixes &&
+      s_xdamage.QueryExtension(s_dpy,&s_xdamage.event_base,&s_xdamage.error_base))
+  {
+    s_damage = s_xdamage.Create(s_dpy,DefaultRootWindow(s_dpy),XDamageReportNonEmpty);
+    s_damage_region = XFixesCreateRegion(s_dpy,NULL,0);
+  }
+  return true;
+}
+
+LICE_IBitmap *CreateScreenBitmap(int w, int h)
+{
+  WDL_MutexLock lock(&s_mutex);
+  if (w>0 && h>0 && OpenDisplay() && s_has_shm)
+  {
+    XShmSegmentInfo si;
+    memset(&si,0,sizeof(si));
+    const int scr = DefaultScreen(s_dpy);
+    XImage *img = XShmCreateImage(s_dpy,DefaultVisual(s_dpy,scr),DefaultDepth(s_dpy,scr),ZPixmap,NULL,&si,w,h);
+    if (img) img->obdata=NULL; // points at si, which is on the stack
+    if (img && img->bits_per_pixel == 32)
+    {
+      si.shmid = shmget(IPC_PRIVATE,img->bytes_per_line*img->height,IPC_CREAT|0600);
+      if (si.shmid != -1)
+      {
+        si.shmaddr = img->data = (char *)shmat(si.shmid,NULL,0);
+        si.readOnly = False;
+
+        bool ok = si.shmaddr != (char *)-1;
+        if (ok)
+        {
+          // XShmAttach fails asynchronously (e.g. with a remote display)
+          s_x_error=false;
+          int (*oldh)(Display *, XErrorEvent *) = XSetErrorHandler(ErrorHandler);
+          ok = XShmAttach(s_dpy,&si) && (XSync(s_dpy,False), !s_x_error);
+          XSetErrorHandler(oldh);
+          if (!ok) shmdt(si.shmaddr);
+        }
+        shmctl(si.shmid,IPC_RMID,NULL); // freed when the last process detaches
+
+        if (ok)
+        {
+          ShmBitmap *bm = new ShmBitmap(img,si);
+          ShmBitmap::s_bitmaps.Add(bm);
+          return bm;
+        }
+        s_has_shm=false; // don't retry, e.g. a remote display or no shm left
+      }
+      img->data=img->obdata=NULL;
+    }
+    if (img) XDestroyImage(img);
+  }
+  return new LICE_MemBitmap(w,h);
+}
+
+// damage since the previous call, must be called before the screen is read
+static void UpdateDamage(int xpos, int ypos, int w, int h) // s_mutex must be held
+{
+  s_damage_cnt=-1;
+  s_damage_rects.Resize(0,false);
+  if (!s_damage) return;
+
+  // drain the notify events, the region is queried directly
+  while (XPending(s_dpy))
+  {
+    XEvent ev;
+    XNextEvent(s_dpy,&ev);
+  }
+  s_xdamage.Subtract(s_dpy,s_damage,None,s_damage_region);
+
+  const bool same_pos = s_damage_pos[0] == xpos && s_damage_pos[1] == ypos &&
+                        s_damage_pos[2] == w && s_damage_pos[3] == h;
+  s_damage_pos[0]=xpos;
+  s_damage_pos[1]=ypos;
+  s_damage_pos[2]=w;
+  s_damage_pos[3]=h;
+  if (!same_pos) return; // first frame at this position, everything is new
+
+  int n=0;
+  XRectangle *list = XFixesFetchRegion(s_dpy,s_damage_region,&n);
+  int x;
+  for (x=0;x<n;x++)
+  {
+    RECT r = { list[x].x-xpos, list[x].y-ypos, list[x].x-xpos+list[x].width, list[x].y-ypos+list[x].height };
+    if (r.left < 0) r.left=0;
+    if (r.top < 0) r.top=0;
+    if (r.right > w) r.right=w;
+    if (r.bottom > h) r.bottom=h;
+    if (r.right > r.left && r.bottom > r.top) s_damage_rects.Add(r);
+  }
+  if (list) XFree(list);
+  s_damage_cnt = s_damage_rects.GetSize();
+}
+
+bool GetScreenData(int xpos, int ypos, LICE_IBitmap *bmOut)
+{
+  WDL_MutexLock lock(&s_mutex);
+  if (!bmOut || !OpenDisplay()) return false;
+
+  const int w = bmOut->getWidth(), h = bmOut->getHeight();
+  UpdateDamage(xpos,ypos,w,h);
+
+  const Window root = DefaultRootWindow(s_dpy);
+
+  ShmBitmap *sbm = ShmBitmap::Find(bmOut);
+  if (sbm && xpos >= 0 && ypos >= 0 && xpos+w <= s_scr_w && ypos+h <= s_scr_h)
+  {
+    // directly into the bitmap
+    if (XShmGetImage(s_dpy,root,sbm->m_img,xpos,ypos,AllPlanes)) return true;
+  }
+
+  // partially offscreen, or not one of our bitmaps
+  int sx=xpos, sy=ypos, sw=w, sh=h;
+  if (sx < 0) { sw += sx; sx=0; }
+  if (sy < 0) { sh += sy; sy=0; }
+  if (sx+sw > s_scr_w) sw = s_scr_w-sx;
+  if (sy+sh > s_scr_h) sh = s_scr_h-sy;
+  if (sw != w || sh != h) LICE_Clear(bmOut,0);
+  if (sw<1 || sh<1) return true;
+
+  XImage *img = XGetImage(s_dpy,root,sx,sy,sw,sh,AllPlanes,ZPixmap);
+  if (!img) return false;
+
+  const bool direct = img->bits_per_pixel == 32 && IsCompatibleVisual(DefaultVisual(s_dpy,DefaultScreen(s_dpy)),img->depth);
+  int y;
+  for (y=0;y<sh;y++)
+  {
+    const int dy = sy-ypos+y;
+    LICE_pixel *out = bmOut->getBits() + (bmOut->isFlipped() ? h-1-dy : dy)*bmOut->getRowSpan() + sx-xpos;
+    if (direct)
+    {
+      memcpy(out,img->data + y*img->bytes_per_line,sw*sizeof(LICE_pixel));
+    }
+    else
+    {
+      int x;
+      for (x=0;x<sw;x++)
+      {
+        const unsigned long p = XGetPixel(img,x,y);
+        // assumes 8 bits per channel in the visual's masks, as LICE_RGBA does
+        out[x] = LICE_RGBA((p>>16)&0xff,(p>>8)&0xff,p&0xff,255);
+      }
+    }
+  }
+  XDestroyImage(img);
+  return true;
+}
+
+static void AddCursorDamage(const RECT &r) // r in screen coordinates
+{
+  if (s_damage_cnt < 0) return;
+  RECT b = { r.left-s_damage_pos[0], r.top-s_damage_pos[1], r.right-s_damage_pos[0], r.bottom-s_damage_pos[1] };
+  if (b.left < 0) b.left=0;
+  if (b.top < 0) b.top=0;
+  if (b.right > s_damage_pos[2]) b.right=s_damage_pos[2];
+  if (b.bottom > s_damage_pos[3]) b.bottom=s_damage_pos[3];
+  if (b.right > b.left && b.bottom > b.top) s_damage_rects.Add(b);
+  s_damage_cnt = s_damage_rects.GetSize();
+}
+
+void DoMouseCursor(LICE_IBitmap *bmOut, int xoffs, int yoffs)
+{
+  WDL_MutexLock lock(&s_mutex);
+
+  // the cursor isn't part of the screen contents, so the damage doesn't cover it moving
+  if (s_cursor_last_valid) AddCursorDamage(s_cursor_last);
+  s_cursor_last_valid=false;
+
+  if (!s_dpy || !s_has_fixes) return;
+
+  XFixesCursorImage *ci = XFixesGetCursorImage(s_dpy);
+  if (!ci) return;
+
+  const int x0 = ci->x - ci->xhot, y0 = ci->y - ci->yhot;
+  RECT cr = { x0, y0, x0 + ci->width, y0 + ci->height };
+  s_cursor_last = cr;
+  s_cursor_last_valid = true;
+  AddCursorDamage(cr);
+
+  const int bw = bmOut->getWidth(), bh = bmOut->getHeight(), span = bmOut->getRowSpan();
+  LICE_pixel *bits = bmOut->getBits();
+  int y;
+  for (y=0;y<ci->height;y++)
+  {
+    const int dy = y0+yoffs+y;
+    if (dy < 0 || dy >= bh) continue;
+    LICE_pixel *out = bits + (bmOut->isFlipped() ? bh-1-dy : dy)*span;
+    const unsigned long *in = ci->pixels + y*ci->width; // premultiplied ARGB, one per long
+    int x;
+    for (x=0;x<ci->width;x++)
+    {
+      const int dx = x0+xoffs+x;
+      if (dx < 0 || dx >= bw) continue;
+      const unsigned int p = (unsigned int)in[x];
+      const int a = p>>24;
+      if (!a) continue;
+      const LICE_pixel d = out[dx];
+      const int ia = 255-a;
+      out[dx] = LICE_RGBA(((p>>16)&0xff) + (LICE_GETR(d)*ia)/255,
+                          ((p>>8)&0xff) + (LICE_GETG(d)*ia)/255,
+                          (p&0xff) + (LICE_GETB(d)*ia)/255, 255);
+    }
+  }
+  XFree(ci);
+}
+
+// rectangles (in the bitmap's coordinates) that changed since the previous frame, for the last
+// GetScreenData() and DoMouseCursor(). returns -1 if unknown (no XDamage, or the position changed)
+int GetScreenDamage(WDL_TypedBuf<RECT> *list)
+{
+  WDL_MutexLock lock(&s_mutex);
+  if (s_damage_cnt < 0) return -1;
+  list->Resize(0,false);
+  list->Add(s_damage_rects.Get(),s_damage_rects.GetSize());
+  return s_damage_cnt;
+}
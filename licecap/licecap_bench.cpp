@@ -0,0 +1,571 @@
+/*
+    LICEcap (encoder benchmark)
+    Copyright (C) 2010 Cockos Incorporated
+
+    LICEcap is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    LICEcap is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LICEcap; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// replays synthetic screen recordings through the LCF, GIF, PNG and APNG encoders and prints
+// per-stage timings as JSON, so that encoder changes can be compared without a live desktop
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "../WDL/lice/lice_lcf.h"
+#include "../WDL/lice/lice_simd.h"
+#include "licecap_version.h"
+
+enum { WL_STATIC=0, WL_SCROLL, WL_DRAG, WL_NOISE, WL_MAX };
+static const char *s_workload_names[WL_MAX] = { "static", "scroll", "drag", "noise" };
+
+// quantize runs the GIF octree quantizer with both node backends, cmp runs LICE_BitmapCmpEx with each
+// SIMD level. neither writes a file.
+enum { FMT_LCF=0, FMT_GIF, FMT_PNG, FMT_APNG, FMT_QUANTIZE, FMT_CMP, FMT_MAX };
+static const char *s_format_names[FMT_MAX] = { "lcf", "gif", "png", "apng", "quantize", "cmp" };
+
+static double GetTimeMS()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+#endif
+}
+
+static unsigned int BenchRand(unsigned int *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+
+// scenes are built from filled rectangles only, so the benchmark needs nothing beyond what
+// the encoders link against. text is drawn as rows of glyph-sized blocks.
+
+static void DrawTextLine(LICE_IBitmap *bm, int x, int y, int w, int line, LICE_pixel col)
+{
+  unsigned int seed = 0x1234 + line*7919;
+  const int x2 = x + w;
+  while (x < x2)
+  {
+    int wordlen = 2 + BenchRand(&seed)%9;
+    while (wordlen-- > 0 && x+6 <= x2)
+    {
+      const int gh = 5 + BenchRand(&seed)%4;
+      LICE_FillRect(bm,x,y+9-gh,5,gh,col,1.0f,LICE_BLIT_MODE_COPY);
+      x += 7;
+    }
+    x += 7;
+    if (BenchRand(&seed)%23 == 0) break; // short line
+  }
+}
+
+static void DrawWindow(LICE_IBitmap *bm, int x, int y, int w, int h, int first_line, int scroll_px)
+{
+  LICE_FillRect(bm,x,y,w,h,LICE_RGBA(90,90,100,255),1.0f,LICE_BLIT_MODE_COPY);
+  LICE_FillRect(bm,x+1,y+1,w-2,20,LICE_RGBA(40,70,140,255),1.0f,LICE_BLIT_MODE_COPY);
+  DrawTextLine(bm,x+8,y+6,wdl_min(w/3,200),1000+first_line,LICE_RGBA(255,255,255,255));
+
+  const int cx = x+1, cy = y+22, cw = w-2, ch = h-23;
+  if (cw < 1 || ch < 1) return;
+  LICE_FillRect(bm,cx,cy,cw,ch,LICE_RGBA(250,250,245,255),1.0f,LICE_BLIT_MODE_COPY);
+
+  LICE_SubBitmap client(bm,cx,cy,cw,ch); // clips the lines
+  const int lineh = 16;
+  int line = scroll_px / lineh;
+  int ly = 4 - (scroll_px % lineh);
+  while (ly < ch)
+  {
+    DrawTextLine(&client,6,ly,cw-12,first_line+line,LICE_RGBA(20,20,20,255));
+    ly += lineh;
+    line++;
+  }
+}
+
+static void DrawDesktop(LICE_IBitmap *bm)
+{
+  const int w = bm->getWidth(), h = bm->getHeight();
+  int y;
+  for (y=0;y<h;y+=4)
+  {
+    const int c = 60 + y*80/wdl_max(h,1);
+    LICE_FillRect(bm,0,y,w,4,LICE_RGBA(c/2,c*3/4,c,255),1.0f,LICE_BLIT_MODE_COPY);
+  }
+  unsigned int seed = 42;
+  int x;
+  for (x=0;x<12;x++) // icons
+  {
+    LICE_FillRect(bm,16,16+x*72,48,48,LICE_RGBA(BenchRand(&seed)&255,BenchRand(&seed)&255,BenchRand(&seed)&255,255),1.0f,LICE_BLIT_MODE_COPY);
+  }
+  LICE_FillRect(bm,0,h-28,w,28,LICE_RGBA(30,30,35,255),1.0f,LICE_BLIT_MODE_COPY); // taskbar
+  DrawWindow(bm,w/8,h/10,w/2,h/2,0,0);
+}
+
+static void RenderFrame(int workload, LICE_IBitmap *bm, LICE_IBitmap *desktop, int frame)
+{
+  const int w = bm->getWidth(), h = bm->getHeight();
+  LICE_Copy(bm,desktop);
+  switch (workload)
+  {
+    case WL_SCROLL:
+      DrawWindow(bm,w/16,h/16,w*7/8,h*7/8-28,500,frame*3);
+    break;
+    case WL_DRAG:
+      {
+        // a window moved along a smooth path, as when dragged with the mouse
+        const int ww = w*2/5, wh = h*2/5;
+        const int t = frame % 240;
+        const int px = (t < 120 ? t : 240-t) * (w-ww) / 120;
+        const int py = (h-wh-28) / 2 + (int)((h-wh-28)/2 * (((frame*7)%100)-50) / 50.0);
+        DrawWindow(bm,px,wdl_max(py,0),ww,wh,200,0);
+      }
+    break;
+    case WL_NOISE:
+      {
+        // video playing in a window: a moving gradient with noise, every pixel changes
+        const int vx = w/6, vy = h/6, vw = w*2/3, vh = h*2/3;
+        unsigned int seed = 1 + frame*2654435761u;
+        int y;
+        for (y=0;y<vh;y++)
+        {
+          LICE_pixel *p = bm->getBits() + (bm->isFlipped() ? h-1-(vy+y) : vy+y)*bm->getRowSpan() + vx;
+          int x;
+          for (x=0;x<vw;x++)
+          {
+            const int n = BenchRand(&seed) & 31;
+            p[x] = LICE_RGBA(((x+frame*4)&255) ^ n, (((y+frame*2)&255) + (n>>1)) & 255, (x+y+frame)&255, 255);
+          }
+        }
+      }
+    break;
+  }
+}
+
+
+struct benchStage
+{
+  const char *name;
+  double ms;
+};
+
+struct benchResult
+{
+  benchResult() { nstages=0; outsize=0; frames=0; ok=false; }
+  double &Stage(const char *name)
+  {
+    int x;
+    for (x=0;x<nstages;x++) if (!strcmp(stages[x].name,name)) return stages[x].ms;
+    stages[nstages].name = name;
+    stages[nstages].ms = 0.0;
+    return stages[nstages++].ms;
+  }
+
+  benchStage stages[8];
+  int nstages;
+  WDL_INT64 outsize;
+  int frames;
+  bool ok;
+};
+
+static WDL_INT64 GetFileSize64(const char *fn)
+{
+  FILE *fp = fopen(fn,"rb");
+  if (!fp) return 0;
+  fseek(fp,0,SEEK_END);
+  const WDL_INT64 sz = ftell(fp);
+  fclose(fp);
+  return sz;
+}
+
+static void RunLCF(benchResult *res, int workload, int w, int h, int nframes, int nthreads, const char *fn)
+{
+  LICECaptureCompressor *tc = new LICECaptureCompressor(fn,w,h);
+  if (!tc->IsOpen()) { delete tc; return; }
+  if (nthreads > 1) tc->SetParallel(nthreads);
+
+  LICE_MemBitmap desktop(w,h), bm(w,h), last(w,h);
+  DrawDesktop(&desktop);
+
+  double &diff_ms = res->Stage("diff");
+  double &enc_ms = res->Stage("convert_deflate");
+  double &flush_ms = res->Stage("flush");
+  int x;
+  for (x=0;x<nframes;x++)
+  {
+    RenderFrame(workload,&bm,&desktop,x);
+
+    double t0 = GetTimeMS();
+    int coords[4] = { 0, 0, w, h };
+    const bool changed = !x || LICE_BitmapCmpEx(&last,&bm,LICE_RGBA(0xf8,0xfc,0xf8,0),coords);
+    RECT r = { coords[0], coords[1], coords[0]+coords[2], coords[1]+coords[3] };
+    if (changed) LICE_Blit(&last,&bm,r.left,r.top,r.left,r.top,coords[2],coords[3],1.0f,LICE_BLIT_MODE_COPY);
+    double t1 = GetTimeMS();
+    diff_ms += t1-t0;
+
+    if (x) tc->OnFrame(&bm,33,&r,changed ? 1 : 0);
+    else tc->OnFrame(&bm,33);
+    enc_ms += GetTimeMS()-t1;
+  }
+
+  const double t0 = GetTimeMS();
+  tc->OnFrame(NULL,0);
+  delete tc;
+  flush_ms += GetTimeMS()-t0;
+
+  res->outsize = GetFileSize64(fn);
+  res->frames = nframes;
+  res->ok = true;
+}
+
+static void RunGIF(benchResult *res, int workload, int w, int h, int nframes, const char *fn)
+{
+  void *wr = LICE_WriteGIFBeginNoFrame(fn,w,h,0,false);
+  if (!wr) return;
+
+  LICE_MemBitmap desktop(w,h), bm(w,h), last(w,h);
+  DrawDesktop(&desktop);
+
+  double &diff_ms = res->Stage("diff");
+  double &quant_ms = res->Stage("quantize");
+  double &lzw_ms = res->Stage("lzw_io");
+  void *pf = NULL;
+  int x, pending_delay = 0;
+  for (x=0;x<nframes;x++)
+  {
+    RenderFrame(workload,&bm,&desktop,x);
+    pending_delay += 33;
+
+    // same as licecap's gif_encoder: only the changed rectangle is written, with its own colormap
+    double t0 = GetTimeMS();
+    int coords[4] = { 0, 0, w, h };
+    const bool changed = !x || LICE_BitmapCmpEx(&last,&bm,LICE_RGBA(0xf8,0xf8,0xf8,0),coords);
+    if (changed) LICE_Blit(&last,&bm,coords[0],coords[1],coords[0],coords[1],coords[2],coords[3],1.0f,LICE_BLIT_MODE_COPY);
+    double t1 = GetTimeMS();
+    diff_ms += t1-t0;
+    if (!changed) continue;
+
+    LICE_SubBitmap sub(&bm,coords[0],coords[1],coords[2],coords[3]);
+    void *npf = LICE_WriteGIFPrepareFrame(wr,&sub,coords[0],coords[1],true,pf);
+    double t2 = GetTimeMS();
+    if (npf)
+    {
+      pf = npf;
+      quant_ms += t2-t1;
+      LICE_WriteGIFPreparedFrame(wr,pf,pending_delay);
+      lzw_ms += GetTimeMS()-t2;
+    }
+    else
+    {
+      // can't be split into stages
+      LICE_WriteGIFFrame(wr,&sub,coords[0],coords[1],true,pending_delay);
+      res->Stage("quantize_lzw_io") += GetTimeMS()-t1;
+    }
+    pending_delay = 0;
+  }
+  LICE_WriteGIFFreePreparedFrame(pf);
+
+  const double t0 = GetTimeMS();
+  LICE_WriteGIFEnd(wr);
+  res->Stage("flush") += GetTimeMS()-t0;
+
+  res->outsize = GetFileSize64(fn);
+  res->frames = nframes;
+  res->ok = true;
+}
+
+static void RunPNG(benchResult *res, int workload, int w, int h, int nframes, const char *fn)
+{
+  LICE_MemBitmap desktop(w,h), bm(w,h);
+  DrawDesktop(&desktop);
+
+  double &enc_ms = res->Stage("deflate_io");
+  int x;
+  for (x=0;x<nframes;x++)
+  {
+    RenderFrame(workload,&bm,&desktop,x);
+
+    const double t0 = GetTimeMS();
+    if (!LICE_WritePNG(fn,&bm,false)) return;
+    enc_ms += GetTimeMS()-t0;
+
+    res->outsize += GetFileSize64(fn); // every frame is a separate file, overwritten
+  }
+  res->frames = nframes;
+  res->ok = true;
+}
+
+static void RunAPNG(benchResult *res, int workload, int w, int h, int nframes, int nthreads, const char *fn)
+{
+  void *wr = LICE_WriteAPNGBegin(fn,w,h);
+  if (!wr) return;
+  LICE_WriteAPNGSetCompression(wr,6,0,LICE_APNG_FILTER_ADAPTIVE,nthreads);
+
+  LICE_MemBitmap desktop(w,h), bm(w,h);
+  DrawDesktop(&desktop);
+
+  // the writer finds the changed rectangle itself, so diffing is part of this stage
+  double &enc_ms = res->Stage("diff_deflate_io");
+  int x;
+  for (x=0;x<nframes;x++)
+  {
+    RenderFrame(workload,&bm,&desktop,x);
+
+    const double t0 = GetTimeMS();
+    const bool ok = LICE_WriteAPNGFrame(wr,&bm,33);
+    enc_ms += GetTimeMS()-t0;
+    if (!ok)
+    {
+      LICE_WriteAPNGEnd(wr);
+      return;
+    }
+  }
+
+  const double t0 = GetTimeMS();
+  const bool ok = LICE_WriteAPNGEnd(wr);
+  res->Stage("flush") += GetTimeMS()-t0;
+
+  res->outsize = GetFileSize64(fn);
+  res->frames = nframes;
+  res->ok = ok;
+}
+
+// builds a 256 color palette for each frame and maps every pixel to it, as the GIF writer does. the octree
+// is reset between frames, so the pool backend's cheaper reset counts. both backends must give the same result.
+struct quantizeState
+{
+  void *octree;
+  LICE_pixel palette[256];
+  int ncolors;
+  unsigned int sum;
+  double *build_ms, *map_ms;
+};
+
+static void QuantizeFrame(quantizeState *q, LICE_IBitmap *bm)
+{
+  const double t0 = GetTimeMS();
+  LICE_ResetOctree(q->octree,256);
+  LICE_BuildOctree(q->octree,bm);
+  q->ncolors = LICE_ExtractOctreePalette(q->octree,q->palette);
+  const double t1 = GetTimeMS();
+  *q->build_ms += t1-t0;
+
+  unsigned int sum = 0;
+  const int w = bm->getWidth(), h = bm->getHeight(), span = bm->getRowSpan();
+  int y;
+  for (y=0;y<h;y++)
+  {
+    const LICE_pixel *p = bm->getBits() + y*span;
+    int x;
+    for (x=0;x<w;x++) sum = sum*31 + LICE_FindInOctree(q->octree,p[x]);
+  }
+  q->sum = sum;
+  *q->map_ms += GetTimeMS()-t1;
+}
+
+static void RunQuantize(benchResult *res, int workload, int w, int h, int nframes)
+{
+  quantizeState q[2];
+  q[0].octree = LICE_CreateOctree(256);
+  q[0].build_ms = &res->Stage("heap_build");
+  q[0].map_ms = &res->Stage("heap_map");
+  q[1].octree = LICE_CreateOctree(256,LICE_OCTREE_FLAG_POOL);
+  q[1].build_ms = &res->Stage("pool_build");
+  q[1].map_ms = &res->Stage("pool_map");
+
+  LICE_MemBitmap desktop(w,h), bm(w,h);
+  DrawDesktop(&desktop);
+
+  bool same = q[0].octree && q[1].octree;
+  int x;
+  for (x=0;x<nframes && same;x++)
+  {
+    RenderFrame(workload,&bm,&desktop,x);
+
+    // alternate which backend goes first, so neither always gets the warm caches
+    QuantizeFrame(&q[x&1],&bm);
+    QuantizeFrame(&q[!(x&1)],&bm);
+
+    if (q[0].sum != q[1].sum || q[0].ncolors != q[1].ncolors ||
+        memcmp(q[0].palette,q[1].palette,q[0].ncolors*sizeof(LICE_pixel))) same = false;
+  }
+
+  if (q[0].octree) LICE_DestroyOctree(q[0].octree);
+  if (q[1].octree) LICE_DestroyOctree(q[1].octree);
+
+  res->frames = x;
+  res->ok = same;
+}
+
+// compares each frame to the previous one as the encoders do, once per SIMD level that this CPU supports.
+// every level must find the same rectangle as the scalar code.
+static void RunCmp(benchResult *res, int workload, int w, int h, int nframes)
+{
+  static const struct { int mask; const char *name; } levels[] = {
+    { 0, "cmp_scalar" },
+    { LICE_SIMD_SSE2, "cmp_sse2" },
+    { LICE_SIMD_SSE2|LICE_SIMD_AVX2, "cmp_avx2" },
+    { LICE_SIMD_NEON, "cmp_neon" },
+  };
+  const int nlevels = sizeof(levels)/sizeof(levels[0]);
+  const int caps = LICE_SIMD_GetCaps();
+
+  LICE_MemBitmap desktop(w,h), bm(w,h), last(w,h);
+  DrawDesktop(&desktop);
+  RenderFrame(workload,&last,&desktop,0);
+
+  bool same = true;
+  int x;
+  for (x=1;x<=nframes && same;x++)
+  {
+    RenderFrame(workload,&bm,&desktop,x);
+
+    int ref[5] = { 0, };
+    int l;
+    for (l=0;l<nlevels;l++)
+    {
+      if ((caps & levels[l].mask) != levels[l].mask) continue;
+      LICE_SIMD_SetMask(levels[l].mask);
+
+      int coords[5] = { 0, 0, w, h, 0 };
+      const double t0 = GetTimeMS();
+      coords[4] = LICE_BitmapCmpEx(&last,&bm,LICE_RGBA(0xf8,0xfc,0xf8,0),coords);
+      res->Stage(levels[l].name) += GetTimeMS()-t0;
+
+      if (!l) memcpy(ref,coords,sizeof(ref));
+      else if (memcmp(ref,coords,sizeof(ref))) same = false;
+    }
+    LICE_Copy(&last,&bm);
+  }
+  LICE_SIMD_SetMask(~0);
+
+  res->frames = x-1;
+  res->ok = same;
+}
+
+static int ParseList(const char *str, const char **names, int nnames) // returns a bitmask, 0 on error
+{
+  if (!strcmp(str,"all")) return (1<<nnames)-1;
+  int mask=0;
+  while (*str)
+  {
+    int len=0;
+    while (str[len] && str[len] != ',') len++;
+    int x;
+    for (x=0;x<nnames && (strncmp(str,names[x],len) || names[x][len]);x++);
+    if (x==nnames) return 0;
+    mask |= 1<<x;
+    str += len;
+    if (*str) str++;
+  }
+  return mask;
+}
+
+int main(int argc, char **argv)
+{
+  int w=1024, h=768, nframes=150, nthreads=1;
+  int workloads = (1<<WL_MAX)-1, formats = (1<<FMT_MAX)-1;
+  const char *outdir = ".";
+  bool keep = false;
+
+  int x;
+  for (x=1;x<argc;x++)
+  {
+    const char *a = argv[x];
+    const bool hasparm = x+1 < argc;
+    if (!strcmp(a,"-s") && hasparm)
+    {
+      if (sscanf(argv[++x],"%dx%d",&w,&h) != 2) w=h=0;
+    }
+    else if (!strcmp(a,"-n") && hasparm) nframes = atoi(argv[++x]);
+    else if (!strcmp(a,"-t") && hasparm) nthreads = atoi(argv[++x]);
+    else if (!strcmp(a,"-w") && hasparm) workloads = ParseList(argv[++x],s_workload_names,WL_MAX);
+    else if (!strcmp(a,"-f") && hasparm) formats = ParseList(argv[++x],s_format_names,FMT_MAX);
+    else if (!strcmp(a,"-o") && hasparm) outdir = argv[++x];
+    else if (!strcmp(a,"-k")) keep = true;
+    else break;
+  }
+  if (x < argc || w < 16 || h < 16 || nframes < 1 || !workloads || !formats)
+  {
+    fprintf(stderr,"LICEcap encoder benchmark " LICECAP_VERSION "\n"
+           "usage: licecap_bench [-s WxH] [-n frames] [-t threads] [-w workloads] [-f formats] [-o dir] [-k]\n"
+           "  workloads: static,scroll,drag,noise or all (default)\n"
+           "  formats: lcf,gif,png,apng,quantize,cmp or all (default)\n"
+           "  quantize times the octree quantizer with the heap and pool backends, ok is false if they differ\n"
+           "  cmp times LICE_BitmapCmpEx at each supported SIMD level, ok is false if they differ\n"
+           "  threads: used by lcf and apng (default 1)\n"
+           "  output files are written to dir (default .) and removed unless -k\n"
+           "results are written to stdout as JSON, times in ms\n");
+    return 1;
+  }
+
+  printf("{\n  \"version\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n  \"threads\": %d,\n  \"results\": [",
+    LICECAP_VERSION,w,h,nframes,nthreads);
+
+  bool first = true;
+  int wl, fmt;
+  for (wl=0;wl<WL_MAX;wl++) if (workloads & (1<<wl)) for (fmt=0;fmt<FMT_MAX;fmt++) if (formats & (1<<fmt))
+  {
+    char fn[2048];
+    snprintf(fn,sizeof(fn),"%s/licecap_bench_%s.%s",outdir,s_workload_names[wl],s_format_names[fmt]);
+
+    benchResult res;
+    const double t0 = GetTimeMS();
+    switch (fmt)
+    {
+      case FMT_LCF: RunLCF(&res,wl,w,h,nframes,nthreads,fn); break;
+      case FMT_GIF: RunGIF(&res,wl,w,h,nframes,fn); break;
+      case FMT_PNG: RunPNG(&res,wl,w,h,nframes,fn); break;
+      case FMT_APNG: RunAPNG(&res,wl,w,h,nframes,nthreads,fn); break;
+      case FMT_QUANTIZE: RunQuantize(&res,wl,w,h,nframes); break;
+      case FMT_CMP: RunCmp(&res,wl,w,h,nframes); break;
+    }
+    const double wall = GetTimeMS()-t0;
+    if (!keep && fmt != FMT_QUANTIZE && fmt != FMT_CMP) remove(fn);
+
+    // frame generation is excluded, the encoder time is the sum of the stages
+    double enc = 0.0;
+    for (x=0;x<res.nstages;x++) enc += res.stages[x].ms;
+
+    printf("%s\n    {\n      \"workload\": \"%s\",\n      \"format\": \"%s\",\n      \"ok\": %s",
+      first ? "" : ",", s_workload_names[wl], s_format_names[fmt], res.ok ? "true" : "false");
+    first = false;
+    if (res.ok)
+    {
+      const double secs = wdl_max(enc,0.001) / 1000.0;
+      printf(",\n      \"encode_ms\": %.3f,\n      \"wall_ms\": %.3f,\n      \"fps\": %.2f,\n      \"input_mb_per_sec\": %.2f,\n"
+             "      \"output_bytes\": %lld,\n      \"stages_ms\": {",
+        enc, wall, res.frames / secs, (double)w*h*4*res.frames / secs / (1024.0*1024.0), (long long)res.outsize);
+      for (x=0;x<res.nstages;x++)
+        printf("%s \"%s\": %.3f", x ? "," : "", res.stages[x].name, res.stages[x].ms);
+      printf(" }");
+    }
+    printf("\n    }");
+    fflush(stdout);
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
@@ -71,89 +71,390 @@ void DoMouseCursor(HDC hdc, HWND h, int xoffs, int yoffs)
   else printf("fail cursor\n");
 }
 
+// LCF -> GIF transcoding pipeline: frames are decoded on the calling thread in batches, diffed and quantized
+// on a thread pool, and written in order by an emitter thread. output is identical to the serial loop in main().
+#define GIFPIPE_NSETS 3
+
+struct gifPipeFrame
+{
+  gifPipeFrame() : bm(0,0,1) { delay=0; changed=false; prepared=NULL; memset(coords,0,sizeof(coords)); }
+  ~gifPipeFrame() { LICE_WriteGIFFreePreparedFrame(prepared); }
+
+  LICE_MemBitmap bm;
+  int delay; // time to next frame
+  int coords[4]; // changed region relative to the previous frame
+  bool changed;
+  void *prepared; // NULL if the frame has to be written with LICE_WriteGIFFrame()
+};
+
+struct gifPipeBatch
+{
+  WDL_PtrList<gifPipeFrame> frames;
+  int cnt;
+  gifPipeFrame *prev; // last frame of the previous batch
+  void *wr;
+  bool perImageColorMap;
+  bool prepare; // LICE_WriteGIFCanPrepareFrames() when the batch was started, the writer isn't read otherwise
+};
+
+class gifPipeline
+{
+public:
+  gifPipeline(void *wr, int w, int h, int nthreads, bool perImageColorMap) : m_pool(nthreads-1), m_lastfr(w,h)
+  {
+    m_wr=wr;
+    m_per_image=perImageColorMap;
+    m_w=w;
+    m_h=h;
+    m_ready=m_emitted=0;
+    m_done=false;
+    m_have_pending=false;
+    m_pending_prepared=NULL;
+    m_accum_lat=0;
+    memset(m_pending_coords,0,sizeof(m_pending_coords));
+    m_can_prepare=LICE_WriteGIFCanPrepareFrames(wr,perImageColorMap);
+
+    // a few frames per thread, but keep the frame buffers to around 256MB
+    int bsize = nthreads*2;
+    const int maxframes = (int) ((256<<20) / ((WDL_INT64)GIFPIPE_NSETS*wdl_max(w*h,1)*4));
+    if (bsize > maxframes) bsize = maxframes;
+    if (bsize < 2) bsize = 2;
+
+    int x;
+    for (x=0;x<GIFPIPE_NSETS;x++)
+    {
+      int y;
+      for (y=0;y<bsize;y++) m_sets[x].frames.Add(new gifPipeFrame);
+      m_sets[x].cnt=0;
+      m_sets[x].prev=NULL;
+      m_sets[x].wr=wr;
+      m_sets[x].perImageColorMap=perImageColorMap;
+      m_sets[x].prepare=false;
+    }
+  }
+  ~gifPipeline()
+  {
+    int x;
+    for (x=0;x<GIFPIPE_NSETS;x++) m_sets[x].frames.Empty(true);
+    LICE_WriteGIFFreePreparedFrame(m_pending_prepared);
+  }
+
+  void Run(LICECaptureDecompressor *tc)
+  {
+    m_emit_thread.Start(EmitThreadProc,this);
+
+    int k=0;
+    if (Decode(tc,0) > 0)
+    {
+      m_sets[0].prepare = CanPrepare();
+      m_pool.Start(m_sets[0].cnt,FrameJob,&m_sets[0]);
+      for (;;)
+      {
+        // decode the next batch while the pool works on batch k and the emitter writes batch k-1
+        const int nk = (k+1)%GIFPIPE_NSETS;
+        while (GetEmitted() < k+1+1-GIFPIPE_NSETS) m_emitted_ev.Wait(100);
+
+        m_sets[nk].prev = m_sets[k%GIFPIPE_NSETS].frames.Get(m_sets[k%GIFPIPE_NSETS].cnt-1);
+        const int n = Decode(tc,nk);
+
+        m_pool.Wait();
+        m_mutex.Enter();
+        m_ready=k+1;
+        m_mutex.Leave();
+        m_ready_ev.Set();
+
+        if (n<1) break;
+        k++;
+        m_sets[nk].prepare = CanPrepare();
+        m_pool.Start(n,FrameJob,&m_sets[nk]);
+      }
+    }
+
+    m_mutex.Enter();
+    m_done=true;
+    m_mutex.Leave();
+    m_ready_ev.Set();
+    m_emit_thread.Join();
+
+    if (m_have_pending) WritePending();
+  }
+
+private:
+  int Decode(LICECaptureDecompressor *tc, int set)
+  {
+    gifPipeBatch *b = &m_sets[set];
+    b->cnt=0;
+    while (b->cnt < b->frames.GetSize() && !g_done)
+    {
+      LICE_IBitmap *bm = tc->GetCurrentFrame();
+      if (!bm) break;
+      gifPipeFrame *f = b->frames.Get(b->cnt++);
+      LICE_Copy(&f->bm,bm);
+      f->delay = tc->GetTimeToNextFrame();
+      tc->NextFrame();
+    }
+    return b->cnt;
+  }
+
+  static void FrameJob(void *ctx, int job)
+  {
+    gifPipeBatch *b = (gifPipeBatch *)ctx;
+    gifPipeFrame *f = b->frames.Get(job), *prev = job ? b->frames.Get(job-1) : b->prev;
+    const int w = f->bm.getWidth(), h = f->bm.getHeight();
+
+    f->coords[0]=f->coords[1]=0;
+    f->coords[2]=w;
+    f->coords[3]=h;
+    f->changed = !prev || LICE_BitmapCmp(&f->bm,&prev->bm,f->coords);
+    if (f->changed && b->prepare)
+    {
+      LICE_SubBitmap sub(&f->bm,f->coords[0],f->coords[1],f->coords[2],f->coords[3]);
+      void *p = LICE_WriteGIFPrepareFrame(b->wr,&sub,f->coords[0],f->coords[1],b->perImageColorMap,f->prepared);
+      if (!p && f->prepared)
+      {
+        LICE_WriteGIFFreePreparedFrame(f->prepared);
+        f->prepared=NULL;
+      }
+      else f->prepared=p;
+    }
+    else if (f->prepared)
+    {
+      LICE_WriteGIFFreePreparedFrame(f->prepared);
+      f->prepared=NULL;
+    }
+  }
+
+  int GetEmitted()
+  {
+    WDL_MutexLock lock(&m_mutex);
+    return m_emitted;
+  }
+
+  bool CanPrepare()
+  {
+    WDL_MutexLock lock(&m_mutex);
+    return m_can_prepare;
+  }
+
+  static unsigned int EmitThreadProc(void *p)
+  {
+    gifPipeline *_this = (gifPipeline *)p;
+    for (;;)
+    {
+      _this->m_mutex.Enter();
+      const int ready = _this->m_ready, emitted = _this->m_emitted;
+      const bool done = _this->m_done;
+      _this->m_mutex.Leave();
+
+      if (emitted >= ready)
+      {
+        if (done) break;
+        _this->m_ready_ev.Wait(100);
+        continue;
+      }
+
+      gifPipeBatch *b = &_this->m_sets[emitted%GIFPIPE_NSETS];
+      int x;
+      for (x=0;x<b->cnt;x++) _this->EmitFrame(b->frames.Get(x));
+      const bool can_prepare = LICE_WriteGIFCanPrepareFrames(_this->m_wr,_this->m_per_image);
+
+      _this->m_mutex.Enter();
+      _this->m_emitted++;
+      _this->m_can_prepare = can_prepare; // the writer's tables are published to the next batch by m_mutex
+      _this->m_mutex.Leave();
+      _this->m_emitted_ev.Set();
+    }
+    return 0;
+  }
+
+  void EmitFrame(gifPipeFrame *f)
+  {
+    if (f->changed)
+    {
+      if (m_have_pending) WritePending();
+
+      // keep the frame until its duration is known, the batch will be reused
+      void *t = m_pending_prepared;
+      m_pending_prepared = f->prepared;
+      f->prepared = t;
+      memcpy(m_pending_coords,f->coords,sizeof(m_pending_coords));
+      if (!m_pending_prepared) LICE_Copy(&m_lastfr,&f->bm);
+      m_have_pending=true;
+    }
+    m_accum_lat += f->delay;
+  }
+
+  void WritePending()
+  {
+    if (m_accum_lat<1) m_accum_lat=1;
+    if (m_pending_prepared) LICE_WriteGIFPreparedFrame(m_wr,m_pending_prepared,m_accum_lat);
+    else
+    {
+      LICE_SubBitmap bm(&m_lastfr,m_pending_coords[0],m_pending_coords[1],m_pending_coords[2],m_pending_coords[3]);
+      LICE_WriteGIFFrame(m_wr,&bm,m_pending_coords[0],m_pending_coords[1],m_per_image,m_accum_lat);
+    }
+    m_accum_lat=0;
+    m_have_pending=false;
+  }
+
+  void *m_wr;
+  int m_w, m_h;
+  bool m_per_image;
+  gifPipeBatch m_sets[GIFPIPE_NSETS];
+  LICE_ThreadPool m_pool;
+  LICE_Thread m_emit_thread;
+  WDL_Mutex m_mutex;
+  LICE_Event m_ready_ev, m_emitted_ev;
+  int m_ready, m_emitted; // batches handed to / written by the emitter
+  bool m_done;
+  bool m_can_prepare; // the writer's colormap no longer changes, set by the emitter
+
+  // emitter state
+  LICE_MemBitmap m_lastfr;
+  void *m_pending_prepared;
+  int m_pending_coords[4];
+  int m_accum_lat;
+  bool m_have_pending;
+};
+
+// -s: exact halving uses the box filter, other downscales are area averaged in one pass
+static void ScaleFrame(LICE_IBitmap *dest, LICE_IBitmap *src)
+{
+  const int dw = dest->getWidth(), dh = dest->getHeight();
+  if (src->getWidth()/2 == dw && src->getHeight()/2 == dh) 
+  {
+    LICE_HalveBlitAA(dest,src);
+    return;
+  }
+  const bool down = dw <= src->getWidth() && dh <= src->getHeight();
+  LICE_ScaledBlit(dest,src,0,0,dw,dh,0.0f,0.0f,(float)src->getWidth(),(float)src->getHeight(),1.0f,
+    LICE_BLIT_MODE_COPY|(down ? LICE_BLIT_FILTER_AREA : LICE_BLIT_FILTER_BILINEAR));
+}
+
 int main(int argc, char **argv)
 {
   printf("LICEcap CLI utility " LICECAP_VERSION "\nCopyright (C) 2010 Cockos Incorporated\n");
   signal(SIGINT,sigfuncint);
-  if (argc==4 && !strcmp(argv[1],"-d"))
+
+  int palette_step=0, gif_lossy=0, optpos=4;
+  bool gif_dither=false;
+  if (argc>=4 && !strcmp(argv[1],"-d")) for (;optpos<argc;optpos++)
+  {
+    const char *opt = argv[optpos];
+    if (!strncmp(opt,"-g",2)) palette_step = opt[2] ? wdl_max(atoi(opt+2),1) : 1;
+    else if (!strncmp(opt,"-l",2)) gif_lossy = opt[2] ? wdl_max(atoi(opt+2),0) : 16;
+    else if (!strcmp(opt,"-f")) gif_dither = true;
+    else break;
+  }
+
+  int cap_scale=100, lcf_threads=LICE_Thread::GetCPUCount();
+  if (argc>=3 && !strcmp(argv[1],"-e")) 
+  {
+    optpos = (argc>=4 && argv[3][0] != '-') ? 4 : 3;
+    for (;optpos<argc;optpos++)
+    {
+      const char *opt = argv[optpos];
+      if (!strncmp(opt,"-s",2)) cap_scale = opt[2] ? wdl_max(wdl_min(atoi(opt+2),100),1) : 50;
+      else if (!strncmp(opt,"-t",2)) lcf_threads = opt[2] ? wdl_max(atoi(opt+2),1) : 1;
+      else break;
+    }
+  }
+
+  if (argc>=4 && optpos==argc && !strcmp(argv[1],"-d"))
   {
     LICECaptureDecompressor tc(argv[2],true);
     if (tc.IsOpen())
     {
+      tc.SetThreadCount(LICE_Thread::GetCPUCount());
+      tc.SetPrefetch(true);
       int x;
 
       if (strstr(argv[3],".gif"))
       {
-        void *wr=LICE_WriteGIFBeginNoFrame(argv[3],tc.GetWidth(),tc.GetHeight(),0,true);
+        void *wr=LICE_WriteGIFBeginNoFrame(argv[3],tc.GetWidth(),tc.GetHeight(),0,gif_dither,false,gif_lossy);
 
         if (wr)
         {
-          bool useSinglePalette = false;
-          if (useSinglePalette) // create
+          const bool useSinglePalette = palette_step > 0;
+          if (useSinglePalette) // first pass: histogram of every palette_step-th frame
           {
-            void *octree = LICE_CreateOctree(256);
-            if (octree)
+            void *hist = LICE_CreateHistogram();
+            if (hist)
             {
               printf("building palette...");
               fflush(stdout);
               for (x=0;!g_done;x++)
               {
-                LICE_IBitmap *bm = tc.GetCurrentFrame();
-                if (!bm) break;
-                LICE_BuildOctree(octree, bm);
-                printf(".");
-                fflush(stdout);
-                tc.NextFrame();
+                if (!(x%palette_step))
+                {
+                  LICE_IBitmap *bm = tc.GetCurrentFrame();
+                  if (!bm) break;
+                  LICE_AddToHistogram(hist, bm);
+                  if (!(x%(palette_step*16)))
+                  {
+                    printf(".");
+                    fflush(stdout);
+                  }
+                }
+                if (tc.NextFrame()) break;
               }
-              LICE_SetGIFColorMapFromOctree(wr, octree, 256);
-              printf("done\n");
-              LICE_DestroyOctree(octree);
+              printf("done, %d colors\n",LICE_SetGIFColorMapFromHistogram(wr, hist));
+              LICE_DestroyHistogram(hist);
             }
           }
 
-          LICE_MemBitmap lastfr(tc.GetWidth(),tc.GetHeight());
-          int lastfr_coords[4];
-          int accum_lat=0;
-          bool first=true;
-
           tc.Seek(0);
-          for (x=0;!g_done;x++)
+          const int nthreads = LICE_Thread::GetCPUCount();
+          if (nthreads > 1)
           {
-            LICE_IBitmap *bm = tc.GetCurrentFrame();
-            if (!bm) break;
-            int diffcoords[4]={0,0,tc.GetWidth(),tc.GetHeight()};
+            gifPipeline pipe(wr,tc.GetWidth(),tc.GetHeight(),nthreads,!useSinglePalette);
+            pipe.Run(&tc);
+          }
+          else
+          {
+            LICE_MemBitmap lastfr(tc.GetWidth(),tc.GetHeight());
+            int lastfr_coords[4];
+            int accum_lat=0;
+            bool first=true;
 
-            if (!first)
+            for (x=0;!g_done;x++)
             {
-              if (!LICE_BitmapCmp(bm,&lastfr,diffcoords))
+              LICE_IBitmap *bm = tc.GetCurrentFrame();
+              if (!bm) break;
+              int diffcoords[4]={0,0,tc.GetWidth(),tc.GetHeight()};
+
+              if (!first)
               {
-                accum_lat += tc.GetTimeToNextFrame();
-                tc.NextFrame();
-                continue;
+                if (!LICE_BitmapCmp(bm,&lastfr,diffcoords))
+                {
+                  accum_lat += tc.GetTimeToNextFrame();
+                  tc.NextFrame();
+                  continue;
+                }
+                LICE_SubBitmap bm(&lastfr,lastfr_coords[0],lastfr_coords[1],
+                  lastfr_coords[2],lastfr_coords[3]);
+
+                if (accum_lat<1) accum_lat=1;
+                LICE_WriteGIFFrame(wr,&bm,lastfr_coords[0],lastfr_coords[1],
+                                      !useSinglePalette,accum_lat);
+                accum_lat=0;
               }
+
+              first=false;
+              accum_lat += tc.GetTimeToNextFrame();
+
+              LICE_Copy(&lastfr,bm);
+              memcpy(lastfr_coords,diffcoords,sizeof(diffcoords));
+
+              tc.NextFrame();
+            }
+            if (!first) 
+            {
               LICE_SubBitmap bm(&lastfr,lastfr_coords[0],lastfr_coords[1],
                 lastfr_coords[2],lastfr_coords[3]);
-
               if (accum_lat<1) accum_lat=1;
-              LICE_WriteGIFFrame(wr,&bm,lastfr_coords[0],lastfr_coords[1],
-                                    !useSinglePalette,accum_lat);
-              accum_lat=0;
+              LICE_WriteGIFFrame(wr,&bm,lastfr_coords[0],lastfr_coords[1],!useSinglePalette,accum_lat);
             }
-
-            first=false;
-            accum_lat += tc.GetTimeToNextFrame();
-
-            LICE_Copy(&lastfr,bm);
-            memcpy(lastfr_coords,diffcoords,sizeof(diffcoords));
-
-            tc.NextFrame();
-          }
-          if (!first) 
-          {
-            LICE_SubBitmap bm(&lastfr,lastfr_coords[0],lastfr_coords[1],
-              lastfr_coords[2],lastfr_coords[3]);
-            if (accum_lat<1) accum_lat=1;
-            LICE_WriteGIFFrame(wr,&bm,lastfr_coords[0],lastfr_coords[1],!useSinglePalette,accum_lat);
           }
 
           LICE_WriteGIFEnd(wr);
@@ -163,6 +464,26 @@ int main(int argc, char **argv)
            printf("error writing gif '%s'\n",argv[3]);
         }
       }
+      else if (strstr(argv[3],".apng"))
+      {
+        void *wr=LICE_WriteAPNGBegin(argv[3],tc.GetWidth(),tc.GetHeight());
+        if (wr)
+        {
+          LICE_WriteAPNGSetCompression(wr,6,0,LICE_APNG_FILTER_ADAPTIVE,LICE_Thread::GetCPUCount());
+          for (x=0;!g_done;x++)
+          {
+            LICE_IBitmap *bm = tc.GetCurrentFrame();
+            if (!bm) break;
+            LICE_WriteAPNGFrame(wr,bm,wdl_max(tc.GetTimeToNextFrame(),1));
+            if (tc.NextFrame()) break;
+          }
+          LICE_WriteAPNGEnd(wr);
+        }
+        else
+        {
+           printf("error writing apng '%s'\n",argv[3]);
+        }
+      }
       else for (x=0;!g_done;x++)
       {
         LICE_IBitmap *bm = tc.GetCurrentFrame();
@@ -184,10 +505,10 @@ int main(int argc, char **argv)
     }
     else printf("Error opening '%s'\n",argv[2]);
   }
-  else if ((argc==3||argc==4) && !strcmp(argv[1],"-e"))
+  else if (argc>=3 && optpos==argc && !strcmp(argv[1],"-e"))
   {
     DWORD st = GetTickCount();
-    double fr = argc==4 ? atof(argv[3]) : 5.0;
+    double fr = (argc>=4 && argv[3][0] != '-') ? atof(argv[3]) : 5.0;
     if (fr < 1.0) fr=1.0;
     fr = 1000.0/fr;
 
@@ -198,19 +519,44 @@ int main(int argc, char **argv)
     GetClientRect(h,&r);
     bm.resize(r.right,r.bottom);
 
+    // encoded size, frames are scaled right after the grab if smaller
+    const int ow = wdl_max(r.right*cap_scale/100,1), oh = wdl_max(r.bottom*cap_scale/100,1);
+    LICE_MemBitmap sbm;
+    LICE_IBitmap *enc = &bm;
+    if (ow != r.right || oh != r.bottom)
+    {
+      sbm.resize(ow,oh);
+      enc = &sbm;
+      LICE_SetThreadCount(-1); // large scaled blits are split across cores
+    }
+
     LICE_MemBitmap *lastbm=NULL;
 
-    bool gifMode=false,pngMode=false;
+    bool gifMode=false,pngMode=false,apngMode=false;
     if (strstr(argv[2],".gif")) gifMode=true;
     if (strstr(argv[2],".png")) pngMode=true;
+    if (strstr(argv[2],".apng")) apngMode=true;
 
     LICECaptureCompressor *tc = NULL;
-    void *gif_wr=NULL;
+    void *gif_wr=NULL, *apng_wr=NULL;
     
-    if (!gifMode&&!pngMode) tc = new LICECaptureCompressor(argv[2],r.right,r.bottom);
-    if (gifMode||pngMode||tc->IsOpen())
+    if (!gifMode&&!pngMode&&!apngMode) 
+    {
+      tc = new LICECaptureCompressor(argv[2],ow,oh);
+      if (tc->IsOpen()) 
+      {
+        if (lcf_threads > 1) tc->SetParallel(lcf_threads);
+        tc->SetAsync(8);
+      }
+    }
+    if (apngMode)
+    {
+      apng_wr = LICE_WriteAPNGBegin(argv[2],ow,oh);
+      if (apng_wr) LICE_WriteAPNGSetCompression(apng_wr,6,0,LICE_APNG_FILTER_ADAPTIVE,LICE_Thread::GetCPUCount());
+    }
+    if (gifMode||pngMode||apng_wr||(tc && tc->IsOpen()))
     {
-      printf("Encoding %dx%d target %.1f fps (press Ctrl+C to stop):\n",r.right,r.bottom,1000.0/fr);
+      printf("Encoding %dx%d target %.1f fps (press Ctrl+C to stop):\n",ow,oh,1000.0/fr);
 
       DWORD lastt=GetTickCount();
       while (!g_done)
@@ -223,14 +569,28 @@ int main(int argc, char **argv)
         }
 
         DoMouseCursor(bm.getDC(),h,0,0);
+        if (enc != &bm) ScaleFrame(enc,&bm);
 
         DWORD thist = GetTickCount();
 
         x++;
-        printf("Frame: %d (%.1ffps, offs=%d)\r",x,x*1000.0/(thist-st),thist-lastt);
+        if (tc) printf("Frame: %d (%.1ffps, offs=%d, queued=%d, dropped=%d)\r",x,x*1000.0/(thist-st),thist-lastt,tc->GetQueuedFrames(),tc->GetDroppedFrames());
+        else printf("Frame: %d (%.1ffps, offs=%d)\r",x,x*1000.0/(thist-st),thist-lastt);
 
         if (tc) 
-          tc->OnFrame(&bm,thist - lastt);
+          tc->OnFrame(enc,thist - lastt);
+        else if (apng_wr)
+        {
+          // a frame's delay is known once the next one is grabbed
+          if (!lastbm) lastbm = new LICE_MemBitmap;
+          else
+          {
+            int del = thist-lastt;
+            if (del<1) del=1;
+            LICE_WriteAPNGFrame(apng_wr,lastbm,del);
+          }
+          LICE_Copy(lastbm,enc);
+        }
         else if (pngMode)
         {
           char buf[512];
@@ -242,7 +602,7 @@ int main(int argc, char **argv)
           {
             sprintf(p,"-%03d.png",x-1);
           }
-          LICE_WritePNG(buf,&bm,false);
+          LICE_WritePNG(buf,enc,false);
         }
         else if (gifMode)
         {
@@ -269,7 +629,7 @@ int main(int argc, char **argv)
             LICE_WriteGIFFrame(gif_wr,lastbm,0,0,true,del);
           }
 
-          if (lastbm) LICE_Copy(lastbm,&bm);
+          if (lastbm) LICE_Copy(lastbm,enc);
         }
         lastt = thist;
     
@@ -281,6 +641,7 @@ int main(int argc, char **argv)
       if (tc)
       {
         tc->OnFrame(NULL,0);
+        if (tc->GetDroppedFrames()) printf("%d frames dropped (%d stalls)\n",tc->GetDroppedFrames(),tc->GetStalledFrames());
         outsz=tc->GetOutSize();
         intsz = tc->GetInSize();
         delete tc;
@@ -295,11 +656,22 @@ int main(int argc, char **argv)
         }
         LICE_WriteGIFEnd(gif_wr);
       }
+      if (apng_wr)
+      {
+        if (lastbm)
+        {
+          int del = GetTickCount()-lastt;
+          if (del<1) del=1;
+          LICE_WriteAPNGFrame(apng_wr,lastbm,del);
+        }
+        outsz = LICE_WriteAPNGGetSize(apng_wr);
+        LICE_WriteAPNGEnd(apng_wr);
+      }
       delete lastbm;
       lastbm=0;
 
-      printf("%d %dx%d frames in %.1fs, %.1f fps %.1fMB/s (%.1fMB/s -> %.3fMB/s)\n",x,r.right,r.bottom,st/1000.0,x*1000.0/st,
-        r.right*r.bottom*4 * (x*1000.0/st) / 1024.0/1024.0,
+      printf("%d %dx%d frames in %.1fs, %.1f fps %.1fMB/s (%.1fMB/s -> %.3fMB/s)\n",x,ow,oh,st/1000.0,x*1000.0/st,
+        ow*oh*4 * (x*1000.0/st) / 1024.0/1024.0,
         intsz /1024.0/1024.0 / (st/1000.0),
         outsz /1024.0/1024.0 / (st/1000.0));
     }
@@ -309,9 +681,15 @@ int main(int argc, char **argv)
   else 
   {
     printf("usage: \n"
-           "  licecap -d file.lcf fnout[.gif|.png]]  ; converts lcf file to gif (or PNGs)\n"
-           "  licecap -e file.[lcf|gif|png] [maxfps] ; encodes full screen until Ctrl+C\n"
+           "  licecap -d file.lcf fnout[.gif|.apng|.png] ; converts lcf file to gif, animated png (or PNGs)\n"
+           "  licecap -d file.lcf fnout.gif -g[N]    ; converts to gif with one palette for all frames (from every Nth frame)\n"
+           "  licecap -d file.lcf fnout.gif -l[N]    ; lossy gif compression, colors may change by up to N (default 16)\n"
+           "  licecap -d file.lcf fnout.gif -f       ; Floyd-Steinberg dithering (off by default)\n"
+           "  licecap -e file.[lcf|gif|apng|png] [maxfps] ; encodes full screen until Ctrl+C\n"
+           "  licecap -e file.lcf [maxfps] -s[N]     ; encodes at N percent of the screen size (default 50)\n"
+           "  licecap -e file.lcf [maxfps] -t[N]     ; compresses with N threads, -t1 writes files older versions can read\n"
            "Note: if PNG specified, filenames will be file-XXX.png\n"
+           "      .apng output is an animated PNG storing only the changed area of each frame\n"
            );
   }
   return 0;
@@ -273,6 +273,10 @@ SOURCE=..\WDL\lice\lice.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\WDL\lice\lice_apng_write.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\WDL\lice\lice_gif_write.cpp
 # End Source File
 # Begin Source File
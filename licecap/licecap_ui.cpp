@@ -28,7 +28,9 @@
 #endif
 #include "../WDL/queue.h"
 #include "../WDL/mutex.h"
+#include "../WDL/wdlatomic.h"
 #include "../WDL/wdlcstring.h"
+#include "../WDL/lice/lice_thread.h"
 
 
 //#define TEST_MULTIPLE_MODES
@@ -97,10 +99,40 @@ class gif_encoder
   int loopcnt;
   LICE_pixel trans_mask;
 
+#ifndef NO_LCF_SUPPORT
+  // single palette mode: frames are spooled to a temporary .lcf while a histogram of the changed pixels
+  // is collected, the .gif is written with one global colormap when the encoder is destroyed
+  LICECaptureCompressor *spool;
+  WDL_String spool_fn;
+  void *spool_hist;
+  WDL_TypedBuf<int> spool_frames; // x, y, w, h, delay per frame
+
+  void spool_write()
+  {
+    delete spool; // flushes
+    spool=NULL;
+
+    LICE_SetGIFColorMapFromHistogram(ctx,spool_hist);
+
+    LICECaptureDecompressor dec(spool_fn.Get());
+    const int nf = spool_frames.GetSize()/5;
+    int x;
+    for (x=0;x<nf && dec.IsOpen();x++)
+    {
+      LICE_IBitmap *fr = dec.GetCurrentFrame();
+      if (!fr) break;
+      const int *f = spool_frames.Get() + x*5;
+      LICE_SubBitmap bm(fr,f[0],f[1],f[2],f[3]);
+      LICE_WriteGIFFrame(ctx,&bm,f[0],f[1],false,f[4],loopcnt);
+      dec.NextFrame();
+    }
+  }
+#endif
+
 public:
 
 
-  gif_encoder(void *gifctx, int use_loopcnt, int trans_chan_mask=0xff)
+  gif_encoder(void *gifctx, int use_loopcnt, int trans_chan_mask=0xff, const char *single_palette_spoolfn=NULL)
   {
     lastbm = NULL;
     memset(lastbm_coords,0,sizeof(lastbm_coords));
@@ -108,10 +140,27 @@ public:
     ctx=gifctx;
     loopcnt=use_loopcnt;
     trans_mask = LICE_RGBA(trans_chan_mask,trans_chan_mask,trans_chan_mask,0);
+#ifndef NO_LCF_SUPPORT
+    spool=NULL;
+    spool_hist=NULL;
+    if (single_palette_spoolfn) 
+    {
+      spool_fn.Set(single_palette_spoolfn);
+      spool_hist = LICE_CreateHistogram();
+    }
+#endif
   }
   ~gif_encoder()
   {
     frame_finish();
+#ifndef NO_LCF_SUPPORT
+    if (spool) 
+    {
+      spool_write();
+      remove(spool_fn.Get());
+    }
+    LICE_DestroyHistogram(spool_hist);
+#endif
     LICE_WriteGIFEnd(ctx);
     delete lastbm;
   }
@@ -133,6 +182,30 @@ public:
       
       int del = lastbm_accumdelay;
       if (del<1) del=1;
+#ifndef NO_LCF_SUPPORT
+      if (spool_hist && !spool)
+      {
+        spool = new LICECaptureCompressor(spool_fn.Get(),lastbm->getWidth(),lastbm->getHeight());
+        if (spool->IsOpen()) spool->SetAsync(4,true); // every frame must be kept, spool_frames maps 1:1 to them
+        else
+        {
+          // fall back to per-frame colormaps
+          delete spool;
+          spool=NULL;
+          LICE_DestroyHistogram(spool_hist);
+          spool_hist=NULL;
+        }
+      }
+      if (spool)
+      {
+        const RECT r = { lastbm_coords[0], lastbm_coords[1], lastbm_coords[0]+lastbm_coords[2], lastbm_coords[1]+lastbm_coords[3] };
+        spool->OnFrame(lastbm,del,&r,1);
+        LICE_AddToHistogram(spool_hist,&bm);
+        const int f[5] = { lastbm_coords[0], lastbm_coords[1], lastbm_coords[2], lastbm_coords[3], del };
+        spool_frames.Add(f,5);
+      }
+      else
+#endif
       LICE_WriteGIFFrame(ctx,&bm,lastbm_coords[0],lastbm_coords[1],true,del,loopcnt);
     }
     lastbm_accumdelay=0;
@@ -171,12 +244,16 @@ public:
 
 
 
-int g_prefs; // &1=title frame, &2=giant font, &4=record mousedown, &8=timeline, &16=shift+space pause, &32=transparency-fu
+int g_prefs; // &1=title frame, &2=giant font, &4=record mousedown, &8=timeline, &16=shift+space pause, &32=transparency-fu, &64=stop after, &128=single gif palette
 int g_stop_after_msec;
 
 
 int g_gif_loopcount=0;
+int g_gif_lossy=0; // LZW tolerance, 0=lossless
+bool g_gif_dither=false; // Floyd-Steinberg dithering, off by default since it adds noise to flat areas and grows the file
 int g_max_fps=8;  
+int g_cap_scale=100; // percent of the captured size that is encoded
+int g_lcf_threads=0; // .lcf compression threads, 0=one per CPU. 1 writes single-stream files that older versions can read
 
 char g_last_fn[2048];
 WDL_String g_ini_file;
@@ -263,16 +340,36 @@ void MakeTimeStr(int sec, char* buf, int w, int h, int* timepos)
   timepos[1] = h-timepos[3];
 }
 
+// the label only changes once a second but is drawn a few times per encoded frame (current and
+// previously written second), so the last two are kept rendered. safe to call from any thread.
 void draw_timedisp(LICE_IBitmap *bm, int sec, int timeposout[4], int bw, int bh)
 {
-  char timestr[256];
-  int timepos[4]; // x,y,w,h
-  MakeTimeStr(sec, timestr, bw, bh, timepos);
-  if (bm)
+  static WDL_Mutex s_mutex;
+  static LICE_IBitmap *s_label[2];
+  static int s_label_sec[2] = { -1, -1 }, s_label_next;
+
+  if (sec < 0) sec=0;
+  WDL_MutexLock lock(&s_mutex);
+  int slot;
+  for (slot=0; slot<2 && (s_label_sec[slot] != sec || !s_label[slot]); slot++);
+  if (slot == 2)
   {
-    LICE_FillRect(bm, timepos[0], timepos[1], timepos[2], timepos[3], LICE_RGBA(0,0,0,255), 1.0f, LICE_BLIT_MODE_COPY);
-    LICE_DrawText(bm, timepos[0]+4, timepos[1]+4, timestr, LICE_RGBA(255,255,255,255), 1.0f, LICE_BLIT_MODE_COPY);
+    char timestr[256];
+    int timepos[4]; // x,y,w,h
+    MakeTimeStr(sec, timestr, 0, 0, timepos);
+
+    slot = s_label_next;
+    s_label_next ^= 1;
+    if (!s_label[slot]) s_label[slot] = LICE_CreateMemBitmap(timepos[2],timepos[3]);
+    else s_label[slot]->resize(timepos[2],timepos[3]);
+    LICE_Clear(s_label[slot], LICE_RGBA(0,0,0,255));
+    LICE_DrawText(s_label[slot], 4, 4, timestr, LICE_RGBA(255,255,255,255), 1.0f, LICE_BLIT_MODE_COPY);
+    s_label_sec[slot] = sec;
   }
+
+  LICE_IBitmap *label = s_label[slot];
+  const int timepos[4] = { bw-label->getWidth(), bh-label->getHeight(), label->getWidth(), label->getHeight() };
+  if (bm) LICE_Blit(bm, label, timepos[0], timepos[1], 0, 0, timepos[2], timepos[3], 1.0f, LICE_BLIT_MODE_COPY);
   if (timeposout) memcpy(timeposout,timepos,sizeof(timepos));
 }
 
@@ -565,6 +662,426 @@ void UpdateDimBoxes(HWND hwndDlg)
 }
 
 
+// capture runs on its own thread, scheduled against an absolute timeline so that frames are taken at 
+// g_max_fps rather than at multiples of a UI timer period. grabbed frames are passed to the encode thread 
+// through a single producer/single consumer ring of preallocated bitmaps, the UI thread only updates status.
+#define CAP_RING_SIZE 4 // power of 2
+
+struct capRingSlot
+{
+  LICE_IBitmap *bm; // same layout as g_cap_bm_inv (macOS) or g_cap_bm
+  DWORD t; // time of capture
+  int ndirty; // -1 if unknown, otherwise the number of rectangles in dirty
+  WDL_TypedBuf<RECT> dirty; // parts of bm that changed since the previous frame in the ring, if known
+};
+
+static capRingSlot s_cap_ring[CAP_RING_SIZE];
+static int s_cap_ring_wr, s_cap_ring_rd; // only advanced by the capture and encode thread, respectively
+static int s_cap_ring_dropped; // frames not captured because the encoder was behind
+static RECT s_cap_rect; // screen position of IDC_VIEWRECT, updated by the UI thread
+static WDL_Mutex s_cap_rect_mutex, s_cap_grab_mutex; // s_cap_grab_mutex is held while a frame is captured
+static LICE_Thread s_cap_thread, s_enc_thread;
+static LICE_Event s_cap_wake, s_enc_wake;
+static int s_cap_kill, s_cap_need_stop; // flags, see cap_ring_load()/cap_ring_store()
+static WDL_Mutex s_cap_stats_mutex; // g_ms_written, g_frate_avg and g_frate_valid while the encode thread runs
+
+static int cap_ring_load(int *v) // read with a full barrier
+{
+#ifdef _WIN32
+  return (int)InterlockedCompareExchange((LONG *)v,0,0);
+#else
+  return __sync_fetch_and_add(v,0);
+#endif
+}
+
+static void cap_ring_store(int *v, int val) // write with a full barrier
+{
+#ifdef _WIN32
+  InterlockedExchange((LONG *)v,val);
+#else
+  __sync_synchronize();
+  __sync_lock_test_and_set(v,val);
+#endif
+}
+
+#ifndef _WIN32
+bool GetScreenData(int xpos, int ypos, LICE_IBitmap *bmOut);
+#endif
+#if !defined(_WIN32) && !defined(__APPLE__)
+// capturewindow_x11.cpp
+LICE_IBitmap *CreateScreenBitmap(int w, int h);
+int GetScreenDamage(WDL_TypedBuf<RECT> *list);
+#endif
+#ifdef __APPLE__
+void *CaptureThread_PushPool();
+void CaptureThread_PopPool(void *pool);
+#endif
+
+static void CaptureThread_UpdateRect(HWND hwndDlg)
+{
+  RECT r;
+  GetWindowRect(GetDlgItem(hwndDlg,IDC_VIEWRECT),&r);
+#ifdef _WIN32
+  __LogicalToPhysicalPointForPerMonitorDPI(g_hwnd,(LPPOINT)&r);
+#endif
+  s_cap_rect_mutex.Enter();
+  s_cap_rect = r;
+  s_cap_rect_mutex.Leave();
+}
+
+static bool CaptureThread_Grab(LICE_IBitmap *bm)
+{
+  s_cap_rect_mutex.Enter();
+  RECT r = s_cap_rect;
+  s_cap_rect_mutex.Leave();
+
+#ifdef _WIN32
+  HWND h = GetDesktopWindow();
+  HDC hdc = GetDC(h);
+  if (!hdc) return false;
+
+  LICE_Clear(bm,0);
+  BitBlt(bm->getDC(),0,0,bm->getWidth(),bm->getHeight(),hdc,r.left+1,r.top+1,SRCCOPY);
+  ReleaseDC(h,hdc);
+  DoMouseCursor(bm,h,-(r.left+1),-(r.top+1));
+  return true;
+#else
+
+#ifdef __APPLE__
+  RECT r3;
+  if (s_has_async_offset && GetAsyncNSWindowRect(g_hwnd,&r3)) // follows the window while it is being dragged
+  {
+    const int w = r.right-r.left;
+    const int h = r.bottom-r.top;
+    r.left = r3.left + s_async_offset.x;
+    r.top = r3.top + s_async_offset.y;
+
+    r.bottom = r.top + h;
+    r.right = r.left + w;
+  }
+#endif
+
+  void DoMouseCursor(LICE_IBitmap *,int,int);
+#ifdef __APPLE__
+  if (!GetScreenData(r.left,wdl_min(r.top,r.bottom),bm)) return false;
+  DoMouseCursor(bm,-(r.left+1),-(r.bottom+1));
+#else
+  // X11 screen coordinates are top-down, as on win32
+  if (!GetScreenData(r.left+1,r.top+1,bm)) return false;
+  DoMouseCursor(bm,-(r.left+1),-(r.top+1));
+#endif
+  return true;
+#endif
+}
+
+static void EncodeCapturedFrame(DWORD now, WDL_TypedBuf<RECT> *dirty) // g_cap_bm has the frame, dirty=NULL if unknown
+{
+  s_cap_stats_mutex.Enter();
+  g_ms_written += now-g_last_frame_capture_time;
+  s_cap_stats_mutex.Leave();
+
+  const int bw = g_cap_bm->getWidth();
+  const int bh = g_cap_bm->getHeight();
+  const bool dotime = !!(g_prefs&8);
+
+  const int frame_time_in_seconds = g_ms_written/1000;
+  
+#ifdef VIDEO_ENCODER_SUPPORT
+  if (g_cap_video)
+  {
+    if (dotime) draw_timedisp(g_cap_bm,frame_time_in_seconds,NULL,bw,bh);
+
+    EncodeFrameToVideo(g_cap_video,g_cap_bm);
+  }
+#endif
+#ifndef NO_LCF_SUPPORT
+  if (g_cap_lcf)
+  {
+    static RECT s_lasttime; // the time display isn't part of the screen damage
+    RECT timer = {0,};
+    if (dotime)
+    {
+      int pos[4];
+      draw_timedisp(g_cap_bm,frame_time_in_seconds,pos,bw,bh);
+      timer.left = pos[0];
+      timer.top = pos[1];
+      timer.right = pos[0]+pos[2];
+      timer.bottom = pos[1]+pos[3];
+      if (dirty)
+      {
+        dirty->Add(s_lasttime);
+        dirty->Add(timer);
+      }
+    }
+    s_lasttime = timer;
+
+    int del = now-g_last_frame_capture_time;
+    if (g_dotitle)
+    {
+      del += g_titlems;
+      g_dotitle=false;
+    }
+    if (dirty) g_cap_lcf->OnFrame(g_cap_bm,del,dirty->Get(),dirty->GetSize());
+    else g_cap_lcf->OnFrame(g_cap_bm,del);
+  }
+#endif
+
+  if (g_cap_gif)
+  {
+    // draw old time display for frame_compare(), so that it finds the portion other than the time display that changes
+    int old_time_coords[4]={0,};
+    if (dotime && g_cap_gif_lastsec_written>=0)
+      draw_timedisp(g_cap_bm,g_cap_gif_lastsec_written,old_time_coords,bw,bh);
+
+    g_cap_gif->frame_advancetime(now-g_last_frame_capture_time);
+#ifdef TEST_MULTIPLE_MODES
+    if (g_cap_gif2) g_cap_gif2->frame_advancetime(now-g_last_frame_capture_time);
+    if (g_cap_gif3) g_cap_gif3->frame_advancetime(now-g_last_frame_capture_time);
+#endif
+
+    int diffs[4];
+    
+    if (g_cap_gif->frame_compare(g_cap_bm,diffs))
+    {
+      g_cap_gif->frame_finish();
+#ifdef TEST_MULTIPLE_MODES
+      if (g_cap_gif2) g_cap_gif2->frame_finish();
+      if (g_cap_gif3) g_cap_gif3->frame_finish();
+#endif
+
+      if (dotime && frame_time_in_seconds != g_cap_gif_lastsec_written)
+      {
+        int pos[4];
+        draw_timedisp(NULL,frame_time_in_seconds,pos,bw,bh);
+
+        union_diffs(pos, old_time_coords);
+
+        if (diffs[0]+diffs[2] >= pos[0] && diffs[1]+diffs[3] >= pos[1])
+        {
+          union_diffs(diffs, pos); // add pos into diffs for display update
+
+          draw_timedisp(g_cap_bm,frame_time_in_seconds,pos,bw,bh);
+          g_cap_gif_lastsec_written = frame_time_in_seconds;
+        }
+      }
+
+      g_cap_gif->frame_new(g_cap_bm,diffs[0],diffs[1],diffs[2],diffs[3]);
+#ifdef TEST_MULTIPLE_MODES
+      if (g_cap_gif2) g_cap_gif2->frame_new(g_cap_bm,diffs[0],diffs[1],diffs[2],diffs[3]);
+      if (g_cap_gif3) g_cap_gif3->frame_new(g_cap_bm,diffs[0],diffs[1],diffs[2],diffs[3]);
+#endif
+    }
+
+    if (dotime && frame_time_in_seconds != g_cap_gif_lastsec_written)
+    {
+      // time changed and wasn't previously included, so include as a dedicated frame
+      g_cap_gif->frame_finish();
+#ifdef TEST_MULTIPLE_MODES
+      if (g_cap_gif2) g_cap_gif2->frame_finish();
+      if (g_cap_gif3) g_cap_gif3->frame_finish();
+#endif
+
+      int pos[4];
+      draw_timedisp(g_cap_bm,frame_time_in_seconds,pos,bw,bh);
+      union_diffs(pos, old_time_coords);
+
+      g_cap_gif_lastsec_written = frame_time_in_seconds;
+      g_cap_gif->frame_new(g_cap_bm,pos[0],pos[1],pos[2],pos[3]);
+#ifdef TEST_MULTIPLE_MODES
+      if (g_cap_gif2) g_cap_gif2->frame_new(g_cap_bm,pos[0],pos[1],pos[2],pos[3]);
+      if (g_cap_gif3) g_cap_gif3->frame_new(g_cap_bm,pos[0],pos[1],pos[2],pos[3]);
+#endif
+    }
+  }
+
+  if (now > g_last_frame_capture_time)
+  {
+    double fr = 1000.0 / (double) (now - g_last_frame_capture_time);
+    if (fr>100.0) fr=100.0;
+
+    WDL_MutexLock lock(&s_cap_stats_mutex);
+    if (g_frate_valid) 
+    {
+      g_frate_avg = g_frate_avg*0.9 + fr*0.1;
+    }
+    else 
+    {
+      g_frate_avg=fr;
+      g_frate_valid=true;
+    }
+  }
+
+  g_last_frame_capture_time = now;
+
+  if ((g_prefs&64) && g_ms_written > g_stop_after_msec) cap_ring_store(&s_cap_need_stop,1);
+}
+
+static unsigned int CaptureThreadProc(void *p)
+{
+#ifdef _WIN32
+  timeBeginPeriod(1); // so the waits below are accurate to 1ms
+#endif
+  double next_t = timeGetTime();
+  bool need_full = true; // the first frame after a pause follows frames the ring didn't see
+  while (!cap_ring_load(&s_cap_kill))
+  {
+    const double interval = 1000.0 / wdl_max(g_max_fps,1);
+    const DWORD now = timeGetTime();
+
+    if (g_cap_state!=1 || now < g_cap_prerolluntil || now < g_skip_capture_until)
+    {
+      next_t = now + interval;
+      need_full = true;
+      s_cap_wake.Wait(5);
+      continue;
+    }
+    if ((double)now < next_t)
+    {
+      s_cap_wake.Wait((int)(next_t - now + 0.5));
+      continue;
+    }
+
+    // the next frame is due relative to when this one was due rather than when it was taken, so
+    // wakeup and capture latency don't accumulate. after a stall of more than a frame, resync instead of catching up
+    next_t += interval;
+    if (next_t <= now) next_t = now + interval;
+
+    const int wr = s_cap_ring_wr;
+    if (wr - cap_ring_load(&s_cap_ring_rd) >= CAP_RING_SIZE)
+    {
+      // encoder is behind: skip this frame, its time goes to the next frame that gets encoded
+      wdl_atomic_incr(&s_cap_ring_dropped);
+      continue;
+    }
+
+    capRingSlot *slot = &s_cap_ring[wr & (CAP_RING_SIZE-1)];
+
+    s_cap_grab_mutex.Enter();
+    if (g_cap_state == 1) // state is only changed by the UI thread, see CaptureThread_Sync()
+    {
+#ifdef __APPLE__
+      void *pool = CaptureThread_PushPool();
+#endif
+      const bool ok = CaptureThread_Grab(slot->bm);
+#ifdef __APPLE__
+      CaptureThread_PopPool(pool);
+#endif
+      if (ok)
+      {
+        slot->t = now;
+        slot->ndirty = -1;
+#if !defined(_WIN32) && !defined(__APPLE__)
+        if (!need_full) slot->ndirty = GetScreenDamage(&slot->dirty);
+#endif
+        need_full = false;
+        wdl_atomic_incr(&s_cap_ring_wr);
+        s_enc_wake.Set();
+      }
+    }
+    s_cap_grab_mutex.Leave();
+  }
+#ifdef _WIN32
+  timeEndPeriod(1);
+#endif
+  return 0;
+}
+
+// resamples a grabbed frame to the output size: halving uses the box filter (exact for 50%),
+// other downscales are area averaged in a single pass, upscales are bilinear
+static void ScaleCapturedFrame(LICE_IBitmap *dest, LICE_IBitmap *src, WDL_TypedBuf<RECT> *dirty, int ndirty)
+{
+  const int sw = src->getWidth(), sh = src->getHeight(), dw = dest->getWidth(), dh = dest->getHeight();
+
+  if (sw/2 == dw && sh/2 == dh) LICE_HalveBlitAA(dest,src);
+  else
+    LICE_ScaledBlit(dest,src,0,0,dw,dh,0.0f,0.0f,(float)sw,(float)sh,1.0f,
+      LICE_BLIT_MODE_COPY|(dw <= sw && dh <= sh ? LICE_BLIT_FILTER_AREA : LICE_BLIT_FILTER_BILINEAR));
+
+  RECT *r = dirty ? dirty->Get() : NULL;
+  int x;
+  for (x=0;x<ndirty;x++) // grow outwards by a pixel for the filter footprint
+  {
+    r[x].left = wdl_max(r[x].left*dw/sw - 1, 0);
+    r[x].top = wdl_max(r[x].top*dh/sh - 1, 0);
+    r[x].right = wdl_min((r[x].right*dw + sw-1)/sw + 1, dw);
+    r[x].bottom = wdl_min((r[x].bottom*dh + sh-1)/sh + 1, dh);
+  }
+}
+
+static unsigned int EncodeThreadProc(void *p)
+{
+  for (;;)
+  {
+    const int rd = s_cap_ring_rd;
+    if (rd == cap_ring_load(&s_cap_ring_wr))
+    {
+      if (cap_ring_load(&s_cap_kill)) break; // only after everything captured has been encoded
+      s_enc_wake.Wait(100);
+      continue;
+    }
+
+    capRingSlot *slot = &s_cap_ring[rd & (CAP_RING_SIZE-1)];
+    LICE_IBitmap *dest = g_cap_bm_inv?g_cap_bm_inv:g_cap_bm;
+    if (dest->getWidth() == slot->bm->getWidth() && dest->getHeight() == slot->bm->getHeight())
+      LICE_Copy(dest, slot->bm);
+    else
+      ScaleCapturedFrame(dest, slot->bm, &slot->dirty, slot->ndirty);
+    EncodeCapturedFrame(slot->t, slot->ndirty >= 0 ? &slot->dirty : NULL);
+
+    wdl_atomic_incr(&s_cap_ring_rd); // slot is free once the frame is encoded, see CaptureThread_Sync()
+  }
+  return 0;
+}
+
+static void CaptureThread_Start(HWND hwndDlg, int w, int h)
+{
+  int x;
+  for (x=0;x<CAP_RING_SIZE;x++)
+  {
+#if !defined(_WIN32) && !defined(__APPLE__)
+    s_cap_ring[x].bm = CreateScreenBitmap(w,h); // captured into without a copy
+#else
+    s_cap_ring[x].bm = LICE_CreateSysBitmap(w,h);
+#endif
+  }
+  s_cap_ring_wr = s_cap_ring_rd = 0;
+  s_cap_ring_dropped = 0;
+  s_cap_kill = s_cap_need_stop = 0; // before the threads start
+  CaptureThread_UpdateRect(hwndDlg);
+
+  s_enc_thread.Start(EncodeThreadProc,NULL);
+  s_cap_thread.Start(CaptureThreadProc,NULL);
+}
+
+// call after g_cap_state leaves 1: returns once every captured frame is encoded, after which 
+// the UI thread can use g_cap_bm and the encoders until g_cap_state is set to 1 again
+static void CaptureThread_Sync()
+{
+  s_cap_grab_mutex.Enter(); // wait for a grab in progress
+  s_cap_grab_mutex.Leave();
+  while (s_enc_thread.IsRunning() && cap_ring_load(&s_cap_ring_rd) != cap_ring_load(&s_cap_ring_wr))
+  {
+    s_enc_wake.Set();
+    Sleep(1);
+  }
+}
+
+static void CaptureThread_Stop()
+{
+  cap_ring_store(&s_cap_kill,1);
+  s_cap_wake.Set();
+  s_cap_thread.Join();
+  s_enc_wake.Set();
+  s_enc_thread.Join(); // encodes what's left in the ring first
+
+  int x;
+  for (x=0;x<CAP_RING_SIZE;x++)
+  {
+    delete s_cap_ring[x].bm;
+    s_cap_ring[x].bm = NULL;
+  }
+}
+
 DWORD g_pause_time; // time of last pause
 DWORD g_insert_cnt=0; // number of frames inserted, purely for display
 int g_insert_ms=g_titlems;
@@ -606,7 +1123,11 @@ void UpdateStatusText(HWND hwndDlg)
   snprintf(buf,sizeof(buf),"%s%s",pbuf,dims);
 
 #ifndef NO_LCF_SUPPORT
-  if (g_cap_lcf) strcat(buf, " LCF");
+  if (g_cap_lcf) 
+  {
+    strcat(buf, " LCF");
+    if (g_cap_lcf->GetDroppedFrames()) snprintf_append(buf,sizeof(buf)," (%d dropped)",g_cap_lcf->GetDroppedFrames());
+  }
 #endif
 #ifdef VIDEO_ENCODER_SUPPORT
   if (g_cap_video) 
@@ -617,13 +1138,24 @@ void UpdateStatusText(HWND hwndDlg)
 #endif
   if (g_cap_gif) lstrcatn(buf, " GIF", sizeof(buf));
   
+  s_cap_stats_mutex.Enter();
+  const DWORD ms_written = g_ms_written;
+  const bool frate_valid = g_frate_valid;
+  const double frate_avg = g_frate_avg;
+  s_cap_stats_mutex.Leave();
+  const int dropped = cap_ring_load(&s_cap_ring_dropped);
+
   if (g_cap_state)
   {
-    snprintf_append(buf,sizeof(buf), " %d:%02d", g_ms_written/60000, (g_ms_written/1000)%60);
+    snprintf_append(buf,sizeof(buf), " %d:%02d", ms_written/60000, (ms_written/1000)%60);
   }
-  if (g_cap_state && g_frate_valid)
+  if (g_cap_state && frate_valid)
   {   
-    snprintf_append(buf,sizeof(buf)," @ %.1ffps" ,g_frate_avg);
+    snprintf_append(buf,sizeof(buf)," @ %.1ffps" ,frate_avg);
+  }
+  if (g_cap_state && dropped)
+  {
+    snprintf_append(buf,sizeof(buf)," (%d skipped)",dropped);
   }
 
   GetDlgItemText(hwndDlg,IDC_STATUS,oldtext,sizeof(oldtext));
@@ -690,6 +1222,8 @@ void SWELL_SetWindowResizeable(HWND, bool);
 
 void Capture_Finish(HWND hwndDlg)
 {
+  CaptureThread_Stop();
+
   SetDlgItemText(hwndDlg,IDC_REC,"Record...");
   EnableWindow(GetDlgItem(hwndDlg,IDC_STOP),0);
 
@@ -806,6 +1340,7 @@ static UINT_PTR CALLBACK SaveOptsProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPA
       if (g_prefs&8) CheckDlgButton(hwndDlg, IDC_TIMELINE, BST_CHECKED);
       if (g_prefs&16) CheckDlgButton(hwndDlg, IDC_SSPAUSE, BST_CHECKED);
       if (g_prefs&32) CheckDlgButton(hwndDlg, IDC_CHECK1, BST_CHECKED);
+      if (g_prefs&128) CheckDlgButton(hwndDlg, IDC_GIFPALETTE, BST_CHECKED);
       
 
       if (g_prefs&64) 
@@ -828,6 +1363,8 @@ static UINT_PTR CALLBACK SaveOptsProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPA
       EnableWindow(GetDlgItem(hwndDlg, IDC_BIGFONT), (g_prefs&1));
       EnableWindow(GetDlgItem(hwndDlg, IDC_TITLE), (g_prefs&1));
       SetDlgItemInt(hwndDlg, IDC_LOOPCNT, g_gif_loopcount,FALSE);
+      SetDlgItemInt(hwndDlg, IDC_GIFLOSSY, g_gif_lossy,FALSE);
+      SetDlgItemInt(hwndDlg, IDC_CAPSCALE, g_cap_scale,FALSE);
 #ifndef VIDEO_ENCODER_SUPPORT
       ShowWindow(GetDlgItem(hwndDlg, IDC_BUTTON1), false);
 #endif
@@ -843,6 +1380,7 @@ static UINT_PTR CALLBACK SaveOptsProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPA
       if (IsDlgButtonChecked(hwndDlg, IDC_SSPAUSE)) g_prefs |= 16;
       if (IsDlgButtonChecked(hwndDlg, IDC_CHECK1)) g_prefs |= 32;
       if (IsDlgButtonChecked(hwndDlg, IDC_CHECK2)) g_prefs |= 64;
+      if (IsDlgButtonChecked(hwndDlg, IDC_GIFPALETTE)) g_prefs |= 128;
 
       char buf[256];
       GetDlgItemText(hwndDlg, IDC_MS, buf, sizeof(buf));
@@ -858,6 +1396,10 @@ static UINT_PTR CALLBACK SaveOptsProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPA
         BOOL t=FALSE;
         int a=GetDlgItemInt(hwndDlg,IDC_LOOPCNT,&t,FALSE);
         if (t) g_gif_loopcount=(a>0&&a<65536) ? a : 0;
+        a=GetDlgItemInt(hwndDlg,IDC_GIFLOSSY,&t,FALSE);
+        if (t) g_gif_lossy=wdl_min(a,255);
+        a=GetDlgItemInt(hwndDlg,IDC_CAPSCALE,&t,FALSE);
+        if (t) g_cap_scale=wdl_max(wdl_min(a,100),10);
       }
 
     }
@@ -1076,11 +1618,6 @@ WDL_DLGRET InsertProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
 	return 0;
 }
 
-#ifndef _WIN32
-bool GetScreenData(int xpos, int ypos, LICE_IBitmap *bmOut);
-
-#endif
-
 
 void SaveConfig(HWND hwndDlg)
 {
@@ -1097,8 +1634,15 @@ void SaveConfig(HWND hwndDlg)
   WritePrivateProfileString("licecap","titlems",buf,g_ini_file.Get());
   sprintf(buf, "%d", g_gif_loopcount);
   WritePrivateProfileString("licecap","gifloopcnt",buf,g_ini_file.Get());
+  sprintf(buf, "%d", g_gif_lossy);
+  WritePrivateProfileString("licecap","giflossy",buf,g_ini_file.Get());
+  WritePrivateProfileString("licecap","gifdither",g_gif_dither ? "1" : "0",g_ini_file.Get());
+  sprintf(buf, "%d", g_cap_scale);
+  WritePrivateProfileString("licecap","capscale",buf,g_ini_file.Get());
   sprintf(buf, "%d", g_stop_after_msec);
   WritePrivateProfileString("licecap","stopafter",buf,g_ini_file.Get());
+  sprintf(buf, "%d", g_lcf_threads);
+  WritePrivateProfileString("licecap","lcfthreads",buf,g_ini_file.Get());
   
   
 
@@ -1148,6 +1692,9 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
       ++g_reent;
 
       g_gif_loopcount = GetPrivateProfileInt("licecap","gifloopcnt",g_gif_loopcount,g_ini_file.Get());
+      g_gif_lossy = GetPrivateProfileInt("licecap","giflossy",g_gif_lossy,g_ini_file.Get());
+      g_gif_dither = !!GetPrivateProfileInt("licecap","gifdither",g_gif_dither,g_ini_file.Get());
+      g_cap_scale = wdl_max(wdl_min(GetPrivateProfileInt("licecap","capscale",g_cap_scale,g_ini_file.Get()),100),10);
       g_max_fps = GetPrivateProfileInt("licecap", "maxfps", g_max_fps, g_ini_file.Get());
       SetDlgItemInt(hwndDlg,IDC_MAXFPS,g_max_fps,FALSE);
       --g_reent;
@@ -1181,6 +1728,7 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
       g_prefs = GetPrivateProfileInt("licecap", "prefs", g_prefs, g_ini_file.Get());
       g_titlems = GetPrivateProfileInt("licecap", "titlems", g_titlems, g_ini_file.Get());
       g_stop_after_msec = GetPrivateProfileInt("licecap", "stopafter", g_stop_after_msec, g_ini_file.Get());
+      g_lcf_threads = wdl_max(GetPrivateProfileInt("licecap", "lcfthreads", g_lcf_threads, g_ini_file.Get()),0);
 
       GetPrivateProfileString("licecap","title","",g_title,sizeof(g_title),g_ini_file.Get());
 
@@ -1207,175 +1755,8 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
       if (wParam==1)
       {     
         DWORD now=timeGetTime();
-        bool need_stop=false;
-
-        if (g_cap_state==1 && g_cap_bm && now >= g_cap_prerolluntil && now >= g_skip_capture_until)
-        {
-          if (now >= g_last_frame_capture_time + (1000/(wdl_max(g_max_fps,1))))
-          {
-            g_ms_written += now-g_last_frame_capture_time;
-
-#ifdef _WIN32
-            HWND h = GetDesktopWindow();
-
-            HDC hdc = GetDC(h);
-            if (hdc)
-            {
-              RECT r;
-              GetWindowRect(GetDlgItem(hwndDlg,IDC_VIEWRECT),&r);
-              int bw = g_cap_bm->getWidth();
-              int bh = g_cap_bm->getHeight();
-
-              __LogicalToPhysicalPointForPerMonitorDPI(g_hwnd,(LPPOINT)&r);
-              
-              LICE_Clear(g_cap_bm,0);
-              BitBlt(g_cap_bm->getDC(),0,0,bw,bh,hdc,r.left+1,r.top+1,SRCCOPY);
-              ReleaseDC(h,hdc);
-              DoMouseCursor(g_cap_bm,h,-(r.left+1),-(r.top+1));                        
-#else
-            int bw = g_cap_bm->getWidth();
-            int bh = g_cap_bm->getHeight();
-            RECT r2,r3;
-            HWND sub = GetDlgItem(hwndDlg,IDC_VIEWRECT);
-            GetWindowRect(sub,&r2);
-#ifdef __APPLE__
-            if (s_has_async_offset && GetAsyncNSWindowRect(hwndDlg,&r3))
-            {
-              const int w = r2.right-r2.left;
-              const int h = r2.bottom-r2.top;
-              r2.left = r3.left + s_async_offset.x;
-              r2.top = r3.top + s_async_offset.y;
-
-              r2.bottom = r2.top + h;
-              r2.right = r2.left + w;
-            }
-#endif
-
-            if (GetScreenData(r2.left,wdl_min(r2.top,r2.bottom),g_cap_bm_inv?g_cap_bm_inv:g_cap_bm))
-            {
-              void DoMouseCursor(LICE_IBitmap *,int,int);
-              DoMouseCursor(g_cap_bm_inv?g_cap_bm_inv:g_cap_bm,-(r2.left+1),-(r2.bottom+1));                        
-#endif
-              const bool dotime = !!(g_prefs&8);
-
-              const int frame_time_in_seconds = g_ms_written/1000;
-              
-#ifdef VIDEO_ENCODER_SUPPORT
-              if (g_cap_video)
-              {
-                if (dotime) draw_timedisp(g_cap_bm,frame_time_in_seconds,NULL,bw,bh);
 
-                EncodeFrameToVideo(g_cap_video,g_cap_bm);
-              }
-#endif
-#ifndef NO_LCF_SUPPORT
-              if (g_cap_lcf)
-              {
-                if (dotime) draw_timedisp(g_cap_bm,frame_time_in_seconds,NULL,bw,bh);
-
-                int del = now-g_last_frame_capture_time;
-                if (g_dotitle)
-                {
-                  del += g_titlems;
-                  g_dotitle=false;
-                }
-                g_cap_lcf->OnFrame(g_cap_bm,del);
-              }
-#endif
-
-              if (g_cap_gif)
-              {
-                // draw old time display for frame_compare(), so that it finds the portion other than the time display that changes
-                int old_time_coords[4]={0,};
-                if (dotime && g_cap_gif_lastsec_written>=0)
-                  draw_timedisp(g_cap_bm,g_cap_gif_lastsec_written,old_time_coords,bw,bh);
-            
-                g_cap_gif->frame_advancetime(now-g_last_frame_capture_time);
-#ifdef TEST_MULTIPLE_MODES
-                if (g_cap_gif2) g_cap_gif2->frame_advancetime(now-g_last_frame_capture_time);
-                if (g_cap_gif3) g_cap_gif3->frame_advancetime(now-g_last_frame_capture_time);
-#endif
-
-                int diffs[4];
-                
-                if (g_cap_gif->frame_compare(g_cap_bm,diffs))
-                {
-                  g_cap_gif->frame_finish();
-#ifdef TEST_MULTIPLE_MODES
-                  if (g_cap_gif2) g_cap_gif2->frame_finish();
-                  if (g_cap_gif3) g_cap_gif3->frame_finish();
-#endif
-
-                  if (dotime && frame_time_in_seconds != g_cap_gif_lastsec_written)
-                  {
-                    int pos[4];
-                    draw_timedisp(NULL,frame_time_in_seconds,pos,bw,bh);
-
-                    union_diffs(pos, old_time_coords);
-
-                    if (diffs[0]+diffs[2] >= pos[0] && diffs[1]+diffs[3] >= pos[1])
-                    {
-                      union_diffs(diffs, pos); // add pos into diffs for display update
-
-                      draw_timedisp(g_cap_bm,frame_time_in_seconds,pos,bw,bh);
-                      g_cap_gif_lastsec_written = frame_time_in_seconds;
-                    }
-                  }
-
-                  g_cap_gif->frame_new(g_cap_bm,diffs[0],diffs[1],diffs[2],diffs[3]);
-#ifdef TEST_MULTIPLE_MODES
-                  if (g_cap_gif2) g_cap_gif2->frame_new(g_cap_bm,diffs[0],diffs[1],diffs[2],diffs[3]);
-                  if (g_cap_gif3) g_cap_gif3->frame_new(g_cap_bm,diffs[0],diffs[1],diffs[2],diffs[3]);
-#endif
-                }
-
-                if (dotime && frame_time_in_seconds != g_cap_gif_lastsec_written)
-                {
-                  // time changed and wasn't previously included, so include as a dedicated frame
-                  g_cap_gif->frame_finish();
-#ifdef TEST_MULTIPLE_MODES
-                  if (g_cap_gif2) g_cap_gif2->frame_finish();
-                  if (g_cap_gif3) g_cap_gif3->frame_finish();
-#endif
-
-                  int pos[4];
-                  draw_timedisp(g_cap_bm,frame_time_in_seconds,pos,bw,bh);
-                  union_diffs(pos, old_time_coords);
-
-                  g_cap_gif_lastsec_written = frame_time_in_seconds;
-                  g_cap_gif->frame_new(g_cap_bm,pos[0],pos[1],pos[2],pos[3]);
-#ifdef TEST_MULTIPLE_MODES
-                  if (g_cap_gif2) g_cap_gif2->frame_new(g_cap_bm,pos[0],pos[1],pos[2],pos[3]);
-                  if (g_cap_gif3) g_cap_gif3->frame_new(g_cap_bm,pos[0],pos[1],pos[2],pos[3]);
-#endif
-                }
-              }
-
-              double fr = 1000.0 / (double) (now - g_last_frame_capture_time);
-              if (fr>100.0) fr=100.0;
-
-              if (g_frate_valid) 
-              {
-                g_frate_avg = g_frate_avg*0.9 + fr*0.1;
-              }
-              else 
-              {
-                g_frate_avg=fr;
-                g_frate_valid=true;
-              }
-
-              g_last_frame_capture_time = now;
-
-              if (g_prefs&64) 
-              {
-                if (g_ms_written > g_stop_after_msec)
-                {
-                  need_stop=true;
-                }
-              }
-            }
-          }
-        }
+        if (g_cap_state) CaptureThread_UpdateRect(hwndDlg);
 
         bool force_status=false;
         if (g_cap_prerolluntil && g_cap_state==1)
@@ -1396,8 +1777,11 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
           last_status_t=now;
           UpdateStatusText(hwndDlg);
         }
-        if (need_stop)
+        if (cap_ring_load(&s_cap_need_stop))
+        {
+          cap_ring_store(&s_cap_need_stop,0);
           SendMessage(hwndDlg,WM_COMMAND,IDC_STOP,0);
+        }
 
       }
     break;
@@ -1509,9 +1893,7 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
         case IDC_INSERT:
           if (!g_cap_bm_txt)
           {
-            int w,h;
-            GetViewRectSize(&w,&h);
-            g_cap_bm_txt = LICE_CreateSysBitmap(w,h);
+            g_cap_bm_txt = LICE_CreateSysBitmap(g_cap_bm->getWidth(),g_cap_bm->getHeight());
             LICE_Copy(g_cap_bm_txt, g_cap_bm);
           }
           DialogBox(g_hInst,MAKEINTRESOURCE(IDD_INSERT),hwndDlg,InsertProc);
@@ -1589,11 +1971,14 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
               }
 #endif
 
-              int w,h;
-              GetViewRectSize(&w,&h);
+              int cap_w,cap_h;
+              GetViewRectSize(&cap_w,&cap_h);
+              // frames are encoded at the output size, the capture thread grabs at cap_w x cap_h
+              const int w = wdl_max(cap_w*g_cap_scale/100,1), h = wdl_max(cap_h*g_cap_scale/100,1);
+              LICE_SetThreadCount(w != cap_w || h != cap_h ? -1 : 1); // large scaled blits are split across cores
               
               delete g_cap_bm;
-#ifdef _WIN32
+#if defined(_WIN32) || !defined(__APPLE__)
               g_cap_bm = LICE_CreateSysBitmap(w,h);
 #else
               delete g_cap_bm_inv;
@@ -1605,18 +1990,24 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
 
               if (strlen(g_last_fn)>4 && !stricmp(g_last_fn+strlen(g_last_fn)-4,".gif"))
               {
-                void *ctx = LICE_WriteGIFBeginNoFrame(g_last_fn,w,h,(g_prefs&32) ? (-1)&~7 : 0,true);
+                void *ctx = LICE_WriteGIFBeginNoFrame(g_last_fn,w,h,(g_prefs&32) ? (-1)&~7 : 0,g_gif_dither,false,g_gif_lossy);
+#ifndef NO_LCF_SUPPORT
+                WDL_String spoolfn(g_last_fn);
+                spoolfn.Append(".tmp.lcf");
+                if (ctx) g_cap_gif = new gif_encoder(ctx,g_gif_loopcount,0xf8,(g_prefs&128) ? spoolfn.Get() : NULL);
+#else
                 if (ctx) g_cap_gif = new gif_encoder(ctx,g_gif_loopcount,0xf8);
+#endif
                 g_cap_gif_lastsec_written = -1;
 
 #ifdef TEST_MULTIPLE_MODES
                 char tmp[1024];
                 sprintf(tmp,"%s.trans-nostats.gif",g_last_fn);
-                ctx = LICE_WriteGIFBeginNoFrame(tmp,w,h,(-1)&~(7|0x100),true);
+                ctx = LICE_WriteGIFBeginNoFrame(tmp,w,h,(-1)&~(7|0x100),g_gif_dither);
                 if (ctx) g_cap_gif2 = new gif_encoder(ctx,g_gif_loopcount,0xf8);
 
                 sprintf(tmp,"%s.trans-0.gif",g_last_fn);
-                ctx = LICE_WriteGIFBeginNoFrame(tmp,w,h,0,true);
+                ctx = LICE_WriteGIFBeginNoFrame(tmp,w,h,0,g_gif_dither);
                 if (ctx) g_cap_gif3 = new gif_encoder(ctx,g_gif_loopcount,0xf8);
 #endif
 
@@ -1674,6 +2065,12 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
                   delete g_cap_lcf;
                   g_cap_lcf = NULL;
                 }
+                else
+                {
+                  const int nthreads = g_lcf_threads ? g_lcf_threads : LICE_Thread::GetCPUCount();
+                  if (nthreads > 1) g_cap_lcf->SetParallel(nthreads);
+                  g_cap_lcf->SetAsync(); // compress on a worker thread so the encode thread doesn't stall
+                }
               }
 #endif
 
@@ -1729,6 +2126,7 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
 
                 g_last_frame_capture_time = g_cap_prerolluntil=timeGetTime()+PREROLL_AMT;
                 g_cap_state=1;
+                CaptureThread_Start(hwndDlg,cap_w,cap_h);
                 UpdateCaption(hwndDlg);
                 UpdateStatusText(hwndDlg);
                 UpdateDimBoxes(hwndDlg);
@@ -1742,6 +2140,7 @@ static WDL_DLGRET liceCapMainProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
             ShowWindow(GetDlgItem(hwndDlg,IDC_STATUS),SW_HIDE);
             SetDlgItemText(hwndDlg,IDC_REC,"[unpause]");
             g_cap_state=2;
+            CaptureThread_Sync();
             UpdateCaption(hwndDlg);
             UpdateStatusText(hwndDlg);
           }
@@ -2096,8 +2495,9 @@ void OnAudioBuffer(bool isPost, int len, double srate, struct audio_hook_registe
   }
 }
 
-void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transparent_alpha, bool dither, bool is_append)
+void *LICE_WriteGIFBeginNoFrame(const char *filename, int w, int h, int transparent_alpha, bool dither, bool is_append, int lossy_tolerance)
 {
+  // REAPER's GIF writer has no lossy mode, lossy_tolerance is ignored
   if (!__LICE_WriteGIFBeginNoFrame || !__LICE_WriteGIFFrame || !__LICE_WriteGIFEnd)
   {
     *(void **)&__LICE_WriteGIFBeginNoFrame = reaperAPI_getfunc("LICE_WriteGIFBeginNoFrame2");
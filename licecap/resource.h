@@ -36,6 +36,9 @@
 #define IDC_CHECK1                      1022
 #define IDC_CHECK2                      1023
 #define IDC_STOPAFTER_SEC_LBL           1024
+#define IDC_GIFPALETTE                  1025
+#define IDC_GIFLOSSY                    1026
+#define IDC_CAPSCALE                    1027
 
 // Next default values for new objects
 // 
@@ -43,7 +46,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        107
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1025
+#define _APS_NEXT_CONTROL_VALUE         1028
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -0,0 +1,288 @@
+/*
+    LICEcap
+    Copyright (C) 2010 Cockos Incorporated
+
+    LICEcap is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    LICEcap is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LICEcap; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// runs capturewindow_x11.cpp against the X server in $DISPLAY, meant for a private Xvfb (make check):
+//  - capture rate at several region sizes, for MIT-SHM bitmaps and plain LICE_MemBitmaps (XGetImage)
+//  - pixels: rectangles drawn on the root window read back with the right colors, partially
+//    offscreen regions are cleared outside the screen, both capture paths return the same pixels
+//  - damage: random rectangles are drawn between frames, every pixel that changed and every
+//    rectangle drawn inside the region must be covered by the rects GetScreenDamage() returns
+//
+// usage: x11capcheck [ms per size] [damage frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "../WDL/swell/swell.h"
+#include "../WDL/lice/lice.h"
+#include "../WDL/heapbuf.h"
+
+// capturewindow_x11.cpp
+LICE_IBitmap *CreateScreenBitmap(int w, int h);
+bool GetScreenData(int xpos, int ypos, LICE_IBitmap *bmOut);
+int GetScreenDamage(WDL_TypedBuf<RECT> *list);
+
+#define RGB_MASK LICE_RGBA(255,255,255,0)
+
+static Display *s_dpy; // separate connection for drawing, as another client would
+static int s_scr_w, s_scr_h;
+
+static double GetTimeMS()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+static unsigned int CheckRand(unsigned int *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+// r,g,b as a 24 bit TrueColor pixel, checked in main()
+static void FillRoot(int x, int y, int w, int h, int r, int g, int b)
+{
+  GC gc = DefaultGC(s_dpy,DefaultScreen(s_dpy));
+  XSetForeground(s_dpy,gc,(r<<16)|(g<<8)|b);
+  XFillRectangle(s_dpy,DefaultRootWindow(s_dpy),gc,x,y,w,h);
+}
+
+static LICE_pixel GetPix(LICE_IBitmap *bm, int x, int y)
+{
+  const int h = bm->getHeight();
+  return bm->getBits()[(bm->isFlipped() ? h-1-y : y)*bm->getRowSpan() + x];
+}
+
+static int CheckRate(int w, int h, double ms)
+{
+  int fails=0, pass;
+  for (pass=0;pass<2;pass++)
+  {
+    LICE_IBitmap *bm = pass ? (LICE_IBitmap *)new LICE_MemBitmap(w,h) : CreateScreenBitmap(w,h);
+    int frames=0;
+    const double t0 = GetTimeMS();
+    double t = t0;
+    while (t - t0 < ms)
+    {
+      if (!GetScreenData(0,0,bm)) { fails++; break; }
+      frames++;
+      t = GetTimeMS();
+    }
+    const double fps = t > t0 ? frames*1000.0/(t-t0) : 0.0;
+    printf("%4dx%-4d %-8s %8.1f fps %8.1f MB/s\n",w,h,pass ? "XGetImage" : "MIT-SHM",fps,fps*w*h*4.0/(1024.0*1024.0));
+    delete bm;
+  }
+  return fails;
+}
+
+static int CheckPixels()
+{
+  int fails=0, x, y;
+  const int w = s_scr_w < 300 ? s_scr_w : 300, h = s_scr_h < 200 ? s_scr_h : 200;
+  FillRoot(0,0,w,h,0x10,0x20,0x30);
+  FillRoot(20,30,50,40,0xff,0x80,0x01);
+  XSync(s_dpy,False);
+
+  LICE_IBitmap *sbm = CreateScreenBitmap(w,h);
+  LICE_MemBitmap mbm(w,h);
+  if (!GetScreenData(0,0,sbm) || !GetScreenData(0,0,&mbm)) { printf("pixels: GetScreenData() failed\n"); fails++; }
+  for (y=0;y<h && !fails;y++)
+  {
+    for (x=0;x<w;x++)
+    {
+      const bool in = x >= 20 && x < 70 && y >= 30 && y < 70;
+      const LICE_pixel want = in ? LICE_RGBA(0xff,0x80,0x01,0) : LICE_RGBA(0x10,0x20,0x30,0);
+      const LICE_pixel a = GetPix(sbm,x,y) & RGB_MASK, b = GetPix(&mbm,x,y) & RGB_MASK;
+      if (a != want || b != want)
+      {
+        printf("pixels: %d,%d is %06x (MIT-SHM) %06x (XGetImage), expected %06x\n",x,y,a,b,want);
+        fails++;
+        break;
+      }
+    }
+  }
+
+  // 10 pixels above and left of the screen are outside, the rest is the same as before
+  if (!fails && GetScreenData(-10,-10,sbm))
+  {
+    for (y=0;y<h && !fails;y++)
+    {
+      for (x=0;x<w;x++)
+      {
+        const LICE_pixel want = x < 10 || y < 10 ? 0 : GetPix(&mbm,x-10,y-10) & RGB_MASK;
+        if ((GetPix(sbm,x,y) & RGB_MASK) != want)
+        {
+          printf("pixels: offscreen region, %d,%d is %06x, expected %06x\n",x,y,GetPix(sbm,x,y) & RGB_MASK,want);
+          fails++;
+          break;
+        }
+      }
+    }
+  }
+  delete sbm;
+  printf("pixels: %s\n",fails ? "FAILED" : "OK");
+  return fails;
+}
+
+static bool Covered(const WDL_TypedBuf<RECT> *list, int x, int y)
+{
+  int i;
+  for (i=0;i<list->GetSize();i++)
+  {
+    const RECT *r = list->Get()+i;
+    if (x >= r->left && x < r->right && y >= r->top && y < r->bottom) return true;
+  }
+  return false;
+}
+
+static int CheckDamage(int nframes)
+{
+  // a region away from the screen edges, rectangles are drawn inside, across and outside it
+  const int rx = s_scr_w/4, ry = s_scr_h/4, w = s_scr_w/2, h = s_scr_h/2;
+  LICE_IBitmap *bm = CreateScreenBitmap(w,h);
+  LICE_MemBitmap prev(w,h);
+  WDL_TypedBuf<RECT> list;
+  unsigned int seed = 1;
+  int fails=0, unknown=0, nrects=0, f, x, y;
+  double area=0.0;
+
+  FillRoot(0,0,s_scr_w,s_scr_h,0,0,0);
+  XSync(s_dpy,False);
+  GetScreenData(rx,ry,bm);
+  if (GetScreenDamage(&list) >= 0) { printf("damage: known for the first frame at a position\n"); fails++; }
+
+  for (f=0;f<nframes && fails<10;f++)
+  {
+    LICE_Copy(&prev,bm);
+
+    RECT drawn[8];
+    const int ndrawn = CheckRand(&seed)%8; // including none
+    int i;
+    for (i=0;i<ndrawn;i++)
+    {
+      const int dw = 1 + CheckRand(&seed)%(w/3), dh = 1 + CheckRand(&seed)%(h/3);
+      const int dx = rx - w/4 + CheckRand(&seed)%(w + w/2), dy = ry - h/4 + CheckRand(&seed)%(h + h/2);
+      // same color as before now and then, damaged but unchanged
+      const int c = CheckRand(&seed)%4 ? CheckRand(&seed)&255 : 0;
+      FillRoot(dx,dy,dw,dh,c,255-c,c/2);
+      RECT r = { dx-rx, dy-ry, dx-rx+dw, dy-ry+dh };
+      drawn[i] = r;
+    }
+    XSync(s_dpy,False);
+
+    if (!GetScreenData(rx,ry,bm)) { printf("damage: GetScreenData() failed\n"); fails++; break; }
+    const int n = GetScreenDamage(&list);
+    if (n < 0) { unknown++; continue; }
+    if (n != list.GetSize()) { printf("damage: frame %d returned %d but listed %d rects\n",f,n,list.GetSize()); fails++; }
+    nrects += list.GetSize();
+
+    for (i=0;i<list.GetSize();i++)
+    {
+      const RECT *r = list.Get()+i;
+      if (r->left < 0 || r->top < 0 || r->right > w || r->bottom > h || r->right <= r->left || r->bottom <= r->top)
+      {
+        printf("damage: frame %d rect %d,%d-%d,%d outside %dx%d or empty\n",f,r->left,r->top,r->right,r->bottom,w,h);
+        fails++;
+      }
+      area += (double)(r->right-r->left)*(r->bottom-r->top);
+    }
+
+    // every pixel that changed, and every pixel drawn to, must be covered
+    for (y=0;y<h;y++)
+    {
+      for (x=0;x<w;x++)
+      {
+        bool dirty = ((GetPix(bm,x,y) ^ GetPix(&prev,x,y)) & RGB_MASK) != 0;
+        for (i=0;i<ndrawn && !dirty;i++)
+          dirty = x >= drawn[i].left && x < drawn[i].right && y >= drawn[i].top && y < drawn[i].bottom;
+        if (dirty && !Covered(&list,x,y))
+        {
+          printf("damage: frame %d pixel %d,%d changed but isn't in the %d damage rects\n",f,x,y,list.GetSize());
+          fails++;
+          y=h;
+          break;
+        }
+      }
+    }
+  }
+  delete bm;
+
+  if (unknown == nframes)
+  {
+    printf("damage: unknown for every frame (no XDamage, libXdamage.so.1 or the DAMAGE extension missing), not checked\n");
+  }
+  else
+  {
+    if (unknown) { printf("damage: unknown for %d of %d frames at the same position\n",unknown,nframes); fails++; }
+    printf("damage: %d frames, %d rects, %.1f%% of the region per frame: %s\n",nframes,nrects,
+           nframes ? area*100.0/((double)w*h*nframes) : 0.0,fails ? "FAILED" : "OK");
+  }
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  const double ms = argc > 1 ? atof(argv[1]) : 1000.0;
+  const int nframes = argc > 2 ? atoi(argv[2]) : 200;
+  if (ms <= 0.0 || nframes < 1)
+  {
+    printf("usage: x11capcheck [ms per size] [damage frames]\n");
+    return 1;
+  }
+
+  s_dpy = XOpenDisplay(NULL);
+  if (!s_dpy)
+  {
+    printf("can't open display %s\n",XDisplayName(NULL));
+    return 1;
+  }
+  const int scr = DefaultScreen(s_dpy);
+  const Visual *v = DefaultVisual(s_dpy,scr);
+  if (DefaultDepth(s_dpy,scr) != 24 || v->red_mask != 0xff0000 || v->green_mask != 0xff00 || v->blue_mask != 0xff)
+  {
+    printf("needs a 24 bit TrueColor screen, e.g. Xvfb -screen 0 1920x1080x24\n");
+    return 1;
+  }
+  s_scr_w = DisplayWidth(s_dpy,scr);
+  s_scr_h = DisplayHeight(s_dpy,scr);
+  printf("display %s, %dx%d\n",XDisplayName(NULL),s_scr_w,s_scr_h);
+
+  int fails = CheckPixels();
+
+  static const int sizes[][2] = { { 320, 240 }, { 640, 480 }, { 1024, 768 }, { 1920, 1080 }, { 0, 0 } };
+  int x;
+  for (x=0;x<(int)(sizeof(sizes)/sizeof(sizes[0]));x++)
+  {
+    const int w = sizes[x][0] ? sizes[x][0] : s_scr_w, h = sizes[x][1] ? sizes[x][1] : s_scr_h;
+    if (w <= s_scr_w && h <= s_scr_h && (sizes[x][0] || w != sizes[x-1][0] || h != sizes[x-1][1]))
+      fails += CheckRate(w,h,ms);
+  }
+
+  fails += CheckDamage(nframes);
+
+  XCloseDisplay(s_dpy);
+  printf(fails ? "FAILED\n" : "OK\n");
+  return fails ? 1 : 0;
+}